@@ -53,6 +53,10 @@ macro(configure_bullet)
     if (WIN32)
         set(BULLET_DEBUG_LIBRARIES BulletDynamics_d BulletCollision_d LinearMath_d)
     endif()
+    # BT_THREADSAFE must match the Bullet build, it enables the multithreaded physics worlds.
+    if (BULLET_MULTITHREADING)
+        add_definitions(-DBT_THREADSAFE=1)
+    endif()
 endmacro (configure_bullet)
 
 # Boost needed by modules utilizing websocketpp
@@ -131,6 +131,11 @@ bool AvatarDescAsset::IsLoaded() const
     return !avatarAppearanceXML_.Empty();
 }
 
+uint AvatarDescAsset::CpuMemoryUsage() const
+{
+    return avatarAppearanceXML_.Capacity();
+}
+
 bool AvatarDescAsset::ReadAvatarAppearance(Urho3D::XMLFile& source)
 {
     URHO3D_PROFILE(Avatar_ReadAvatarAppearance);
@@ -35,6 +35,8 @@ public:
     bool SerializeTo(Vector<u8> &dst, const String &serializationParameters) const override;
     /// Check if asset is loaded. Checks only XML data size
     bool IsLoaded() const;
+    /// Returns the size of the appearance XML data. IAsset override.
+    uint CpuMemoryUsage() const override;
 
 private:
     virtual void DoUnload();
@@ -4,7 +4,7 @@
 
 #include "BulletPhysics.h"
 #include "PhysicsWorld.h"
-#include "CollisionShapeUtils.h"
+#include "CollisionShapeCache.h"
 #include "ConvexHull.h"
 #include "RigidBody.h"
 #include "VolumeTrigger.h"
@@ -19,10 +19,13 @@
 #include "SceneAPI.h"
 #include "Framework.h"
 #include "Scene/Scene.h"
+#include "AssetAPI.h"
+#include "AssetCache.h"
 #include "ConsoleAPI.h"
 #include "IComponentFactory.h"
 #include "LoggingFunctions.h"
 #include "IMeshAsset.h"
+#include "PhysicsUtils.h"
 
 #include "JavaScript.h"
 #include "JavaScriptInstance.h"
@@ -37,6 +40,9 @@
 #pragma warning(disable : 4100)
 #endif
 #include <btBulletDynamicsCommon.h>
+#ifdef BULLETPHYSICS_MULTITHREADING
+#include <LinearMath/btThreads.h>
+#endif
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
@@ -49,12 +55,23 @@ namespace Tundra
 BulletPhysics::BulletPhysics(Framework* owner)
 :IModule("BulletPhysics", owner),
 defaultPhysicsUpdatePeriod_(1.0f / 60.0f),
-defaultMaxSubSteps_(6) // If fps is below 10, we start to slow down physics
+defaultMaxSubSteps_(6), // If fps is below 10, we start to slow down physics
+defaultMultithreaded_(false),
+defaultDeterministic_(false),
+taskScheduler_(0)
 {
 }
 
 BulletPhysics::~BulletPhysics()
 {
+#ifdef BULLETPHYSICS_MULTITHREADING
+    if (taskScheduler_)
+    {
+        btSetTaskScheduler(btGetSequentialTaskScheduler());
+        delete taskScheduler_;
+        taskScheduler_ = 0;
+    }
+#endif
 }
 
 void BulletPhysics::Load()
@@ -99,6 +116,28 @@ void BulletPhysics::Initialize()
         if (steps > 0)
             SetDefaultMaxSubSteps(steps);
     }
+
+    // Multithreading: --physicsThreads 0 uses all cores
+    params = framework->CommandLineParameters("--physicsThreads");
+    if (!params.Empty())
+        SetPhysicsThreads(Urho3D::ToInt(params.Front()));
+    else if (framework->HasCommandLineParameter("--physicsThreads"))
+        SetPhysicsThreads(0);
+    if (framework->HasCommandLineParameter("--physicsDeterministic"))
+        SetDefaultDeterministic(true);
+
+    // Collision shapes are cached on disk in the asset cache, unless disabled with --noCollisionShapeCache
+    String shapeCacheDirectory;
+    if (framework->Asset()->Cache() && !framework->HasCommandLineParameter("--noCollisionShapeCache"))
+        shapeCacheDirectory = framework->Asset()->Cache()->CacheDirectory() + "collisionshapes/";
+    shapeCache_ = new CollisionShapeCache(framework, shapeCacheDirectory);
+
+    // Convex decomposition: --convexDecomposition without a value uses 16 hulls
+    params = framework->CommandLineParameters("--convexDecomposition");
+    if (!params.Empty())
+        SetConvexDecompositionMaxHulls(Urho3D::ToInt(params.Front()));
+    else if (framework->HasCommandLineParameter("--convexDecomposition"))
+        SetConvexDecompositionMaxHulls(16);
     
     // Connect to JavaScript module instance creation to be able to expose the physics classes to each instance
     JavaScript* javaScript = framework->Module<JavaScript>();
@@ -108,6 +147,7 @@ void BulletPhysics::Initialize()
 
 void BulletPhysics::Uninitialize()
 {
+    shapeCache_.Reset();
 }
 
 void BulletPhysics::ToggleDebugGeometry()
@@ -133,6 +173,57 @@ void BulletPhysics::SetDefaultMaxSubSteps(int steps)
         defaultMaxSubSteps_ = steps;
 }
 
+bool BulletPhysics::IsMultithreadingSupported()
+{
+#ifdef BULLETPHYSICS_MULTITHREADING
+    return true;
+#else
+    return false;
+#endif
+}
+
+void BulletPhysics::SetPhysicsThreads(int numThreads)
+{
+    if (numThreads < 0)
+        numThreads = 0;
+    // The task scheduler must not be changed while asynchronous simulation steps are using it
+    for(Vector<PhysicsWorldPtr>::Iterator i = physicsWorlds_.Begin(); i != physicsWorlds_.End(); ++i)
+        (*i)->WaitForStep();
+#ifdef BULLETPHYSICS_MULTITHREADING
+    if (numThreads == 1 && !taskScheduler_)
+    {
+        defaultMultithreaded_ = false;
+        return;
+    }
+    if (!taskScheduler_)
+    {
+        taskScheduler_ = btCreateDefaultTaskScheduler();
+        if (!taskScheduler_)
+        {
+            LogError("BulletPhysics::SetPhysicsThreads: Failed to create Bullet task scheduler, physics will be single-threaded.");
+            return;
+        }
+        btSetTaskScheduler(taskScheduler_);
+    }
+    const int maxThreads = taskScheduler_->getMaxNumThreads();
+    taskScheduler_->setNumThreads(numThreads > 0 && numThreads < maxThreads ? numThreads : maxThreads);
+    defaultMultithreaded_ = (numThreads != 1);
+    LogInfoF("BulletPhysics: Using %d threads for physics simulation", taskScheduler_->getNumThreads());
+#else
+    if (numThreads != 1)
+        LogWarning("BulletPhysics::SetPhysicsThreads: Bullet was built without multithreading support, physics will be single-threaded.");
+#endif
+}
+
+int BulletPhysics::PhysicsThreads() const
+{
+#ifdef BULLETPHYSICS_MULTITHREADING
+    if (taskScheduler_)
+        return taskScheduler_->getNumThreads();
+#endif
+    return 1;
+}
+
 void BulletPhysics::StopPhysics()
 {
     SetRunPhysics(false);
@@ -173,6 +264,9 @@ void BulletPhysics::AutoCollisionMesh()
 void BulletPhysics::Update(float frametime)
 {
     URHO3D_PROFILE(BulletPhysics_Update);
+    // Publish the collision shapes generated in the background before simulating
+    if (shapeCache_)
+        shapeCache_->Update();
     // Loop all the physics worlds and update them.
     Vector<PhysicsWorldPtr>::Iterator i = physicsWorlds_.Begin();
     while(i != physicsWorlds_.End())
@@ -184,7 +278,7 @@ void BulletPhysics::Update(float frametime)
 
 void BulletPhysics::CreatePhysicsWorld(Scene *scene, AttributeChange::Type /*change*/)
 {
-    SharedPtr<PhysicsWorld> newWorld(new PhysicsWorld(scene, !scene->IsAuthority()));
+    SharedPtr<PhysicsWorld> newWorld(new PhysicsWorld(scene, !scene->IsAuthority(), defaultMultithreaded_, defaultDeterministic_));
     newWorld->SetGravity(scene->UpVector() * -9.81f);
     newWorld->SetPhysicsUpdatePeriod(defaultPhysicsUpdatePeriod_);
     newWorld->SetMaxSubSteps(defaultMaxSubSteps_);
@@ -211,77 +305,39 @@ void BulletPhysics::SetRunPhysics(bool enable)
 
 int BulletPhysics::ForgetUnusedCacheShapes()
 {
-    /* This function check shared ptrs where use count == 1, meaning our cache map is the only
-       this keeping the ptr alive. These will be forgotten. */
-    int forgotten = 0;
+    return shapeCache_ ? shapeCache_->ForgetUnused() : 0;
+}
 
-    for (TriangleMeshMap::Iterator iter = triangleMeshes_.Begin(), end = triangleMeshes_.End();
-        iter != end;)
-    {
-        shared_ptr<btTriangleMesh> &ptr = iter->second_;
-        if (ptr.use_count() == 1)
-        {
-            iter = triangleMeshes_.Erase(iter);
-            forgotten++;
-        }
-        else
-            iter++;
-    }
+void BulletPhysics::SetConvexDecompositionMaxHulls(int maxHulls)
+{
+    if (shapeCache_)
+        shapeCache_->SetConvexDecomposition(maxHulls > 1 ? (uint)maxHulls : 1, shapeCache_->ConvexDecompositionConcavity());
+}
 
-    for (ConvexHullSetMap::Iterator iter = convexHullSets_.Begin(), end = convexHullSets_.End();
-        iter != end;)
-    {
-        shared_ptr<ConvexHullSet> &ptr = iter->second_;
-        if (ptr.use_count() == 1)
-        {
-            iter = convexHullSets_.Erase(iter);
-            forgotten++;
-        }
-        else
-            iter++;
-    }
+int BulletPhysics::ConvexDecompositionMaxHulls() const
+{
+    return shapeCache_ ? (int)shapeCache_->ConvexDecompositionMaxHulls() : 1;
+}
 
-    return forgotten;
+void BulletPhysics::SetConvexDecompositionConcavity(float maxConcavity)
+{
+    if (shapeCache_)
+        shapeCache_->SetConvexDecomposition(shapeCache_->ConvexDecompositionMaxHulls(), maxConcavity);
 }
 
-shared_ptr<btTriangleMesh> BulletPhysics::GetTriangleMeshFromMeshAsset(IMeshAsset* mesh)
+float BulletPhysics::ConvexDecompositionConcavity() const
 {
-    shared_ptr<btTriangleMesh> ptr;
-    if (!mesh)
-        return ptr;
-    
-    // Check if has already been converted
-    TriangleMeshMap::ConstIterator iter = triangleMeshes_.Find(mesh->Name());
-    if (iter != triangleMeshes_.End())
-        return iter->second_;
-    
-    // Create new, then interrogate the mesh
-    ptr = shared_ptr<btTriangleMesh>(new btTriangleMesh());
-    GenerateTriangleMesh(mesh, ptr.get());
-    
-    triangleMeshes_[mesh->Name()] = ptr;
-    
-    return ptr;
+    return shapeCache_ ? shapeCache_->ConvexDecompositionConcavity() : 0.0f;
 }
 
-shared_ptr<ConvexHullSet> BulletPhysics::GetConvexHullSetFromMeshAsset(IMeshAsset* mesh)
+shared_ptr<TriangleMeshShape> BulletPhysics::GetTriangleMeshShapeFromMeshAsset(IMeshAsset* mesh)
 {
-    shared_ptr<ConvexHullSet> ptr;
-    if (!mesh)
-        return ptr;
-    
-    // Check if has already been converted
-    ConvexHullSetMap::ConstIterator iter = convexHullSets_.Find(mesh->Name());
-    if (iter != convexHullSets_.End())
-        return iter->second_;
-    
-    // Create new, then interrogate the mesh
-    ptr = shared_ptr<ConvexHullSet>(new ConvexHullSet());
-    GenerateConvexHullSet(mesh, ptr.get());
+    return shapeCache_ ? shapeCache_->TriangleMeshShapeFor(mesh) : shared_ptr<TriangleMeshShape>();
+}
 
-    convexHullSets_[mesh->Name()] = ptr;
-    
-    return ptr;
+shared_ptr<ConvexHullSet> BulletPhysics::GetConvexHullSetFromMeshAsset(IMeshAsset* mesh)
+{
+    return shapeCache_ ? shapeCache_->ConvexHullSetFor(mesh) : shared_ptr<ConvexHullSet>();
 }
 
 void BulletPhysics::OnScriptInstanceCreated(JavaScriptInstance* instance)
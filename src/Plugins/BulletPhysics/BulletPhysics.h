@@ -34,19 +34,40 @@ public:
     void Update(float frametime);
 
     /// Forget cache bullet shapes.
-    /** Code that loads into the cache with calling GetTriangleMeshFromMesh and GetConvexHullSetFromMesh is
+    /** Code that loads into the cache with calling GetTriangleMeshShapeFromMeshAsset and GetConvexHullSetFromMeshAsset is
         responsible to call this function when it has reseted its own shared ptr, to ensure if your code was the last
         use of this particular Mesh, the shapes memory will get released. */
     int ForgetUnusedCacheShapes();
 
-    /// Get a Bullet triangle mesh corresponding to a graphics mesh.
-    /** If already has been generated, returns the previously created one */
-    shared_ptr<btTriangleMesh> GetTriangleMeshFromMeshAsset(IMeshAsset* mesh);
+    /// Get a Bullet triangle mesh shape corresponding to a graphics mesh. [noscript]
+    /** If already has been generated, returns the previously created one. The shape is generated in the background
+        and can be used once its ready_ flag is set. @sa CollisionShapeCache */
+    shared_ptr<TriangleMeshShape> GetTriangleMeshShapeFromMeshAsset(IMeshAsset* mesh);
 
-    /// Get a Bullet convex hull set (using minimum recursion, not very accurate but fast) corresponding to an Ogre mesh.
-    /** If already has been generated, returns the previously created one */
+    /// Get a Bullet convex hull set (using minimum recursion, not very accurate but fast) corresponding to an Ogre mesh. [noscript]
+    /** If already has been generated, returns the previously created one. The hulls are generated in the background
+        and can be used once the ready_ flag is set. @sa CollisionShapeCache */
     shared_ptr<ConvexHullSet> GetConvexHullSetFromMeshAsset(IMeshAsset* mesh);
 
+    /// Set the maximum number of hulls generated for ConvexHull collision shapes
+    /** With more than one hull, concave meshes are approximated with a compound of convex hulls. 1 generates a single
+        hull for each mesh. Affects collision meshes loaded after the change. Can be set with the --convexDecomposition
+        command line parameter. @sa GenerateConvexDecomposition */
+    void SetConvexDecompositionMaxHulls(int maxHulls);
+
+    /// Return the maximum number of hulls generated for ConvexHull collision shapes [property]
+    int ConvexDecompositionMaxHulls() const;
+
+    /// Set the allowed concavity of the hulls of a convex decomposition, relative to the size of the mesh
+    /** Smaller values produce more accurate shapes with more hulls, up to the maximum number of hulls. */
+    void SetConvexDecompositionConcavity(float maxConcavity);
+
+    /// Return the allowed concavity of the hulls of a convex decomposition [property]
+    float ConvexDecompositionConcavity() const;
+
+    /// Returns the collision shape cache. [noscript]
+    CollisionShapeCache *ShapeCache() const { return shapeCache_; }
+
     /// Set default physics update rate for new physics worlds
     void SetDefaultPhysicsUpdatePeriod(float updatePeriod);
 
@@ -59,6 +80,25 @@ public:
     /// Return default physics max substeps for new physics worlds [property]
     int DefaultMaxSubSteps() const { return defaultMaxSubSteps_; }
 
+    /// Set the number of threads used by the physics simulation
+    /** With more than one thread, new physics worlds are multithreaded and the thread count of the existing multithreaded
+        worlds is changed. 0 uses all available cores. Requires Bullet to be built with multithreading support.
+        Can be set with the --physicsThreads command line parameter. */
+    void SetPhysicsThreads(int numThreads);
+
+    /// Return the number of threads used by the physics simulation [property]
+    int PhysicsThreads() const;
+
+    /// Set deterministic mode for new multithreaded physics worlds. @sa PhysicsWorld::PhysicsWorld
+    /** Can be enabled with the --physicsDeterministic command line parameter. */
+    void SetDefaultDeterministic(bool enable) { defaultDeterministic_ = enable; }
+
+    /// Return whether new multithreaded physics worlds are deterministic [property]
+    bool DefaultDeterministic() const { return defaultDeterministic_; }
+
+    /// Return whether Bullet was built with multithreading support
+    static bool IsMultithreadingSupported();
+
     /// Toggles physics debug geometry
     void ToggleDebugGeometry();
 
@@ -89,16 +129,15 @@ private:
     /// All PhysicsWorlds created.
     Vector<PhysicsWorldPtr> physicsWorlds_;
 
-    typedef HashMap<String, shared_ptr<btTriangleMesh> > TriangleMeshMap;
-    /// Bullet triangle meshes generated from graphics meshes
-    TriangleMeshMap triangleMeshes_;
-
-    typedef HashMap<String, shared_ptr<ConvexHullSet> > ConvexHullSetMap;
-    /// Bullet convex hull sets generated from graphics meshes
-    ConvexHullSetMap convexHullSets_;
+    /// Collision shapes generated from graphics meshes
+    SharedPtr<CollisionShapeCache> shapeCache_;
     
     float defaultPhysicsUpdatePeriod_;
     int defaultMaxSubSteps_;
+    bool defaultMultithreaded_;
+    bool defaultDeterministic_;
+    /// Bullet task scheduler used by multithreaded physics worlds, null if not created
+    btITaskScheduler *taskScheduler_;
 };
 
 }
@@ -63,6 +63,38 @@ static duk_ret_t BulletPhysics_DefaultMaxSubSteps(duk_context* ctx)
     return 1;
 }
 
+static duk_ret_t BulletPhysics_SetConvexDecompositionMaxHulls_int(duk_context* ctx)
+{
+    BulletPhysics* thisObj = GetThisWeakObject<BulletPhysics>(ctx);
+    int maxHulls = (int)duk_require_number(ctx, 0);
+    thisObj->SetConvexDecompositionMaxHulls(maxHulls);
+    return 0;
+}
+
+static duk_ret_t BulletPhysics_ConvexDecompositionMaxHulls(duk_context* ctx)
+{
+    BulletPhysics* thisObj = GetThisWeakObject<BulletPhysics>(ctx);
+    int ret = thisObj->ConvexDecompositionMaxHulls();
+    duk_push_number(ctx, ret);
+    return 1;
+}
+
+static duk_ret_t BulletPhysics_SetConvexDecompositionConcavity_float(duk_context* ctx)
+{
+    BulletPhysics* thisObj = GetThisWeakObject<BulletPhysics>(ctx);
+    float maxConcavity = (float)duk_require_number(ctx, 0);
+    thisObj->SetConvexDecompositionConcavity(maxConcavity);
+    return 0;
+}
+
+static duk_ret_t BulletPhysics_ConvexDecompositionConcavity(duk_context* ctx)
+{
+    BulletPhysics* thisObj = GetThisWeakObject<BulletPhysics>(ctx);
+    float ret = thisObj->ConvexDecompositionConcavity();
+    duk_push_number(ctx, ret);
+    return 1;
+}
+
 static duk_ret_t BulletPhysics_ToggleDebugGeometry(duk_context* ctx)
 {
     BulletPhysics* thisObj = GetThisWeakObject<BulletPhysics>(ctx);
@@ -105,6 +137,10 @@ static const duk_function_list_entry BulletPhysics_Functions[] = {
     ,{"DefaultPhysicsUpdatePeriod", BulletPhysics_DefaultPhysicsUpdatePeriod, 0}
     ,{"SetDefaultMaxSubSteps", BulletPhysics_SetDefaultMaxSubSteps_int, 1}
     ,{"DefaultMaxSubSteps", BulletPhysics_DefaultMaxSubSteps, 0}
+    ,{"SetConvexDecompositionMaxHulls", BulletPhysics_SetConvexDecompositionMaxHulls_int, 1}
+    ,{"ConvexDecompositionMaxHulls", BulletPhysics_ConvexDecompositionMaxHulls, 0}
+    ,{"SetConvexDecompositionConcavity", BulletPhysics_SetConvexDecompositionConcavity_float, 1}
+    ,{"ConvexDecompositionConcavity", BulletPhysics_ConvexDecompositionConcavity, 0}
     ,{"ToggleDebugGeometry", BulletPhysics_ToggleDebugGeometry, 0}
     ,{"StopPhysics", BulletPhysics_StopPhysics, 0}
     ,{"StartPhysics", BulletPhysics_StartPhysics, 0}
@@ -120,6 +156,8 @@ void Expose_BulletPhysics(duk_context* ctx)
     duk_put_function_list(ctx, -1, BulletPhysics_Functions);
     DefineProperty(ctx, "defaultPhysicsUpdatePeriod", BulletPhysics_DefaultPhysicsUpdatePeriod, BulletPhysics_SetDefaultPhysicsUpdatePeriod_float);
     DefineProperty(ctx, "defaultMaxSubSteps", BulletPhysics_DefaultMaxSubSteps, BulletPhysics_SetDefaultMaxSubSteps_int);
+    DefineProperty(ctx, "convexDecompositionMaxHulls", BulletPhysics_ConvexDecompositionMaxHulls, BulletPhysics_SetConvexDecompositionMaxHulls_int);
+    DefineProperty(ctx, "convexDecompositionConcavity", BulletPhysics_ConvexDecompositionConcavity, BulletPhysics_SetConvexDecompositionConcavity_float);
     duk_put_prop_string(ctx, -2, "prototype");
     duk_put_global_string(ctx, BulletPhysics_ID);
 }
@@ -9,6 +9,7 @@ namespace JSBindings
 void Expose_PhysicsConstraint(duk_context* ctx);
 void Expose_PhysicsMotor(duk_context* ctx);
 void Expose_PhysicsRaycastResult(duk_context* ctx);
+void Expose_PhysicsQueryResults(duk_context* ctx);
 void Expose_PhysicsWorld(duk_context* ctx);
 void Expose_RigidBody(duk_context* ctx);
 void Expose_VolumeTrigger(duk_context* ctx);
@@ -19,6 +20,7 @@ void ExposeBulletPhysicsClasses(duk_context* ctx)
     Expose_PhysicsConstraint(ctx);
     Expose_PhysicsMotor(ctx);
     Expose_PhysicsRaycastResult(ctx);
+    Expose_PhysicsQueryResults(ctx);
     Expose_PhysicsWorld(ctx);
     Expose_RigidBody(ctx);
     Expose_VolumeTrigger(ctx);
@@ -0,0 +1,63 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+// Written by hand rather than generated, so it is not listed in RegenerateBulletPhysicsBindings.cmd
+
+#include "StableHeaders.h"
+#include "CoreTypes.h"
+#include "JavaScriptInstance.h"
+#include "LoggingFunctions.h"
+#include "PhysicsWorld.h"
+
+#ifdef _MSC_VER
+#pragma warning(disable: 4800)
+#endif
+
+#include "Entity.h"
+
+
+using namespace Tundra;
+using namespace std;
+
+namespace JSBindings
+{
+
+static const char* PhysicsQueryResults_ID = "PhysicsQueryResults";
+
+static duk_ret_t PhysicsQueryResults_Finalizer(duk_context* ctx)
+{
+    FinalizeValueObject<PhysicsQueryResults>(ctx, PhysicsQueryResults_ID);
+    return 0;
+}
+
+static duk_ret_t PhysicsQueryResults_Get_entities(duk_context* ctx)
+{
+    PhysicsQueryResults* thisObj = GetThisValueObject<PhysicsQueryResults>(ctx, PhysicsQueryResults_ID);
+    PushWeakObjectVector(ctx, thisObj->entities);
+    return 1;
+}
+
+static duk_ret_t PhysicsQueryResults_Set_hits(duk_context* ctx)
+{
+    PhysicsQueryResults* thisObj = GetThisValueObject<PhysicsQueryResults>(ctx, PhysicsQueryResults_ID);
+    Vector<float> hits = GetFloatVector(ctx, 0);
+    thisObj->hits = hits;
+    return 0;
+}
+
+static duk_ret_t PhysicsQueryResults_Get_hits(duk_context* ctx)
+{
+    PhysicsQueryResults* thisObj = GetThisValueObject<PhysicsQueryResults>(ctx, PhysicsQueryResults_ID);
+    PushFloatVector(ctx, thisObj->hits);
+    return 1;
+}
+
+void Expose_PhysicsQueryResults(duk_context* ctx)
+{
+    duk_push_object(ctx);
+    duk_push_object(ctx);
+    DefineProperty(ctx, "entities", PhysicsQueryResults_Get_entities, nullptr);
+    DefineProperty(ctx, "hits", PhysicsQueryResults_Get_hits, PhysicsQueryResults_Set_hits);
+    duk_put_prop_string(ctx, -2, "prototype");
+    duk_put_global_string(ctx, PhysicsQueryResults_ID);
+}
+
+}
@@ -23,6 +23,8 @@ namespace JSBindings
 
 static const char* float3_ID = "float3";
 static const char* PhysicsRaycastResult_ID = "PhysicsRaycastResult";
+static const char* Quat_ID = "Quat";
+static const char* PhysicsQueryResults_ID = "PhysicsQueryResults";
 
 static duk_ret_t float3_Finalizer(duk_context* ctx)
 {
@@ -36,6 +38,12 @@ static duk_ret_t PhysicsRaycastResult_Finalizer(duk_context* ctx)
     return 0;
 }
 
+static duk_ret_t PhysicsQueryResults_Finalizer(duk_context* ctx)
+{
+    FinalizeValueObject<PhysicsQueryResults>(ctx, PhysicsQueryResults_ID);
+    return 0;
+}
+
 
 static const char* PhysicsWorld_ID = "PhysicsWorld";
 
@@ -528,6 +536,41 @@ static duk_ret_t PhysicsWorld_IsClient(duk_context* ctx)
     return 1;
 }
 
+static duk_ret_t PhysicsWorld_SetAllContactsReported_bool(duk_context* ctx)
+{
+    PhysicsWorld* thisObj = GetThisWeakObject<PhysicsWorld>(ctx);
+    bool enable = duk_require_boolean(ctx, 0);
+    thisObj->SetAllContactsReported(enable);
+    return 0;
+}
+
+static duk_ret_t PhysicsWorld_AllContactsReported(duk_context* ctx)
+{
+    PhysicsWorld* thisObj = GetThisWeakObject<PhysicsWorld>(ctx);
+    bool ret = thisObj->AllContactsReported();
+    duk_push_boolean(ctx, ret);
+    return 1;
+}
+
+static duk_ret_t PhysicsWorld_CollidingEntities_Entity(duk_context* ctx)
+{
+    PhysicsWorld* thisObj = GetThisWeakObject<PhysicsWorld>(ctx);
+    Entity* entity = GetWeakObject<Entity>(ctx, 0);
+    EntityVector ret = thisObj->CollidingEntities(entity);
+    PushWeakObjectVector(ctx, ret);
+    return 1;
+}
+
+static duk_ret_t PhysicsWorld_AreColliding_Entity_Entity(duk_context* ctx)
+{
+    PhysicsWorld* thisObj = GetThisWeakObject<PhysicsWorld>(ctx);
+    Entity* entityA = GetWeakObject<Entity>(ctx, 0);
+    Entity* entityB = GetWeakObject<Entity>(ctx, 1);
+    bool ret = thisObj->AreColliding(entityA, entityB);
+    duk_push_boolean(ctx, ret);
+    return 1;
+}
+
 static duk_ret_t PhysicsWorld_Raycast_float3_float3_float_int_int(duk_context* ctx)
 {
     int numArgs = duk_get_top(ctx);
@@ -542,6 +585,89 @@ static duk_ret_t PhysicsWorld_Raycast_float3_float3_float_int_int(duk_context* c
     return 1;
 }
 
+static duk_ret_t PhysicsWorld_RaycastBatch_Vector_float_int_int(duk_context* ctx)
+{
+    int numArgs = duk_get_top(ctx);
+    PhysicsWorld* thisObj = GetThisWeakObject<PhysicsWorld>(ctx);
+    Vector<float> rays = GetFloatVector(ctx, 0);
+    int collisionGroup = numArgs > 1 ? (int)duk_require_number(ctx, 1) : -1;
+    int collisionMask = numArgs > 2 ? (int)duk_require_number(ctx, 2) : -1;
+    PhysicsQueryResults ret = thisObj->RaycastBatch(rays, collisionGroup, collisionMask);
+    PushValueObjectCopy<PhysicsQueryResults>(ctx, ret, PhysicsQueryResults_ID, PhysicsQueryResults_Finalizer);
+    return 1;
+}
+
+static duk_ret_t PhysicsWorld_SphereSweepBatch_float_Vector_float_int_int(duk_context* ctx)
+{
+    int numArgs = duk_get_top(ctx);
+    PhysicsWorld* thisObj = GetThisWeakObject<PhysicsWorld>(ctx);
+    float radius = (float)duk_require_number(ctx, 0);
+    Vector<float> sweeps = GetFloatVector(ctx, 1);
+    int collisionGroup = numArgs > 2 ? (int)duk_require_number(ctx, 2) : -1;
+    int collisionMask = numArgs > 3 ? (int)duk_require_number(ctx, 3) : -1;
+    PhysicsQueryResults ret = thisObj->SphereSweepBatch(radius, sweeps, collisionGroup, collisionMask);
+    PushValueObjectCopy<PhysicsQueryResults>(ctx, ret, PhysicsQueryResults_ID, PhysicsQueryResults_Finalizer);
+    return 1;
+}
+
+static duk_ret_t PhysicsWorld_BoxSweepBatch_float3_Quat_Vector_float_int_int(duk_context* ctx)
+{
+    int numArgs = duk_get_top(ctx);
+    PhysicsWorld* thisObj = GetThisWeakObject<PhysicsWorld>(ctx);
+    float3& halfExtents = *GetCheckedValueObject<float3>(ctx, 0, float3_ID);
+    Quat& orientation = *GetCheckedValueObject<Quat>(ctx, 1, Quat_ID);
+    Vector<float> sweeps = GetFloatVector(ctx, 2);
+    int collisionGroup = numArgs > 3 ? (int)duk_require_number(ctx, 3) : -1;
+    int collisionMask = numArgs > 4 ? (int)duk_require_number(ctx, 4) : -1;
+    PhysicsQueryResults ret = thisObj->BoxSweepBatch(halfExtents, orientation, sweeps, collisionGroup, collisionMask);
+    PushValueObjectCopy<PhysicsQueryResults>(ctx, ret, PhysicsQueryResults_ID, PhysicsQueryResults_Finalizer);
+    return 1;
+}
+
+static duk_ret_t PhysicsWorld_AabbOverlapBatch_Vector_float_int_int(duk_context* ctx)
+{
+    int numArgs = duk_get_top(ctx);
+    PhysicsWorld* thisObj = GetThisWeakObject<PhysicsWorld>(ctx);
+    Vector<float> boxes = GetFloatVector(ctx, 0);
+    int collisionGroup = numArgs > 1 ? (int)duk_require_number(ctx, 1) : -1;
+    int collisionMask = numArgs > 2 ? (int)duk_require_number(ctx, 2) : -1;
+    PhysicsQueryResults ret = thisObj->AabbOverlapBatch(boxes, collisionGroup, collisionMask);
+    PushValueObjectCopy<PhysicsQueryResults>(ctx, ret, PhysicsQueryResults_ID, PhysicsQueryResults_Finalizer);
+    return 1;
+}
+
+static duk_ret_t PhysicsWorld_SetParallelQueries_bool(duk_context* ctx)
+{
+    PhysicsWorld* thisObj = GetThisWeakObject<PhysicsWorld>(ctx);
+    bool enable = duk_require_boolean(ctx, 0);
+    thisObj->SetParallelQueries(enable);
+    return 0;
+}
+
+static duk_ret_t PhysicsWorld_ParallelQueries(duk_context* ctx)
+{
+    PhysicsWorld* thisObj = GetThisWeakObject<PhysicsWorld>(ctx);
+    bool ret = thisObj->ParallelQueries();
+    duk_push_boolean(ctx, ret);
+    return 1;
+}
+
+static duk_ret_t PhysicsWorld_SetAsynchronousSimulation_bool(duk_context* ctx)
+{
+    PhysicsWorld* thisObj = GetThisWeakObject<PhysicsWorld>(ctx);
+    bool enable = duk_require_boolean(ctx, 0);
+    thisObj->SetAsynchronousSimulation(enable);
+    return 0;
+}
+
+static duk_ret_t PhysicsWorld_AsynchronousSimulation(duk_context* ctx)
+{
+    PhysicsWorld* thisObj = GetThisWeakObject<PhysicsWorld>(ctx);
+    bool ret = thisObj->AsynchronousSimulation();
+    duk_push_boolean(ctx, ret);
+    return 1;
+}
+
 static const duk_function_list_entry PhysicsWorld_Functions[] = {
     {"SetPhysicsUpdatePeriod", PhysicsWorld_SetPhysicsUpdatePeriod_float, 1}
     ,{"PhysicsUpdatePeriod", PhysicsWorld_PhysicsUpdatePeriod, 0}
@@ -554,7 +680,19 @@ static const duk_function_list_entry PhysicsWorld_Functions[] = {
     ,{"SetRunning", PhysicsWorld_SetRunning_bool, 1}
     ,{"IsRunning", PhysicsWorld_IsRunning, 0}
     ,{"IsClient", PhysicsWorld_IsClient, 0}
+    ,{"SetAllContactsReported", PhysicsWorld_SetAllContactsReported_bool, 1}
+    ,{"AllContactsReported", PhysicsWorld_AllContactsReported, 0}
+    ,{"CollidingEntities", PhysicsWorld_CollidingEntities_Entity, 1}
+    ,{"AreColliding", PhysicsWorld_AreColliding_Entity_Entity, 2}
     ,{"Raycast", PhysicsWorld_Raycast_float3_float3_float_int_int, DUK_VARARGS}
+    ,{"RaycastBatch", PhysicsWorld_RaycastBatch_Vector_float_int_int, DUK_VARARGS}
+    ,{"SphereSweepBatch", PhysicsWorld_SphereSweepBatch_float_Vector_float_int_int, DUK_VARARGS}
+    ,{"BoxSweepBatch", PhysicsWorld_BoxSweepBatch_float3_Quat_Vector_float_int_int, DUK_VARARGS}
+    ,{"AabbOverlapBatch", PhysicsWorld_AabbOverlapBatch_Vector_float_int_int, DUK_VARARGS}
+    ,{"SetParallelQueries", PhysicsWorld_SetParallelQueries_bool, 1}
+    ,{"ParallelQueries", PhysicsWorld_ParallelQueries, 0}
+    ,{"SetAsynchronousSimulation", PhysicsWorld_SetAsynchronousSimulation_bool, 1}
+    ,{"AsynchronousSimulation", PhysicsWorld_AsynchronousSimulation, 0}
     ,{nullptr, nullptr, 0}
 };
 
@@ -573,6 +711,9 @@ void Expose_PhysicsWorld(duk_context* ctx)
     DefineProperty(ctx, "debugGeometryEnabled", PhysicsWorld_IsDebugGeometryEnabled, PhysicsWorld_SetDebugGeometryEnabled_bool);
     DefineProperty(ctx, "running", PhysicsWorld_IsRunning, PhysicsWorld_SetRunning_bool);
     DefineProperty(ctx, "client", PhysicsWorld_IsClient, nullptr);
+    DefineProperty(ctx, "allContactsReported", PhysicsWorld_AllContactsReported, PhysicsWorld_SetAllContactsReported_bool);
+    DefineProperty(ctx, "parallelQueries", PhysicsWorld_ParallelQueries, PhysicsWorld_SetParallelQueries_bool);
+    DefineProperty(ctx, "asynchronousSimulation", PhysicsWorld_AsynchronousSimulation, PhysicsWorld_SetAsynchronousSimulation_bool);
     duk_put_prop_string(ctx, -2, "prototype");
     duk_put_global_string(ctx, PhysicsWorld_ID);
 }
@@ -12,10 +12,13 @@ namespace Tundra
 {
     struct ConvexHull;
     struct ConvexHullSet;
+    struct TriangleMeshShape;
 
     class BulletPhysics;
+    class CollisionShapeCache;
     class PhysicsWorld;
     struct PhysicsRaycastResult;
+    struct PhysicsTransformUpdate;
     class RigidBody;
     class VolumeTrigger;
 
@@ -25,6 +28,7 @@ namespace Tundra
 
 // From Bullet:
 class btTriangleMesh;
+class btBvhTriangleMeshShape;
 class btCollisionConfiguration;
 class btBroadphaseInterface;
 class btConstraintSolver;
@@ -32,7 +36,9 @@ class btDiscreteDynamicsWorld;
 class btDispatcher;
 class btCollisionObject;
 class btConvexHullShape;
+class btConvexShape;
 class btRigidBody;
 class btCollisionShape;
 class btHeightfieldTerrainShape;
+class btITaskScheduler;
 
@@ -0,0 +1,455 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#define MATH_BULLET_INTEROP
+#include "CollisionShapeCache.h"
+#include "CollisionShapeUtils.h"
+#include "ConvexHull.h"
+#include "PhysicsUtils.h"
+#include "Framework.h"
+#include "AssetCache.h"
+#include "IMeshAsset.h"
+#include "LoggingFunctions.h"
+#include "MemoryMappedFile.h"
+
+#include <Urho3D/Container/HashSet.h>
+#include <Urho3D/Core/Profiler.h>
+#include <Urho3D/Core/WorkQueue.h>
+#include <Urho3D/Graphics/Model.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/MemoryBuffer.h>
+#include <Urho3D/IO/VectorBuffer.h>
+
+// Disable unreferenced formal parameter coming from Bullet
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4100)
+#endif
+#include <btBulletDynamicsCommon.h>
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+namespace Tundra
+{
+
+/// Cache file identifiers and format version. Increment the version when the file contents change.
+static const unsigned cBvhFileId = 0x48564254; // "TBVH"
+static const unsigned cHullFileId = 0x4C554854; // "THUL"
+static const unsigned cCacheFileVersion = 1;
+
+TriangleMeshShape::TriangleMeshShape() :
+    shape_(0),
+    bvhBuffer_(0),
+    ready_(true)
+{
+}
+
+TriangleMeshShape::~TriangleMeshShape()
+{
+    // A BVH loaded from the disk cache is not owned by the shape, but was constructed inside bvhBuffer_.
+    btOptimizedBvh *loadedBvh = (shape_ && bvhBuffer_ ? shape_->getOptimizedBvh() : 0);
+    delete shape_;
+    if (loadedBvh)
+        loadedBvh->~btOptimizedBvh();
+    if (bvhBuffer_)
+        btAlignedFree(bvhBuffer_);
+}
+
+struct CollisionShapeCache::Job
+{
+    Job() : owner(0), maxHulls(1), maxConcavity(0.0f) {}
+
+    CollisionShapeCache *owner;
+    /// Cache file path, empty if the disk cache is disabled
+    String cacheFile;
+    /// Triangle list of the mesh
+    PODVector<float3> triangles;
+    /// Shape to generate, only one of these is set
+    shared_ptr<TriangleMeshShape> triangleMeshShape;
+    shared_ptr<ConvexHullSet> convexHullSet;
+    /// Convex decomposition parameters of the convex hull set
+    uint maxHulls;
+    float maxConcavity;
+};
+
+/// Loads a serialized BVH for the triangle mesh of a job. Returns false if the cache file is missing or invalid.
+/** The BVH is deserialized in place, so it is copied from the mapped file to a buffer with the alignment Bullet requires. */
+static bool LoadBvh(Urho3D::Context *context, const String &fileName, uint numTriangles, TriangleMeshShape *shape)
+{
+    SharedPtr<MemoryMappedFile> file = AssetCache::MapVersionedFile(context, fileName, cBvhFileId, cCacheFileVersion);
+    if (!file)
+        return false;
+
+    Urho3D::MemoryBuffer data(file->Data() + AssetCache::VersionedFileHeaderSize, (unsigned)file->Size() - AssetCache::VersionedFileHeaderSize);
+    if (data.GetSize() < 3 * sizeof(unsigned) || data.ReadUInt() != sizeof(btScalar) || data.ReadUInt() != numTriangles)
+        return false;
+    unsigned dataSize = data.ReadUInt();
+    if (!dataSize || dataSize != data.GetSize() - data.GetPosition())
+        return false;
+
+    void *buffer = btAlignedAlloc(dataSize, 16);
+    memcpy(buffer, data.GetData() + data.GetPosition(), dataSize);
+    btOptimizedBvh *bvh = btOptimizedBvh::deSerializeInPlace(buffer, dataSize, false);
+    if (!bvh)
+    {
+        btAlignedFree(buffer);
+        return false;
+    }
+
+    shape->shape_ = new btBvhTriangleMeshShape(shape->mesh_.get(), true, false);
+    shape->shape_->setOptimizedBvh(bvh);
+    shape->bvhBuffer_ = buffer;
+    return true;
+}
+
+/// Stores the BVH of a triangle mesh shape to the disk cache.
+static void SaveBvh(Urho3D::Context *context, const String &fileName, uint numTriangles, TriangleMeshShape *shape)
+{
+    btOptimizedBvh *bvh = (shape->shape_ ? shape->shape_->getOptimizedBvh() : 0);
+    if (fileName.Empty() || !bvh)
+        return;
+
+    unsigned dataSize = bvh->calculateSerializeBufferSize();
+    void *buffer = btAlignedAlloc(dataSize, 16);
+    if (bvh->serializeInPlace(buffer, dataSize, false))
+    {
+        Urho3D::VectorBuffer data;
+        data.WriteUInt(sizeof(btScalar));
+        data.WriteUInt(numTriangles);
+        data.WriteUInt(dataSize);
+        data.Write(buffer, dataSize);
+        AssetCache::WriteVersionedFile(context, fileName, cBvhFileId, cCacheFileVersion, data.GetData(), data.GetSize());
+    }
+    btAlignedFree(buffer);
+}
+
+/// Loads the hull vertices of a convex hull set. Returns false if the cache file is missing or invalid.
+static bool LoadHulls(Urho3D::Context *context, const String &fileName, ConvexHullSet *set)
+{
+    SharedPtr<MemoryMappedFile> file = AssetCache::MapVersionedFile(context, fileName, cHullFileId, cCacheFileVersion);
+    if (!file)
+        return false;
+
+    Urho3D::MemoryBuffer data(file->Data() + AssetCache::VersionedFileHeaderSize, (unsigned)file->Size() - AssetCache::VersionedFileHeaderSize);
+    uint numHulls = data.ReadUInt();
+    PODVector<float3> vertices;
+    for(uint i = 0; i < numHulls && !data.IsEof(); ++i)
+    {
+        float3 position;
+        if (data.Read(&position, sizeof(float3)) != sizeof(float3))
+            break;
+        uint numVertices = data.ReadUInt();
+        if (!numVertices || numVertices > (data.GetSize() - data.GetPosition()) / sizeof(float3))
+            break;
+        vertices.Resize(numVertices);
+        data.Read(&vertices[0], numVertices * sizeof(float3));
+        AddConvexHull(&vertices[0], numVertices, set);
+        set->hulls_.Back().position_ = position;
+    }
+    if (set->hulls_.Size() != numHulls || !numHulls)
+    {
+        set->hulls_.Clear();
+        return false;
+    }
+    return true;
+}
+
+/// Stores the hull vertices of a convex hull set to the disk cache.
+static void SaveHulls(Urho3D::Context *context, const String &fileName, const ConvexHullSet *set)
+{
+    if (fileName.Empty() || set->hulls_.Empty())
+        return;
+
+    Urho3D::VectorBuffer data;
+    data.WriteUInt(set->hulls_.Size());
+    for(uint i = 0; i < set->hulls_.Size(); ++i)
+    {
+        const btConvexHullShape *hull = set->hulls_[i].hull_.get();
+        data.Write(&set->hulls_[i].position_, sizeof(float3));
+        data.WriteUInt(hull->getNumPoints());
+        const btVector3 *points = hull->getUnscaledPoints();
+        for(int j = 0; j < hull->getNumPoints(); ++j)
+        {
+            float3 point = points[j];
+            data.Write(&point, sizeof(float3));
+        }
+    }
+    AssetCache::WriteVersionedFile(context, fileName, cHullFileId, cCacheFileVersion, data.GetData(), data.GetSize());
+}
+
+CollisionShapeCache::CollisionShapeCache(Framework *framework, const String &cacheDirectory) :
+    Object(framework->GetContext()),
+    framework_(framework),
+    maxHulls_(1),
+    maxConcavity_(0.01f)
+{
+    if (!cacheDirectory.Empty())
+    {
+        Urho3D::FileSystem *fileSystem = GetSubsystem<Urho3D::FileSystem>();
+        String directory = Urho3D::AddTrailingSlash(cacheDirectory);
+        if (fileSystem->DirExists(directory) || fileSystem->CreateDir(directory))
+            cacheDirectory_ = directory;
+        else
+            LogWarning("CollisionShapeCache: Failed to create cache directory " + directory + ", collision shapes are only cached in memory.");
+    }
+}
+
+CollisionShapeCache::~CollisionShapeCache()
+{
+    // Finish the background jobs, as they refer to the cache and the shapes
+    if (!jobs_.Empty())
+    {
+        Urho3D::WorkQueue *workQueue = GetSubsystem<Urho3D::WorkQueue>();
+        if (workQueue)
+            workQueue->Complete(0);
+    }
+    for(uint i = 0; i < jobs_.Size(); ++i)
+        delete jobs_[i];
+    jobs_.Clear();
+    completedJobs_.Clear();
+}
+
+String CollisionShapeCache::MeshKey(IMeshAsset *mesh, PODVector<float3> &triangles)
+{
+    /* The entry is forgotten when the mesh is loaded again or unloaded. As the Loaded handlers of a mesh may be called
+       in any order, a handler that asks for a shape before ours has run is caught by the model check. */
+    MeshKeyMap::ConstIterator iter = meshKeys_.Find(mesh->Name());
+    if (iter != meshKeys_.End() && mesh->UrhoModel() && iter->second_.model.Get() == mesh->UrhoModel())
+        return iter->second_.key;
+
+    GetTrianglesFromMesh(mesh, triangles);
+    MeshKeyEntry &entry = meshKeys_[mesh->Name()];
+    entry.model = mesh->UrhoModel();
+    entry.key = AssetCache::ContentKey(triangles.Buffer(), triangles.Size() * sizeof(float3));
+    mesh->Loaded.Connect(this, &CollisionShapeCache::OnMeshLoaded);
+    mesh->Unloaded.Connect(this, &CollisionShapeCache::OnMeshUnloaded);
+    return entry.key;
+}
+
+void CollisionShapeCache::ForgetMeshKey(IAsset *mesh)
+{
+    mesh->Loaded.Disconnect(this, &CollisionShapeCache::OnMeshLoaded);
+    mesh->Unloaded.Disconnect(this, &CollisionShapeCache::OnMeshUnloaded);
+    meshKeys_.Erase(mesh->Name());
+}
+
+void CollisionShapeCache::OnMeshLoaded(AssetPtr mesh)
+{
+    ForgetMeshKey(mesh.Get());
+}
+
+void CollisionShapeCache::OnMeshUnloaded(IAsset *mesh)
+{
+    ForgetMeshKey(mesh);
+}
+
+shared_ptr<TriangleMeshShape> CollisionShapeCache::TriangleMeshShapeFor(IMeshAsset *mesh)
+{
+    if (!mesh)
+        return shared_ptr<TriangleMeshShape>();
+
+    PODVector<float3> triangles;
+    String key = MeshKey(mesh, triangles);
+    TriangleMeshShapeMap::ConstIterator iter = triangleMeshShapes_.Find(key);
+    if (iter != triangleMeshShapes_.End())
+        return iter->second_;
+
+    shared_ptr<TriangleMeshShape> shape(new TriangleMeshShape());
+    shape->ready_ = false;
+    triangleMeshShapes_[key] = shape;
+
+    Job *job = new Job();
+    job->owner = this;
+    if (triangles.Empty())
+        GetTrianglesFromMesh(mesh, triangles);
+    job->triangles.Swap(triangles);
+    job->triangleMeshShape = shape;
+    if (!cacheDirectory_.Empty())
+        job->cacheFile = cacheDirectory_ + key + ".bvh";
+    Schedule(job);
+    return shape;
+}
+
+shared_ptr<ConvexHullSet> CollisionShapeCache::ConvexHullSetFor(IMeshAsset *mesh)
+{
+    if (!mesh)
+        return shared_ptr<ConvexHullSet>();
+
+    PODVector<float3> triangles;
+    String key = MeshKey(mesh, triangles);
+    if (maxHulls_ > 1)
+        key += "_cd" + String(maxHulls_) + "_" + String((int)(maxConcavity_ * 10000.0f));
+    ConvexHullSetMap::ConstIterator iter = convexHullSets_.Find(key);
+    if (iter != convexHullSets_.End())
+        return iter->second_;
+
+    shared_ptr<ConvexHullSet> set(new ConvexHullSet());
+    set->ready_ = false;
+    convexHullSets_[key] = set;
+
+    Job *job = new Job();
+    job->owner = this;
+    if (triangles.Empty())
+        GetTrianglesFromMesh(mesh, triangles);
+    job->triangles.Swap(triangles);
+    job->convexHullSet = set;
+    job->maxHulls = maxHulls_;
+    job->maxConcavity = maxConcavity_;
+    if (!cacheDirectory_.Empty())
+        job->cacheFile = cacheDirectory_ + key + ".hull";
+    Schedule(job);
+    return set;
+}
+
+void CollisionShapeCache::SetConvexDecomposition(uint maxHulls, float maxConcavity)
+{
+    maxHulls_ = Urho3D::Max(maxHulls, 1U);
+    maxConcavity_ = Urho3D::Max(maxConcavity, 0.0f);
+}
+
+void CollisionShapeCache::Schedule(Job *job)
+{
+    Urho3D::WorkQueue *workQueue = GetSubsystem<Urho3D::WorkQueue>();
+    if (!workQueue)
+    {
+        Urho3D::WorkItem item;
+        item.aux_ = job;
+        ProcessJob(&item, 0);
+        {
+            Urho3D::MutexLock lock(completedJobsMutex_);
+            completedJobs_.Remove(job);
+        }
+        Publish(job);
+        delete job;
+        return;
+    }
+
+    jobs_.Push(job);
+    SharedPtr<Urho3D::WorkItem> item(new Urho3D::WorkItem());
+    item->workFunction_ = &CollisionShapeCache::ProcessJob;
+    item->aux_ = job;
+    workQueue->AddWorkItem(item);
+}
+
+void CollisionShapeCache::ProcessJob(const Urho3D::WorkItem *item, unsigned /*threadIndex*/)
+{
+    Job *job = static_cast<Job*>(item->aux_);
+    Urho3D::Context *context = job->owner->GetContext();
+    const uint numTriangles = job->triangles.Size() / 3;
+
+    if (job->triangleMeshShape && numTriangles)
+    {
+        TriangleMeshShape *shape = job->triangleMeshShape.get();
+        shape->mesh_ = shared_ptr<btTriangleMesh>(new btTriangleMesh());
+        GenerateTriangleMesh(job->triangles, shape->mesh_.get());
+        if (!LoadBvh(context, job->cacheFile, numTriangles, shape))
+        {
+            shape->shape_ = new btBvhTriangleMeshShape(shape->mesh_.get(), true, true);
+            SaveBvh(context, job->cacheFile, numTriangles, shape);
+        }
+    }
+    else if (job->convexHullSet)
+    {
+        ConvexHullSet *set = job->convexHullSet.get();
+        if (!LoadHulls(context, job->cacheFile, set))
+        {
+            GenerateConvexDecomposition(job->triangles, job->maxHulls, job->maxConcavity, set);
+            SaveHulls(context, job->cacheFile, set);
+        }
+    }
+
+    Urho3D::MutexLock lock(job->owner->completedJobsMutex_);
+    job->owner->completedJobs_.Push(job);
+}
+
+void CollisionShapeCache::Publish(Job *job)
+{
+    if (job->triangleMeshShape)
+    {
+        job->triangleMeshShape->ready_ = true;
+        job->triangleMeshShape->Ready.Emit();
+        job->triangleMeshShape->Ready.Clear();
+    }
+    if (job->convexHullSet)
+    {
+        job->convexHullSet->ready_ = true;
+        job->convexHullSet->Ready.Emit();
+        job->convexHullSet->Ready.Clear();
+    }
+}
+
+void CollisionShapeCache::Update()
+{
+    if (jobs_.Empty())
+        return;
+
+    URHO3D_PROFILE(CollisionShapeCache_Update);
+
+    Vector<Job*> completed;
+    {
+        Urho3D::MutexLock lock(completedJobsMutex_);
+        completed.Swap(completedJobs_);
+    }
+    // Remove all completed jobs before publishing, as the Ready handlers may schedule new jobs
+    for(uint i = 0; i < completed.Size(); ++i)
+        jobs_.Remove(completed[i]);
+    for(uint i = 0; i < completed.Size(); ++i)
+    {
+        Publish(completed[i]);
+        delete completed[i];
+    }
+}
+
+int CollisionShapeCache::ForgetUnused()
+{
+    /* Forget the shapes whose use count is 1, meaning that the cache map is the only one keeping them alive.
+       Shapes that are being generated are also referred by their job. */
+    int forgotten = 0;
+
+    for(TriangleMeshShapeMap::Iterator iter = triangleMeshShapes_.Begin(); iter != triangleMeshShapes_.End();)
+    {
+        if (iter->second_.use_count() == 1)
+        {
+            iter = triangleMeshShapes_.Erase(iter);
+            forgotten++;
+        }
+        else
+            ++iter;
+    }
+
+    for(ConvexHullSetMap::Iterator iter = convexHullSets_.Begin(); iter != convexHullSets_.End();)
+    {
+        if (iter->second_.use_count() == 1)
+        {
+            iter = convexHullSets_.Erase(iter);
+            forgotten++;
+        }
+        else
+            ++iter;
+    }
+
+    if (forgotten)
+    {
+        // Convex hull sets of a convex decomposition are keyed by the mesh key followed by the decomposition parameters
+        HashSet<String> usedKeys;
+        for(TriangleMeshShapeMap::ConstIterator iter = triangleMeshShapes_.Begin(); iter != triangleMeshShapes_.End(); ++iter)
+            usedKeys.Insert(iter->first_);
+        for(ConvexHullSetMap::ConstIterator iter = convexHullSets_.Begin(); iter != convexHullSets_.End(); ++iter)
+        {
+            unsigned decomposition = iter->first_.Find("_cd");
+            usedKeys.Insert(decomposition != String::NPOS ? iter->first_.Substring(0, decomposition) : iter->first_);
+        }
+        for(MeshKeyMap::Iterator iter = meshKeys_.Begin(); iter != meshKeys_.End();)
+        {
+            if (!usedKeys.Contains(iter->second_.key))
+                iter = meshKeys_.Erase(iter);
+            else
+                ++iter;
+        }
+    }
+
+    return forgotten;
+}
+
+}
@@ -0,0 +1,117 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "BulletPhysicsApi.h"
+#include "BulletPhysicsFwd.h"
+#include "FrameworkFwd.h"
+#include "AssetFwd.h"
+#include "StdPtr.h"
+
+#include <Urho3D/Core/Mutex.h>
+#include <Urho3D/Core/Object.h>
+
+namespace Urho3D
+{
+    class Model;
+    struct WorkItem;
+}
+
+namespace Tundra
+{
+
+class IMeshAsset;
+
+/// Caches the collision shapes generated from mesh assets, in memory and on disk.
+/** Shapes are keyed by a hash of the mesh triangle data, so meshes with identical content share their shapes
+    regardless of their asset name. Convex hull sets are also keyed by their convex decomposition parameters.
+    Triangle mesh shapes store their quantized BVH and convex hull sets the vertices of their hulls in the disk
+    cache, to avoid building them again on the next run.
+
+    Cache misses are generated in the background on the Urho3D worker threads. Returned shapes are ready
+    for use once their ready_ flag has been set, at which point their Ready signal is emitted.
+
+    The disk cache is stored in the collisionshapes subdirectory of the asset cache and is disabled when
+    running without an asset cache or with the --noCollisionShapeCache command line parameter.
+    @sa BulletPhysics::GetTriangleMeshShapeFromMeshAsset, BulletPhysics::GetConvexHullSetFromMeshAsset */
+class BULLETPHYSICS_API CollisionShapeCache : public Object
+{
+    URHO3D_OBJECT(CollisionShapeCache, Object);
+
+public:
+    /// @param cacheDirectory Directory of the disk cache. If empty, shapes are only cached in memory.
+    CollisionShapeCache(Framework *framework, const String &cacheDirectory);
+    ~CollisionShapeCache();
+
+    /// Returns the triangle mesh shape of a mesh, generating it if necessary.
+    shared_ptr<TriangleMeshShape> TriangleMeshShapeFor(IMeshAsset *mesh);
+
+    /// Returns the convex hull set of a mesh, generating it if necessary.
+    shared_ptr<ConvexHullSet> ConvexHullSetFor(IMeshAsset *mesh);
+
+    /// Sets the convex decomposition parameters used for new convex hull sets. @sa GenerateConvexDecomposition
+    /** With maxHulls 1, a single hull is generated for each mesh. Sets generated with other parameters stay cached. */
+    void SetConvexDecomposition(uint maxHulls, float maxConcavity);
+
+    /// Returns the maximum number of hulls in new convex hull sets.
+    uint ConvexDecompositionMaxHulls() const { return maxHulls_; }
+
+    /// Returns the maximum concavity of the parts of new convex hull sets.
+    float ConvexDecompositionConcavity() const { return maxConcavity_; }
+
+    /// Publishes the shapes whose background generation has completed.
+    void Update();
+
+    /// Forgets the shapes that are not used outside the cache. @return Number of forgotten shapes.
+    int ForgetUnused();
+
+    /// Returns the disk cache directory, or an empty string if the disk cache is disabled.
+    const String &CacheDirectory() const { return cacheDirectory_; }
+
+private:
+    struct Job;
+
+    /// Returns the content key of a mesh and fills its triangle list if the key was not already known.
+    String MeshKey(IMeshAsset *mesh, PODVector<float3> &triangles);
+    /// Forgets the content key of a mesh whose content has changed.
+    void ForgetMeshKey(IAsset *mesh);
+    /// Handles the Loaded signal of a hashed mesh.
+    void OnMeshLoaded(AssetPtr mesh);
+    /// Handles the Unloaded signal of a hashed mesh.
+    void OnMeshUnloaded(IAsset *mesh);
+    /// Starts background generation of a job, or runs it immediately if there is no work queue.
+    void Schedule(Job *job);
+    /// Marks the shapes of a completed job ready and emits their Ready signals.
+    void Publish(Job *job);
+
+    /// Urho3D work queue function. Loads the shape of a job from the disk cache, or generates and stores it.
+    static void ProcessJob(const Urho3D::WorkItem *item, unsigned threadIndex);
+
+    /// Content key of a hashed mesh, valid as long as the mesh keeps the model it was hashed from.
+    struct MeshKeyEntry
+    {
+        WeakPtr<Urho3D::Model> model;
+        String key;
+    };
+
+    typedef HashMap<String, MeshKeyEntry> MeshKeyMap;
+    typedef HashMap<String, shared_ptr<TriangleMeshShape> > TriangleMeshShapeMap;
+    typedef HashMap<String, shared_ptr<ConvexHullSet> > ConvexHullSetMap;
+
+    Framework *framework_;
+    String cacheDirectory_;
+    /// Convex decomposition parameters
+    uint maxHulls_;
+    float maxConcavity_;
+    /// Content keys of already hashed meshes, by asset name
+    MeshKeyMap meshKeys_;
+    TriangleMeshShapeMap triangleMeshShapes_;
+    ConvexHullSetMap convexHullSets_;
+    /// Jobs that are being processed in the background
+    Vector<Job*> jobs_;
+    /// Jobs completed by the worker threads, waiting to be published on the main thread
+    Vector<Job*> completedJobs_;
+    Urho3D::Mutex completedJobsMutex_;
+};
+
+}
@@ -8,10 +8,13 @@
 #include "LoggingFunctions.h"
 #include "hull.h"
 #include "IMeshAsset.h"
+#include "Geometry/AABB.h"
 
 #include <Urho3D/Graphics/Geometry.h>
 #include <Urho3D/Graphics/Model.h>
 
+#include <cfloat>
+
 // Disable unreferenced formal parameter coming from Bullet
 #ifdef _MSC_VER
 #pragma warning(push)
@@ -29,8 +32,12 @@ void GenerateTriangleMesh(IMeshAsset* mesh, btTriangleMesh* ptr)
 {
     PODVector<float3> triangles;
     GetTrianglesFromMesh(mesh, triangles);
-    
-    for(uint i = 0; i < triangles.Size(); i += 3)
+    GenerateTriangleMesh(triangles, ptr);
+}
+
+void GenerateTriangleMesh(const PODVector<float3>& triangles, btTriangleMesh* ptr)
+{
+    for(uint i = 0; i + 2 < triangles.Size(); i += 3)
         ptr->addTriangle(triangles[i], triangles[i+1], triangles[i+2]);
 }
 
@@ -38,6 +45,11 @@ void GenerateConvexHullSet(IMeshAsset* mesh, ConvexHullSet* ptr)
 {
     PODVector<float3> vertices;
     GetTrianglesFromMesh(mesh, vertices);
+    GenerateConvexHullSet(vertices, ptr);
+}
+
+void GenerateConvexHullSet(const PODVector<float3>& vertices, ConvexHullSet* ptr)
+{
     if (!vertices.Size())
     {
         LogError("Mesh had no triangles; aborting convex hull generation");
@@ -61,15 +73,198 @@ void GenerateConvexHullSet(IMeshAsset* mesh, ConvexHullSet* ptr)
         return;
     }
     
-    ConvexHull hull;
-    hull.position_ = float3(0,0,0);
     /// \todo StanHull always produces only 1 hull. Therefore using a hull set is unnecessary and could be optimized away
-    hull.hull_ = shared_ptr<btConvexHullShape>(new btConvexHullShape((const btScalar*)&result.mOutputVertices[0], result.mNumOutputVertices, static_cast<int>(3 * sizeof(float))));
-    ptr->hulls_.Push(hull);
+    AddConvexHull((const float3*)&result.mOutputVertices[0], result.mNumOutputVertices, ptr);
     
     lib.ReleaseResult(result);
 }
 
+/// Part of a mesh during convex decomposition
+struct DecompositionPart
+{
+    DecompositionPart() : concavity(0.0f) {}
+
+    PODVector<float3> triangles;
+    PODVector<float3> hullVertices;
+    /// Largest depth of the part triangles inside the hull
+    float concavity;
+};
+
+/// Generates the convex hull of a decomposition part and measures its concavity. Returns false if no hull could be generated.
+static bool GeneratePartHull(DecompositionPart& part)
+{
+    part.hullVertices.Clear();
+    part.concavity = 0.0f;
+    if (part.triangles.Size() < 3)
+        return false;
+
+    StanHull::HullDesc desc;
+    desc.SetHullFlag(StanHull::QF_TRIANGLES);
+    desc.mVcount = (uint)part.triangles.Size();
+    desc.mVertices = &part.triangles[0].x;
+    desc.mVertexStride = sizeof(float3);
+    desc.mSkinWidth = 0.01f;
+
+    StanHull::HullLibrary lib;
+    StanHull::HullResult result;
+    lib.CreateConvexHull(desc, result);
+    if (!result.mNumOutputVertices)
+    {
+        lib.ReleaseResult(result);
+        return false;
+    }
+
+    const float3* vertices = (const float3*)&result.mOutputVertices[0];
+    float3 center = float3::zero;
+    for(uint i = 0; i < result.mNumOutputVertices; ++i)
+    {
+        part.hullVertices.Push(vertices[i]);
+        center += vertices[i];
+    }
+    center /= (float)result.mNumOutputVertices;
+
+    // Hull face planes, oriented so that the normals point outwards
+    PODVector<float3> normals;
+    PODVector<float> distances;
+    for(uint i = 0; i + 2 < result.mNumIndices; i += 3)
+    {
+        const float3& a = vertices[result.mIndices[i]];
+        float3 normal = (vertices[result.mIndices[i+1]] - a).Cross(vertices[result.mIndices[i+2]] - a);
+        if (normal.Normalize() == 0.0f)
+            continue;
+        float distance = normal.Dot(a);
+        if (normal.Dot(center) > distance)
+        {
+            normal = -normal;
+            distance = -distance;
+        }
+        normals.Push(normal);
+        distances.Push(distance);
+    }
+
+    // Triangles of a convex part lie on the hull surface. The deeper inside the hull they are, the more concave the part is.
+    for(uint i = 0; i + 2 < part.triangles.Size(); i += 3)
+    {
+        float3 centroid = (part.triangles[i] + part.triangles[i+1] + part.triangles[i+2]) / 3.0f;
+        float depth = FLT_MAX;
+        for(uint j = 0; j < normals.Size(); ++j)
+        {
+            float planeDepth = distances[j] - normals[j].Dot(centroid);
+            if (planeDepth < depth)
+                depth = planeDepth;
+        }
+        if (depth != FLT_MAX && depth > part.concavity)
+            part.concavity = depth;
+    }
+
+    lib.ReleaseResult(result);
+    return true;
+}
+
+/// Splits a decomposition part in two at the center of its bounding box along the given axis.
+static void SplitPart(const DecompositionPart& part, int axis, DecompositionPart& front, DecompositionPart& back)
+{
+    AABB bounds;
+    bounds.SetNegativeInfinity();
+    for(uint i = 0; i < part.triangles.Size(); ++i)
+        bounds.Enclose(part.triangles[i]);
+    const float split = bounds.CenterPoint()[axis];
+
+    front.triangles.Clear();
+    back.triangles.Clear();
+    for(uint i = 0; i + 2 < part.triangles.Size(); i += 3)
+    {
+        PODVector<float3>& dest = ((part.triangles[i][axis] + part.triangles[i+1][axis] + part.triangles[i+2][axis]) / 3.0f < split ?
+            back.triangles : front.triangles);
+        dest.Push(part.triangles[i]);
+        dest.Push(part.triangles[i+1]);
+        dest.Push(part.triangles[i+2]);
+    }
+}
+
+void GenerateConvexDecomposition(const PODVector<float3>& triangles, uint maxHulls, float maxConcavity, ConvexHullSet* ptr)
+{
+    if (maxHulls <= 1)
+    {
+        GenerateConvexHullSet(triangles, ptr);
+        return;
+    }
+    if (triangles.Size() < 3)
+    {
+        LogError("Mesh had no triangles; aborting convex decomposition");
+        return;
+    }
+
+    AABB bounds;
+    bounds.SetNegativeInfinity();
+    for(uint i = 0; i < triangles.Size(); ++i)
+        bounds.Enclose(triangles[i]);
+    const float concavityThreshold = maxConcavity * bounds.Size().Length();
+
+    Vector<DecompositionPart> parts(1);
+    parts[0].triangles = triangles;
+    GeneratePartHull(parts[0]);
+
+    DecompositionPart front, back, bestFront, bestBack;
+    while(parts.Size() < maxHulls)
+    {
+        // Split the most concave part
+        uint splitIndex = parts.Size();
+        float splitConcavity = concavityThreshold;
+        for(uint i = 0; i < parts.Size(); ++i)
+        {
+            if (parts[i].concavity > splitConcavity)
+            {
+                splitIndex = i;
+                splitConcavity = parts[i].concavity;
+            }
+        }
+        if (splitIndex == parts.Size())
+            break;
+
+        // Try a split along each axis and keep the one that leaves the least concavity
+        float bestConcavity = FLT_MAX;
+        for(int axis = 0; axis < 3; ++axis)
+        {
+            SplitPart(parts[splitIndex], axis, front, back);
+            if (!GeneratePartHull(front) || !GeneratePartHull(back))
+                continue;
+            float concavity = front.concavity + back.concavity;
+            if (concavity < bestConcavity)
+            {
+                bestConcavity = concavity;
+                bestFront = front;
+                bestBack = back;
+            }
+        }
+
+        if (bestConcavity == FLT_MAX)
+        {
+            // Can not be split further, accept the part as it is
+            parts[splitIndex].concavity = 0.0f;
+            continue;
+        }
+        parts[splitIndex] = bestFront;
+        parts.Push(bestBack);
+    }
+
+    for(uint i = 0; i < parts.Size(); ++i)
+    {
+        if (!parts[i].hullVertices.Empty())
+            AddConvexHull(&parts[i].hullVertices[0], parts[i].hullVertices.Size(), ptr);
+    }
+    if (ptr->hulls_.Empty())
+        LogError("No vertices were generated; aborting convex decomposition");
+}
+
+void AddConvexHull(const float3* vertices, uint numVertices, ConvexHullSet* ptr)
+{
+    ConvexHull hull;
+    hull.position_ = float3(0,0,0);
+    hull.hull_ = shared_ptr<btConvexHullShape>(new btConvexHullShape((const btScalar*)vertices, numVertices, static_cast<int>(3 * sizeof(float))));
+    ptr->hulls_.Push(hull);
+}
+
 void GetTrianglesFromMesh(IMeshAsset* mesh, PODVector<float3>& dest)
 {
     dest.Clear();
@@ -15,5 +15,17 @@ class IMeshAsset;
 void BULLETPHYSICS_API GenerateTriangleMesh(IMeshAsset* mesh, btTriangleMesh* ptr);
 void BULLETPHYSICS_API GetTrianglesFromMesh(IMeshAsset*, PODVector<float3>& dest);
 void BULLETPHYSICS_API GenerateConvexHullSet(IMeshAsset* mesh, ConvexHullSet* ptr);
+/// Generates a triangle mesh from a triangle list, as returned by GetTrianglesFromMesh.
+void BULLETPHYSICS_API GenerateTriangleMesh(const PODVector<float3>& triangles, btTriangleMesh* ptr);
+/// Generates a convex hull set from a triangle list, as returned by GetTrianglesFromMesh.
+void BULLETPHYSICS_API GenerateConvexHullSet(const PODVector<float3>& vertices, ConvexHullSet* ptr);
+/// Generates an approximate convex decomposition of a triangle list into at most maxHulls hulls.
+/** The most concave part of the mesh is split recursively with axis-aligned planes until the concavity of all parts is
+    below maxConcavity, or maxHulls parts have been created. The concavity of a part is the largest depth of its
+    triangles inside its convex hull, relative to the bounding box diagonal of the whole mesh. With maxHulls 1, this
+    is equal to GenerateConvexHullSet. */
+void BULLETPHYSICS_API GenerateConvexDecomposition(const PODVector<float3>& triangles, uint maxHulls, float maxConcavity, ConvexHullSet* ptr);
+/// Adds a convex hull created from the given hull vertices to a convex hull set.
+void BULLETPHYSICS_API AddConvexHull(const float3* vertices, uint numVertices, ConvexHullSet* ptr);
 
 }
@@ -7,6 +7,7 @@
 #include "BulletPhysicsApi.h"
 #include "BulletPhysicsFwd.h"
 #include "Math/float3.h"
+#include "Signals.h"
 
 #include "StdPtr.h"
 
@@ -22,7 +23,29 @@ struct ConvexHull
 
 struct ConvexHullSet
 {
+    ConvexHullSet() : ready_(true) {}
+
     Vector<ConvexHull> hulls_;
+    /// Whether the hulls have been generated. Generation of cached sets happens in the background.
+    bool ready_;
+    /// Emitted once when background generation completes. The connections are cleared after emitting.
+    Signal0<void> Ready;
+};
+
+struct TriangleMeshShape
+{
+    TriangleMeshShape();
+    ~TriangleMeshShape();
+
+    shared_ptr<btTriangleMesh> mesh_;
+    /// BVH shape shared by all rigid bodies using the mesh. Scaled per body with btScaledBvhTriangleMeshShape.
+    btBvhTriangleMeshShape *shape_;
+    /// Aligned buffer of a BVH loaded from the disk cache, null if the BVH was built. The BVH of shape_ lives inside the buffer.
+    void *bvhBuffer_;
+    /// Whether the shape has been generated. Generation of cached shapes happens in the background.
+    bool ready_;
+    /// Emitted once when background generation completes. The connections are cleared after emitting.
+    Signal0<void> Ready;
 };
 /** @endcond */
 
@@ -9,6 +9,12 @@
 #include <BulletDynamics/Dynamics/btRigidBody.h>
 #include <BulletCollision/CollisionDispatch/btCollisionWorld.h>
 
+/// Multithreaded physics worlds require Bullet 2.87 or newer built with BULLET2_MULTITHREADING, with BT_THREADSAFE
+/// defined to match the Bullet build (the BULLET_MULTITHREADING CMake option). Otherwise physics worlds are always single-threaded.
+#if defined(BT_THREADSAFE) && BT_BULLET_VERSION >= 287
+#define BULLETPHYSICS_MULTITHREADING
+#endif
+
 /// Simple raycast against single rigid body
 /** @param rayFrom origin of ray
     @param rayTo ray destination
@@ -7,7 +7,9 @@
 #include "PhysicsWorld.h"
 #include "PhysicsUtils.h"
 #include "RigidBody.h"
+#include "VolumeTrigger.h"
 #include "Framework.h"
+#include "CoreDefines.h"
 #include "LoggingFunctions.h"
 
 #include "Scene.h"
@@ -29,39 +31,289 @@
 #pragma warning(disable : 4100)
 #endif
 #include <btBulletDynamicsCommon.h>
+#ifdef BULLETPHYSICS_MULTITHREADING
+#include <BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h>
+#include <BulletDynamics/Dynamics/btDiscreteDynamicsWorldMt.h>
+#include <LinearMath/btThreads.h>
+#endif
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
 
+#include <Urho3D/Core/Condition.h>
 #include <Urho3D/Core/Profiler.h>
+#include <Urho3D/Core/Thread.h>
 #include <Urho3D/Core/Timer.h>
 
 namespace Tundra
 {
 
-struct CollisionSignal
-{
-    WeakPtr<RigidBody> bodyA;
-    WeakPtr<RigidBody> bodyB;
-    float3 position;
-    float3 normal;
-    float distance;
-    float impulse;
-    bool newCollision;
-};
-
 struct ObbCallback : public btCollisionWorld::ContactResultCallback
 {
-    ObbCallback(HashSet<btCollisionObjectWrapper*>& result) : result_(result) {}
+    ObbCallback(HashSet<const btCollisionObject*>& result) : result_(result) {}
 
     virtual btScalar addSingleResult(btManifoldPoint &/*cp*/, const btCollisionObjectWrapper *colObj0, int, int, const btCollisionObjectWrapper *colObj1, int, int)
     {
-        result_.Insert((btCollisionObjectWrapper*)(colObj0));
-        result_.Insert((btCollisionObjectWrapper*)(colObj1));
+        // The wrappers only live during the contact test, store the objects instead
+        result_.Insert(colObj0->getCollisionObject());
+        result_.Insert(colObj1->getCollisionObject());
         return 0.0f;
     }
     
-    HashSet<btCollisionObjectWrapper*>& result_;
+    HashSet<const btCollisionObject*>& result_;
+};
+
+struct AabbOverlapCallback : public btBroadphaseAabbCallback
+{
+    AabbOverlapCallback(EntityVector& result, int collisionGroup, int collisionMask) :
+        result_(result),
+        collisionGroup_(collisionGroup),
+        collisionMask_(collisionMask),
+        count_(0)
+    {
+    }
+
+    virtual bool process(const btBroadphaseProxy* proxy)
+    {
+        if (!(proxy->m_collisionFilterGroup & collisionMask_) || !(collisionGroup_ & proxy->m_collisionFilterMask))
+            return true;
+        const btCollisionObject* object = static_cast<const btCollisionObject*>(proxy->m_clientObject);
+        RigidBody* body = (object ? static_cast<RigidBody*>(object->getUserPointer()) : 0);
+        if (body && body->ParentEntity())
+        {
+            result_.Push(EntityPtr(body->ParentEntity()));
+            ++count_;
+        }
+        return true;
+    }
+
+    EntityVector& result_;
+    int collisionGroup_;
+    int collisionMask_;
+    uint count_;
+};
+
+/// Reports the broadphase overlap changes of the rigid bodies of volume triggers to the triggers.
+/** Installed as the ghost pair callback of the overlapping pair cache, so it is only called when a pair is
+    added to or removed from the cache, not for every overlapping pair on every step. */
+struct VolumeTriggerPairCallback : public btOverlappingPairCallback
+{
+    virtual btBroadphasePair* addOverlappingPair(btBroadphaseProxy* proxy0, btBroadphaseProxy* proxy1)
+    {
+        PairChanged(proxy0, proxy1, true);
+        return 0;
+    }
+
+    virtual void* removeOverlappingPair(btBroadphaseProxy* proxy0, btBroadphaseProxy* proxy1, btDispatcher* /*dispatcher*/)
+    {
+        PairChanged(proxy0, proxy1, false);
+        return 0;
+    }
+
+    /// The hashed pair cache removes the pairs of a proxy one by one, so this is never called.
+    virtual void removeOverlappingPairsContainingProxy(btBroadphaseProxy* /*proxy0*/, btDispatcher* /*dispatcher*/) {}
+
+    void PairChanged(btBroadphaseProxy* proxy0, btBroadphaseProxy* proxy1, bool overlapping)
+    {
+        // Forget removed pairs even if their trigger is gone, so that only pairs in the cache are tracked
+        if (!overlapping)
+            Untrack(proxy0, proxy1);
+        if (triggers.Empty())
+            return;
+        RigidBody* body0 = BodyOf(proxy0);
+        RigidBody* body1 = BodyOf(proxy1);
+        if (!body0 || !body1)
+            return;
+        const bool trigger0 = Notify(body0, body1, overlapping);
+        const bool trigger1 = Notify(body1, body0, overlapping);
+        if (overlapping && (trigger0 || trigger1))
+            Track(proxy0, proxy1);
+    }
+
+    /// Reports an overlap change to the trigger of @c triggerBody. Returns false if the body is not the body of a trigger.
+    bool Notify(RigidBody* triggerBody, RigidBody* otherBody, bool overlapping)
+    {
+        HashMap<RigidBody*, VolumeTrigger*>::ConstIterator i = triggers.Find(triggerBody);
+        if (i == triggers.End())
+            return false;
+        // During an asynchronous simulation step the triggers must not be touched from the physics thread
+        if (deferred)
+        {
+            PendingChange change = { triggerBody, otherBody, overlapping };
+            pending.Push(change);
+        }
+        else
+            i->second_->OnOverlapChanged(otherBody->ParentEntity(), overlapping);
+        return true;
+    }
+
+    /// Starts tracking an overlapping pair that involves the body of a trigger.
+    void Track(btBroadphaseProxy* proxy0, btBroadphaseProxy* proxy1)
+    {
+        PODVector<btBroadphaseProxy*>& pairs0 = trackedPairs[proxy0];
+        if (!pairs0.Contains(proxy1))
+        {
+            pairs0.Push(proxy1);
+            trackedPairs[proxy1].Push(proxy0);
+        }
+    }
+
+    /// Stops tracking a pair that was removed from the pair cache.
+    void Untrack(btBroadphaseProxy* proxy0, btBroadphaseProxy* proxy1)
+    {
+        if (trackedPairs.Empty())
+            return;
+        UntrackPartner(proxy0, proxy1);
+        UntrackPartner(proxy1, proxy0);
+    }
+
+    void UntrackPartner(btBroadphaseProxy* proxy, btBroadphaseProxy* partner)
+    {
+        HashMap<btBroadphaseProxy*, PODVector<btBroadphaseProxy*> >::Iterator i = trackedPairs.Find(proxy);
+        if (i != trackedPairs.End() && i->second_.Remove(partner) && i->second_.Empty())
+            trackedPairs.Erase(i);
+    }
+
+    /// Removes the tracked pairs of a moved proxy whose bounding volumes no longer overlap.
+    /** The broadphase only checks a part of all pairs for removal on each step, which would delay the leave events.
+        This uses the same test as the broadphase, so a removed pair is added again once the volumes overlap again. */
+    void RemoveSeparatedPairs(btDbvtBroadphase* broadphase, btBroadphaseProxy* proxy, btDispatcher* dispatcher)
+    {
+        if (trackedPairs.Empty())
+            return;
+        HashMap<btBroadphaseProxy*, PODVector<btBroadphaseProxy*> >::ConstIterator i = trackedPairs.Find(proxy);
+        if (i == trackedPairs.End())
+            return;
+
+        // Removing a pair untracks it, so collect the pairs first
+        const btDbvtVolume& volume = static_cast<btDbvtProxy*>(proxy)->leaf->volume;
+        separated.Clear();
+        for(uint j = 0; j < i->second_.Size(); ++j)
+            if (!Intersect(volume, static_cast<btDbvtProxy*>(i->second_[j])->leaf->volume))
+                separated.Push(i->second_[j]);
+        for(uint j = 0; j < separated.Size(); ++j)
+            broadphase->m_paircache->removeOverlappingPair(proxy, separated[j], dispatcher);
+    }
+
+    /// Reports the changes recorded during an asynchronous simulation step. Called on the main thread after the step.
+    void Dispatch()
+    {
+        deferred = false;
+        for(uint i = 0; i < pending.Size(); ++i)
+            Notify(pending[i].triggerBody, pending[i].otherBody, pending[i].overlapping);
+        pending.Clear();
+    }
+
+    static RigidBody* BodyOf(const btBroadphaseProxy* proxy)
+    {
+        const btCollisionObject* object = static_cast<const btCollisionObject*>(proxy->m_clientObject);
+        return (object ? static_cast<RigidBody*>(object->getUserPointer()) : 0);
+    }
+
+    struct PendingChange
+    {
+        RigidBody* triggerBody;
+        RigidBody* otherBody;
+        bool overlapping;
+    };
+
+    VolumeTriggerPairCallback() : deferred(false) {}
+
+    /// Volume triggers by their rigid body
+    HashMap<RigidBody*, VolumeTrigger*> triggers;
+    /// Overlap partners of the proxies in pairs that involve the body of a trigger
+    HashMap<btBroadphaseProxy*, PODVector<btBroadphaseProxy*> > trackedPairs;
+    /// Pairs to remove, reused by RemoveSeparatedPairs
+    PODVector<btBroadphaseProxy*> separated;
+    /// Whether changes are recorded instead of reported, because an asynchronous simulation step is running
+    bool deferred;
+    /// Changes recorded during an asynchronous simulation step
+    Vector<PendingChange> pending;
+};
+
+/// Broadphase that checks the volume trigger pairs of each moved proxy for removal.
+struct VolumeTriggerBroadphase : public btDbvtBroadphase
+{
+    explicit VolumeTriggerBroadphase(VolumeTriggerPairCallback* pairCallback) : triggerPairs(pairCallback) {}
+
+    virtual void setAabb(btBroadphaseProxy* proxy, const btVector3& aabbMin, const btVector3& aabbMax, btDispatcher* dispatcher)
+    {
+        btDbvtBroadphase::setAabb(proxy, aabbMin, aabbMax, dispatcher);
+        triggerPairs->RemoveSeparatedPairs(this, proxy, dispatcher);
+    }
+
+    VolumeTriggerPairCallback* triggerPairs;
+};
+
+/// Number of values written per query by raycast and sweep batches.
+static const uint cValuesPerHit = 7;
+
+/// Runs a range of the raycasts or convex sweeps of a batched query. Only reads the collision world, so ranges can be run in parallel.
+struct QueryBatchRunner
+#ifdef BULLETPHYSICS_MULTITHREADING
+    : public btIParallelForBody
+#endif
+{
+    const btCollisionWorld* world;
+    const float* queries;
+    uint valuesPerQuery;
+    const btConvexShape* shape;
+    btQuaternion orientation;
+    short collisionGroup;
+    short collisionMask;
+    float* hits;
+    const btCollisionObject** hitObjects;
+
+    static void WriteHit(float* hit, float distance, const btVector3& pos, const btVector3& normal)
+    {
+        hit[0] = distance;
+        hit[1] = pos.x();
+        hit[2] = pos.y();
+        hit[3] = pos.z();
+        hit[4] = normal.x();
+        hit[5] = normal.y();
+        hit[6] = normal.z();
+    }
+
+    void forLoop(int begin, int end) const
+    {
+        for(int i = begin; i < end; ++i)
+        {
+            const float* query = queries + i * valuesPerQuery;
+            float* hit = hits + i * cValuesPerHit;
+            WriteHit(hit, -1.0f, btVector3(0, 0, 0), btVector3(0, 0, 0));
+            hitObjects[i] = 0;
+
+            if (!shape)
+            {
+                float3 origin(query[0], query[1], query[2]);
+                float3 to = origin + query[6] * float3(query[3], query[4], query[5]).Normalized();
+                btCollisionWorld::ClosestRayResultCallback rayCallback(origin, to);
+                rayCallback.m_collisionFilterGroup = collisionGroup;
+                rayCallback.m_collisionFilterMask = collisionMask;
+                world->rayTest(rayCallback.m_rayFromWorld, rayCallback.m_rayToWorld, rayCallback);
+                if (rayCallback.hasHit())
+                {
+                    WriteHit(hit, (float3(rayCallback.m_hitPointWorld) - origin).Length(), rayCallback.m_hitPointWorld, rayCallback.m_hitNormalWorld);
+                    hitObjects[i] = rayCallback.m_collisionObject;
+                }
+            }
+            else
+            {
+                float3 from(query[0], query[1], query[2]);
+                float3 to(query[3], query[4], query[5]);
+                btCollisionWorld::ClosestConvexResultCallback sweepCallback(from, to);
+                sweepCallback.m_collisionFilterGroup = collisionGroup;
+                sweepCallback.m_collisionFilterMask = collisionMask;
+                world->convexSweepTest(shape, btTransform(orientation, from), btTransform(orientation, to), sweepCallback);
+                if (sweepCallback.hasHit())
+                {
+                    WriteHit(hit, sweepCallback.m_closestHitFraction * from.Distance(to), sweepCallback.m_hitPointWorld, sweepCallback.m_hitNormalWorld);
+                    hitObjects[i] = sweepCallback.m_hitCollisionObject;
+                }
+            }
+        }
+    }
 };
 
 void TickCallback(btDynamicsWorld *world, btScalar timeStep)
@@ -69,6 +321,70 @@ void TickCallback(btDynamicsWorld *world, btScalar timeStep)
     static_cast<PhysicsWorld*>(world->getWorldUserInfo())->ProcessPostTick(timeStep);
 }
 
+/// Runs the asynchronous simulation steps of a physics world.
+class PhysicsWorld::StepThread : public Urho3D::Thread
+{
+public:
+    explicit StepThread(btDiscreteDynamicsWorld* world) :
+        world_(world),
+        timeStep_(0.0f),
+        maxSubSteps_(0),
+        fixedTimeStep_(0.0f),
+        stepTime_(0.0f)
+    {
+    }
+
+    /// Starts a simulation step. The previous step must have finished.
+    void StartStep(float timeStep, int maxSubSteps, float fixedTimeStep)
+    {
+        timeStep_ = timeStep;
+        maxSubSteps_ = maxSubSteps;
+        fixedTimeStep_ = fixedTimeStep;
+        startCondition_.Set();
+    }
+
+    /// Waits for the started simulation step to finish.
+    void WaitStep()
+    {
+        finishedCondition_.Wait();
+    }
+
+    /// Returns the duration of the finished simulation step in milliseconds.
+    float StepTime() const { return stepTime_; }
+
+    /// Stops the thread. Must not be called while a step is running.
+    void Shutdown()
+    {
+        shouldRun_ = false;
+        startCondition_.Set();
+        Stop();
+    }
+
+    /// Urho3D::Thread override.
+    void ThreadFunction() override
+    {
+        for(;;)
+        {
+            startCondition_.Wait();
+            if (!shouldRun_)
+                break;
+            Urho3D::HiresTimer stepTimer;
+            world_->stepSimulation(timeStep_, maxSubSteps_, fixedTimeStep_);
+            stepTime_ = stepTimer.GetUSec(false) / 1000.0f;
+            finishedCondition_.Set();
+        }
+    }
+
+private:
+    btDiscreteDynamicsWorld* world_;
+    float timeStep_;
+    int maxSubSteps_;
+    float fixedTimeStep_;
+    float stepTime_;
+    Urho3D::Condition startCondition_;
+    Urho3D::Condition finishedCondition_;
+};
+
 struct PhysicsWorld::Impl : public btIDebugDraw
 {
     struct DebugDrawLineCacheItem
@@ -78,22 +394,54 @@ struct PhysicsWorld::Impl : public btIDebugDraw
         Color color;
     };
 
-    explicit Impl(PhysicsWorld *owner) :
+    Impl(PhysicsWorld *owner, bool multithreaded, bool deterministic) :
         debugDrawMode(0),
         collisionConfiguration(0),
         collisionDispatcher(0),
         broadphase(0),
         solver(0),
         world(0),
+        isMultithreaded(false),
+        isDeterministic(false),
         cachedGraphicsWorld(0)
     {
         collisionConfiguration = new btDefaultCollisionConfiguration();
-        collisionDispatcher = new btCollisionDispatcher(collisionConfiguration);
-        broadphase = new btDbvtBroadphase();
-        solver = new btSequentialImpulseConstraintSolver();
-        world = new btDiscreteDynamicsWorld(collisionDispatcher, broadphase, solver, collisionConfiguration);
+        broadphase = new VolumeTriggerBroadphase(&volumeTriggerPairs);
+#ifdef BULLETPHYSICS_MULTITHREADING
+        if (multithreaded)
+        {
+            // Collision pairs are processed in parallel unless deterministic, as the order of the
+            // created contact manifolds then depends on thread timing. Islands are always solved in parallel.
+            if (deterministic)
+                collisionDispatcher = new btCollisionDispatcher(collisionConfiguration);
+            else
+                collisionDispatcher = new btCollisionDispatcherMt(collisionConfiguration);
+            btConstraintSolverPoolMt *solverPool = new btConstraintSolverPoolMt(btGetTaskScheduler()->getMaxNumThreads());
+            solver = solverPool;
+#if BT_BULLET_VERSION >= 288
+            world = new btDiscreteDynamicsWorldMt(collisionDispatcher, broadphase, solverPool, 0, collisionConfiguration);
+#else
+            world = new btDiscreteDynamicsWorldMt(collisionDispatcher, broadphase, solverPool, collisionConfiguration);
+#endif
+            if (deterministic)
+                world->getSolverInfo().m_solverMode &= ~SOLVER_RANDMIZE_ORDER;
+            isMultithreaded = true;
+            isDeterministic = deterministic;
+        }
+        else
+#else
+        if (multithreaded)
+            LogWarning("PhysicsWorld: Bullet was built without multithreading support, using a single-threaded physics world.");
+        UNREFERENCED_PARAM(deterministic);
+#endif
+        {
+            collisionDispatcher = new btCollisionDispatcher(collisionConfiguration);
+            solver = new btSequentialImpulseConstraintSolver();
+            world = new btDiscreteDynamicsWorld(collisionDispatcher, broadphase, solver, collisionConfiguration);
+        }
         world->setDebugDrawer(this);
         world->setInternalTickCallback(TickCallback, (void*)owner, false);
+        broadphase->getOverlappingPairCache()->setInternalGhostPairCallback(&volumeTriggerPairs);
     }
 
     ~Impl()
@@ -216,6 +564,12 @@ struct PhysicsWorld::Impl : public btIDebugDraw
     btConstraintSolver* solver;
     /// Bullet physics world
     btDiscreteDynamicsWorld* world;
+    /// Reports broadphase overlap changes to volume triggers
+    VolumeTriggerPairCallback volumeTriggerPairs;
+    /// Whether world is a multithreaded btDiscreteDynamicsWorldMt
+    bool isMultithreaded;
+    /// Whether the multithreaded world runs in deterministic mode
+    bool isDeterministic;
     /// Bullet debug draw / debug behaviour flags
     int debugDrawMode;
     /// Cached GraphicsWorld pointer for drawing debug geometry
@@ -366,7 +720,7 @@ struct PhysicsWorld::Impl : public btIDebugDraw
     DebugDrawState debugDrawState;
 };
 
-PhysicsWorld::PhysicsWorld(Scene* scene, bool isClient) :
+PhysicsWorld::PhysicsWorld(Scene* scene, bool isClient, bool multithreaded, bool deterministic) :
     Object(scene->GetContext()),
     scene_(scene),
     physicsUpdatePeriod_(1.0f / 60.0f),
@@ -377,14 +731,32 @@ PhysicsWorld::PhysicsWorld(Scene* scene, bool isClient) :
     runPhysics_(true),
     drawDebugManuallySet_(false),
     useVariableTimestep_(false),
-    impl(new Impl(this))
+    batchedTransformSignals_(false),
+    allContactsReported_(false),
+    parallelQueries_(false),
+    asyncThread_(0),
+    stepping_(false),
+    stepWorldCollisionListeners_(false),
+    stepCount_(0),
+    appliedStep_(0),
+    impl(new Impl(this, multithreaded, deterministic))
 {
     if (scene->GetFramework()->HasCommandLineParameter("--variablephysicsstep"))
         useVariableTimestep_ = true;
+    if (scene->GetFramework()->HasCommandLineParameter("--batchPhysicsSignals"))
+        batchedTransformSignals_ = true;
+    if (scene->GetFramework()->HasCommandLineParameter("--physicsThread"))
+        SetAsynchronousSimulation(true);
 }
 
 PhysicsWorld::~PhysicsWorld()
 {
+    if (asyncThread_)
+    {
+        WaitForStep();
+        asyncThread_->Shutdown();
+        delete asyncThread_;
+    }
     delete impl;
 }
 
@@ -404,23 +776,140 @@ void PhysicsWorld::SetMaxSubSteps(int steps)
 
 void PhysicsWorld::SetGravity(const float3& gravity)
 {
+    WaitForStep();
     impl->world->setGravity(gravity);
 }
 
 float3 PhysicsWorld::Gravity() const
 {
+    const_cast<PhysicsWorld*>(this)->WaitForStep();
     return impl->world->getGravity();
 }
 
 btDiscreteDynamicsWorld* PhysicsWorld::BulletWorld() const
 {
+    const_cast<PhysicsWorld*>(this)->WaitForStep();
     return impl->world;
 }
 
+void PhysicsWorld::SetAsynchronousSimulation(bool enable)
+{
+    if (enable == (asyncThread_ != 0))
+        return;
+
+    if (enable)
+    {
+        asyncThread_ = new StepThread(impl->world);
+        if (!asyncThread_->Run())
+        {
+            LogError("PhysicsWorld::SetAsynchronousSimulation: Failed to start the physics thread, simulating synchronously.");
+            delete asyncThread_;
+            asyncThread_ = 0;
+        }
+    }
+    else
+    {
+        // Deliver the results of the last step and the changes queued during it
+        WaitForStep();
+        EmitStepSignals();
+        ApplyCommands();
+        ApplyTransformUpdates(stepTransformUpdates_);
+        // Apply all transforms from now on
+        appliedStep_ = stepCount_ + 1;
+        asyncThread_->Shutdown();
+        delete asyncThread_;
+        asyncThread_ = 0;
+    }
+}
+
+void PhysicsWorld::WaitForStep()
+{
+    if (!stepping_)
+        return;
+
+    {
+        URHO3D_PROFILE(PhysicsWorld_WaitForStep);
+        asyncThread_->WaitStep();
+    }
+    stepping_ = false;
+    stepStatistics_.stepTime = asyncThread_->StepTime();
+
+    // Take weak references to the colliding bodies now, as the bodies may be removed before the signals are emitted
+    collisionSignals_.Clear();
+    for(uint i = 0; i < stepCollisions_.Size(); ++i)
+    {
+        const StepCollision &c = stepCollisions_[i];
+        CollisionSignal s;
+        s.bodyA = c.bodyA;
+        s.bodyB = c.bodyB;
+        s.position = c.position;
+        s.normal = c.normal;
+        s.distance = c.distance;
+        s.impulse = c.impulse;
+        s.newCollision = c.newCollision;
+        collisionSignals_.Push(s);
+    }
+    stepCollisions_.Clear();
+
+    impl->volumeTriggerPairs.Dispatch();
+}
+
+bool PhysicsWorld::IsMultithreaded() const
+{
+    return impl->isMultithreaded;
+}
+
+bool PhysicsWorld::IsDeterministic() const
+{
+    return impl->isDeterministic;
+}
+
+void PhysicsWorld::AddVolumeTrigger(VolumeTrigger* trigger, RigidBody* body)
+{
+    if (!trigger || !body)
+        return;
+
+    WaitForStep();
+    impl->volumeTriggerPairs.triggers[body] = trigger;
+
+    // Report and track the pairs that were found before the trigger was added
+    btRigidBody* object = body->BulletRigidBody();
+    btBroadphaseProxy* proxy = (object ? object->getBroadphaseHandle() : 0);
+    if (!proxy)
+        return;
+    btBroadphasePairArray& pairs = impl->broadphase->getOverlappingPairCache()->getOverlappingPairArray();
+    for(int i = 0; i < pairs.size(); ++i)
+    {
+        btBroadphaseProxy* other = (pairs[i].m_pProxy0 == proxy ? pairs[i].m_pProxy1 : (pairs[i].m_pProxy1 == proxy ? pairs[i].m_pProxy0 : 0));
+        RigidBody* otherBody = (other ? VolumeTriggerPairCallback::BodyOf(other) : 0);
+        if (otherBody)
+        {
+            impl->volumeTriggerPairs.Track(proxy, other);
+            trigger->OnOverlapChanged(otherBody->ParentEntity(), true);
+        }
+    }
+}
+
+void PhysicsWorld::RemoveVolumeTrigger(RigidBody* body)
+{
+    WaitForStep();
+    // The body may already have been destroyed, it is only used as the key
+    impl->volumeTriggerPairs.triggers.Erase(body);
+}
+
 void PhysicsWorld::Simulate(float frametime)
 {
+    if (asyncThread_)
+    {
+        SimulateAsynchronous(frametime);
+        return;
+    }
+
     if (!runPhysics_)
+    {
+        statistics_ = PhysicsStatistics();
         return;
+    }
     
     URHO3D_PROFILE(PhysicsWorld_Simulate);
 
@@ -428,6 +917,8 @@ void PhysicsWorld::Simulate(float frametime)
     
     AboutToUpdate.Emit(fFrametime);
     
+    stepStatistics_ = PhysicsStatistics();
+    Urho3D::HiresTimer timer;
     {
         URHO3D_PROFILE(Bullet_stepSimulation); ///\note Do not delete or rename this URHO3D_PROFILE() block. The DebugStats profiler uses this string as a label to know where to inject the Bullet internal profiling data.
         
@@ -442,12 +933,77 @@ void PhysicsWorld::Simulate(float frametime)
         else
             impl->world->stepSimulation(fFrametime, maxSubSteps_, physicsUpdatePeriod_);
     }
+    stepStatistics_.stepTime = timer.GetUSec(true) / 1000.0f;
+    statistics_ = stepStatistics_;
+
+    statistics_.transformUpdates = transformUpdates_.Size();
+    ApplyTransformUpdates(transformUpdates_);
+    statistics_.transformUpdateTime = timer.GetUSec(false) / 1000.0f;
     
+    UpdateDebugGeometry(fFrametime);
+}
+
+void PhysicsWorld::SimulateAsynchronous(float frametime)
+{
+    URHO3D_PROFILE(PhysicsWorld_Simulate);
+
+    // Finish the step started on the previous frame. Usually it has already finished while the rest of the frame was processed.
+    const bool stepFinished = stepping_;
+    WaitForStep();
+    statistics_ = (stepFinished ? stepStatistics_ : PhysicsStatistics());
+    EmitStepSignals();
+    ApplyCommands();
+    UpdateDebugGeometry(frametime);
+
+    // The transforms moved by the finished step are applied while the next step is running
+    transformUpdates_.Swap(stepTransformUpdates_);
+    transformUpdates_.Clear();
+    appliedStep_ = stepCount_;
+
+    if (runPhysics_)
+    {
+        AboutToUpdate.Emit(frametime);
+
+        float timeStep = frametime;
+        int maxSubSteps = maxSubSteps_;
+        float fixedTimeStep = physicsUpdatePeriod_;
+        // Use variable timestep if enabled, and if frame timestep exceeds the single physics simulation substep
+        if (useVariableTimestep_ && frametime > physicsUpdatePeriod_)
+        {
+            timeStep = Urho3D::Min(frametime, 0.1f); // Advance max. 1/10 sec. during one frame
+            maxSubSteps = 0;
+            fixedTimeStep = timeStep;
+        }
+        ++stepCount_;
+        stepStatistics_ = PhysicsStatistics();
+        // Script and component code may connect to the collision signals while the step is running, so the physics thread
+        // decides from a snapshot of the listeners which collisions to collect.
+        stepWorldCollisionListeners_ = !PhysicsCollision.Empty() || !NewPhysicsCollision.Empty();
+        const btCollisionObjectArray& objects = impl->world->getCollisionObjectArray();
+        for(int i = 0; i < objects.size(); ++i)
+        {
+            RigidBody* body = static_cast<RigidBody*>(objects[i]->getUserPointer());
+            if (body)
+                body->stepCollisionListeners_ = body->HasCollisionListeners();
+        }
+        stepping_ = true;
+        impl->volumeTriggerPairs.deferred = true;
+        asyncThread_->StartStep(timeStep, maxSubSteps, fixedTimeStep);
+    }
+
+    Urho3D::HiresTimer timer;
+    statistics_.transformUpdates = stepTransformUpdates_.Size();
+    ApplyTransformUpdates(stepTransformUpdates_);
+    statistics_.transformUpdateTime = timer.GetUSec(false) / 1000.0f;
+}
+
+void PhysicsWorld::UpdateDebugGeometry(float frametime)
+{
     if (!scene_.Expired() && !scene_.Lock()->GetFramework()->IsHeadless())
     {
         // Don't choke debug rendering if it is not spending too much time and cache items per frame.
         // If debug rendering is having performance issues, drop to rendering it few times a second (debugDrawUpdatePeriod_).
-        debugDrawT_ += fFrametime;
+        debugDrawT_ += frametime;
         if (!impl->debugDrawState.IsExhausted() || debugDrawT_ >= debugDrawUpdatePeriod_)
         {
             debugDrawT_ = 0.0f;
@@ -473,21 +1029,26 @@ void PhysicsWorld::Simulate(float frametime)
 void PhysicsWorld::ProcessPostTick(float substeptime)
 {
     URHO3D_PROFILE(PhysicsWorld_ProcessPostTick);
+    Urho3D::HiresTimer timer;
     // Check contacts and send collision signals for them
     int numManifolds = impl->collisionDispatcher->getNumManifolds();
     
-    HashSet<Pair<const btCollisionObject*, const btCollisionObject*> > currentCollisions;
+    // The pair set and the signal list are members that are cleared instead of recreated, so that their memory is reused between steps.
+    currentCollisions_.Clear();
     
     // Collect all collision signals to a list before emitting any of them, in case a collision
     // handler changes physics state before the loop below is over (which would lead into catastrophic
     // consequences)
-    Vector<CollisionSignal> collisions;
-    collisions.Reserve(numManifolds * 3); // Guess some initial memory size for the collision list.
+    collisionSignals_.Clear();
 
     if (numManifolds > 0)
     {
         URHO3D_PROFILE(PhysicsWorld_SendCollisions);
         
+        // Signals are not collected for pairs that nobody is listening to. On the physics thread the listeners are read from
+        // the snapshot taken when the step was started, as the signals may be connected to on the main thread meanwhile.
+        const bool worldListeners = stepping_ ? stepWorldCollisionListeners_ : !PhysicsCollision.Empty() || !NewPhysicsCollision.Empty();
+        
         for(int i = 0; i < numManifolds; ++i)
         {
             btPersistentManifold* contactManifold = impl->collisionDispatcher->getManifoldByIndexInternal(i);
@@ -525,70 +1086,261 @@ void PhysicsWorld::ProcessPostTick(float substeptime)
             if (!objectA->isActive() && !objectB->isActive())
                 continue;
             
+            currentCollisions_.Insert(objectPair);
+            
+            const bool listenersA = stepping_ ? bodyA->stepCollisionListeners_ : bodyA->HasCollisionListeners();
+            const bool listenersB = stepping_ ? bodyB->stepCollisionListeners_ : bodyB->HasCollisionListeners();
+            if (!worldListeners && !listenersA && !listenersB)
+                continue;
+            
             bool newCollision = previousCollisions_.Find(objectPair) == previousCollisions_.End();
             
-            for(int j = 0; j < numContacts; ++j)
+            // Unless all contacts are requested, report only the contact with the largest impulse
+            int firstContact = 0;
+            int lastContact = numContacts - 1;
+            if (!allContactsReported_)
+            {
+                for(int j = 1; j < numContacts; ++j)
+                    if (contactManifold->getContactPoint(j).m_appliedImpulse > contactManifold->getContactPoint(firstContact).m_appliedImpulse)
+                        firstContact = j;
+                lastContact = firstContact;
+            }
+            
+            for(int j = firstContact; j <= lastContact; ++j)
             {
                 btManifoldPoint& point = contactManifold->getContactPoint(j);
                 
-                CollisionSignal s;
-                s.bodyA = bodyA;
-                s.bodyB = bodyB;
-                s.position = point.m_positionWorldOnB;
-                s.normal = point.m_normalWorldOnB;
-                s.distance = point.m_distance1;
-                s.impulse = point.m_appliedImpulse;
-                s.newCollision = newCollision;
-                collisions.Push(s);
+                // On the physics thread the bodies are stored as raw pointers, and converted to weak pointers after the step
+                if (stepping_)
+                {
+                    StepCollision c;
+                    c.bodyA = bodyA;
+                    c.bodyB = bodyB;
+                    c.position = point.m_positionWorldOnB;
+                    c.normal = point.m_normalWorldOnB;
+                    c.distance = point.m_distance1;
+                    c.impulse = point.m_appliedImpulse;
+                    c.newCollision = newCollision;
+                    stepCollisions_.Push(c);
+                }
+                else
+                {
+                    CollisionSignal s;
+                    s.bodyA = bodyA;
+                    s.bodyB = bodyB;
+                    s.position = point.m_positionWorldOnB;
+                    s.normal = point.m_normalWorldOnB;
+                    s.distance = point.m_distance1;
+                    s.impulse = point.m_appliedImpulse;
+                    s.newCollision = newCollision;
+                    collisionSignals_.Push(s);
+                }
                 
                 // Report newCollision = true only for the first contact, in case there are several contacts, and application does some logic depending on it
                 // (for example play a sound -> avoid multiple sounds being played)
                 newCollision = false;
             }
-            
-            currentCollisions.Insert(objectPair);
         }
     }
 
-    // Now fire all collision signals. Safeguard for the body components expiring in case signal handlers delete them from the scene
-    {
-        URHO3D_PROFILE(PhysicsWorld_emit_PhysicsCollisions);
-        for(size_t i = 0; i < collisions.Size(); ++i)
-        {
-            const CollisionSignal &collision = collisions[i];
-            const float3 &pos = collision.position;
-            const float3 &normal = collision.normal;
-            const float distance = collision.distance;
-            const float impulse = collision.impulse;
-            const bool newCollision = collision.newCollision;
+    previousCollisions_.Swap(currentCollisions_);
 
-            if (collision.bodyA.Expired() || collision.bodyB.Expired())
-                continue;
-            if (newCollision)
-                NewPhysicsCollision.Emit(collision.bodyA->ParentEntity(), collision.bodyB->ParentEntity(), pos, normal, distance, impulse);
-            PhysicsCollision.Emit(collision.bodyA->ParentEntity(), collision.bodyB->ParentEntity(), pos, normal, distance, impulse, newCollision);
-            
-            if (collision.bodyA.Expired() || collision.bodyB.Expired())
-                continue;
-            collision.bodyA->EmitPhysicsCollision(collision.bodyB->ParentEntity(), pos, normal, distance, impulse, newCollision);
-            
-            if (collision.bodyA.Expired() || collision.bodyB.Expired())
-                continue;
-            collision.bodyB->EmitPhysicsCollision(collision.bodyA->ParentEntity(), pos, normal, distance, impulse, newCollision);
-        }
+    ++stepStatistics_.subSteps;
+    stepStatistics_.collidingPairs = previousCollisions_.Size();
+
+    // During an asynchronous step the signals are emitted on the main thread after the step
+    if (stepping_)
+    {
+        stepCollisionCounts_.Push(stepCollisions_.Size());
+        stepSubsteps_.Push(substeptime);
+        stepStatistics_.collisionSignals = stepCollisions_.Size();
+        stepStatistics_.postTickTime += timer.GetUSec(false) / 1000.0f;
+        return;
     }
 
-    previousCollisions_ = currentCollisions;
+    stepStatistics_.collisionSignals += collisionSignals_.Size();
+    EmitCollisionSignals(0, collisionSignals_.Size());
+    // Release the body references, but keep the capacity
+    collisionSignals_.Clear();
     
     {
         URHO3D_PROFILE(PhysicsWorld_ProcessPostTick_Updated);
         Updated.Emit(substeptime);
     }
+    stepStatistics_.postTickTime += timer.GetUSec(false) / 1000.0f;
+}
+
+EntityVector PhysicsWorld::CollidingEntities(Entity* entity) const
+{
+    const_cast<PhysicsWorld*>(this)->WaitForStep();
+    EntityVector entities;
+    if (!entity)
+        return entities;
+
+    for(HashSet<Pair<const btCollisionObject*, const btCollisionObject*> >::ConstIterator i = previousCollisions_.Begin(); i != previousCollisions_.End(); ++i)
+    {
+        RigidBody* bodyA = static_cast<RigidBody*>(i->first_->getUserPointer());
+        RigidBody* bodyB = static_cast<RigidBody*>(i->second_->getUserPointer());
+        Entity* entityA = (bodyA ? bodyA->ParentEntity() : 0);
+        Entity* entityB = (bodyB ? bodyB->ParentEntity() : 0);
+        if (entityA == entity && entityB)
+            entities.Push(EntityPtr(entityB));
+        else if (entityB == entity && entityA)
+            entities.Push(EntityPtr(entityA));
+    }
+    return entities;
+}
+
+bool PhysicsWorld::AreColliding(Entity* entityA, Entity* entityB) const
+{
+    const_cast<PhysicsWorld*>(this)->WaitForStep();
+    if (!entityA || !entityB)
+        return false;
+    RigidBody* bodyA = entityA->Component<RigidBody>().Get();
+    RigidBody* bodyB = entityB->Component<RigidBody>().Get();
+    const btCollisionObject* objectA = (bodyA ? bodyA->BulletRigidBody() : 0);
+    const btCollisionObject* objectB = (bodyB ? bodyB->BulletRigidBody() : 0);
+    if (!objectA || !objectB)
+        return false;
+
+    if (objectA < objectB)
+        return previousCollisions_.Contains(Urho3D::MakePair(objectA, objectB));
+    else
+        return previousCollisions_.Contains(Urho3D::MakePair(objectB, objectA));
+}
+
+void PhysicsWorld::EmitCollisionSignals(uint begin, uint end)
+{
+    if (begin >= end)
+        return;
+
+    // Safeguard for the body components expiring in case signal handlers delete them from the scene
+    URHO3D_PROFILE(PhysicsWorld_emit_PhysicsCollisions);
+    for(uint i = begin; i < end; ++i)
+    {
+        const CollisionSignal &collision = collisionSignals_[i];
+        const float3 &pos = collision.position;
+        const float3 &normal = collision.normal;
+        const float distance = collision.distance;
+        const float impulse = collision.impulse;
+        const bool newCollision = collision.newCollision;
+
+        if (collision.bodyA.Expired() || collision.bodyB.Expired())
+            continue;
+        if (newCollision)
+            NewPhysicsCollision.Emit(collision.bodyA->ParentEntity(), collision.bodyB->ParentEntity(), pos, normal, distance, impulse);
+        PhysicsCollision.Emit(collision.bodyA->ParentEntity(), collision.bodyB->ParentEntity(), pos, normal, distance, impulse, newCollision);
+        
+        if (collision.bodyA.Expired() || collision.bodyB.Expired())
+            continue;
+        collision.bodyA->EmitPhysicsCollision(collision.bodyB->ParentEntity(), pos, normal, distance, impulse, newCollision);
+        
+        if (collision.bodyA.Expired() || collision.bodyB.Expired())
+            continue;
+        collision.bodyB->EmitPhysicsCollision(collision.bodyA->ParentEntity(), pos, normal, distance, impulse, newCollision);
+    }
+}
+
+void PhysicsWorld::EmitStepSignals()
+{
+    if (stepSubsteps_.Empty())
+        return;
+
+    // Emit the collisions of each substep followed by its Updated, like a synchronous step would
+    uint begin = 0;
+    for(uint i = 0; i < stepSubsteps_.Size(); ++i)
+    {
+        const uint end = stepCollisionCounts_[i];
+        EmitCollisionSignals(begin, end);
+        begin = end;
+
+        URHO3D_PROFILE(PhysicsWorld_ProcessPostTick_Updated);
+        Updated.Emit(stepSubsteps_[i]);
+    }
+    collisionSignals_.Clear();
+    stepCollisionCounts_.Clear();
+    stepSubsteps_.Clear();
+}
+
+void PhysicsWorld::QueueTransformUpdate(RigidBody* body, const float3& position, const Quat& orientation,
+    const float3& linearVelocity, const float3& angularVelocity)
+{
+    PhysicsTransformUpdate update;
+    update.body = body;
+    update.position = position;
+    update.orientation = orientation;
+    update.linearVelocity = linearVelocity;
+    update.angularVelocity = angularVelocity;
+    update.change = AttributeChange::Default;
+    update.linearVelocityChanged = false;
+    update.angularVelocityChanged = false;
+    transformUpdates_.Push(update);
+}
+
+void PhysicsWorld::CancelTransformUpdates(RigidBody* body)
+{
+    // Called only when no asynchronous step is running, so the updates of the running step can be touched too
+    for(uint i = 0; i < transformUpdates_.Size(); ++i)
+        if (transformUpdates_[i].body == body)
+            transformUpdates_[i].body = 0;
+    for(uint i = 0; i < stepTransformUpdates_.Size(); ++i)
+        if (stepTransformUpdates_[i].body == body)
+            stepTransformUpdates_[i].body = 0;
+}
+
+void PhysicsWorld::ApplyTransformUpdates(PhysicsTransformUpdateVector& updates)
+{
+    if (updates.Empty())
+        return;
+
+    URHO3D_PROFILE(PhysicsWorld_ApplyTransformUpdates);
+
+    // Bullet reports the moved bodies at the end of stepSimulation. Apply them all here in one pass instead of
+    // one by one from within Bullet. Signal handlers may remove bodies, which nulls their pending updates.
+    const bool signalChanges = !batchedTransformSignals_;
+    for(uint i = 0; i < updates.Size(); ++i)
+    {
+        PhysicsTransformUpdate &update = updates[i];
+        if (update.body && !update.body->ApplyTransformUpdate(update, signalChanges))
+            update.body = 0;
+    }
+
+    {
+        URHO3D_PROFILE(PhysicsWorld_emit_TransformsUpdated);
+        TransformsUpdated.Emit(updates);
+    }
+    updates.Clear();
+}
+
+void PhysicsWorld::PostCommand(RigidBody* body, BodyCommand::Type type, const float3& vector, const float3& position)
+{
+    BodyCommand command;
+    command.body = body;
+    command.type = type;
+    command.vector = vector;
+    command.position = position;
+    commands_.Push(command);
+}
+
+void PhysicsWorld::ApplyCommands()
+{
+    if (commands_.Empty())
+        return;
+
+    URHO3D_PROFILE(PhysicsWorld_ApplyCommands);
+    for(uint i = 0; i < commands_.Size(); ++i)
+    {
+        const BodyCommand &command = commands_[i];
+        if (!command.body.Expired())
+            command.body->ExecuteCommand(command.type, command.vector, command.position);
+    }
+    commands_.Clear();
 }
 
 PhysicsRaycastResult PhysicsWorld::Raycast(const float3& origin, const float3& direction, float maxdistance, int collisiongroup, int collisionmask)
 {
     URHO3D_PROFILE(PhysicsWorld_Raycast);
+    WaitForStep();
     
     PhysicsRaycastResult result;
     
@@ -622,36 +1374,141 @@ PhysicsRaycastResult PhysicsWorld::Raycast(const float3& origin, const float3& d
 EntityVector PhysicsWorld::ObbCollisionQuery(const OBB &obb, int collisionGroup, int collisionMask)
 {
     URHO3D_PROFILE(PhysicsWorld_ObbCollisionQuery);
+    WaitForStep();
     
-    HashSet<btCollisionObjectWrapper*> objects;
+    HashSet<const btCollisionObject*> objects;
     EntityVector entities;
     
+    // The query object does not need to be added to the world for a contact test
     btBoxShape box(obb.HalfSize()); // Note: Bullet uses box halfsize
     float3x3 m(obb.axis[0], obb.axis[1], obb.axis[2]);
-    btTransform t1(m.ToQuat(), obb.CenterPoint());
-    btRigidBody* tempRigidBody = new btRigidBody(1.0f, 0, &box);
-    tempRigidBody->setWorldTransform(t1);
-    impl->world->addRigidBody(tempRigidBody, (short)collisionGroup, (short)collisionMask);
-    tempRigidBody->activate(); // To make sure we get collision results from static sleeping rigidbodies, activate the temp rigid body
+    btCollisionObject queryObject;
+    queryObject.setCollisionShape(&box);
+    queryObject.setWorldTransform(btTransform(m.ToQuat(), obb.CenterPoint()));
     
     ObbCallback resultCallback(objects);
-    impl->world->contactTest(tempRigidBody, resultCallback);
+    resultCallback.m_collisionFilterGroup = (short)collisionGroup;
+    resultCallback.m_collisionFilterMask = (short)collisionMask;
+    impl->world->contactTest(&queryObject, resultCallback);
     
-    for (HashSet<btCollisionObjectWrapper*>::Iterator i = objects.Begin(); i != objects.End(); ++i)
+    for (HashSet<const btCollisionObject*>::Iterator i = objects.Begin(); i != objects.End(); ++i)
     {
-        RigidBody* body = static_cast<RigidBody*>((*i)->getCollisionObject()->getUserPointer());
+        RigidBody* body = static_cast<RigidBody*>((*i)->getUserPointer());
         if (body && body->ParentEntity())
             entities.Push(EntityPtr(body->ParentEntity()));
     }
     
-    impl->world->removeRigidBody(tempRigidBody);
-    delete tempRigidBody;
-    
     return entities;
 }
 
+PhysicsQueryResults PhysicsWorld::RaycastBatch(const Vector<float>& rays, int collisionGroup, int collisionMask)
+{
+    PhysicsQueryResults results;
+    RaycastBatch(rays, results, collisionGroup, collisionMask);
+    return results;
+}
+
+void PhysicsWorld::RaycastBatch(const Vector<float>& rays, PhysicsQueryResults& results, int collisionGroup, int collisionMask)
+{
+    URHO3D_PROFILE(PhysicsWorld_RaycastBatch);
+    QueryBatch(rays, 7, 0, Quat::identity, results, collisionGroup, collisionMask);
+}
+
+PhysicsQueryResults PhysicsWorld::SphereSweepBatch(float radius, const Vector<float>& sweeps, int collisionGroup, int collisionMask)
+{
+    PhysicsQueryResults results;
+    SphereSweepBatch(radius, sweeps, results, collisionGroup, collisionMask);
+    return results;
+}
+
+void PhysicsWorld::SphereSweepBatch(float radius, const Vector<float>& sweeps, PhysicsQueryResults& results, int collisionGroup, int collisionMask)
+{
+    URHO3D_PROFILE(PhysicsWorld_SphereSweepBatch);
+    // The same shape is used for all sweeps of the batch
+    btSphereShape sphere(radius);
+    QueryBatch(sweeps, 6, &sphere, Quat::identity, results, collisionGroup, collisionMask);
+}
+
+PhysicsQueryResults PhysicsWorld::BoxSweepBatch(const float3& halfExtents, const Quat& orientation, const Vector<float>& sweeps, int collisionGroup, int collisionMask)
+{
+    PhysicsQueryResults results;
+    BoxSweepBatch(halfExtents, orientation, sweeps, results, collisionGroup, collisionMask);
+    return results;
+}
+
+void PhysicsWorld::BoxSweepBatch(const float3& halfExtents, const Quat& orientation, const Vector<float>& sweeps, PhysicsQueryResults& results, int collisionGroup, int collisionMask)
+{
+    URHO3D_PROFILE(PhysicsWorld_BoxSweepBatch);
+    // The same shape is used for all sweeps of the batch
+    btBoxShape box(halfExtents);
+    QueryBatch(sweeps, 6, &box, orientation, results, collisionGroup, collisionMask);
+}
+
+PhysicsQueryResults PhysicsWorld::AabbOverlapBatch(const Vector<float>& boxes, int collisionGroup, int collisionMask)
+{
+    PhysicsQueryResults results;
+    AabbOverlapBatch(boxes, results, collisionGroup, collisionMask);
+    return results;
+}
+
+void PhysicsWorld::AabbOverlapBatch(const Vector<float>& boxes, PhysicsQueryResults& results, int collisionGroup, int collisionMask)
+{
+    URHO3D_PROFILE(PhysicsWorld_AabbOverlapBatch);
+    WaitForStep();
+    
+    uint numBoxes = boxes.Size() / 6;
+    results.entities.Clear();
+    results.hits.Resize(numBoxes);
+    
+    for(uint i = 0; i < numBoxes; ++i)
+    {
+        const float* box = &boxes[i * 6];
+        AabbOverlapCallback callback(results.entities, (short)collisionGroup, (short)collisionMask);
+        impl->broadphase->aabbTest(btVector3(box[0], box[1], box[2]), btVector3(box[3], box[4], box[5]), callback);
+        results.hits[i] = (float)callback.count_;
+    }
+}
+
+void PhysicsWorld::QueryBatch(const Vector<float>& queries, uint valuesPerQuery, const btConvexShape* shape, const Quat& orientation,
+    PhysicsQueryResults& results, int collisionGroup, int collisionMask)
+{
+    WaitForStep();
+    uint numQueries = queries.Size() / valuesPerQuery;
+    results.hits.Resize(numQueries * cValuesPerHit);
+    results.entities.Resize(numQueries);
+    queryHits_.Resize(numQueries);
+    if (!numQueries)
+        return;
+    
+    QueryBatchRunner runner;
+    runner.world = impl->world;
+    runner.queries = &queries[0];
+    runner.valuesPerQuery = valuesPerQuery;
+    runner.shape = shape;
+    runner.orientation = orientation;
+    runner.collisionGroup = (short)collisionGroup;
+    runner.collisionMask = (short)collisionMask;
+    runner.hits = &results.hits[0];
+    runner.hitObjects = &queryHits_[0];
+    
+#ifdef BULLETPHYSICS_MULTITHREADING
+    if (parallelQueries_ && impl->isMultithreaded)
+        btParallelFor(0, (int)numQueries, 64, runner);
+    else
+#endif
+        runner.forLoop(0, (int)numQueries);
+    
+    // Resolve the hit entities on this thread, as entity reference counts are not thread-safe
+    for(uint i = 0; i < numQueries; ++i)
+    {
+        RigidBody* body = (queryHits_[i] ? static_cast<RigidBody*>(queryHits_[i]->getUserPointer()) : 0);
+        results.entities[i] = (body ? body->ParentEntity() : 0);
+    }
+}
+
 void PhysicsWorld::SetDebugGeometryEnabled(bool enable)
 {
+    WaitForStep();
     if (scene_.Expired() || !scene_->ViewEnabled() || IsDebugGeometryEnabled() == enable)
         return;
 
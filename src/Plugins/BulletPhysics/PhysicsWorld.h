@@ -6,7 +6,9 @@
 #include "SceneFwd.h"
 #include "BulletPhysicsApi.h"
 #include "BulletPhysicsFwd.h"
+#include "AttributeChangeType.h"
 #include "Math/float3.h"
+#include "Math/Quat.h"
 #include "Signals.h"
 
 #include <Urho3D/Core/Object.h>
@@ -28,6 +30,57 @@ struct PhysicsRaycastResult
     float distance; ///< Distance from ray origin to the hit point.
 };
 
+/// Results of a batched physics query.
+/** @sa PhysicsWorld::RaycastBatch, PhysicsWorld::SphereSweepBatch, PhysicsWorld::BoxSweepBatch, PhysicsWorld::AabbOverlapBatch */
+struct PhysicsQueryResults
+{
+    /// Raycasts and sweeps: the entity that was hit by each query, null if none.
+    /// Overlap tests: the overlapping entities of all queries in query order.
+    EntityVector entities;
+    /// Raycasts and sweeps: 7 values per query, the distance to the hit (negative if none), the hit position and the hit normal.
+    /// Overlap tests: the number of overlapping entities per query.
+    Vector<float> hits;
+};
+
+/// Transform of a rigid body moved by the physics simulation.
+/** @sa PhysicsWorld::TransformsUpdated */
+struct PhysicsTransformUpdate
+{
+    RigidBody* body; ///< Moved body, null if the body was removed or its transform could not be applied.
+    float3 position; ///< New world position.
+    Quat orientation; ///< New world orientation.
+    float3 linearVelocity; ///< Linear velocity at the end of the simulation step.
+    float3 angularVelocity; ///< Angular velocity at the end of the simulation step, in degrees.
+    AttributeChange::Type change; ///< Change type of the applied attribute changes.
+    bool linearVelocityChanged; ///< Whether the linear velocity attribute changed.
+    bool angularVelocityChanged; ///< Whether the angular velocity attribute changed.
+};
+typedef Vector<PhysicsTransformUpdate> PhysicsTransformUpdateVector;
+
+/// Timings and counters of a physics world update, for profiling and benchmarking.
+/** @sa PhysicsWorld::Statistics */
+struct PhysicsStatistics
+{
+    PhysicsStatistics() :
+        stepTime(0.0f),
+        postTickTime(0.0f),
+        transformUpdateTime(0.0f),
+        subSteps(0),
+        collidingPairs(0),
+        collisionSignals(0),
+        transformUpdates(0)
+    {
+    }
+
+    float stepTime; ///< Time spent in the Bullet simulation step, including ProcessPostTick, in milliseconds.
+    float postTickTime; ///< Time spent in ProcessPostTick on all substeps, in milliseconds.
+    float transformUpdateTime; ///< Time spent applying the moved transforms to the scene, in milliseconds.
+    uint subSteps; ///< Number of simulation substeps.
+    uint collidingPairs; ///< Number of colliding body pairs after the last substep.
+    uint collisionSignals; ///< Number of collision signals collected on all substeps.
+    uint transformUpdates; ///< Number of applied transform updates.
+};
+
 /// A physics world that encapsulates a Bullet physics world
 class BULLETPHYSICS_API PhysicsWorld : public Object
 {
@@ -35,12 +88,17 @@ class BULLETPHYSICS_API PhysicsWorld : public Object
 
     friend class BulletPhysics;
     friend class RigidBody;
+    friend class VolumeTrigger;
 
 public:
     /// Constructor.
     /** @param scene Scene of which this PhysicsWorld is physical representation of.
-        @param isClient Whether this physics world is for a client scene i.e. only simulates local entities' motion on their own.*/
-    PhysicsWorld(Scene* scene, bool isClient);
+        @param isClient Whether this physics world is for a client scene i.e. only simulates local entities' motion on their own.
+        @param multithreaded Whether to use a multithreaded Bullet world that runs collision detection and solves simulation islands in parallel
+               using the Bullet task scheduler. Falls back to a single-threaded world if Bullet was not built with multithreading support.
+        @param deterministic When multithreaded, use single-threaded collision detection and a fixed solver order, so that the results
+               do not depend on thread timing. @sa BulletPhysics::SetPhysicsThreads */
+    PhysicsWorld(Scene* scene, bool isClient, bool multithreaded = false, bool deterministic = false);
     virtual ~PhysicsWorld();
     
     /// Step the physics world. May trigger several internal simulation substeps, according to the deltatime given. [noscript]
@@ -87,11 +145,67 @@ public:
     bool IsRunning() const { return runPhysics_; }
 
     /// Return the Bullet world object
+    /** If a simulation step is running asynchronously, waits for it to finish, so that the world can be accessed. */
     btDiscreteDynamicsWorld* BulletWorld() const;
 
+    /// Enable/disable asynchronous simulation.
+    /** When enabled, Simulate starts the simulation step on a dedicated physics thread and returns without waiting for it, so the
+        step runs in parallel with the rest of the frame. The results of the step are applied on the next call to Simulate: the
+        collision signals and Updated are emitted before starting the next step, and the transforms moved by the step are applied
+        while the next step is running. Forces, impulses, velocity and transform changes and attribute changes of rigid bodies made
+        during a step are queued and applied before the next step. Other access to the Bullet world, eg. queries and creating or
+        removing bodies, waits for the running step to finish.
+        Disabled by default, can be enabled with the --physicsThread command line parameter. */
+    void SetAsynchronousSimulation(bool enable);
+
+    /// Return whether the simulation steps run asynchronously on a dedicated physics thread. [property]
+    bool AsynchronousSimulation() const { return asyncThread_ != 0; }
+
+    /// Return whether an asynchronous simulation step is running. [noscript]
+    bool IsStepping() const { return stepping_; }
+
+    /// Wait for the running asynchronous simulation step to finish. No-op if no step is running. [noscript]
+    void WaitForStep();
+
+    /// Return the timings and counters of the latest Simulate call. [noscript]
+    /** With asynchronous simulation, the step figures are of the step that finished during the call, and the transform
+        figures of the transforms applied during the call. */
+    const PhysicsStatistics &Statistics() const { return statistics_; }
+
     /// Return whether the physics world is for a client scene. Client scenes only simulate local entities' motion on their own. [property]
     bool IsClient() const { return isClient_; }
 
+    /// Return whether the physics world uses a multithreaded Bullet world. [property]
+    bool IsMultithreaded() const;
+
+    /// Return whether the multithreaded physics world runs in deterministic mode. [property]
+    bool IsDeterministic() const;
+
+    /// Enable/disable batched transform signals.
+    /** When enabled, the placeable transforms and rigid body velocities changed by the simulation are applied without emitting
+        attribute change signals for each body. Placeable scene nodes are updated directly, and all changes are signaled at once
+        with TransformsUpdated. Listeners of individual attribute changes, eg. scripts, do not get notified of simulated movement.
+        Disabled by default, can be enabled with the --batchPhysicsSignals command line parameter. */
+    void SetBatchedTransformSignals(bool enable) { batchedTransformSignals_ = enable; }
+
+    /// Return whether batched transform signals are enabled. [property]
+    bool BatchedTransformSignals() const { return batchedTransformSignals_; }
+
+    /// Enable/disable collision signals for every contact point.
+    /** By default the collision signals are emitted once per colliding pair and simulation step, for the contact point
+        with the largest impulse. When enabled, the signals are emitted for each contact point of the pair. */
+    void SetAllContactsReported(bool enable) { allContactsReported_ = enable; }
+
+    /// Return whether collision signals are emitted for every contact point. [property]
+    bool AllContactsReported() const { return allContactsReported_; }
+
+    /// Returns the entities that were colliding with an entity during the last simulation step.
+    /** Can be polled instead of connecting to the collision signals. */
+    EntityVector CollidingEntities(Entity* entity) const;
+
+    /// Returns whether two entities were colliding during the last simulation step.
+    bool AreColliding(Entity* entityA, Entity* entityB) const;
+
     /// Raycast to the world. Returns only a single (the closest) result.
     /** @param origin World origin position
         @param direction Direction to raycast to. Will be normalized automatically
@@ -101,6 +215,54 @@ public:
         @return result PhysicsRaycastResult structure */
     PhysicsRaycastResult Raycast(const float3& origin, const float3& direction, float maxDistance, int collisionGroup = -1, int collisionMask = -1);
 
+    /// Raycasts a batch of rays to the world. Returns only the closest result of each ray.
+    /** @param rays 7 values per ray: the origin, the direction (will be normalized automatically) and the length of the ray.
+        @param collisionGroup Collision layer. Default has all bits set.
+        @param collisionMask Collision mask. Default has all bits set.
+        @return The hit entity and hit data of each ray. @sa PhysicsQueryResults */
+    PhysicsQueryResults RaycastBatch(const Vector<float>& rays, int collisionGroup = -1, int collisionMask = -1);
+    /// @overload Writes to @c results, reusing its memory. [noscript]
+    void RaycastBatch(const Vector<float>& rays, PhysicsQueryResults& results, int collisionGroup = -1, int collisionMask = -1);
+
+    /// Sweeps a sphere along a batch of line segments. Returns only the closest result of each sweep.
+    /** @param radius Radius of the sphere.
+        @param sweeps 6 values per sweep: the start and end positions of the sphere center.
+        @param collisionGroup Collision layer. Default has all bits set.
+        @param collisionMask Collision mask. Default has all bits set.
+        @return The hit entity and hit data of each sweep. The hit distance is the distance the sphere traveled before the hit. @sa PhysicsQueryResults */
+    PhysicsQueryResults SphereSweepBatch(float radius, const Vector<float>& sweeps, int collisionGroup = -1, int collisionMask = -1);
+    /// @overload Writes to @c results, reusing its memory. [noscript]
+    void SphereSweepBatch(float radius, const Vector<float>& sweeps, PhysicsQueryResults& results, int collisionGroup = -1, int collisionMask = -1);
+
+    /// Sweeps a box along a batch of line segments. Returns only the closest result of each sweep.
+    /** @param halfExtents Half size of the box.
+        @param orientation World orientation of the box.
+        @param sweeps 6 values per sweep: the start and end positions of the box center.
+        @param collisionGroup Collision layer. Default has all bits set.
+        @param collisionMask Collision mask. Default has all bits set.
+        @return The hit entity and hit data of each sweep. The hit distance is the distance the box traveled before the hit. @sa PhysicsQueryResults */
+    PhysicsQueryResults BoxSweepBatch(const float3& halfExtents, const Quat& orientation, const Vector<float>& sweeps, int collisionGroup = -1, int collisionMask = -1);
+    /// @overload Writes to @c results, reusing its memory. [noscript]
+    void BoxSweepBatch(const float3& halfExtents, const Quat& orientation, const Vector<float>& sweeps, PhysicsQueryResults& results, int collisionGroup = -1, int collisionMask = -1);
+
+    /// Finds the entities whose rigid body bounding boxes overlap a batch of world axis-aligned bounding boxes.
+    /** Only the broadphase is queried, so this is much faster than ObbCollisionQuery but the results contain all
+        bodies whose bounding box overlaps the query, not only the ones whose shape does.
+        @param boxes 6 values per box: the minimum and maximum corners.
+        @param collisionGroup Collision layer. Default has all bits set.
+        @param collisionMask Collision mask. Default has all bits set.
+        @return The overlapping entities of each box. @sa PhysicsQueryResults */
+    PhysicsQueryResults AabbOverlapBatch(const Vector<float>& boxes, int collisionGroup = -1, int collisionMask = -1);
+    /// @overload Writes to @c results, reusing its memory. [noscript]
+    void AabbOverlapBatch(const Vector<float>& boxes, PhysicsQueryResults& results, int collisionGroup = -1, int collisionMask = -1);
+
+    /// Enable/disable running the raycasts and sweeps of batched queries on the Bullet worker threads.
+    /** Has effect only if the world is multithreaded. Disabled by default. @sa IsMultithreaded */
+    void SetParallelQueries(bool enable) { parallelQueries_ = enable; }
+
+    /// Return whether batched queries are run on the Bullet worker threads. [property]
+    bool ParallelQueries() const { return parallelQueries_; }
+
     /// Performs collision query for OBB.
     /** @param obb Oriented bounding box to test
         @param collisionGroup Collision layer of the OBB. Default has all bits set.
@@ -109,8 +271,9 @@ public:
     EntityVector ObbCollisionQuery(const OBB &obb, int collisionGroup = -1, int collisionMask = -1);
 
     /// A physics collision has happened between two entities. 
-    /** Note: both rigidbodies participating in the collision will also emit a signal separately. 
-        Also, if there are several contact points, the signal will be sent multiple times for each contact.
+    /** Note: both rigidbodies participating in the collision will also emit a signal separately.
+        Also, if all contacts are reported and there are several contact points, the signal will be sent multiple times for each contact.
+        @sa SetAllContactsReported
         @param entityA The first entity
         @param entityB The second entity
         @param position World position of collision
@@ -135,10 +298,101 @@ public:
     /** @param frametime Length of simulation step */
     Signal1<float ARG(frametime)> Updated;
 
+    /// Emitted once per frame after the transforms of all bodies moved by the simulation have been applied. [noscript]
+    /** Updates whose body is null should be ignored. @sa SetBatchedTransformSignals */
+    Signal1<const PhysicsTransformUpdateVector& ARG(updates)> TransformsUpdated;
+
 private:
+    class StepThread;
+
+    /// A change to a rigid body made while an asynchronous simulation step is running.
+    struct BodyCommand
+    {
+        enum Type
+        {
+            ApplyForce,
+            ApplyTorque,
+            ApplyImpulse,
+            ApplyTorqueImpulse,
+            Activate,
+            KeepActive,
+            ResetForces,
+            UpdateTransform,
+            ApplyAttributes
+        };
+
+        WeakPtr<RigidBody> body;
+        Type type;
+        float3 vector;
+        float3 position;
+    };
+
+    /// A collision collected by an asynchronous simulation step. The bodies are stored as raw pointers, because the step
+    /// thread must not touch reference counts. Bodies are not destroyed while a step is running.
+    struct StepCollision
+    {
+        RigidBody* bodyA;
+        RigidBody* bodyB;
+        float3 position;
+        float3 normal;
+        float distance;
+        float impulse;
+        bool newCollision;
+    };
+
+    struct CollisionSignal
+    {
+        WeakPtr<RigidBody> bodyA;
+        WeakPtr<RigidBody> bodyB;
+        float3 position;
+        float3 normal;
+        float distance;
+        float impulse;
+        bool newCollision;
+    };
+
     /// Draw physics debug geometry, if debug drawing enabled
     void DrawDebugGeometry();
 
+    /// Queue a transform of a body moved by the simulation. Called by RigidBody during stepSimulation.
+    void QueueTransformUpdate(RigidBody* body, const float3& position, const Quat& orientation, const float3& linearVelocity, const float3& angularVelocity);
+
+    /// Remove queued transform updates of a body that is being removed.
+    void CancelTransformUpdates(RigidBody* body);
+
+    /// Apply queued transform updates in a single pass, emit TransformsUpdated and clear them.
+    void ApplyTransformUpdates(PhysicsTransformUpdateVector& updates);
+
+    /// Queue a change to a rigid body while an asynchronous simulation step is running. Called by RigidBody.
+    void PostCommand(RigidBody* body, BodyCommand::Type type, const float3& vector = float3::zero, const float3& position = float3::zero);
+
+    /// Apply the changes to rigid bodies queued during the previous asynchronous simulation step.
+    void ApplyCommands();
+
+    /// Simulate with asynchronous simulation enabled.
+    void SimulateAsynchronous(float frametime);
+
+    /// Emit a range of the collected collision signals. Signal handlers may remove bodies.
+    void EmitCollisionSignals(uint begin, uint end);
+
+    /// Emit the collision signals and Updated for the substeps of the finished asynchronous simulation step.
+    void EmitStepSignals();
+
+    /// Draw debug geometry, if enabled, according to the debug draw choking state.
+    void UpdateDebugGeometry(float frametime);
+
+    /// Run the raycasts (if @c shape is null) or convex sweeps of a batch and write the results.
+    void QueryBatch(const Vector<float>& queries, uint valuesPerQuery, const btConvexShape* shape, const Quat& orientation,
+        PhysicsQueryResults& results, int collisionGroup, int collisionMask);
+
+    /// Start reporting the broadphase overlap changes of the rigid body of a volume trigger to the trigger.
+    /** The pairs already overlapping the body are reported immediately. */
+    void AddVolumeTrigger(VolumeTrigger* trigger, RigidBody* body);
+
+    /// Stop reporting broadphase overlap changes of a rigid body to its volume trigger.
+    /** @param body Body the trigger was added with. It may already have been destroyed. */
+    void RemoveVolumeTrigger(RigidBody* body);
+
     struct Impl;
     Impl *impl;
     /// Length of one physics simulation step
@@ -151,12 +405,48 @@ private:
     SceneWeakPtr scene_;
     /// Previous frame's collisions. We store these to know whether the collision was new or "ongoing"
     HashSet<Pair<const btCollisionObject*, const btCollisionObject*> > previousCollisions_;
+    /// Collisions of the current step. Swapped with previousCollisions_ after each step to reuse the memory of both sets
+    HashSet<Pair<const btCollisionObject*, const btCollisionObject*> > currentCollisions_;
+    /// Collision signals of the current step. Reused between steps to not allocate.
+    Vector<CollisionSignal> collisionSignals_;
+    /// Report all contact points flag
+    bool allContactsReported_;
     /// Debug geometry manually enabled/disabled (with physicsdebug console command). If true, do not automatically enable/disable debug geometry anymore
     bool drawDebugManuallySet_;
     /// Whether should run physics. Default true
     bool runPhysics_;
     /// Variable timestep flag
     bool useVariableTimestep_;
+    /// Batched transform signals flag
+    bool batchedTransformSignals_;
+    /// Transforms of the bodies moved by the current simulation step. Reused between frames to not allocate.
+    PhysicsTransformUpdateVector transformUpdates_;
+    /// Parallel batched queries flag
+    bool parallelQueries_;
+    /// Physics thread running the asynchronous simulation steps, null if asynchronous simulation is disabled
+    StepThread* asyncThread_;
+    /// Whether an asynchronous simulation step is running
+    bool stepping_;
+    /// Whether anything was connected to the world collision signals when the running asynchronous simulation step was started
+    bool stepWorldCollisionListeners_;
+    /// Number of asynchronous simulation steps started
+    uint stepCount_;
+    /// Number of the asynchronous simulation step whose transforms are being applied
+    uint appliedStep_;
+    /// Transforms moved by the previous asynchronous simulation step, applied while the next step is running. Swapped with transformUpdates_.
+    PhysicsTransformUpdateVector stepTransformUpdates_;
+    /// Changes to rigid bodies queued during the running asynchronous simulation step
+    Vector<BodyCommand> commands_;
+    /// Collisions of the running asynchronous simulation step, and the number of collisions at the end of each of its substeps
+    Vector<StepCollision> stepCollisions_;
+    PODVector<uint> stepCollisionCounts_;
+    /// Lengths of the substeps of the running asynchronous simulation step
+    PODVector<float> stepSubsteps_;
+    /// Statistics of the latest Simulate call, and of the simulation step in progress
+    PhysicsStatistics statistics_;
+    PhysicsStatistics stepStatistics_;
+    /// Hit objects of the current batched query. Reused between queries to not allocate.
+    Vector<const btCollisionObject*> queryHits_;
     
     /// Debug draw-enabled rigidbodies. Note: these pointers are never dereferenced, it is just used for counting
     HashSet<RigidBody*> debugRigidBodies_;
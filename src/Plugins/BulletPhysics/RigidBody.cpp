@@ -40,8 +40,15 @@ struct RigidBody::Impl : public btMotionState
         world(0),
         owner(0),
         shape(0),
-        childShape(0),
         heightField(0),
+        heightData(0),
+        heightFieldWidth(0),
+        heightFieldHeight(0),
+        heightFieldMinY(0.0f),
+        heightFieldMaxY(0.0f),
+        heightFieldOutOfRange(false),
+        discardStep(0),
+        pendingAttributes(0),
         disconnected(false),
         cachedShapeType(-1),
         cachedSize(float3::zero),
@@ -53,11 +60,21 @@ struct RigidBody::Impl : public btMotionState
     /// btMotionState override. Called when Bullet wants us to tell the body's initial transform
     void getWorldTransform(btTransform &worldTrans) const
     {
+        // On the physics thread the placeable must not be touched. Kinematic bodies are moved from the placeable before the step.
+        if (world && world->IsStepping())
+        {
+            if (body)
+                worldTrans = body->getWorldTransform();
+            return;
+        }
         if (placeable.Expired())
             return;
 
-        float3 position = placeable->WorldPosition();
-        Quat orientation = placeable->WorldOrientation();
+        // Decompose the cached world transform once, instead of querying position and orientation separately
+        float3 position;
+        Quat orientation;
+        float3 scale;
+        placeable->LocalToWorld().Decompose(position, orientation, scale);
     
         worldTrans.setOrigin(position);
         worldTrans.setRotation(orientation);
@@ -66,63 +83,16 @@ struct RigidBody::Impl : public btMotionState
     /// btMotionState override. Called when Bullet wants to tell us the body's current transform
     void setWorldTransform(const btTransform &worldTrans)
     {
-        /// \todo For a large scene, applying the changed transforms of rigid bodies is slow (slower than the physics simulation itself,
-        /// or handling collisions) due to the large number of signals being fired.
-    
         // Cannot modify server-authoritative physics object, rather get the transform changes through placeable attributes
-        const bool hasAuthority = rigidBody->HasAuthority();
-        if (!hasAuthority && !clientExtrapolating)
+        if (!rigidBody->HasAuthority() && !clientExtrapolating)
             return;
-    
-        if (placeable.Expired())
+        if (placeable.Expired() || !world)
             return;
-        Placeable* p = placeable;
-        // Important: disconnect our own response to attribute changes to not create an endless loop!
-        disconnected = true;
-    
-        AttributeChange::Type changeType = hasAuthority ? AttributeChange::Default : AttributeChange::LocalOnly;
 
-        // Set transform
-        float3 position = worldTrans.getOrigin();
-        Quat orientation = worldTrans.getRotation();
-    
-        // Non-parented case
-        if (p->parentRef.Get().IsEmpty())
-        {
-            Transform newTrans = p->transform.Get();
-            newTrans.SetPos(position.x, position.y, position.z);
-            newTrans.SetOrientation(orientation);
-            p->transform.Set(newTrans, changeType);
-        }
-        else
-        // The placeable has a parent itself
-        {
-            Urho3D::Node* parent = p->UrhoSceneNode()->GetParent();
-            if (parent)
-            {
-                position = parent->WorldToLocal(position);
-                orientation = parent->GetWorldRotation().Inverse() * orientation;
-                Transform newTrans = p->transform.Get();
-                newTrans.SetPos(position);
-                newTrans.SetOrientation(orientation);
-                p->transform.Set(newTrans, changeType);
-            }
-        }
-        // Set linear & angular velocity
-        if (body)
-        {
-            // Performance optimization: because applying each attribute causes signals to be fired, which is slow in a large scene
-            // (and furthermore, on a server, causes each connection's sync state to be accessed), do not set the linear/angular
-            // velocities if they haven't changed
-            float3 linearVel = body->getLinearVelocity();
-            float3 angularVel = RadToDeg(body->getAngularVelocity());
-            if (!linearVel.Equals(rigidBody->linearVelocity.Get()))
-                rigidBody->linearVelocity.Set(linearVel, changeType);
-            if (!angularVel.Equals(rigidBody->angularVelocity.Get()))
-                rigidBody->angularVelocity.Set(angularVel, changeType);
-        }
-    
-        disconnected = false;
+        // Applying the changed transforms one by one is slow in a large scene due to the large number of signals being fired.
+        // Queue the transform to the physics world, which applies all of them in a single pass after the simulation step.
+        world->QueueTransformUpdate(rigidBody, worldTrans.getOrigin(), worldTrans.getRotation(),
+            body->getLinearVelocity(), RadToDeg(float3(body->getAngularVelocity())));
     }
 
     /// Calculate mass, shape & static/dynamic-classification dependant properties
@@ -171,8 +141,6 @@ struct RigidBody::Impl : public btMotionState
     btRigidBody* body;
     /// Bullet collision shape
     btCollisionShape* shape;
-    /// Bullet collision child shape. This is needed to use btScaledBvhTriangleMeshShape
-    btCollisionShape* childShape;
     /// Physics world. May be 0 if the scene does not have a physics world. In that case most of RigidBody's functionality is a no-op
     PhysicsWorld* world;
     /// BulletPhysics pointer
@@ -181,16 +149,34 @@ struct RigidBody::Impl : public btMotionState
     int cachedShapeType;
     /// Cached shapesize (last created)
     float3 cachedSize;
-    /// Bullet triangle mesh
-    shared_ptr<btTriangleMesh> triangleMesh;
+    /// Bullet triangle mesh shape, shared by all bodies using the same collision mesh
+    shared_ptr<TriangleMeshShape> triangleMesh;
     /// Convex hull set
     shared_ptr<ConvexHullSet> convexHullSet;
     /// Bullet heightfield shape. Note: this is always put inside a compound shape (impl->shape)
     btHeightfieldTerrainShape* heightField;
-    /// Heightfield values, for the case the shape is a heightfield.
-    PODVector<float> heightValues;
+    /// Terrain height grid the heightfield reads from. Owned by Terrain.
+    const float *heightData;
+    /// Dimensions of the heightfield
+    uint heightFieldWidth;
+    uint heightFieldHeight;
+    /// Height range of the heightfield
+    float heightFieldMinY;
+    float heightFieldMaxY;
+    /// Whether terrain edits have gone outside the height range of the heightfield
+    bool heightFieldOutOfRange;
+    /// Transform updates of asynchronous simulation steps before this step are ignored, as the body has been moved since they were started
+    uint discardStep;
+    /// Attribute changes queued while an asynchronous simulation step is running, as a bitmask of attribute indices
+    uint pendingAttributes;
 };
 
+/// Returns whether an attribute is included in a bitmask of attribute indices.
+static inline bool IsChanged(uint changedAttributes, const IAttribute &attribute)
+{
+    return (changedAttributes & (1u << attribute.Index())) != 0;
+}
+
 RigidBody::RigidBody(Urho3D::Context* context, Scene* scene) :
     IComponent(context, scene),
     INIT_ATTRIBUTE_VALUE(mass, "Mass", 0.0f),
@@ -212,6 +198,7 @@ RigidBody::RigidBody(Urho3D::Context* context, Scene* scene) :
     INIT_ATTRIBUTE_VALUE(collisionMask, "Collision Mask", -1),
     INIT_ATTRIBUTE_VALUE(rollingFriction, "Rolling friction", 0.5f),
     INIT_ATTRIBUTE_VALUE(useGravity, "Use gravity", true),
+    stepCollisionListeners_(false),
     impl(new Impl(this))
 {
     static AttributeMetadata shapemetadata;
@@ -236,6 +223,10 @@ RigidBody::RigidBody(Urho3D::Context* context, Scene* scene) :
 RigidBody::~RigidBody()
 {
     // Explicitly reset here, RemoveCollisionShape() wont do it if shape type matches.
+    if (impl->triangleMesh)
+        impl->triangleMesh->Ready.Disconnect(this, &RigidBody::OnCollisionShapeReady);
+    if (impl->convexHullSet)
+        impl->convexHullSet->Ready.Disconnect(this, &RigidBody::OnCollisionShapeReady);
     impl->triangleMesh.reset();
     impl->convexHullSet.reset();
 
@@ -287,6 +278,8 @@ void RigidBody::ApplyForce(const float3& force, const float3& position)
     // If force is very small, do not wake up the body and apply
     if (force.LengthSq() < cForceThresholdSq)
         return;
+    if (QueueIfStepping(PhysicsWorld::BodyCommand::ApplyForce, force, position))
+        return;
     
     if (!impl->body)
         CreateBody();
@@ -309,6 +302,8 @@ void RigidBody::ApplyTorque(const float3& torque)
     // If torque is very small, do not wake up the body and apply
     if (torque.LengthSq() < cTorqueThresholdSq)
         return;
+    if (QueueIfStepping(PhysicsWorld::BodyCommand::ApplyTorque, torque))
+        return;
         
     if (!impl->body)
         CreateBody();
@@ -328,6 +323,8 @@ void RigidBody::ApplyImpulse(const float3& impulse, const float3& position)
     // If impulse is very small, do not wake up the body and apply
     if (impulse.LengthSq() < cImpulseThresholdSq)
         return;
+    if (QueueIfStepping(PhysicsWorld::BodyCommand::ApplyImpulse, impulse, position))
+        return;
     
     if (!impl->body)
         CreateBody();
@@ -350,6 +347,8 @@ void RigidBody::ApplyTorqueImpulse(const float3& torqueImpulse)
     // If impulse is very small, do not wake up the body and apply
     if (torqueImpulse.LengthSq() < cTorqueThresholdSq)
         return;
+    if (QueueIfStepping(PhysicsWorld::BodyCommand::ApplyTorqueImpulse, torqueImpulse))
+        return;
         
     if (!impl->body)
         CreateBody();
@@ -365,6 +364,8 @@ void RigidBody::Activate()
     // Cannot modify server-authoritative physics object
     if (!HasAuthority())
         return;
+    if (QueueIfStepping(PhysicsWorld::BodyCommand::Activate))
+        return;
     
     if (!impl->body)
         CreateBody();
@@ -374,12 +375,16 @@ void RigidBody::Activate()
 
 void RigidBody::KeepActive()
 {
+    if (QueueIfStepping(PhysicsWorld::BodyCommand::KeepActive))
+        return;
     if (impl->body)
         impl->body->activate(true);
 }
 
 bool RigidBody::IsActive()
 {
+    if (impl->world)
+        impl->world->WaitForStep();
     if (impl->body)
         return impl->body->isActive();
     else
@@ -391,6 +396,8 @@ void RigidBody::ResetForces()
     // Cannot modify server-authoritative physics object
     if (!HasAuthority())
         return;
+    if (QueueIfStepping(PhysicsWorld::BodyCommand::ResetForces))
+        return;
     
     if (!impl->body)
         CreateBody();
@@ -440,6 +447,8 @@ void RigidBody::CheckForPlaceableAndTerrain()
         {
             impl->terrain = terrain;
             terrain->TerrainRegenerated.Connect(this, &RigidBody::OnTerrainRegenerated);
+            terrain->HeightsChanged.Connect(this, &RigidBody::OnTerrainHeightsChanged);
+            terrain->HeightsAboutToChange.Connect(this, &RigidBody::OnTerrainHeightsAboutToChange);
             terrain->AttributeChanged.Connect(this, &RigidBody::TerrainUpdated);
         }
     }
@@ -447,6 +456,8 @@ void RigidBody::CheckForPlaceableAndTerrain()
 
 void RigidBody::CreateCollisionShape()
 {
+    if (impl->world)
+        impl->world->WaitForStep();
     RemoveCollisionShape();
     
     float3 sizeVec = size.Get();
@@ -474,11 +485,10 @@ void RigidBody::CreateCollisionShape()
         impl->shape = new btCapsuleShape(sizeVec.x * 0.5f, sizeVec.y * 0.5f);
         break;
     case TriMesh:
-        if (impl->triangleMesh)
+        if (impl->triangleMesh && impl->triangleMesh->ready_ && impl->triangleMesh->shape_)
         {
-            // Need to first create a bvhTriangleMeshShape, then a scaled version of it to allow for individual scaling.
-            impl->childShape = new btBvhTriangleMeshShape(impl->triangleMesh.get(), true, true);
-            impl->shape = new btScaledBvhTriangleMeshShape(static_cast<btBvhTriangleMeshShape*>(impl->childShape), btVector3(1.0f, 1.0f, 1.0f));
+            // The cached bvhTriangleMeshShape is shared, use a scaled version of it to allow for individual scaling.
+            impl->shape = new btScaledBvhTriangleMeshShape(impl->triangleMesh->shape_, btVector3(1.0f, 1.0f, 1.0f));
         }
         break;
     case HeightField:
@@ -502,17 +512,24 @@ void RigidBody::RemoveCollisionShape()
 {
     if (impl->shape)
     {
+        if (impl->world)
+            impl->world->WaitForStep();
         if (impl->body)
             impl->body->setCollisionShape(0);
         SAFE_DELETE(impl->shape);
     }
-    SAFE_DELETE(impl->childShape);
     SAFE_DELETE(impl->heightField);
 
-    if (shapeType.Get() != TriMesh)
+    if (shapeType.Get() != TriMesh && impl->triangleMesh)
+    {
+        impl->triangleMesh->Ready.Disconnect(this, &RigidBody::OnCollisionShapeReady);
         impl->triangleMesh.reset();
-    if (shapeType.Get() != ConvexHull)
+    }
+    if (shapeType.Get() != ConvexHull && impl->convexHullSet)
+    {
+        impl->convexHullSet->Ready.Disconnect(this, &RigidBody::OnCollisionShapeReady);
         impl->convexHullSet.reset();
+    }
 
     if (impl->owner)
         impl->owner->ForgetUnusedCacheShapes();
@@ -575,6 +592,8 @@ void RigidBody::RemoveBody()
 {
     if (impl->body && impl->world)
     {
+        impl->world->WaitForStep();
+        impl->world->CancelTransformUpdates(this);
         impl->world->BulletWorld()->removeRigidBody(impl->body);
         SAFE_DELETE(impl->body);
     }
@@ -587,13 +606,106 @@ void RigidBody::SetClientExtrapolating(bool isClientExtrapolating)
 
 btRigidBody* RigidBody::BulletRigidBody() const
 {
+    if (impl->world)
+        impl->world->WaitForStep();
     return impl->body;
 }
 
 void RigidBody::OnTerrainRegenerated()
 {
-    if (shapeType.Get() == HeightField)
-        CreateCollisionShape();
+    if (shapeType.Get() != HeightField)
+        return;
+
+    // The body was removed when the old height grid was reallocated
+    if (!impl->body)
+    {
+        CreateBody();
+        return;
+    }
+
+    // The heightfield reads the terrain height grid directly, so edits within its height range are already visible.
+    Terrain* terrain = impl->terrain;
+    if (impl->heightField && terrain && !impl->heightFieldOutOfRange && terrain->HeightData() == impl->heightData &&
+        terrain->VerticesWidth() == impl->heightFieldWidth && terrain->VerticesHeight() == impl->heightFieldHeight)
+        return;
+
+    CreateCollisionShape();
+}
+
+void RigidBody::OnTerrainHeightsAboutToChange(bool reallocating)
+{
+    if (shapeType.Get() != HeightField || !impl->heightField || !impl->world)
+        return;
+
+    // The heightfield reads the height grid directly, also on the physics thread during an asynchronous step.
+    impl->world->WaitForStep();
+    // The old grid is freed, so the heightfield must not be stepped again before it is recreated in OnTerrainRegenerated.
+    if (reallocating)
+    {
+        RemoveBody();
+        RemoveCollisionShape();
+    }
+}
+
+/// Wakes up the dynamic bodies overlapping an AABB.
+struct ActivateBodiesCallback : public btBroadphaseAabbCallback
+{
+    bool process(const btBroadphaseProxy *proxy)
+    {
+        btCollisionObject *object = static_cast<btCollisionObject*>(proxy->m_clientObject);
+        if (object && !object->isStaticOrKinematicObject())
+            object->activate(true);
+        return true;
+    }
+};
+
+void RigidBody::OnTerrainHeightsChanged(uint minPatchX, uint minPatchY, uint maxPatchX, uint maxPatchY)
+{
+    Terrain* terrain = impl->terrain;
+    if (shapeType.Get() != HeightField || !impl->heightField || !terrain || terrain->HeightData() != impl->heightData ||
+        terrain->VerticesWidth() != impl->heightFieldWidth || terrain->VerticesHeight() != impl->heightFieldHeight)
+        return; // The heightfield is recreated in OnTerrainRegenerated
+
+    URHO3D_PROFILE(RigidBody_OnTerrainHeightsChanged);
+
+    // Include the neighboring vertices, as the cells on the patch edges span to them.
+    const uint minX = (minPatchX > 0 ? minPatchX * Terrain::cPatchSize - 1 : 0);
+    const uint minZ = (minPatchY > 0 ? minPatchY * Terrain::cPatchSize - 1 : 0);
+    const uint maxX = Urho3D::Min((maxPatchX + 1) * Terrain::cPatchSize, impl->heightFieldWidth - 1);
+    const uint maxZ = Urho3D::Min((maxPatchY + 1) * Terrain::cPatchSize, impl->heightFieldHeight - 1);
+    float minY = impl->heightFieldMaxY;
+    float maxY = impl->heightFieldMinY;
+    for(uint z = minZ; z <= maxZ; ++z)
+        for(uint x = minX; x <= maxX; ++x)
+        {
+            float value = impl->heightData[z * impl->heightFieldWidth + x];
+            minY = Urho3D::Min(minY, value);
+            maxY = Urho3D::Max(maxY, value);
+        }
+
+    // Bullet centers the heightfield on its height range, so a larger range requires recreating the shape.
+    if (minY < impl->heightFieldMinY || maxY > impl->heightFieldMaxY)
+    {
+        impl->heightFieldOutOfRange = true;
+        return;
+    }
+
+    // Wake up the bodies resting on the changed area
+    if (!impl->world || !impl->body)
+        return;
+    const Transform &transform = terrain->nodeTransformation.Get();
+    const btTransform &bodyTransform = impl->body->getWorldTransform();
+    btVector3 aabbMin(BT_LARGE_FLOAT, BT_LARGE_FLOAT, BT_LARGE_FLOAT);
+    btVector3 aabbMax(-BT_LARGE_FLOAT, -BT_LARGE_FLOAT, -BT_LARGE_FLOAT);
+    for(uint i = 0; i < 8; ++i)
+    {
+        float3 corner((float)((i & 1) ? maxX : minX), (i & 2) ? maxY : minY, (float)((i & 4) ? maxZ : minZ));
+        btVector3 worldCorner = bodyTransform * btVector3(transform.pos + transform.scale.Mul(corner));
+        aabbMin.setMin(worldCorner);
+        aabbMax.setMax(worldCorner);
+    }
+    ActivateBodiesCallback callback;
+    impl->world->BulletWorld()->getBroadphase()->aabbTest(aabbMin, aabbMax, callback);
 }
 
 void RigidBody::OnCollisionMeshAssetLoaded(AssetPtr asset)
@@ -603,14 +715,25 @@ void RigidBody::OnCollisionMeshAssetLoaded(AssetPtr asset)
         LogError("RigidBody::OnCollisionMeshAssetLoaded: Mesh asset load finished for asset \"" +
             asset->Name() + "\", but asset pointer was null!");
 
+    // Cached shapes may still be generating in the background. In that case the shape is created when they are ready.
     if (shapeType.Get() == TriMesh)
     {
-        impl->triangleMesh = impl->owner->GetTriangleMeshFromMeshAsset(meshAsset);
+        shared_ptr<TriangleMeshShape> triangleMesh = impl->owner->GetTriangleMeshShapeFromMeshAsset(meshAsset);
+        if (impl->triangleMesh && impl->triangleMesh != triangleMesh)
+            impl->triangleMesh->Ready.Disconnect(this, &RigidBody::OnCollisionShapeReady);
+        impl->triangleMesh = triangleMesh;
+        if (triangleMesh && !triangleMesh->ready_)
+            triangleMesh->Ready.Connect(this, &RigidBody::OnCollisionShapeReady);
         CreateCollisionShape();
     }
     else if (shapeType.Get() == ConvexHull)
     {
-        impl->convexHullSet = impl->owner->GetConvexHullSetFromMeshAsset(meshAsset);
+        shared_ptr<ConvexHullSet> convexHullSet = impl->owner->GetConvexHullSetFromMeshAsset(meshAsset);
+        if (impl->convexHullSet && impl->convexHullSet != convexHullSet)
+            impl->convexHullSet->Ready.Disconnect(this, &RigidBody::OnCollisionShapeReady);
+        impl->convexHullSet = convexHullSet;
+        if (convexHullSet && !convexHullSet->ready_)
+            convexHullSet->Ready.Connect(this, &RigidBody::OnCollisionShapeReady);
         CreateCollisionShape();
     }
 
@@ -618,11 +741,38 @@ void RigidBody::OnCollisionMeshAssetLoaded(AssetPtr asset)
     impl->cachedSize = size.Get();
 }
 
+void RigidBody::OnCollisionShapeReady()
+{
+    CreateCollisionShape();
+}
+
 void RigidBody::AttributesChanged()
 {
     if (impl->disconnected)
         return;
-    
+
+    uint changedAttributes = 0;
+    const AttributeVector &attributes = Attributes();
+    for(uint i = 0; i < attributes.Size(); ++i)
+        if (attributes[i] && attributes[i]->ValueChanged())
+            changedAttributes |= 1u << attributes[i]->Index();
+
+    // The changed flags are cleared after this call, so remember the changes until they can be applied
+    if (impl->world && impl->world->IsStepping())
+    {
+        if (IsChanged(changedAttributes, linearVelocity) || IsChanged(changedAttributes, angularVelocity))
+            DiscardStepTransforms();
+        if (!impl->pendingAttributes)
+            QueueIfStepping(PhysicsWorld::BodyCommand::ApplyAttributes);
+        impl->pendingAttributes |= changedAttributes;
+        return;
+    }
+
+    ApplyAttributeChanges(changedAttributes);
+}
+
+void RigidBody::ApplyAttributeChanges(uint changedAttributes)
+{
     bool isShapeTriMeshOrConvexHull = (shapeType.Get() == TriMesh || shapeType.Get() == ConvexHull);
     bool bodyRead = false;
     bool meshRequested = false;
@@ -634,32 +784,32 @@ void RigidBody::AttributesChanged()
     if (!impl->body)
         return;
     
-    if (mass.ValueChanged() || collisionLayer.ValueChanged() || collisionMask.ValueChanged())
+    if (IsChanged(changedAttributes, mass) || IsChanged(changedAttributes, collisionLayer) || IsChanged(changedAttributes, collisionMask))
     {
         // Read body to the world in case static/dynamic classification changed, or if collision mask changed
         ReaddBody();
         bodyRead = true;
     }
     
-    if (friction.ValueChanged())
+    if (IsChanged(changedAttributes, friction))
         impl->body->setFriction(friction.Get());
     
-    if (rollingFriction.ValueChanged())
+    if (IsChanged(changedAttributes, rollingFriction))
         impl->body->setRollingFriction(rollingFriction.Get());
     
-    if (restitution.ValueChanged())
+    if (IsChanged(changedAttributes, restitution))
         impl->body->setRestitution(friction.Get());
     
-    if (linearDamping.ValueChanged() || angularDamping.ValueChanged())
+    if (IsChanged(changedAttributes, linearDamping) || IsChanged(changedAttributes, angularDamping))
          impl->body->setDamping(linearDamping.Get(), angularDamping.Get());
     
-    if (linearFactor.ValueChanged())
+    if (IsChanged(changedAttributes, linearFactor))
         impl->body->setLinearFactor(linearFactor.Get());
     
-    if (angularFactor.ValueChanged())
+    if (IsChanged(changedAttributes, angularFactor))
         impl->body->setAngularFactor(angularFactor.Get());
     
-    if (shapeType.ValueChanged() || size.ValueChanged())
+    if (IsChanged(changedAttributes, shapeType) || IsChanged(changedAttributes, size))
     {
         if (shapeType.Get() != impl->cachedShapeType || !size.Get().Equals(impl->cachedSize))
         {
@@ -683,14 +833,14 @@ void RigidBody::AttributesChanged()
     }
     
     // Request mesh if its id changes
-    if (collisionMeshRef.ValueChanged() && isShapeTriMeshOrConvexHull && !meshRequested)
+    if (IsChanged(changedAttributes, collisionMeshRef) && isShapeTriMeshOrConvexHull && !meshRequested)
         RequestMesh();
     
     // Readd body to the world in case phantom or kinematic classification changed
-    if (!bodyRead && (phantom.ValueChanged() || kinematic.ValueChanged()))
+    if (!bodyRead && (IsChanged(changedAttributes, phantom) || IsChanged(changedAttributes, kinematic)))
         ReaddBody();
     
-    if (drawDebug.ValueChanged())
+    if (IsChanged(changedAttributes, drawDebug))
     {
         bool enable = drawDebug.Get();
         if (impl->body)
@@ -713,19 +863,21 @@ void RigidBody::AttributesChanged()
         }
     }
     
-    if (linearVelocity.ValueChanged() && !impl->disconnected)
+    if (IsChanged(changedAttributes, linearVelocity) && !impl->disconnected)
     {
+        DiscardStepTransforms();
         impl->body->setLinearVelocity(linearVelocity.Get());
         impl->body->activate();
     }
     
-    if (angularVelocity.ValueChanged() && !impl->disconnected)
+    if (IsChanged(changedAttributes, angularVelocity) && !impl->disconnected)
     {
+        DiscardStepTransforms();
         impl->body->setAngularVelocity(DegToRad(angularVelocity.Get()));
         impl->body->activate();
     }
     
-    if (useGravity.ValueChanged())
+    if (IsChanged(changedAttributes, useGravity))
         UpdateGravity();
 }
 
@@ -741,6 +893,10 @@ void RigidBody::PlaceableUpdated(IAttribute* attribute, AttributeChange::Type /*
     
     if (attribute == &placeable->transform)
     {
+        DiscardStepTransforms();
+        if (QueueIfStepping(PhysicsWorld::BodyCommand::UpdateTransform))
+            return;
+
         // Important: when changing both transform and parent, always set parentref first, then transform
         // Otherwise the physics simulation may interpret things wrong and the object ends up
         // in an unintended location
@@ -784,7 +940,8 @@ void RigidBody::SetRotation(const float3& rotation)
         trans.rot = rotation;
         placeable->transform.Set(trans, AttributeChange::Default);
         
-        if (impl->body)
+        DiscardStepTransforms();
+        if (impl->body && !QueueIfStepping(PhysicsWorld::BodyCommand::UpdateTransform))
         {
             btTransform& worldTrans = impl->body->getWorldTransform();
             btTransform interpTrans = impl->body->getInterpolationWorldTransform();
@@ -812,7 +969,8 @@ void RigidBody::Rotate(const float3& rotation)
         trans.rot += rotation;
         placeable->transform.Set(trans, AttributeChange::Default);
         
-        if (impl->body)
+        DiscardStepTransforms();
+        if (impl->body && !QueueIfStepping(PhysicsWorld::BodyCommand::UpdateTransform))
         {
             btTransform& worldTrans = impl->body->getWorldTransform();
             btTransform interpTrans = impl->body->getInterpolationWorldTransform();
@@ -825,6 +983,86 @@ void RigidBody::Rotate(const float3& rotation)
     impl->disconnected = false;
 }
 
+bool RigidBody::ApplyTransformUpdate(PhysicsTransformUpdate& update, bool signalChanges)
+{
+    Placeable* p = impl->placeable;
+    if (!p)
+        return false;
+    // The body has been moved outside the simulation after the asynchronous step that produced the update was started
+    if (impl->world && impl->world->appliedStep_ < impl->discardStep)
+        return false;
+
+    update.change = HasAuthority() ? AttributeChange::Default : AttributeChange::LocalOnly;
+    AttributeChange::Type changeType = signalChanges ? update.change : AttributeChange::Disconnected;
+
+    // Important: disconnect our own response to attribute changes to not create an endless loop!
+    impl->disconnected = true;
+
+    bool applied = false;
+    float3 position = update.position;
+    Quat orientation = update.orientation;
+    // The placeable has a parent itself
+    if (!p->parentRef.Get().IsEmpty())
+    {
+        Placeable* parentPlaceable = p->ParentPlaceableComponent();
+        if (parentPlaceable && p->parentBone.Get().Empty())
+        {
+            // Use the cached world transform of the parent instead of going through the scene node hierarchy
+            position = parentPlaceable->WorldToLocal().TransformPos(position);
+            orientation = parentPlaceable->WorldOrientation().Inverse() * orientation;
+            applied = true;
+        }
+        else
+        {
+            Urho3D::Node* parent = p->UrhoSceneNode()->GetParent();
+            if (parent)
+            {
+                position = parent->WorldToLocal(position);
+                orientation = parent->GetWorldRotation().Inverse() * orientation;
+                applied = true;
+            }
+        }
+    }
+    else
+        applied = true;
+
+    if (applied)
+    {
+        Transform newTrans = p->transform.Get();
+        newTrans.SetPos(position);
+        newTrans.SetOrientation(orientation);
+        p->transform.Set(newTrans, changeType);
+        if (!signalChanges)
+            p->ApplyTransformToNode();
+    }
+
+    // Set linear & angular velocity
+    if (impl->body)
+    {
+        // Performance optimization: because applying each attribute causes signals to be fired, which is slow in a large scene
+        // (and furthermore, on a server, causes each connection's sync state to be accessed), do not set the linear/angular
+        // velocities if they haven't changed
+        const float3 &linearVel = update.linearVelocity;
+        const float3 &angularVel = update.angularVelocity;
+        update.linearVelocityChanged = !linearVel.Equals(linearVelocity.Get());
+        update.angularVelocityChanged = !angularVel.Equals(angularVelocity.Get());
+        if (update.linearVelocityChanged)
+            linearVelocity.Set(linearVel, changeType);
+        if (update.angularVelocityChanged)
+            angularVelocity.Set(angularVel, changeType);
+        // Without signals AttributesChanged is not called to clear the changed flags. Clear them here so that later
+        // attribute changes do not apply the stale velocities to the body.
+        if (!signalChanges)
+        {
+            linearVelocity.ClearChangedFlag();
+            angularVelocity.ClearChangedFlag();
+        }
+    }
+
+    impl->disconnected = false;
+    return applied;
+}
+
 PhysicsWorld* RigidBody::World() const
 {
     return impl->world;
@@ -832,7 +1070,8 @@ PhysicsWorld* RigidBody::World() const
 
 float3 RigidBody::GetLinearVelocity()
 {
-    if (impl->body)
+    // During an asynchronous step, the attribute holds the velocity at the end of the previous step
+    if (impl->body && !impl->world->IsStepping())
         return impl->body->getLinearVelocity();
     else 
         return linearVelocity.Get();
@@ -840,7 +1079,7 @@ float3 RigidBody::GetLinearVelocity()
 
 float3 RigidBody::GetAngularVelocity()
 {
-    if (impl->body)
+    if (impl->body && !impl->world->IsStepping())
         return RadToDeg(impl->body->getAngularVelocity());
     else
         return angularVelocity.Get();
@@ -856,6 +1095,8 @@ bool RigidBody::HasAuthority() const
 
 AABB RigidBody::ShapeAABB() const
 {
+    if (impl->world)
+        impl->world->WaitForStep();
     AABB aabb;
     if (impl->body && impl->shape)
     {
@@ -923,6 +1164,9 @@ void RigidBody::UpdateScale()
 {
     URHO3D_PROFILE(RigidBody_UpdateScale);
 
+    if (impl->world)
+        impl->world->WaitForStep();
+
     // If placeable exists, set local scaling from its scale
     Placeable* placeable = impl->placeable;
     if (placeable && impl->shape)
@@ -954,6 +1198,7 @@ void RigidBody::UpdateGravity()
 {
     if (!impl->body || !impl->world)
         return;
+    impl->world->WaitForStep();
     
     int flags = impl->body->getFlags();
     if (useGravity.Get())
@@ -978,34 +1223,29 @@ void RigidBody::CreateHeightFieldFromTerrain()
     if (!terrain)
         return;
     
-    uint width = terrain->PatchWidth() * Terrain::cPatchSize;
-    uint height = terrain->PatchHeight() * Terrain::cPatchSize;
-    if (!width || !height)
+    uint width = terrain->VerticesWidth();
+    uint height = terrain->VerticesHeight();
+    if (!width || !height || !terrain->HeightData())
         return;
     
-    impl->heightValues.Resize(width * height);
-    
+    // The heightfield reads the height grid of the terrain directly, without copying it.
     float xzSpacing = 1.0f;
     float ySpacing = 1.0f;
-    float minY = 1000000000;
-    float maxY = -1000000000;
-    for(uint z = 0; z < height; ++z)
-        for(uint x = 0; x < width; ++x)
-        {
-            float value = terrain->GetPoint(x, z);
-            if (value < minY)
-                minY = value;
-            if (value > maxY)
-                maxY = value;
-            impl->heightValues[z * width + x] = value;
-        }
+    float minY, maxY;
+    terrain->GetTerrainHeightRange(minY, maxY);
+    impl->heightData = terrain->HeightData();
+    impl->heightFieldWidth = width;
+    impl->heightFieldHeight = height;
+    impl->heightFieldMinY = minY;
+    impl->heightFieldMaxY = maxY;
+    impl->heightFieldOutOfRange = false;
 
     float3 scale = terrain->nodeTransformation.Get().scale;
     float3 bbMin(0, minY, 0);
     float3 bbMax(xzSpacing * (width - 1), maxY, xzSpacing * (height - 1));
     float3 bbCenter = scale.Mul((bbMin + bbMax) * 0.5f);
     
-    impl->heightField = new btHeightfieldTerrainShape(width, height, &impl->heightValues[0], ySpacing, minY, maxY, 1, PHY_FLOAT, false);
+    impl->heightField = new btHeightfieldTerrainShape(width, height, impl->heightData, ySpacing, minY, maxY, 1, PHY_FLOAT, false);
     
     /** \todo Terrain uses its own transform that is independent of the placeable. It is not nice to support, since rest of RigidBody assumes
         the transform is in the placeable. Right now, we only support position & scaling. Here, we also counteract Bullet's nasty habit to center 
@@ -1024,7 +1264,7 @@ void RigidBody::CreateHeightFieldFromTerrain()
 
 void RigidBody::CreateConvexHullSetShape()
 {
-    if (!impl->convexHullSet)
+    if (!impl->convexHullSet || !impl->convexHullSet->ready_)
         return;
     
     // Avoid creating a compound shape if only 1 hull in the set
@@ -1067,6 +1307,64 @@ void RigidBody::UpdatePosRotFromPlaceable()
     KeepActive();
 }
 
+bool RigidBody::QueueIfStepping(int type, const float3& vector, const float3& position)
+{
+    if (!impl->world || !impl->world->IsStepping())
+        return false;
+    impl->world->PostCommand(this, static_cast<PhysicsWorld::BodyCommand::Type>(type), vector, position);
+    return true;
+}
+
+void RigidBody::DiscardStepTransforms()
+{
+    // The steps started so far do not know about the change, so their transforms would overwrite it
+    if (impl->world && impl->world->AsynchronousSimulation())
+        impl->discardStep = impl->world->stepCount_ + 1;
+}
+
+void RigidBody::ExecuteCommand(int type, const float3& vector, const float3& position)
+{
+    switch(type)
+    {
+    case PhysicsWorld::BodyCommand::ApplyForce:
+        ApplyForce(vector, position);
+        break;
+    case PhysicsWorld::BodyCommand::ApplyTorque:
+        ApplyTorque(vector);
+        break;
+    case PhysicsWorld::BodyCommand::ApplyImpulse:
+        ApplyImpulse(vector, position);
+        break;
+    case PhysicsWorld::BodyCommand::ApplyTorqueImpulse:
+        ApplyTorqueImpulse(vector);
+        break;
+    case PhysicsWorld::BodyCommand::Activate:
+        Activate();
+        break;
+    case PhysicsWorld::BodyCommand::KeepActive:
+        KeepActive();
+        break;
+    case PhysicsWorld::BodyCommand::ResetForces:
+        ResetForces();
+        break;
+    case PhysicsWorld::BodyCommand::UpdateTransform:
+        if (impl->body)
+        {
+            UpdatePosRotFromPlaceable();
+            UpdateScale();
+            impl->body->updateInertiaTensor();
+        }
+        break;
+    case PhysicsWorld::BodyCommand::ApplyAttributes:
+    {
+        const uint changedAttributes = impl->pendingAttributes;
+        impl->pendingAttributes = 0;
+        ApplyAttributeChanges(changedAttributes);
+        break;
+    }
+    }
+}
+
 void RigidBody::EmitPhysicsCollision(Entity* otherEntity, const float3& position, const float3& normal, float distance, float impulse, bool newCollision)
 {
     if (newCollision)
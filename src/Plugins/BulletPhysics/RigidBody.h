@@ -290,12 +290,25 @@ private:
     /// Called when Terrain has been regenerated
     void OnTerrainRegenerated();
 
+    /// Called when height values of Terrain patches have changed
+    void OnTerrainHeightsChanged(uint minPatchX, uint minPatchY, uint maxPatchX, uint maxPatchY);
+
+    /// Called before the Terrain height grid is written to or reallocated
+    void OnTerrainHeightsAboutToChange(bool reallocating);
+
     /// Called when collision mesh has been downloaded.
     void OnCollisionMeshAssetLoaded(AssetPtr asset);
 
+    /// Called when the cached collision shape of the collision mesh has been generated.
+    void OnCollisionShapeReady();
+
     /// Called when some of the attributes has been changed.
     void AttributesChanged();
 
+    /// Apply the changes of attributes to the body.
+    /** @param changedAttributes Bitmask of the indices of the changed attributes. */
+    void ApplyAttributeChanges(uint changedAttributes);
+
     /// (Re)create the collisionshape
     void CreateCollisionShape();
     
@@ -333,6 +346,28 @@ private:
     /// Emit a physics collision. Called from PhysicsWorld
     void EmitPhysicsCollision(Entity* otherEntity, const float3& position, const float3& normal, float distance, float impulse, bool newCollision);
 
+    /// Return whether anything is connected to the collision signals. Called from PhysicsWorld
+    bool HasCollisionListeners() const { return !PhysicsCollision.Empty() || !NewPhysicsCollision.Empty(); }
+
+    /// Apply a transform and velocities from the simulation to the placeable and velocity attributes. Called from PhysicsWorld
+    /** @param update Transform update of this body. Receives the change type and which velocities changed.
+        @param signalChanges Whether to emit attribute change signals. If false, the placeable scene node is updated directly.
+        @return True if the transform was applied. */
+    bool ApplyTransformUpdate(PhysicsTransformUpdate& update, bool signalChanges);
+
+    /// Queue a change as a PhysicsWorld::BodyCommand, if an asynchronous simulation step is running.
+    /** @return True if the change was queued, false if it can be applied immediately. */
+    bool QueueIfStepping(int type, const float3& vector = float3::zero, const float3& position = float3::zero);
+
+    /// Ignore the transforms of the asynchronous simulation steps started before the body was moved outside the simulation.
+    void DiscardStepTransforms();
+
+    /// Apply a change queued during an asynchronous simulation step. Called from PhysicsWorld
+    void ExecuteCommand(int type, const float3& vector, const float3& position);
+
+    /// HasCollisionListeners() at the start of the running asynchronous simulation step, read on the physics thread instead of the signals
+    bool stepCollisionListeners_;
+
     struct Impl;
     Impl *impl;
 };
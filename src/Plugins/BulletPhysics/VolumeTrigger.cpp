@@ -22,21 +22,26 @@ namespace Tundra
 VolumeTrigger::VolumeTrigger(Urho3D::Context* context, Scene* scene) :
     IComponent(context, scene),
     INIT_ATTRIBUTE_VALUE(byPivot, "By Pivot", false),
-    INIT_ATTRIBUTE(entities, "Entities")
+    INIT_ATTRIBUTE(entities, "Entities"),
+    trackedBody_(0),
+    checkAll_(false)
 {
     ParentEntitySet.Connect(this, &VolumeTrigger::UpdateSignals);
 }
 
 VolumeTrigger::~VolumeTrigger()
 {
+    SharedPtr<PhysicsWorld> world = world_.Lock();
+    if (world && trackedBody_)
+        world->RemoveVolumeTrigger(trackedBody_);
 }
 
 EntityVector VolumeTrigger::EntitiesInside() const
 {
     EntityVector ret;
-    for(EntitiesWithinVolumeMap::ConstIterator it = entities_.Begin(); it != entities_.End(); ++it)
+    for(EntitySet::ConstIterator it = entities_.Begin(); it != entities_.End(); ++it)
     {
-        ret.Push(it->first_.Lock());
+        ret.Push(it->Lock());
     }
     return ret;
 }
@@ -51,10 +56,10 @@ Entity* VolumeTrigger::EntityInside(size_t idx) const
     if (idx < entities_.Size())
     {
         size_t currentIndex = 0;
-        for(EntitiesWithinVolumeMap::ConstIterator it = entities_.Begin(); it != entities_.End(); ++it)
+        for(EntitySet::ConstIterator it = entities_.Begin(); it != entities_.End(); ++it)
         {
             if (currentIndex == idx)
-                return it->first_;
+                return it->Get();
             ++currentIndex;
         }
     }
@@ -81,24 +86,17 @@ float VolumeTrigger::EntityInsidePercent(const Entity *entity) const
 
 float VolumeTrigger::EntityInsidePercentByName(const String &name) const
 {
-    for(EntitiesWithinVolumeMap::ConstIterator it = entities_.Begin(); it != entities_.End(); ++it)
-        if (!it->first_.Expired() && it->first_->Name().Compare(name) == 0)
-            return EntityInsidePercent(it->first_);
+    for(EntitySet::ConstIterator it = entities_.Begin(); it != entities_.End(); ++it)
+        if (!it->Expired() && (*it)->Name().Compare(name) == 0)
+            return EntityInsidePercent(it->Get());
     return 0.f;
 }
 
 bool VolumeTrigger::IsInterestingEntity(const String &name) const
 {
-    URHO3D_PROFILE(VolumeTrigger_IsInterestingEntity); ///\todo The performance of this function feels really fishy - on each physics collision, we iterate through a list performing string comparisons.
-
-    const VariantList &interestingEntities = entities.Get();
-    if (interestingEntities.Empty())
+    if (entities.Get().Empty())
         return true;
-
-    foreach(const Variant &intname, interestingEntities)
-        if (intname.GetString().Compare(name) == 0)
-            return true;
-    return false;
+    return interestingNames_.Contains(name);
 }
 
 bool VolumeTrigger::IsPivotInside(Entity *entity) const
@@ -132,10 +130,15 @@ bool VolumeTrigger::IsInsideVolume(const float3& point) const
 
 void VolumeTrigger::AttributesChanged()
 {
-    /// \todo Attribute updates not handled yet, there are a bit too many problems of what signals to send after the update -cm
-
-    //if (mass.ValueChanged())
-    //    ReadBody();
+    if (entities.ValueChanged())
+    {
+        interestingNames_.Clear();
+        foreach(const Variant &intname, entities.Get())
+            interestingNames_.Insert(intname.GetString());
+    }
+    // Entities may have entered or left the volume without moving, check them on the next physics update
+    if (entities.ValueChanged() || byPivot.ValueChanged())
+        checkAll_ = true;
 }
 
 void VolumeTrigger::UpdateSignals()
@@ -144,13 +147,15 @@ void VolumeTrigger::UpdateSignals()
     if (!parent)
         return;
     
-    CheckForRigidBody();
-    parent->ComponentAdded.Connect(this, &VolumeTrigger::OnComponentAdded);
-
     Scene* scene = parent->ParentScene();
-    PhysicsWorld* world = scene->Subsystem<PhysicsWorld>().Get();
+    SharedPtr<PhysicsWorld> world = scene->Subsystem<PhysicsWorld>();
+    world_ = world;
     if (world)
         world->Updated.Connect(this, &VolumeTrigger::OnPhysicsUpdate);
+
+    CheckForRigidBody();
+    parent->ComponentAdded.Connect(this, &VolumeTrigger::OnComponentAdded);
+    parent->ComponentRemoved.Connect(this, &VolumeTrigger::OnComponentRemoved);
 }
 
 void VolumeTrigger::OnComponentAdded(IComponent* /*component*/, AttributeChange::Type /*change*/)
@@ -158,6 +163,26 @@ void VolumeTrigger::OnComponentAdded(IComponent* /*component*/, AttributeChange:
     CheckForRigidBody();
 }
 
+void VolumeTrigger::OnComponentRemoved(IComponent* component, AttributeChange::Type /*change*/)
+{
+    if (component && component == trackedBody_)
+        ReleaseRigidBody();
+}
+
+void VolumeTrigger::ReleaseRigidBody()
+{
+    SharedPtr<PhysicsWorld> world = world_.Lock();
+    if (world && trackedBody_)
+        world->RemoveVolumeTrigger(trackedBody_);
+    trackedBody_ = 0;
+    rigidbody_.Reset();
+
+    // Nothing overlaps without a body
+    overlapping_.Clear();
+    for(EntitySet::ConstIterator it = entities_.Begin(); it != entities_.End(); ++it)
+        changed_.Push(*it);
+}
+
 void VolumeTrigger::CheckForRigidBody()
 {
     Entity* parent = ParentEntity();
@@ -166,95 +191,85 @@ void VolumeTrigger::CheckForRigidBody()
     
     if (!rigidbody_.Lock())
     {
+        // The previous body may have been destroyed without being removed first
+        if (trackedBody_)
+            ReleaseRigidBody();
         SharedPtr<RigidBody> rigidbody = parent->Component<RigidBody>();
-        if (rigidbody)
+        SharedPtr<PhysicsWorld> world = world_.Lock();
+        if (rigidbody && world)
         {
             rigidbody_ = rigidbody;
-            rigidbody->PhysicsCollision.Connect(this, &VolumeTrigger::OnPhysicsCollision);
+            trackedBody_ = rigidbody;
+            world->AddVolumeTrigger(this, rigidbody);
         }
     }
 }
 
+void VolumeTrigger::OnOverlapChanged(Entity* otherEntity, bool overlapping)
+{
+    if (!otherEntity)
+        return;
+
+    EntityWeakPtr otherEntityWeak(otherEntity);
+    if (overlapping)
+        overlapping_.Insert(otherEntityWeak);
+    else
+        overlapping_.Erase(otherEntityWeak);
+    changed_.Push(otherEntityWeak);
+}
+
 void VolumeTrigger::OnPhysicsUpdate(float /*timeStep*/)
 {
     URHO3D_PROFILE(VolumeTrigger_OnPhysicsUpdate);
-    for(EntitiesWithinVolumeMap::Iterator it = entities_.Begin(); it != entities_.End();)
+
+    // Pivot points may move in and out of the volume while the bodies keep overlapping
+    if (checkAll_ || byPivot.Get())
     {
-        bool remove = false;
-        EntityPtr entity = it->first_.Lock();
-        
-        // Entity was destroyed without us knowing? Remove from map in that case
-        if (!entity)
-            remove = true;
-        else
+        checkAll_ = false;
+        for(EntitySet::Iterator it = overlapping_.Begin(); it != overlapping_.End();)
         {
-            // If collision is old, remove the entity if its rigidbody is active
-            // (inactive rigidbodies do not refresh the collision, so we would remove the entity mistakenly)
-            if (!it->second_)
-            {
-                bool active = true;
-                SharedPtr<RigidBody> rigidbody = entity->Component<RigidBody>();
-                if (rigidbody && rigidbody->mass.Get() > 0.0f)
-                    active = rigidbody->IsActive();
-                if (active)
-                    remove = true;
-            }
+            if (it->Expired())
+                it = overlapping_.Erase(it);
             else
-            {
-                // Age the collision from new to old
-                it->second_ = false;
-            }
-        }
-        
-        if (!remove)
-            ++it;
-        else
-        {
-            it = entities_.Erase(it);
-
-            if (entity)
-            {
-                EntityLeave.Emit(entity.Get());
-                entity->EntityRemoved.Disconnect(this, &VolumeTrigger::OnEntityRemoved);
-            }
+                changed_.Push(*it++);
         }
+        for(EntitySet::ConstIterator it = entities_.Begin(); it != entities_.End(); ++it)
+            changed_.Push(*it);
     }
+
+    // Signal handlers may add and remove bodies, which appends to the list while it is processed
+    for(uint i = 0; i < changed_.Size(); ++i)
+        UpdateEntity(changed_[i]);
+    changed_.Clear();
 }
 
-void VolumeTrigger::OnPhysicsCollision(Entity* otherEntity, const float3& /*position*/,
-    const float3& /*normal*/, float /*distance*/, float /*impulse*/, bool newCollision)
+void VolumeTrigger::UpdateEntity(EntityWeakPtr entityWeak)
 {
-    URHO3D_PROFILE(VolumeTrigger_OnPhysicsCollision);
-
-    assert(otherEntity && "Physics collision with no entity.");
-
-    if (!entities.Get().Empty() && !IsInterestingEntity(otherEntity->Name()))
+    EntityPtr entity = entityWeak.Lock();
+    if (!entity)
+    {
+        // Entity was destroyed without us knowing? Remove it silently in that case
+        entities_.Erase(entityWeak);
         return;
+    }
 
     // If byPivot attribute is enabled, we require the object pivot to enter the volume trigger area.
-    // Otherwise, we react on each physics collision message (i.e. we accept if the volumetrigger and other entity just touch).
-    if (byPivot.Get() && !IsPivotInside(otherEntity))
-        return;
+    // Otherwise, we accept if the bounding boxes of the volume trigger and the other entity just touch.
+    const bool inside = overlapping_.Contains(entityWeak) && IsInterestingEntity(entity->Name()) &&
+        (!byPivot.Get() || IsPivotInside(entity));
 
-    bool refreshed = false;
-    EntityWeakPtr otherEntityWeak(otherEntity);
-
-    if (newCollision)
+    EntitySet::Iterator it = entities_.Find(entityWeak);
+    if (inside && it == entities_.End())
     {
-        // make sure the entity isn't already inside the volume
-        if (entities_.Find(otherEntityWeak) == entities_.End())
-        {
-            entities_[otherEntityWeak] = true;
-            EntityEnter.Emit(otherEntity);
-            refreshed = true;
-            otherEntity->EntityRemoved.Connect(this, &VolumeTrigger::OnEntityRemoved);
-        }
+        entities_.Insert(entityWeak);
+        entity->EntityRemoved.Connect(this, &VolumeTrigger::OnEntityRemoved);
+        EntityEnter.Emit(entity.Get());
     }
-
-    if (!refreshed)
+    else if (!inside && it != entities_.End())
     {
-        // Refresh the collision status to new
-        entities_[otherEntityWeak] = true;
+        entities_.Erase(it);
+        entity->EntityRemoved.Disconnect(this, &VolumeTrigger::OnEntityRemoved);
+        EntityLeave.Emit(entity.Get());
     }
 }
 
@@ -263,7 +278,8 @@ void VolumeTrigger::OnEntityRemoved(Entity *entity, AttributeChange::Type /*chan
 {
     assert(entity);
     EntityWeakPtr entityWeak(entity);
-    EntitiesWithinVolumeMap::Iterator i = entities_.Find(entityWeak);
+    overlapping_.Erase(entityWeak);
+    EntitySet::Iterator i = entities_.Find(entityWeak);
     if (i != entities_.End())
     {
         entities_.Erase(i);
@@ -9,6 +9,8 @@
 #include "Signals.h"
 #include "AttributeChangeType.h"
 
+#include <Urho3D/Container/HashSet.h>
+
 namespace Tundra
 {
 
@@ -40,17 +42,19 @@ namespace Tundra
 
     <b>Depends on the component RigitBody.</b>.
 
+    Entities enter and leave the volume when the bounding box of their rigid body starts or stops overlapping the
+    bounding box of the volume's collision shape. The overlaps are tracked by the physics broadphase, so the cost of
+    a volume trigger per physics update only depends on the number of entities entering or leaving it.
+
     @note If you use 'byPivot' -option or use IsPivotInside-function, the pivot point shouldn't be outside the mesh 
         (or physics collision primitive) because physics collisions are used for efficiency even in this case.
-    @todo If you add an entity to the 'interesting entities list', no signals may get send for that entity,
-          and it may not show up in any list of entities contained in this volume trigger until that entity moves.
-          Also if you enable/disable 'byPivot' option when entities are inside the volume, no signals may get send for those entities,
-          and they may not show up in any list of entities contained in this volume trigger until the entities move.
+        With 'byPivot', the pivot points of the entities overlapping the volume are checked on each physics update.
 
     </table> */
 class VolumeTrigger : public IComponent
 {
     friend class PhysicsWorld;
+    friend struct VolumeTriggerPairCallback;
     
     COMPONENT_NAME(VolumeTrigger, 24)
 
@@ -123,17 +127,27 @@ public:
 private:
     void UpdateSignals();
 
-    /// Check for rigid body component and connect to its signals.
+    /// Check for rigid body component and start tracking its overlaps.
     void CheckForRigidBody();
 
     /// Component has been added to the entity. Check for rigid body now.
     void OnComponentAdded(IComponent* /*component*/, AttributeChange::Type /*change*/);
 
+    /// Component has been removed from the entity. Stop tracking the overlaps if it is the rigid body.
+    void OnComponentRemoved(IComponent* component, AttributeChange::Type /*change*/);
+
+    /// Stops tracking the overlaps of the rigid body. The entities inside leave on the next physics update.
+    void ReleaseRigidBody();
+
     /// Collisions have been processed for the scene the parent entity is in
     void OnPhysicsUpdate(float /*timeStep*/);
 
-    /// Called when physics collisions occurs.
-    void OnPhysicsCollision(Entity* otherEntity, const float3& position, const float3& normal, float distance, float impulse, bool newCollision);
+    /// Called by the physics world when the broadphase overlap of the rigid body of this volume and an entity changes.
+    void OnOverlapChanged(Entity* otherEntity, bool overlapping);
+
+    /// Enters or leaves an entity depending on whether it is inside the volume.
+    /** Takes a copy, as signal handlers may modify the list the entity is taken from. */
+    void UpdateEntity(EntityWeakPtr entityWeak);
 
     /// Called when entity inside this volume is removed from the scene
     void OnEntityRemoved(Entity* entity, AttributeChange::Type /*change*/);
@@ -143,12 +157,22 @@ private:
 
     /// Rigid body component that is needed for collision signals
     WeakPtr<RigidBody> rigidbody_;
-
-    typedef HashMap<EntityWeakPtr, bool> EntitiesWithinVolumeMap;
-    /// Map of entities inside this volume. 
-    /** The value is used in physics update to see if the entity is still inside
-        this volume or if it left the volume during last physics update. */
-    EntitiesWithinVolumeMap entities_;
+    /// Rigid body the overlaps are tracked for in the physics world. Kept as the key to stop tracking after the body is destroyed.
+    RigidBody* trackedBody_;
+    /// Physics world the rigid body overlaps are tracked in
+    WeakPtr<PhysicsWorld> world_;
+
+    typedef HashSet<EntityWeakPtr> EntitySet;
+    /// Entities inside this volume.
+    EntitySet entities_;
+    /// Entities whose rigid body overlaps the rigid body of this volume in the broadphase.
+    EntitySet overlapping_;
+    /// Entities whose overlap has changed since the last physics update.
+    Vector<EntityWeakPtr> changed_;
+    /// Names of the interesting entities, cached from the entities attribute.
+    HashSet<String> interestingNames_;
+    /// Whether all overlapping entities need to be checked on the next physics update, because the attributes have changed.
+    bool checkAll_;
 };
 COMPONENT_TYPEDEFS(VolumeTrigger);
 
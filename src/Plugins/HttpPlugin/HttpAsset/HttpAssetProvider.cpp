@@ -13,14 +13,23 @@
 #include "IAssetTransfer.h" /// @todo HttpAssetTransfer
 
 #include "Framework.h"
+#include "LoggingFunctions.h"
+
+#include <Urho3D/Core/Timer.h>
 
 namespace Tundra
 {
 
+/// How long a revalidated cache entry is served without asking the server again.
+static const unsigned cValidatedFreshnessMSec = 60 * 1000;
+
 HttpAssetProvider::HttpAssetProvider(Framework *framework, const HttpClientPtr &client) :
     IAssetProvider(framework->GetContext()),
     framework_(framework),
-    client_(client)
+    client_(client),
+    numNotModified_(0),
+    numRefreshed_(0),
+    numRevalidationsFailed_(0)
 {
 }
 
@@ -93,8 +102,19 @@ AssetTransferPtr HttpAssetProvider::CreateTransfer(String assetRef, String asset
 void HttpAssetProvider::ExecuteTransfer(AssetTransferPtr transfer)
 {
     HttpAssetTransfer *httpTransfer = dynamic_cast<HttpAssetTransfer*>(transfer.Get());
-    if (httpTransfer)
-        client_->Schedule(httpTransfer->Request());
+    if (!httpTransfer)
+        return;
+
+    // Skip the round trip if the cache entry was just revalidated.
+    HashMap<String, unsigned>::Iterator validated = validated_.Find(httpTransfer->source.ref);
+    if (validated != validated_.End())
+    {
+        const bool fresh = (Urho3D::Time::GetSystemTime() - validated->second_ <= cValidatedFreshnessMSec);
+        validated_.Erase(validated);
+        if (fresh && httpTransfer->CompleteFromCache())
+            return;
+    }
+    client_->Schedule(httpTransfer->Request());
 }
 
 bool HttpAssetProvider::AbortTransfer(IAssetTransfer *transfer)
@@ -160,6 +180,98 @@ AssetUploadTransferPtr HttpAssetProvider::UploadAssetFromFileInMemory(const u8 *
     return AssetUploadTransferPtr(); /// @todo
 }
 
+uint HttpAssetProvider::RevalidateCachedAssets(const StringVector &assetRefs)
+{
+    AssetCache *cache = framework_->Asset()->Cache();
+    if (!cache)
+        return 0;
+
+    if (revalidating_.Empty())
+    {
+        numNotModified_ = numRefreshed_ = numRevalidationsFailed_ = 0;
+
+        // Forget the confirmations of the previous pass that have gone stale without being requested.
+        const unsigned now = Urho3D::Time::GetSystemTime();
+        for(HashMap<String, unsigned>::Iterator iter = validated_.Begin(); iter != validated_.End();)
+        {
+            if (now - iter->second_ > cValidatedFreshnessMSec)
+                iter = validated_.Erase(iter);
+            else
+                ++iter;
+        }
+    }
+
+    uint num = 0;
+    foreach(const String &ref, assetRefs)
+    {
+        String assetRef = ref.Trimmed();
+        if (!IsValidRef(assetRef, "") || revalidating_.Contains(assetRef))
+            continue;
+        unsigned lastModified = cache->LastModified(assetRef);
+        if (lastModified == 0)
+            continue;
+
+        HttpRequestPtr request = client_->Create(Http::Method::Get, assetRef);
+        if (!request)
+            continue;
+
+        /* Cache file is deliberately not set to the request, a '304 Not Modified' response
+           does not need the cached data in memory. Changed assets are written in OnRevalidated. */
+        request->SetHeader(Http::Header::IfModifiedSince, Http::LocalEpochToHttpDate(static_cast<time_t>(lastModified)));
+        String eTag = cache->ETag(assetRef);
+        if (!eTag.Empty())
+            request->SetHeader(Http::Header::IfNoneMatch, eTag);
+        request->Finished.Connect(this, &HttpAssetProvider::OnRevalidated);
+        client_->Schedule(request);
+
+        revalidating_.Insert(assetRef);
+        ++num;
+    }
+    if (num > 0)
+        LogInfoF("HttpAssetProvider: Revalidating %u cached assets", num);
+    return num;
+}
+
+uint HttpAssetProvider::RevalidateCache()
+{
+    AssetCache *cache = framework_->Asset()->Cache();
+    return (cache ? RevalidateCachedAssets(cache->CachedAssetRefs()) : 0);
+}
+
+void HttpAssetProvider::OnRevalidated(HttpRequestPtr &request, int status, const String &error)
+{
+    String assetRef = request->Url();
+    revalidating_.Erase(assetRef);
+
+    AssetCache *cache = framework_->Asset()->Cache();
+    if (error.Empty() && status == 304)
+    {
+        validated_[assetRef] = Urho3D::Time::GetSystemTime();
+        ++numNotModified_;
+    }
+    else if (error.Empty() && status == 200 && cache && request->ResponseBodySize() > 0)
+    {
+        const Vector<u8> &body = request->ResponseBody();
+        if (!cache->StoreAsset(&body[0], body.Size(), assetRef).Empty())
+        {
+            time_t lastModified = Http::HttpDateToUtcEpoch(request->ResponseHeader(Http::Header::LastModified));
+            if (lastModified > 0)
+                cache->SetLastModified(assetRef, static_cast<unsigned>(lastModified));
+            cache->SetETag(assetRef, request->ResponseHeader(Http::Header::ETag));
+            validated_[assetRef] = Urho3D::Time::GetSystemTime();
+            ++numRefreshed_;
+        }
+        else
+            ++numRevalidationsFailed_;
+    }
+    else
+        ++numRevalidationsFailed_;
+
+    if (revalidating_.Empty())
+        LogInfoF("HttpAssetProvider: Cache revalidation done, %u up to date, %u refreshed, %u failed",
+            numNotModified_, numRefreshed_, numRevalidationsFailed_);
+}
+
 AssetStoragePtr HttpAssetProvider::TryCreateStorage(HashMap<String, String> &storageParams, bool /*fromNetwork*/)
 {
     if (!storageParams.Contains("src") || !IsValidRef(storageParams["src"], ""))
@@ -7,6 +7,9 @@
 
 #include "IAssetProvider.h"
 
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Container/HashSet.h>
+
 namespace Tundra
 {
 
@@ -45,6 +48,18 @@ public:
     AssetUploadTransferPtr UploadAssetFromFileInMemory(const u8 *data, uint numBytes,
         AssetStoragePtr destination, const String &assetName) override;
 
+    /// Revalidates the cached copies of @c assetRefs with conditional requests.
+    /** All requests are issued at once and only transfer a body if the asset has changed, in which case the cache
+        entry is refreshed. Once confirmed by the server, the next request of an asset is served directly from the
+        cache without another round trip, provided it is requested within a minute of the confirmation. Refs that
+        are not in the cache are ignored.
+        @return Number of revalidation requests issued. */
+    uint RevalidateCachedAssets(const StringVector &assetRefs);
+
+    /// Revalidates all HTTP assets in the asset cache.
+    /** Invoked on startup with the --httpRevalidateCache command line parameter. @see RevalidateCachedAssets. */
+    uint RevalidateCache();
+
 private:
     /// IAssetProvider override.
     AssetStoragePtr TryCreateStorage(HashMap<String, String> &storageParams, bool fromNetwork) override;
@@ -55,10 +70,23 @@ private:
     /// Returns a uniqeu HTTP storage name.
     String UniqueName(String prefix = "Web") const;
 
+    /// Handles completion of a revalidation request.
+    void OnRevalidated(HttpRequestPtr &request, int status, const String &error);
+
     Framework *framework_;
     HttpClientPtr client_;
 
     Vector<AssetStoragePtr> httpStorages_;
+
+    /// Asset refs with an ongoing revalidation request.
+    HashSet<String> revalidating_;
+    /// Asset refs whose cache entries have been revalidated and not yet served from the cache, mapped to the system time
+    /// in milliseconds at which the server confirmed them.
+    HashMap<String, unsigned> validated_;
+    /// Number of revalidations in the current batch that were up to date, refreshed and failed.
+    uint numNotModified_;
+    uint numRefreshed_;
+    uint numRevalidationsFailed_;
 };
 
 }
@@ -27,11 +27,16 @@ HttpAssetTransfer::HttpAssetTransfer(HttpAssetProvider *provider, HttpRequestPtr
        Once 304 response is detected, this will be changed to Cached. */
     diskSourceType = IAsset::Original; 
 
-    // Cache destination path and source for 'If-Modified-Since' for a '304 Not Modified' response.
-    if (provider_->Fw()->Asset()->Cache())
+    /* Cache destination path and source for 'If-Modified-Since' and 'If-None-Match' for a '304 Not Modified' response.
+       Large assets are streamed to a partial file so that an interrupted download can be resumed later. */
+    AssetCache *cache = provider_->Fw()->Asset()->Cache();
+    if (cache)
     {
-        String cacheFile = provider_->Fw()->Asset()->Cache()->DiskSourceByRef(source.ref);
+        String cacheFile = cache->DiskSourceByRef(source.ref);
         request->SetCacheFile(cacheFile, true);
+        if (!cache->FindInCache(source.ref).Empty())
+            request->SetCacheETag(cache->ETag(source.ref));
+        request->SetResumeFile(cache->PartialDiskSourceByRef(source.ref));
         /* Indicated so AssetAPI that we will take care of writing the cache, but it can find
            the source file from this path. */
         SetCachingBehavior(false, cacheFile);
@@ -45,14 +50,29 @@ HttpAssetTransfer::~HttpAssetTransfer()
 {
 }
 
+bool HttpAssetTransfer::CompleteFromCache()
+{
+    AssetCache *cache = provider_->Fw()->Asset()->Cache();
+    String cacheFile = (cache ? cache->FindInCache(source.ref) : "");
+    if (cacheFile.Empty() || !LoadFileToVector(cacheFile, rawAssetData))
+        return false;
+
+    // The request is never scheduled, release it.
+    request_.Reset();
+
+    diskSourceType = IAsset::Cached;
+    provider_->Fw()->Asset()->AssetTransferCompleted(this);
+    return true;
+}
+
 void HttpAssetTransfer::OnFinished(HttpRequestPtr &request, int status, const String &error)
 {
     // Clear out reference.
     request_.Reset();
 
-    // We can consider 200 and 304 as success. Other 3xx codes may represent redirects to the real location,
+    // We can consider 200, 206 (resumed download) and 304 as success. Other 3xx codes may represent redirects to the real location,
     // but these redirects are automatically detected and executed by HttpRequest.
-    if ((status == 200 || status == 304) && error.Empty())
+    if ((status == 200 || status == 206 || status == 304) && error.Empty())
     {
         /* 304 Not Modified
            1) HttpRequest has already written file to asset cache file set with HttpRequest::SetCacheFile()
@@ -61,12 +81,16 @@ void HttpAssetTransfer::OnFinished(HttpRequestPtr &request, int status, const St
            3) If we do not load 'rawAssetData' with a valid disk source. AssetAPI will do the right thing and load
               bytes from disk. This was desirable with Ogre as its threading mechanisms let us pass a filepath.
               If it was a certain type of Ogre asset, the disk read was skipped and path was used. With Urho it is more efficient 
-              to do a memcpy here and not re-read from disk, which is slower as we already have the file in memory here.
+              to take the bytes here and not re-read from disk, which is slower as we already have the file in memory here.
               @todo In other works for above: AssetAPI and its 'data shuffling' could be re-thinked with Urho. */
         if (status == 304)
             diskSourceType = IAsset::Cached;
+        // Remember the entity tag of the freshly written cache file for the next revalidation.
+        else if (provider_->Fw()->Asset()->Cache())
+            provider_->Fw()->Asset()->Cache()->SetETag(source.ref, request->ResponseHeader(Http::Header::ETag));
 
-        request->CopyResponseBodyTo(rawAssetData);
+        // Hand the response body over to the transfer without copying.
+        request->TakeResponseBody(rawAssetData);
 
         provider_->Fw()->Asset()->AssetTransferCompleted(this);
     }
@@ -21,6 +21,11 @@ public:
 
     HttpRequestPtr Request() const { return request_; }
 
+    /// Completes the transfer from the asset cache without executing the request.
+    /** Used by HttpAssetProvider when the cache entry has been revalidated with the server.
+        @return False if the asset could not be read from the cache, in which case the request should be executed. */
+    bool CompleteFromCache();
+
 private:
     void OnFinished(HttpRequestPtr &request, int status, const String &error);
 
@@ -11,6 +11,7 @@
 #include "LoggingFunctions.h"
 
 #include <Urho3D/UI/Text.h>
+#include <Urho3D/Core/StringUtils.h>
 
 #include <curl/curl.h>
 
@@ -22,7 +23,16 @@ HttpClient::HttpClient(Framework *framework) :
 {
     CURLcode err = curl_global_init(CURL_GLOBAL_DEFAULT);
     if (err == CURLE_OK)
+    {
         queue_ = new HttpWorkQueue();
+
+        StringVector maxPerHost = framework_->CommandLineParameters("--httpMaxConcurrencyPerHost");
+        if (!maxPerHost.Empty())
+            queue_->SetMaxConcurrencyPerHost(Urho3D::ToUInt(maxPerHost.Back()));
+        StringVector maxTotal = framework_->CommandLineParameters("--httpMaxConcurrency");
+        if (!maxTotal.Empty())
+            queue_->SetMaxConcurrency(Urho3D::ToUInt(maxTotal.Back()));
+    }
     else
         LogErrorF("[HttpClient] Failed to initialize curl: %s", curl_easy_strerror(err));
 }
@@ -93,6 +103,18 @@ HttpRequestPtr HttpClient::Delete(const String &url)
     return Schedule(Http::Method::Delete, url);
 }
 
+void HttpClient::SetMaxConcurrencyPerHost(uint maxRequests)
+{
+    if (queue_)
+        queue_->SetMaxConcurrencyPerHost(maxRequests);
+}
+
+void HttpClient::SetMaxConcurrency(uint maxRequests)
+{
+    if (queue_)
+        queue_->SetMaxConcurrency(maxRequests);
+}
+
 Http::Stats *HttpClient::Stats() const
 {
     return (queue_ ? queue_->stats_ : nullptr);
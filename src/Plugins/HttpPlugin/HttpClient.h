@@ -54,6 +54,14 @@ public:
     /** @see https://tools.ietf.org/html/rfc2616#section-9.7 */
     HttpRequestPtr Delete(const String &url);
 
+    /// Sets the maximum number of simultaneously executing requests per host. 0 means no limit.
+    /** Can also be set with the --httpMaxConcurrencyPerHost command line parameter. */
+    void SetMaxConcurrencyPerHost(uint maxRequests);
+
+    /// Sets the maximum number of simultaneously executing requests in total. 0 means no limit.
+    /** Can also be set with the --httpMaxConcurrency command line parameter. */
+    void SetMaxConcurrency(uint maxRequests);
+
     /// HTTP client stats.
     Http::Stats *Stats() const;
 
@@ -275,6 +275,7 @@ RequestData::RequestData() :
     msecDiskRead(-1),
     msecDiskWrite(-1),
     bodyWritePos(0),
+    resumeOffset(0),
     method(-1)
 {
 }
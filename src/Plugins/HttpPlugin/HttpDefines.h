@@ -150,6 +150,11 @@ namespace Http
         // File to read and write cache entry to
         String cacheFile;
 
+        // File to stream large response bodies to, so that an interrupted download can be resumed
+        String resumeFile;
+        // Number of body bytes already stored in resumeFile when the request was sent with a Range header
+        uint resumeOffset;
+
         // Error occurred during threaded run.
         String error;
 
@@ -33,6 +33,10 @@ void HttpPlugin::Load()
 void HttpPlugin::Initialize()
 {
     client_->Initialize();
+
+    // Revalidate the whole asset cache up front, assets are then loaded from the cache without further round trips.
+    if (framework->HasCommandLineParameter("--httpRevalidateCache"))
+        provider_->RevalidateCache();
 }
 
 void HttpPlugin::Uninitialize()
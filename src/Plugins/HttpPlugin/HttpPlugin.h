@@ -18,6 +18,9 @@ public:
     HttpPlugin(Framework* owner);
     ~HttpPlugin();
 
+    /// Returns the HTTP client used by the HTTP asset provider.
+    HttpClient *Client() const { return client_.Get(); }
+
 private:
     void Load() override;
     void Initialize() override;
@@ -47,7 +47,6 @@ namespace Tundra
         struct Stats;
     }
     class HttpWorkThread;
-    typedef Vector<HttpWorkThread*> HttpWorkThreadList;
     class HttpHudPanel;
     /// @endcond
 }
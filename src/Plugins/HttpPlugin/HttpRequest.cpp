@@ -19,11 +19,31 @@ namespace Tundra
 
 #define HTTP_INITIAL_BODY_SIZE (256*1024)
 
+/* Resume files start with a header that identifies the entity the partial body belongs to:
+   magic, validator length and the validator (ETag or Last-Modified) followed by the body bytes. */
+static const uint ResumeFileMagic = 0x54525054; // "TPRT"
+
+static bool ReadResumeHeader(Urho3D::File &file, String &validator, uint &dataOffset)
+{
+    if (!file.IsOpen() || file.GetSize() < 8 || file.ReadUInt() != ResumeFileMagic)
+        return false;
+    uint len = file.ReadUInt();
+    if (len == 0 || 8 + len > file.GetSize())
+        return false;
+    Vector<char> buffer(len);
+    if (file.Read(&buffer[0], len) != len)
+        return false;
+    validator = String(&buffer[0], len);
+    dataOffset = 8 + len;
+    return true;
+}
+
 // HttpRequest
 const Logger HttpRequest::log = Logger("HttpRequest");
 
 HttpRequest::HttpRequest(Framework* framework, int method, const String &url) :
     framework_(framework),
+    resumeMinBytes_(0),
     executing_(false),
     verbose_(false),
     completed_(false)
@@ -85,6 +105,15 @@ String HttpRequest::Url() const
     return "";
 }
 
+String HttpRequest::Host() const
+{
+    String url = Url();
+    uint start = url.Find("://");
+    start = (start != String::NPOS ? start + 3 : 0);
+    uint end = url.Find('/', start);
+    return url.Substring(start, end != String::NPOS ? end - start : String::NPOS).ToLower();
+}
+
 String HttpRequest::Error()
 {
     if (!HasCompleted())
@@ -252,6 +281,32 @@ bool HttpRequest::SetCacheFile(const String &filepath, const String &lastModifie
     return true;
 }
 
+bool HttpRequest::SetCacheETag(const String &eTag)
+{
+    Urho3D::MutexLock m(mutexExecute_);
+    if (executing_)
+    {
+        log.Error("SetCacheETag: Cannot set cache entity tag to a running request.");
+        return false;
+    }
+    if (!eTag.Empty())
+        SetHeaderInternal(Http::Header::IfNoneMatch, eTag, false, false); // Do not lock inside SetHeaderInternal, already aquired above.
+    return true;
+}
+
+bool HttpRequest::SetResumeFile(const String &filepath, uint minBytes)
+{
+    Urho3D::MutexLock m(mutexExecute_);
+    if (executing_)
+    {
+        log.Error("SetResumeFile: Cannot set resume file to a running request.");
+        return false;
+    }
+    requestData_.resumeFile = Urho3D::GetInternalPath(filepath);
+    resumeMinBytes_ = minBytes;
+    return true;
+}
+
 // Response API
 
 int HttpRequest::StatusCode()
@@ -316,6 +371,15 @@ bool HttpRequest::CopyResponseBodyTo(Vector<u8> &dest)
     return true; //(dest.Size() == responseData_.bodyBytes.Size());
 }
 
+bool HttpRequest::TakeResponseBody(Vector<u8> &dest)
+{
+    if (!HasCompleted())
+        return false;
+    dest.Clear();
+    dest.Swap(responseData_.bodyBytes);
+    return true;
+}
+
 Vector<u8> HttpRequest::CloneResponseBody()
 {
     if (!HasCompleted())
@@ -531,25 +595,23 @@ uint HttpRequest::HeaderUIntInternal(const String &name, uint defaultValue, bool
     return value;
 }
 
-void HttpRequest::Perform()
+void HttpRequest::Finish(CURLcode res)
 {
     // @note Invoked in worker thread context
+
+    // Anything received so far is in the resume file for the next attempt.
+    if (resumeStream_)
     {
-        Urho3D::MutexLock m(mutexExecute_);
-        executing_ = Prepare();
-        completed_ = !executing_;
+        resumeStream_->Close();
+        resumeStream_.Reset();
     }
-    if (!executing_)
-        return;
 
-    Urho3D::Timer timer;
-    CURLcode res = curl_easy_perform(requestData_.curlHandle);
     if (res != CURLE_OK)
     {
-        requestData_.error = curl_easy_strerror(res);
-        log.ErrorF("Failed to initialze request: %s", requestData_.error.CString());
+        if (requestData_.error.Empty())
+            requestData_.error = curl_easy_strerror(res);
+        log.ErrorF("Failed to execute request: %s", requestData_.error.CString());
     }
-    requestData_.msecNetwork = timer.GetMSec(false);
 
     /* Compact unused bytes from input buffers. bodyBytes should not have any free
        capacity if Content-Lenght header was provided by the server and correct. */
@@ -557,9 +619,12 @@ void HttpRequest::Perform()
     responseData_.bodyBytes.Compact();
 
     /// @todo Don't run if request was aborted. Does this error check suffice?
-    if (res == CURLE_OK)
+    if (res == CURLE_OK && requestData_.curlHandle)
     {
         // Read response information
+        double totalTime = 0.0;
+        if (curl_easy_getinfo(requestData_.curlHandle, CURLINFO_TOTAL_TIME, &totalTime) == CURLE_OK)
+            requestData_.msecNetwork = static_cast<int>(totalTime * 1000.0);
         if (curl_easy_getinfo(requestData_.curlHandle, CURLINFO_RESPONSE_CODE, &responseData_.status) != CURLE_OK)
             log.ErrorF("Failed to read response status code");
         if (curl_easy_getinfo(requestData_.curlHandle, CURLINFO_SPEED_DOWNLOAD, &responseData_.downloadBytesPerSec) != CURLE_OK)
@@ -570,11 +635,21 @@ void HttpRequest::Perform()
         // Parse headers if not done yet.
         ParseHeaders();
 
+        // Resumed download. Combine the previously received part with the rest of the body.
+        bool resumed = (responseData_.status == 206 && requestData_.resumeOffset > 0);
+        if (resumed && !ReadResumedBody())
+        {
+            requestData_.error = "Failed to combine resumed download with the previously received data";
+            log.ErrorF("%s for %s", requestData_.error.CString(), requestData_.options[Options::Url].value.GetString().CString());
+            responseData_.bodyBytes.Clear();
+            resumed = false;
+        }
+
         // Only perform this sanity check for 200 OK. As eg. Not Modified might not return the true bytes in header.
-        if (responseData_.status == 200)
+        if (responseData_.status == 200 || resumed)
         {
             uint contentLenght = HeaderUIntInternal(Http::Header::ContentLength, 0, true, false);
-            if (contentLenght > 0 && responseData_.bodyBytes.Size() != contentLenght)
+            if (!resumed && contentLenght > 0 && responseData_.bodyBytes.Size() != contentLenght)
                 log.WarningF("Content-Lenght %d header does not match size of %d read bytes for %s. Data might be incomplete.", contentLenght, responseData_.bodyBytes.Size(), requestData_.options[Options::Url].value.GetString().CString());
 
             // Write cache file if designated. File will be written regardless if server sent a 'Last-Modified' header.
@@ -622,9 +697,16 @@ void HttpRequest::Perform()
                 requestData_.msecDiskRead = t.GetMSec(false);
             }
         }
-    }
 
-    Cleanup();
+        /* The request has been answered, remove the resume file. Keep it on server errors
+           so that a retry of the same request can still continue from where it left off. */
+        if (!requestData_.resumeFile.Empty() && responseData_.status < 500)
+        {
+            Urho3D::FileSystem *fileSystem = framework_->GetSubsystem<Urho3D::FileSystem>();
+            if (fileSystem->FileExists(requestData_.resumeFile))
+                fileSystem->Delete(requestData_.resumeFile);
+        }
+    }
 
     {
         Urho3D::MutexLock m(mutexExecute_);
@@ -633,17 +715,20 @@ void HttpRequest::Perform()
     }
 }
 
-bool HttpRequest::Prepare()
+bool HttpRequest::Prepare(Curl::RequestHandle *handle)
 {
     // @note Invoked in worker thread context
 
-    /* @todo If we want to reuse the curl handle, its possible,
-       but not within the same HttpRequest. They would need to be pooled somewhere.
-       Research if this would make a perf difference. */
-    if (!requestData_.curlHandle)
-        requestData_.curlHandle = curl_easy_init();
+    {
+        Urho3D::MutexLock m(mutexExecute_);
+        executing_ = true;
+    }
+
+    // Easy handles are pooled by HttpWorkThread and reused across requests.
+    requestData_.curlHandle = handle;
     if (!requestData_.curlHandle)
         return false;
+    curl_easy_setopt(requestData_.curlHandle, CURLOPT_PRIVATE, this);
 
     if (verbose_)
     {
@@ -680,6 +765,14 @@ bool HttpRequest::Prepare()
     // Standard options
     curl_easy_setopt(requestData_.curlHandle, CURLOPT_TCP_KEEPALIVE, 1L);
     curl_easy_setopt(requestData_.curlHandle, CURLOPT_FOLLOWLOCATION, 1L);
+
+    // Prefer HTTP/2 over TLS and wait for an existing connection to multiplex on instead of opening a new one.
+#if LIBCURL_VERSION_NUM >= 0x072F00
+    curl_easy_setopt(requestData_.curlHandle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+#endif
+#if LIBCURL_VERSION_NUM >= 0x072B00
+    curl_easy_setopt(requestData_.curlHandle, CURLOPT_PIPEWAIT, 1L);
+#endif
   
     // Write custom options
     for(Curl::OptionMap::ConstIterator iter = requestData_.options.Begin(); iter != requestData_.options.End(); ++iter)
@@ -713,6 +806,23 @@ bool HttpRequest::Prepare()
             PrintRaw(Urho3D::ToString("  %s: %s\n", iter->first_.CString(), value.ToString().CString()));
     }
 
+    // Continue a previously interrupted download if the resume file holds a part of the body.
+    requestData_.resumeOffset = 0;
+    if (!requestData_.resumeFile.Empty() && framework_->GetSubsystem<Urho3D::FileSystem>()->FileExists(requestData_.resumeFile))
+    {
+        Urho3D::File file(framework_->GetContext(), requestData_.resumeFile, Urho3D::FILE_READ);
+        String validator;
+        uint dataOffset = 0;
+        if (ReadResumeHeader(file, validator, dataOffset) && file.GetSize() > dataOffset)
+        {
+            /* Set the range as a plain header instead of CURLOPT_RESUME_FROM_LARGE. Curl fails the transfer if
+               the server responds with a full body, which is exactly what If-Range asks for when the entity has changed. */
+            requestData_.resumeOffset = file.GetSize() - dataOffset;
+            SetHeaderInternal(Http::Header::Range, Urho3D::ToString("bytes=%u-", requestData_.resumeOffset), false, false);
+            SetHeaderInternal(Http::Header::IfRange, validator, false, false);
+        }
+    }
+
     // Write custom headers
     curl_slist *headers = requestData_.CreateCurlHeaders(verbose_);
     if (headers)
@@ -731,10 +841,22 @@ bool HttpRequest::Prepare()
     return true;
 }
 
-void HttpRequest::Cleanup()
+Curl::RequestHandle *HttpRequest::DetachHandle()
 {
     // @note Invoked in worker thread context
 
+    Curl::RequestHandle *handle = requestData_.curlHandle;
+    requestData_.curlHandle = 0;
+    if (requestData_.curlHeaders)
+    {
+        curl_slist_free_all(requestData_.curlHeaders);
+        requestData_.curlHeaders = 0;
+    }
+    return handle;
+}
+
+void HttpRequest::Cleanup()
+{
     if (requestData_.curlHandle)
     {
         curl_easy_cleanup(requestData_.curlHandle);
@@ -926,13 +1048,98 @@ size_t HttpRequest::ReadBody(void *buffer, uint size)
 
         // Headers have been parsed. Reserve bodyBytes_ to "Content-Length" size.
         responseData_.bodyBytes.Reserve(HeaderUIntInternal(Http::Header::ContentLength, HTTP_INITIAL_BODY_SIZE, true, false));
+
+        OpenResumeStream();
     }
 
-    Vector<u8> data(static_cast<u8*>(buffer), size);
-    responseData_.bodyBytes.Push(data);
+    // Append in place, avoids constructing a temporary vector for each received chunk.
+    uint offset = responseData_.bodyBytes.Size();
+    responseData_.bodyBytes.Resize(offset + size);
+    memcpy(&responseData_.bodyBytes[offset], buffer, size);
+
+    // Keep the received bytes on disk in case the transfer gets interrupted.
+    if (resumeStream_ && resumeStream_->Write(buffer, size) != size)
+    {
+        log.WarningF("Failed to write resume file %s", requestData_.resumeFile.CString());
+        resumeStream_->Close();
+        resumeStream_.Reset();
+    }
     return size;
 }
 
+void HttpRequest::OpenResumeStream()
+{
+    // @note Invoked in worker thread context
+
+    if (requestData_.resumeFile.Empty())
+        return;
+
+    long status = 0;
+    curl_easy_getinfo(requestData_.curlHandle, CURLINFO_RESPONSE_CODE, &status);
+    if (status == 206 && requestData_.resumeOffset > 0)
+    {
+        // Continue appending to the previously received part.
+        resumeStream_ = new Urho3D::File(framework_->GetContext(), requestData_.resumeFile, Urho3D::FILE_READWRITE);
+        if (resumeStream_->IsOpen())
+            resumeStream_->Seek(resumeStream_->GetSize());
+        else
+            resumeStream_.Reset();
+        return;
+    }
+    if (status != 200)
+        return;
+
+    // Full body is being sent. Any previously received part is stale.
+    requestData_.resumeOffset = 0;
+
+    // If-Range requires a strong entity tag, fall back to the modification date.
+    String validator = HeaderInternal(Http::Header::ETag, true, false);
+    if (validator.Empty() || validator.StartsWith("W/"))
+        validator = HeaderInternal(Http::Header::LastModified, true, false);
+    uint contentLength = HeaderUIntInternal(Http::Header::ContentLength, 0, true, false);
+    if (validator.Empty() || contentLength < resumeMinBytes_)
+    {
+        Urho3D::FileSystem *fileSystem = framework_->GetSubsystem<Urho3D::FileSystem>();
+        if (fileSystem->FileExists(requestData_.resumeFile))
+            fileSystem->Delete(requestData_.resumeFile);
+        return;
+    }
+
+    resumeStream_ = new Urho3D::File(framework_->GetContext(), requestData_.resumeFile, Urho3D::FILE_WRITE);
+    if (!resumeStream_->IsOpen() || !resumeStream_->WriteUInt(ResumeFileMagic) || !resumeStream_->WriteUInt(validator.Length()) ||
+        resumeStream_->Write(validator.CString(), validator.Length()) != validator.Length())
+    {
+        log.WarningF("Failed to open resume file %s", requestData_.resumeFile.CString());
+        resumeStream_.Reset();
+    }
+}
+
+bool HttpRequest::ReadResumedBody()
+{
+    // @note Invoked in worker thread context
+
+    // Verify that the server continued from where we left off.
+    String contentRange = HeaderInternal(Http::Header::ContentRange, true, false);
+    if (!contentRange.StartsWith(Urho3D::ToString("bytes %u-", requestData_.resumeOffset)))
+        return false;
+
+    Urho3D::File file(framework_->GetContext(), requestData_.resumeFile, Urho3D::FILE_READ);
+    String validator;
+    uint dataOffset = 0;
+    if (!ReadResumeHeader(file, validator, dataOffset) || file.GetSize() < dataOffset + requestData_.resumeOffset)
+        return false;
+
+    // Read the previously received part and append the rest received in memory.
+    uint received = responseData_.bodyBytes.Size();
+    Vector<u8> body(requestData_.resumeOffset + received);
+    if (file.Read(&body[0], requestData_.resumeOffset) != requestData_.resumeOffset)
+        return false;
+    if (received > 0)
+        memcpy(&body[requestData_.resumeOffset], &responseData_.bodyBytes[0], received);
+    responseData_.bodyBytes.Swap(body);
+    return true;
+}
+
 bool HttpRequest::ParseHeaders()
 {
     if (responseData_.headersParsed || responseData_.headersBytes.Empty())
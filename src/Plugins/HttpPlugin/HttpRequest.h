@@ -12,6 +12,7 @@
 #include <Urho3D/Container/Str.h>
 #include <Urho3D/Container/HashMap.h>
 #include <Urho3D/Container/RefCounted.h>
+#include <Urho3D/IO/File.h>
 
 #include "HttpCurlInterop.h"
 
@@ -64,6 +65,9 @@ public:
     /// Returns the requests target URL.
     String Url() const;
 
+    /// Returns the host (and port, if specified) part of the target URL in lower case.
+    String Host() const;
+
     /// Return error string.
     /** Empty string if no errors and request completed succesfully
         or if request has not completed yet.
@@ -116,6 +120,18 @@ public:
     /** @param 'If-Modified-Since' header will be written to the provided @c lastModifiedHttpDate if non empty string. */
     bool SetCacheFile(const String &filepath, const String &lastModifiedHttpDate);
 
+    /// Sets the 'If-None-Match' header from a previously stored entity tag of the cache file.
+    /** Use together with SetCacheFile. If the server responds with '304 Not Modified' the cache file is used as
+        the response body. The entity tag of a fresh '200 OK' response can be read from the ETag response header. */
+    bool SetCacheETag(const String &eTag);
+
+    /// Sets the @c filepath where large response bodies are streamed to while downloading.
+    /** If the request fails mid-transfer the received bytes are left in the file. The next request with
+        the same resume file continues the download with a 'Range' request, validated with 'If-Range' against
+        the ETag or Last-Modified of the original response. Once the request completes the file is removed
+        and the full body is available as the response body. Only bodies of at least @c minBytes are streamed. */
+    bool SetResumeFile(const String &filepath, uint minBytes = 1024*1024);
+
     ///////////////////////// RESPONSE API
 
     /// Returns status code eg, 200 if request has completed successfully, otherwise -1.
@@ -151,6 +167,12 @@ public:
         @return False if request has not completed or response body is empty. */
     bool CopyResponseBodyTo(Vector<u8> &dest);
 
+    /// Moves the response body to @c dest without copying if request has completed.
+    /** After this the request's own response body is empty. Use this when handing
+        the data off to its final owner, eg. IAssetTransfer::rawAssetData.
+        @return False if request has not completed. */
+    bool TakeResponseBody(Vector<u8> &dest);
+
     /// Returns a copy/clone of the response body if request has completed.
     /** This function should be avoided for large body sizes. @see ResponseBody(). */
     Vector<u8> CloneResponseBody();
@@ -194,15 +216,22 @@ private:
     int HeaderIntInternal(const String &name, int defaultValue, bool respose, bool lock = true);
     uint HeaderUIntInternal(const String &name, uint defaultValue, bool respose, bool lock = true);
 
-    /// Called by HttpWorkThread in worker thread context.
-    void Perform();
-    /// Invoked in worker thread context.
-    bool Prepare();
-    /// Invoked in worker thread context.
+    /// Called by HttpWorkThread in worker thread context before the request is added to the multi handle.
+    bool Prepare(Curl::RequestHandle *handle);
+    /// Called by HttpWorkThread in worker thread context once the transfer has finished with @c res.
+    void Finish(CURLcode res);
+    /// Called by HttpWorkThread in worker thread context. Returns the easy handle for reuse and frees the request headers.
+    Curl::RequestHandle *DetachHandle();
+    /// Frees any curl resources still owned by the request.
     void Cleanup();
 
     /// Parse headers from response raw bytes.
     bool ParseHeaders();
+
+    /// Called by ReadBody once the response headers are known. Opens the resume file for streaming, if applicable.
+    void OpenResumeStream();
+    /// Called by Finish for a '206 Partial Content' response. Replaces the response body with the complete resumed body.
+    bool ReadResumedBody();
     
     /// Called by HttpWorkQueue in main thread context.
     void EmitCompletion(HttpRequestPtr &self);
@@ -231,6 +260,13 @@ private:
     Http::RequestData requestData_;
     Http::ResponseData responseData_;
 
+    // Open resume file while the response body is streamed to it.
+    SharedPtr<Urho3D::File> resumeStream_;
+    uint resumeMinBytes_;
+
+    // Host of the target URL, set by HttpWorkQueue when the request is queued for the worker thread.
+    String host_;
+
     Urho3D::Mutex mutexExecute_;
     bool executing_;
     bool completed_;
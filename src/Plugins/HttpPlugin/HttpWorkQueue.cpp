@@ -10,28 +10,31 @@
 #include <Urho3D/Core/ProcessUtils.h>
 #include <Urho3D/Core/StringUtils.h>
 
+#include <curl/curl.h>
+
 namespace Tundra
 {
 
 // HttpWorkQueue
 
 const float DurationKeepAliveThreads = 10.f;
+const uint DefaultMaxConcurrencyPerHost = 16;
+const uint DefaultMaxConcurrency = 64;
 const Logger HttpWorkQueue::log = Logger("HttpRequest");
 
 HttpWorkQueue::HttpWorkQueue() :
     durationNoWork_(0.f),
+    thread_(nullptr),
+    maxConcurrencyPerHost_(DefaultMaxConcurrencyPerHost),
+    maxConcurrency_(DefaultMaxConcurrency),
     stats_(new Http::Stats())
 {
-    numMaxThreads_ = Urho3D::GetNumLogicalCPUs();
-    if (numMaxThreads_ < 1) numMaxThreads_ = 1;         // Need at least one worker
-    else if (numMaxThreads_ > 32) numMaxThreads_ = 32;  // Cap to something sensible
-    log.DebugF("Maximum number of threads %d detected from %d physical and %d logical CPUs", numMaxThreads_, Urho3D::GetNumPhysicalCPUs(), Urho3D::GetNumLogicalCPUs());
 }
 
 HttpWorkQueue::~HttpWorkQueue()
 {
-    // Stop all threads first. They hold raw ptrs to our queues.
-    StopThreads();
+    // Stop the thread first. It holds raw ptrs to our queues.
+    StopThread();
     {
         Urho3D::MutexLock m(mutexRequests_);
         created_.Clear();
@@ -41,6 +44,7 @@ HttpWorkQueue::~HttpWorkQueue()
         Urho3D::MutexLock m(mutexCompleted_);
         completed_.Clear();
         executing_.Clear();
+        numExecutingPerHost_.Clear();
     }
     SAFE_DELETE(stats_);
 }
@@ -60,6 +64,18 @@ uint HttpWorkQueue::NumPending()
     return num;
 }
 
+void HttpWorkQueue::SetMaxConcurrencyPerHost(uint maxRequests)
+{
+    Urho3D::MutexLock m(mutexRequests_);
+    maxConcurrencyPerHost_ = maxRequests;
+}
+
+void HttpWorkQueue::SetMaxConcurrency(uint maxRequests)
+{
+    Urho3D::MutexLock m(mutexRequests_);
+    maxConcurrency_ = maxRequests;
+}
+
 void HttpWorkQueue::Update(float frametime)
 {
     // Signal completion/failure
@@ -79,12 +95,17 @@ void HttpWorkQueue::Update(float frametime)
        This is done so that main thread can prepare the created request
        witin the creation frame update without threading conflicts. */
     uint numPending = 0;
+    bool newWork = false;
     {
         Urho3D::MutexLock m2(mutexRequests_);
         if (created_.Size() > 0)
         {
+            // The URL can no longer change, parse the host once for the concurrency limits of the worker thread.
+            for (auto iter = created_.Begin(); iter != created_.End(); ++iter)
+                (*iter)->host_ = (*iter)->Host();
             requests_.Insert(requests_.End(), created_.Begin(), created_.End());
             created_.Clear();
+            newWork = true;
         }
         numPending = requests_.Size();
     }
@@ -94,79 +115,78 @@ void HttpWorkQueue::Update(float frametime)
 
     if (numPending + numExecuting == 0)
     {
-        /* Don't stop workers immediately. Wait for some time
+        /* Don't stop the worker immediately. Wait for some time
            if new work will come in. Spinning up threads is not free. */
         durationNoWork_ += frametime;
-        if (durationNoWork_ > DurationKeepAliveThreads && threads_.Size() > 0)
-            StopThreads();
-        stats_->current.idle = (threads_.Size() > 0 ? durationNoWork_ : -1.f);
+        if (durationNoWork_ > DurationKeepAliveThreads && thread_)
+            StopThread();
+        stats_->current.idle = (thread_ ? durationNoWork_ : -1.f);
         return;
     }
     durationNoWork_ = 0.f;
 
-    // Start new threads
-    if (threads_.Size() < numPending)
-        StartThreads(numPending);
+    if (!thread_)
+        StartThread();
+    else if (newWork)
+        thread_->Wakeup();
 
     stats_->current.idle = -1.f;
-    stats_->current.threads = threads_.Size();
+    stats_->current.threads = (thread_ ? 1 : 0);
 }
 
-void HttpWorkQueue::StartThreads(uint max)
+void HttpWorkQueue::StartThread()
 {
-    if (max > numMaxThreads_)
-        max = numMaxThreads_;
-    if (threads_.Size() >= max)
+    if (thread_)
         return;
 
-    while(threads_.Size() < max)
+    HttpWorkThread *thread = new HttpWorkThread(this);
+    if (thread->Run())
+        thread_ = thread;
+    else
     {
-        HttpWorkThread *thread = new HttpWorkThread(this);
-        if (thread->Run())
-            threads_.Push(thread);
-        else
-        {
-            log.Error("Failed to start worker thread.");
-            delete thread;
-            break;
-        }
+        log.Error("Failed to start worker thread.");
+        delete thread;
     }
 }
 
-void HttpWorkQueue::StopThreads()
+void HttpWorkQueue::StopThread()
 {
-    while(threads_.Size() > 0)
+    if (thread_)
     {
-        HttpWorkThread *thread = threads_.Back();
-        threads_.Pop();
-
-        log.DebugF("Stopping thread %d", threads_.Size()+1);
-        thread->Stop();
-        delete thread;
+        log.Debug("Stopping thread");
+        thread_->Wakeup();
+        thread_->Stop();
+        SAFE_DELETE(thread_);
     }
-    stats_->current.threads = threads_.Size();
+    stats_->current.threads = 0;
 }
 
-HttpRequest* HttpWorkQueue::Next()
+void HttpWorkQueue::Next(Vector<HttpRequest*> &dest)
 {
-    mutexRequests_.Acquire();
-    if (requests_.Size() > 0)
+    Urho3D::MutexLock m(mutexRequests_);
+    if (requests_.Empty())
+        return;
+
+    Urho3D::MutexLock m2(mutexCompleted_);
+
+    for (auto iter = requests_.Begin(); iter != requests_.End();)
     {
-        // Remove from pending
-        HttpRequestPtrList::Iterator iter = requests_.Begin();
-        HttpRequestPtr next = *iter;
-        requests_.Erase(iter);
-        mutexRequests_.Release();
+        if (maxConcurrency_ > 0 && executing_.Size() >= maxConcurrency_)
+            break;
 
-        // Add to executing
+        uint &numHost = numExecutingPerHost_[(*iter)->host_];
+        if (maxConcurrencyPerHost_ > 0 && numHost >= maxConcurrencyPerHost_)
         {
-            Urho3D::MutexLock m(mutexCompleted_);
-            executing_.Push(next);
+            ++iter;
+            continue;
         }
-        return next;
+        ++numHost;
+
+        // Move from pending to executing
+        executing_.Push(*iter);
+        dest.Push(iter->Get());
+        iter = requests_.Erase(iter);
     }
-    mutexRequests_.Release();
-    return nullptr;
 }
 
 HttpRequestPtrList::Iterator HttpWorkQueue::FindExecuting(HttpRequest *request)
@@ -190,6 +210,10 @@ void HttpWorkQueue::Completed(HttpRequest *request)
         HttpRequestPtr doneShared = *done;
         completed_.Push(doneShared);
         executing_.Erase(done);
+
+        auto numHost = numExecutingPerHost_.Find(request->host_);
+        if (numHost != numExecutingPerHost_.End() && --numHost->second_ == 0)
+            numExecutingPerHost_.Erase(numHost);
     }
     else
         log.ErrorF("Failed to remove completed request from executing list: %s", request->Url().CString());
@@ -197,25 +221,141 @@ void HttpWorkQueue::Completed(HttpRequest *request)
 
 // HttpWorkThread
 
+/// Maximum time to block waiting for network activity, in milliseconds.
+const int WaitTimeoutMSec = 100;
+
 HttpWorkThread::HttpWorkThread(HttpWorkQueue *queue) :
-    queue_(queue)
+    queue_(queue),
+    multiHandle_(curl_multi_init())
 {
+    if (multiHandle_)
+    {
+        /* The multi handle keeps a connection and DNS cache that is shared by all
+           requests executed on it. Allow multiplexing HTTP/2 streams on these connections. */
+#if LIBCURL_VERSION_NUM >= 0x072B00
+        curl_multi_setopt(multiHandle_, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
+    }
+}
+
+HttpWorkThread::~HttpWorkThread()
+{
+    // Thread has been stopped. Clean up any requests that were left executing.
+    while(!active_.Empty())
+        Detach(active_.Back());
+    foreach(Curl::RequestHandle *handle, handlePool_)
+        curl_easy_cleanup(handle);
+    handlePool_.Clear();
+    if (multiHandle_)
+        curl_multi_cleanup(multiHandle_);
+}
+
+void HttpWorkThread::Wakeup()
+{
+#if LIBCURL_VERSION_NUM >= 0x074400
+    if (multiHandle_)
+        curl_multi_wakeup(multiHandle_);
+#endif
+}
+
+Curl::RequestHandle *HttpWorkThread::AcquireHandle()
+{
+    if (!handlePool_.Empty())
+    {
+        Curl::RequestHandle *handle = handlePool_.Back();
+        handlePool_.Pop();
+        return handle;
+    }
+    return curl_easy_init();
+}
+
+void HttpWorkThread::ReleaseHandle(Curl::RequestHandle *handle)
+{
+    if (!handle)
+        return;
+    // Reset options but keep the handle and its session caches alive for the next request.
+    curl_easy_reset(handle);
+    handlePool_.Push(handle);
+}
+
+void HttpWorkThread::Detach(HttpRequest *request)
+{
+    active_.Remove(request);
+    Curl::RequestHandle *handle = request->DetachHandle();
+    if (handle)
+    {
+        curl_multi_remove_handle(multiHandle_, handle);
+        ReleaseHandle(handle);
+    }
 }
 
 void HttpWorkThread::ThreadFunction()
 {
     LogDebug("[HttpWorkThread] Starting " + String(GetCurrentThreadID()));
 
+    if (!multiHandle_)
+    {
+        LogError("[HttpWorkThread] Failed to initialize curl multi handle");
+        return;
+    }
+
+    Vector<HttpRequest*> started;
     while(shouldRun_)
     {
-        HttpRequest  *request = queue_->Next();
-        if (request)
+        // Start new requests that fit into the concurrency limits
+        started.Clear();
+        queue_->Next(started);
+        foreach(HttpRequest *request, started)
+        {
+            Curl::RequestHandle *handle = AcquireHandle();
+            if (handle && request->Prepare(handle))
+            {
+                curl_multi_add_handle(multiHandle_, handle);
+                active_.Push(request);
+            }
+            else
+            {
+                // Failed to prepare, the request carries the error.
+                Curl::RequestHandle *detached = request->DetachHandle();
+                ReleaseHandle(detached ? detached : handle);
+                request->Finish(CURLE_FAILED_INIT);
+                queue_->Completed(request);
+            }
+        }
+
+        // Drive all transfers
+        int numRunning = 0;
+        CURLMcode mres = curl_multi_perform(multiHandle_, &numRunning);
+        if (mres != CURLM_OK)
+            LogErrorF("[HttpWorkThread] curl_multi_perform failed: %s", curl_multi_strerror(mres));
+
+        // Finish completed transfers
+        int numMessages = 0;
+        while(CURLMsg *msg = curl_multi_info_read(multiHandle_, &numMessages))
         {
-            request->Perform();
+            if (msg->msg != CURLMSG_DONE)
+                continue;
+
+            HttpRequest *request = nullptr;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &request);
+            if (!request)
+                continue;
+
+            CURLcode result = msg->data.result;
+            request->Finish(result);
+            Detach(request);
             queue_->Completed(request);
         }
-        else
+
+        // Wait for network activity or new work. Polling can only be woken up for new work since curl 7.68.
+#if LIBCURL_VERSION_NUM >= 0x074400
+        curl_multi_poll(multiHandle_, NULL, 0, WaitTimeoutMSec, NULL);
+#else
+        if (active_.Empty())
             Urho3D::Time::Sleep(16);
+        else
+            curl_multi_wait(multiHandle_, NULL, 0, WaitTimeoutMSec, NULL);
+#endif
     }
 
     LogDebug("[HttpWorkThread] Stopping " + String(GetCurrentThreadID()));
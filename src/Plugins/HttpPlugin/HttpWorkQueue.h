@@ -16,6 +16,9 @@ namespace Tundra
 {
 
 /// HttpWorkQueue request
+/** Requests are executed by a single I/O thread that drives all transfers with a curl multi handle.
+    Connections and DNS lookups are cached by the multi handle and reused across requests, and HTTP/2
+    streams to the same host are multiplexed over a single connection when the server supports it. */
 class HttpWorkQueue : public Urho3D::RefCounted
 {
     /// @cond PRIVATE
@@ -32,27 +35,39 @@ public:
 
     uint NumPending();
 
+    /// Sets the maximum number of simultaneously executing requests per host. 0 means no limit.
+    void SetMaxConcurrencyPerHost(uint maxRequests);
+
+    /// Sets the maximum number of simultaneously executing requests in total. 0 means no limit.
+    void SetMaxConcurrency(uint maxRequests);
+
 private:
     /// @note You have to ensure mutexCompleted_ is locked prior to calling this function.
     HttpRequestPtrList::Iterator FindExecuting(HttpRequest *request);
 
-    void StartThreads(uint max);
-    void StopThreads();
+    void StartThread();
+    void StopThread();
 
     /// Called by HttpClient
     void Update(float frametime);
 
     /// Called by HttpWorkThread
-    HttpRequest *Next();
+    /** Moves the waiting requests that fit into the concurrency limits to the executing list and appends them to @c dest. */
+    void Next(Vector<HttpRequest*> &dest);
     void Completed(HttpRequest *request);
 
     float durationNoWork_;
-    uint numMaxThreads_;
-    HttpWorkThreadList threads_;
+    HttpWorkThread *thread_;
 
     Urho3D::Mutex mutexRequests_;
     Urho3D::Mutex mutexCompleted_;
 
+    /// Concurrency limits.
+    /** Accessed from multiple thread,
+        protected by mutexRequests_. */
+    uint maxConcurrencyPerHost_;
+    uint maxConcurrency_;
+
     /// Waiting requests.
     /** Accessed from multiple thread,
         protected by mutexRequests_. */
@@ -66,6 +81,11 @@ private:
     /// Currently executing requests.
     HttpRequestPtrList executing_;
 
+    /// Number of executing requests per host.
+    /** Accessed from multiple thread,
+        protected by mutexCompleted_. */
+    HashMap<String, uint> numExecutingPerHost_;
+
     /** Newly created requests that will be moved
         to requests_ in the next frame update.
         This protects worker threads from starting
@@ -85,12 +105,27 @@ class HttpWorkThread : public Urho3D::Thread
 {
 public:
     HttpWorkThread(HttpWorkQueue *queue);
+    ~HttpWorkThread();
 
     /// Urho3D::Thread
     void ThreadFunction() override;
 
+    /// Wakes up the thread if it is waiting for network activity. Can be called from any thread.
+    void Wakeup();
+
 private:
+    /// Returns a pooled easy handle, or a new one if the pool is empty.
+    Curl::RequestHandle *AcquireHandle();
+    /// Resets and returns @c handle to the pool.
+    void ReleaseHandle(Curl::RequestHandle *handle);
+
+    /// Detaches @c request from the multi handle and returns its easy handle to the pool.
+    void Detach(HttpRequest *request);
+
     HttpWorkQueue *queue_;
+    Curl::EngineHandle *multiHandle_;
+    Vector<Curl::RequestHandle*> handlePool_;
+    Vector<HttpRequest*> active_;
 };
 
 /// @endcond
@@ -298,6 +298,11 @@ namespace BindingsGenerator
                     if (typeName == "float3Vector")
                         typeName = "Vector<float3>";
 
+                    if (typeName == "floatVector")
+                        return "Vector<float> " + varName + " = GetFloatVector(ctx, " + stackIndex + ");";
+                    if (typeName == "intVector")
+                        return "Vector<int> " + varName + " = GetIntVector(ctx, " + stackIndex + ");";
+
                     if (templateType == "String" || templateType == "string")
                         return typeName + " " + varName + " = GetStringVector(ctx, " + stackIndex + ");";
                     else
@@ -400,6 +405,10 @@ namespace BindingsGenerator
 
                 if (templateType == "String" || templateType == "string")
                     return "PushStringVector(ctx, " + source + ");";
+                else if (templateType == "float")
+                    return "PushFloatVector(ctx, " + source + ");";
+                else if (templateType == "int")
+                    return "PushIntVector(ctx, " + source + ");";
                 else
                 {
                     /// \todo This needs the id & finalizer, mark dependencies
@@ -1394,7 +1403,7 @@ namespace BindingsGenerator
             if (t.EndsWith("Vector"))
             {
                 string templateType = t.Substring(0, t.Length - 6);
-                if (templateType == "String")
+                if (templateType == "String" || templateType == "float" || templateType == "int")
                     return true;
                 templateType = SanitateTemplateType(templateType);
                 return classNames.Contains(templateType) || dependencyNames.Contains(templateType);
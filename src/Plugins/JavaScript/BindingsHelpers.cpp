@@ -369,6 +369,77 @@ void PushStringVector(duk_context* ctx, const Vector<String>& vector)
     }
 }
 
+/// Return whether the value at stack index is an instance of the global typed array constructor @c typeName
+static bool IsTypedArray(duk_context* ctx, duk_idx_t stackIndex, const char* typeName)
+{
+    if (!duk_is_object(ctx, stackIndex))
+        return false;
+    stackIndex = duk_normalize_index(ctx, stackIndex);
+    duk_get_global_string(ctx, typeName);
+    bool ret = duk_is_function(ctx, -1) && duk_instanceof(ctx, stackIndex, -1);
+    duk_pop(ctx);
+    return ret;
+}
+
+template<class T> static Vector<T> GetNumberVector(duk_context* ctx, duk_idx_t stackIndex, const char* typedArrayName)
+{
+    Vector<T> ret;
+
+    if (IsTypedArray(ctx, stackIndex, typedArrayName))
+    {
+        duk_size_t size = 0;
+        void* data = duk_get_buffer_data(ctx, stackIndex, &size);
+        if (data && size >= sizeof(T))
+        {
+            ret.Resize((unsigned)(size / sizeof(T)));
+            memcpy(&ret[0], data, ret.Size() * sizeof(T));
+        }
+    }
+    else if (duk_is_object(ctx, stackIndex))
+    {
+        duk_size_t len = duk_get_length(ctx, stackIndex);
+        ret.Reserve((unsigned)len);
+        for (duk_size_t i = 0; i < len; ++i)
+        {
+            duk_get_prop_index(ctx, stackIndex, i);
+            ret.Push((T)duk_to_number(ctx, -1));
+            duk_pop(ctx);
+        }
+    }
+
+    return ret;
+}
+
+template<class T> static void PushNumberVector(duk_context* ctx, const Vector<T>& vector, duk_uint_t bufferObjectType)
+{
+    duk_size_t size = vector.Size() * sizeof(T);
+    void* data = duk_push_fixed_buffer(ctx, size);
+    if (size)
+        memcpy(data, &vector[0], size);
+    duk_push_buffer_object(ctx, -1, 0, size, bufferObjectType);
+    duk_remove(ctx, -2);
+}
+
+Vector<float> GetFloatVector(duk_context* ctx, duk_idx_t stackIndex)
+{
+    return GetNumberVector<float>(ctx, stackIndex, "Float32Array");
+}
+
+void PushFloatVector(duk_context* ctx, const Vector<float>& vector)
+{
+    PushNumberVector(ctx, vector, DUK_BUFOBJ_FLOAT32ARRAY);
+}
+
+Vector<int> GetIntVector(duk_context* ctx, duk_idx_t stackIndex)
+{
+    return GetNumberVector<int>(ctx, stackIndex, "Int32Array");
+}
+
+void PushIntVector(duk_context* ctx, const Vector<int>& vector)
+{
+    PushNumberVector(ctx, vector, DUK_BUFOBJ_INT32ARRAY);
+}
+
 void PushVariant(duk_context* ctx, const Variant& variant)
 {
     switch (variant.GetType())
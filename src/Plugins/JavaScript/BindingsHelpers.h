@@ -43,6 +43,18 @@ JAVASCRIPT_API Tundra::Vector<Tundra::String> GetStringVector(duk_context* ctx,
 /// Push a string vector to JS array.
 JAVASCRIPT_API void PushStringVector(duk_context* ctx, const Tundra::Vector<Tundra::String>& vector);
 
+/// Get a float vector from a JS array or typed array. Float32Arrays are copied directly.
+JAVASCRIPT_API Tundra::Vector<float> GetFloatVector(duk_context* ctx, duk_idx_t stackIndex);
+
+/// Push a float vector to a JS Float32Array.
+JAVASCRIPT_API void PushFloatVector(duk_context* ctx, const Tundra::Vector<float>& vector);
+
+/// Get an int vector from a JS array or typed array. Int32Arrays are copied directly.
+JAVASCRIPT_API Tundra::Vector<int> GetIntVector(duk_context* ctx, duk_idx_t stackIndex);
+
+/// Push an int vector to a JS Int32Array.
+JAVASCRIPT_API void PushIntVector(duk_context* ctx, const Tundra::Vector<int>& vector);
+
 /// Convert and push a variant.
 JAVASCRIPT_API void PushVariant(duk_context* ctx, const Tundra::Variant& variant);
 
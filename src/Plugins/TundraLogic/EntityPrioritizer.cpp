@@ -29,16 +29,31 @@ void DefaultEntityPrioritizer::ComputeSyncPriorities(EntitySyncStateMap &entitie
     if (!scn)
         return;
 
+    // Look up the entities first, to query the world transforms of all the placeables in one batch.
+    PODVector<Entity*> syncedEntities;
+    PODVector<Placeable*> placeables;
+    syncedEntities.Reserve(entities.size());
+    placeables.Reserve(entities.size());
     for(EntitySyncStateMap::iterator it = entities.begin(); it != entities.end(); ++it)
+    {
+        Entity *entity = scn->EntityById(it->second.id).Get(); /**< @todo Use EntityWeakPtr in EntitySyncState when available */
+        syncedEntities.Push(entity);
+        placeables.Push(entity ? entity->Component<Placeable>().Get() : 0);
+    }
+    PODVector<float3x4> worldTransforms;
+    Placeable::WorldTransforms(placeables, worldTransforms);
+
+    uint index = 0;
+    for(EntitySyncStateMap::iterator it = entities.begin(); it != entities.end(); ++it, ++index)
     {
         EntitySyncState &entityState = it->second;
-        Entity *entity = scn->EntityById(entityState.id).Get(); /**< @todo Use EntityWeakPtr in EntitySyncState when available */
+        Entity *entity = syncedEntities[index];
         if (!entity)
             continue; // we (might) end up here e.g. when entity was just deleted
 
         /// @todo Check do we end up computing sync prio for local entities
 
-        SharedPtr<Placeable> placeable = entity->Component<Placeable>();
+        Placeable *placeable = placeables[index];
         SharedPtr<Mesh> mesh = entity->Component<Mesh>();
         SharedPtr<RigidBody> rigidBody = entity->Component<RigidBody>();
 
@@ -96,13 +111,13 @@ void DefaultEntityPrioritizer::ComputeSyncPriorities(EntitySyncStateMap &entitie
                 if (!model)
                     LogWarning("SyncManager::ComputeSyncPriorities: " + entity->ToString() + " has null Ogre mesh " + mesh->MeshName());
                 worldObb = model ? AABB(model->GetBoundingBox()) : OBB();
-                worldObb.Transform(placeable->LocalToWorld());
+                worldObb.Transform(worldTransforms[index]);
             }
             else
                 worldObb = mesh->WorldOBB();
             float sizeSq = worldObb.SurfaceArea();
             sizeSq *= sizeSq;
-            float distanceSq = observerPos.DistanceSq(placeable->WorldPosition());
+            float distanceSq = observerPos.DistanceSq(worldTransforms[index].TranslatePart());
             entityState.priority = sizeSq/distanceSq;
             //LogDebug(QString("%1 sizeSq %2 distanceSq %3").arg(entity->ToString()).arg(sizeSq).arg(distanceSq));
         }
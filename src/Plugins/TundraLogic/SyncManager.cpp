@@ -21,6 +21,7 @@
 #include "LoggingFunctions.h"
 #include "Placeable.h"
 #include "RigidBody.h"
+#include "PhysicsWorld.h"
 
 #include <kNet.h>
 
@@ -342,6 +343,10 @@ void SyncManager::RegisterToScene(ScenePtr scene)
         previous->EntityTemporaryStateToggled.Disconnect(this, &SyncManager::OnEntityPropertiesChanged);
         previous->EntityParentChanged.Disconnect(this, &SyncManager::OnEntityParentChanged);
     }
+    PhysicsWorldPtr previousPhysics = physicsWorld_.Lock();
+    if (previousPhysics)
+        previousPhysics->TransformsUpdated.Disconnect(this, &SyncManager::OnPhysicsTransformsUpdated);
+    physicsWorld_.Reset();
     
     serverConnection_->syncState->Clear();
     serverConnection_->syncState->SetParentScene(SceneWeakPtr(scene));
@@ -366,6 +371,10 @@ void SyncManager::RegisterToScene(ScenePtr scene)
     sceneptr->ActionTriggered.Connect(this, &SyncManager::OnActionTriggered);
     sceneptr->EntityTemporaryStateToggled.Connect(this, &SyncManager::OnEntityPropertiesChanged);
     sceneptr->EntityParentChanged.Connect(this, &SyncManager::OnEntityParentChanged);
+
+    physicsWorld_ = sceneptr->Subsystem<PhysicsWorld>();
+    if (physicsWorld_)
+        physicsWorld_->TransformsUpdated.Connect(this, &SyncManager::OnPhysicsTransformsUpdated);
 }
 
 void SyncManager::HandleNetworkMessage(UserConnection* user, kNet::packet_id_t packetId, kNet::message_id_t messageId, const char* data, size_t numBytes)
@@ -518,6 +527,65 @@ void SyncManager::OnAttributeChanged(IComponent* comp, IAttribute* attr, Attribu
     }
 }
 
+void SyncManager::OnPhysicsTransformsUpdated(const Vector<PhysicsTransformUpdate>& updates)
+{
+    // Without batched signals the changes have already been handled in OnAttributeChanged.
+    PhysicsWorld* world = physicsWorld_.Get();
+    if (!world || !world->BatchedTransformSignals())
+        return;
+
+    URHO3D_PROFILE(SyncManager_OnPhysicsTransformsUpdated);
+
+    bool isServer = owner_->IsServer();
+    ScenePtr scene = scene_.Lock();
+
+    // Sync states to which the changes are marked dirty: each user connection on the server, the server connection on the client.
+    Vector<SceneSyncState*> states;
+    if (isServer)
+    {
+        UserConnectionList& users = owner_->Server()->UserConnections();
+        for(auto i = users.Begin(); i != users.End(); ++i)
+            if ((*i)->syncState)
+                states.Push((*i)->syncState.Get());
+    }
+    else
+        states.Push(serverConnection_->syncState.Get());
+
+    for(uint i = 0; i < updates.Size(); ++i)
+    {
+        const PhysicsTransformUpdate &update = updates[i];
+        RigidBody* body = update.body;
+        Entity* entity = (body ? body->ParentEntity() : 0);
+        Placeable* placeable = (entity ? entity->Component<Placeable>().Get() : 0);
+        if (!placeable)
+            continue;
+
+        // Client: stop interpolating the transform if we changed it ourselves, like OnAttributeChanged does.
+        if (!isServer && scene && !scene->IsInterpolating())
+        {
+            if (placeable->transform.Metadata() && placeable->transform.Metadata()->interpolation == AttributeMetadata::Interpolate)
+                scene->EndAttributeInterpolation(&placeable->transform);
+        }
+
+        // Is this change even supposed to go to the network?
+        AttributeChange::Type change = (update.change == AttributeChange::Default ? placeable->UpdateMode() : update.change);
+        if (change != AttributeChange::Replicate || entity->IsLocal())
+            continue;
+
+        for(uint j = 0; j < states.Size(); ++j)
+        {
+            if (!placeable->IsLocal())
+                states[j]->MarkAttributeDirty(entity->Id(), placeable->Id(), placeable->transform.Index());
+            if (body->IsLocal())
+                continue;
+            if (update.linearVelocityChanged)
+                states[j]->MarkAttributeDirty(entity->Id(), body->Id(), body->linearVelocity.Index());
+            if (update.angularVelocityChanged)
+                states[j]->MarkAttributeDirty(entity->Id(), body->Id(), body->angularVelocity.Index());
+        }
+    }
+}
+
 void SyncManager::OnAttributeAdded(IComponent* comp, IAttribute* attr, AttributeChange::Type /*change*/)
 {
     assert(comp && attr);
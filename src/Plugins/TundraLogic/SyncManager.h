@@ -12,6 +12,7 @@
 
 #include "SyncState.h"
 #include "SceneFwd.h"
+#include "BulletPhysicsFwd.h"
 #include "AttributeChangeType.h"
 #include "EntityAction.h"
 #include "EntityPrioritizer.h"
@@ -93,6 +94,9 @@ private:
     /// Trigger EC sync because of component attributes changing
     void OnAttributeChanged(IComponent* comp, IAttribute* attr, AttributeChange::Type change);
 
+    /// Trigger EC sync because of rigid bodies moved by the physics simulation with batched transform signals
+    void OnPhysicsTransformsUpdated(const Vector<PhysicsTransformUpdate>& updates);
+
     /// Trigger EC sync because of component attribute added
     void OnAttributeAdded(IComponent* comp, IAttribute* attr, AttributeChange::Type change);
 
@@ -200,6 +204,9 @@ private:
     
     /// Scene pointer
     SceneWeakPtr scene_;
+
+    /// Physics world of the scene
+    PhysicsWorldWeakPtr physicsWorld_;
     
     /// Time period for update, default 1/30th of a second
     float updatePeriod_;
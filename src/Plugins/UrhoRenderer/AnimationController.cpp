@@ -6,10 +6,10 @@
 #include "AttributeMetadata.h"
 #include "Placeable.h"
 #include "Mesh.h"
+#include "AnimationSystem.h"
 #include "UrhoRenderer.h"
 #include "Scene/Scene.h"
 #include "LoggingFunctions.h"
-#include "FrameAPI.h"
 #include "Framework.h"
 
 #include <Urho3D/Scene/Node.h>
@@ -28,13 +28,16 @@ namespace Tundra
 AnimationController::AnimationController(Urho3D::Context* context, Scene* scene) :
     IComponent(context, scene),
     INIT_ATTRIBUTE_VALUE(animationState, "Animation state", ""),
-    INIT_ATTRIBUTE_VALUE(drawDebug, "Draw debug", false)
+    INIT_ATTRIBUTE_VALUE(drawDebug, "Draw debug", false),
+    animationSlot_(AnimationSystem::NoSlot)
 {
     ParentEntitySet.Connect(this, &AnimationController::UpdateSignals);
 }
 
 AnimationController::~AnimationController()
 {
+    if (animationSystem_)
+        animationSystem_->Remove(animationSlot_);
 }
 
 void AnimationController::UpdateSignals()
@@ -46,13 +49,18 @@ void AnimationController::UpdateSignals()
     if (!parent)
         return;
 
-    framework->Frame()->Updated.Connect(this, &AnimationController::Update);
-
     parent->ComponentAdded.Connect(this, &AnimationController::OnComponentStructureChanged);
     parent->ComponentRemoved.Connect(this, &AnimationController::OnComponentStructureChanged);
 
     if (parent->ParentScene())
         world_ = parent->ParentScene()->Subsystem<GraphicsWorld>();
+
+    // The animation system of the world updates all the controllers of the scene in one pass
+    if (world_ && !animationSystem_)
+    {
+        animationSystem_ = world_->Animations();
+        animationSlot_ = animationSystem_->Add(this);
+    }
 }
 
 void AnimationController::OnComponentStructureChanged(IComponent*, AttributeChange::Type)
@@ -62,6 +70,7 @@ void AnimationController::OnComponentStructureChanged(IComponent*, AttributeChan
         return;
 
     mesh_ = parent->Component<Mesh>();
+    placeable_ = parent->Component<Placeable>();
 }
 
 void AnimationController::AttributesChanged()
@@ -75,6 +84,26 @@ Urho3D::Animation* AnimationController::AnimationByName(const String& name)
     return mesh_ ? mesh_->AnimationByName(name) : nullptr;
 }
 
+AnimationController::Animation* AnimationController::FindAnimation(const String& name)
+{
+    for(uint i = 0; i < animations_.Size(); ++i)
+    {
+        if (animations_[i].name_ == name)
+            return &animations_[i];
+    }
+    return nullptr;
+}
+
+const AnimationController::Animation* AnimationController::FindAnimation(const String& name) const
+{
+    return const_cast<AnimationController*>(this)->FindAnimation(name);
+}
+
+Urho3D::AnimatedModel* AnimationController::UrhoModel() const
+{
+    return mesh_ ? mesh_->UrhoMesh() : nullptr;
+}
+
 void AnimationController::Update(float frametime)
 {
     if (!mesh_)
@@ -84,52 +113,53 @@ void AnimationController::Update(float frametime)
     if (!model)
         return;
 
-    for(auto i = animations_.Begin(); i != animations_.End();)
+    for(uint i = 0; i < animations_.Size();)
     {
+        Animation& anim = animations_[i];
         // Check expiration (model change?)
-        if (!i->second_.animationState_)
-            i = animations_.Erase(i);
+        if (!anim.animationState_)
+            animations_.Erase(i);
         else
         {
-            Urho3D::AnimationState* animstate = i->second_.animationState_;
+            Urho3D::AnimationState* animstate = anim.animationState_;
 
-            switch(i->second_.phase_)
+            switch(anim.phase_)
             {
             case FadeInPhase:
                 // If period is infinitely fast, skip to full weight & PLAY status
-                if (i->second_.fade_period_ == 0.0f)
+                if (anim.fade_period_ == 0.0f)
                 {
-                    i->second_.weight_ = 1.0f;
-                    i->second_.phase_ = PlayPhase;
+                    anim.weight_ = 1.0f;
+                    anim.phase_ = PlayPhase;
                 }   
                 else
                 {
-                    i->second_.weight_ += (1.0f / i->second_.fade_period_) * frametime;
-                    if (i->second_.weight_ >= 1.0f)
+                    anim.weight_ += (1.0f / anim.fade_period_) * frametime;
+                    if (anim.weight_ >= 1.0f)
                     {
-                        i->second_.weight_ = 1.0f;
-                        i->second_.phase_ = PlayPhase;
+                        anim.weight_ = 1.0f;
+                        anim.phase_ = PlayPhase;
                     }
                 }
                 break;
     
             case PlayPhase:
-                if (i->second_.auto_stop_ || i->second_.num_repeats_ != 1)
+                if (anim.auto_stop_ || anim.num_repeats_ != 1)
                 {
-                    if ((i->second_.speed_factor_ >= 0.f && animstate->GetTime() >= animstate->GetLength()) ||
-                        (i->second_.speed_factor_ < 0.f && animstate->GetTime() <= 0.f))
+                    if ((anim.speed_factor_ >= 0.f && animstate->GetTime() >= animstate->GetLength()) ||
+                        (anim.speed_factor_ < 0.f && animstate->GetTime() <= 0.f))
                     {
-                        if (i->second_.num_repeats_ != 1)
+                        if (anim.num_repeats_ != 1)
                         {
-                            if (i->second_.num_repeats_ > 1)
-                                i->second_.num_repeats_--;
+                            if (anim.num_repeats_ > 1)
+                                anim.num_repeats_--;
     
-                            float rewindpos = i->second_.speed_factor_ >= 0.f ? (animstate->GetTime() - animstate->GetLength()) : animstate->GetLength();
+                            float rewindpos = anim.speed_factor_ >= 0.f ? (animstate->GetTime() - animstate->GetLength()) : animstate->GetLength();
                             animstate->SetTime(rewindpos);
                         }
                         else
                         {
-                            i->second_.phase_ = FadeOutPhase;
+                            anim.phase_ = FadeOutPhase;
                         }
                     }
                 }
@@ -137,37 +167,37 @@ void AnimationController::Update(float frametime)
     
             case FadeOutPhase:
                 // If period is infinitely fast, skip to disabled status immediately
-                if (i->second_.fade_period_ == 0.0f)
+                if (anim.fade_period_ == 0.0f)
                 {
-                    i->second_.weight_ = 0.0f;
-                    i->second_.phase_ = StopPhase;
+                    anim.weight_ = 0.0f;
+                    anim.phase_ = StopPhase;
                 }
                 else
                 {
-                    i->second_.weight_ -= (1.0f / i->second_.fade_period_) * frametime;
-                    if (i->second_.weight_ <= 0.0f)
+                    anim.weight_ -= (1.0f / anim.fade_period_) * frametime;
+                    if (anim.weight_ <= 0.0f)
                     {
-                        i->second_.weight_ = 0.0f;
-                        i->second_.phase_ = StopPhase;
+                        anim.weight_ = 0.0f;
+                        anim.phase_ = StopPhase;
                     }
                 }
                 break;
             }
     
             // Set weight & step the animation forward
-            if (i->second_.phase_ != StopPhase)
+            if (anim.phase_ != StopPhase)
             {
-                float advance = i->second_.speed_factor_ * frametime;
-                float new_weight = i->second_.weight_ * i->second_.weight_factor_;
+                float advance = anim.speed_factor_ * frametime;
+                float new_weight = anim.weight_ * anim.weight_factor_;
                 
                 bool cycled = false;
                 float oldtimepos = animstate->GetTime();
                 float animlength = animstate->GetLength();
                 
                 if (new_weight != animstate->GetWeight())
-                    animstate->SetWeight((float)i->second_.weight_ * i->second_.weight_factor_);
+                    animstate->SetWeight((float)anim.weight_ * anim.weight_factor_);
                 if (advance != 0.0f)
-                    animstate->AddTime((float)(i->second_.speed_factor_ * frametime));
+                    animstate->AddTime((float)(anim.speed_factor_ * frametime));
                 
                 // Check if we should fire an "animation finished" signal
                 float newtimepos = animstate->GetTime();
@@ -200,10 +230,12 @@ void AnimationController::Update(float frametime)
                 
                 if (cycled)
                 {
+                    // The handlers may start animations, which can reallocate the animation vector, so pass a copy of the name
+                    const String name = anim.name_;
                     if (animstate->IsLooped())
-                        AnimationCycled.Emit(i->first_);
+                        AnimationCycled.Emit(name);
                     else
-                        AnimationFinished.Emit(i->first_);
+                        AnimationFinished.Emit(name);
                 }
 
                 ++i;
@@ -211,8 +243,8 @@ void AnimationController::Update(float frametime)
             else
             {
                 // If stopped, disable & remove this animation from list
-                model->RemoveAnimationState(i->second_.animationState_);
-                i = animations_.Erase(i);
+                model->RemoveAnimationState(anim.animationState_);
+                animations_.Erase(i);
             }
         }
     }
@@ -229,22 +261,22 @@ void AnimationController::DrawSkeleton()
 bool AnimationController::EnableAnimation(const String& name, bool looped, float fadein, bool high_priority)
 {
     // See if we already have this animation
-    auto i = animations_.Find(name);
-    if (i != animations_.End())
+    Animation* anim = FindAnimation(name);
+    if (anim)
     {
-        if (!i->second_.animationState_)
+        if (!anim->animationState_)
             return false;
 
-        i->second_.animationState_->SetLooped(looped);
-        i->second_.phase_ = FadeInPhase;
-        i->second_.num_repeats_ = (looped ? 0: 1);
-        i->second_.fade_period_ = fadein;
-        i->second_.high_priority_ = high_priority;
+        anim->animationState_->SetLooped(looped);
+        anim->phase_ = FadeInPhase;
+        anim->num_repeats_ = (looped ? 0: 1);
+        anim->fade_period_ = fadein;
+        anim->high_priority_ = high_priority;
         // If animation is nonlooped and has already reached end, rewind to beginning
-        if ((!looped) && (i->second_.speed_factor_ > 0.0f))
+        if ((!looped) && (anim->speed_factor_ > 0.0f))
         {
-            if (i->second_.animationState_->GetTime() >= i->second_.animationState_->GetLength())
-                i->second_.animationState_->SetTime(0.0f);
+            if (anim->animationState_->GetTime() >= anim->animationState_->GetLength())
+                anim->animationState_->SetTime(0.0f);
         }
         return true;
     }
@@ -266,8 +298,9 @@ bool AnimationController::EnableAnimation(const String& name, bool looped, float
     newanim.num_repeats_ = (looped ? 0: 1); // if looped, repeat 0 times (loop indefinetly) otherwise repeat one time.
     newanim.fade_period_ = fadein;
     newanim.high_priority_ = high_priority;
+    newanim.name_ = name;
 
-    animations_[name] = newanim;
+    animations_.Push(newanim);
 
     return true;
 }
@@ -275,16 +308,14 @@ bool AnimationController::EnableAnimation(const String& name, bool looped, float
 bool AnimationController::EnableExclusiveAnimation(const String& name, bool looped, float fadein, float fadeout, bool high_priority)
 {
     // Disable all other active animations
-    auto i = animations_.Begin();
-    while(i != animations_.End())
+    for(uint i = 0; i < animations_.Size(); ++i)
     {
-        const String& other_name = i->first_;
+        const String& other_name = animations_[i].name_;
         if (other_name.Compare(name, false) != 0)
         {
-            i->second_.phase_ = FadeOutPhase;
-            i->second_.fade_period_ = fadeout;
+            animations_[i].phase_ = FadeOutPhase;
+            animations_[i].fade_period_ = fadeout;
         }
-        ++i;
     }
 
     // Then enable this
@@ -293,14 +324,14 @@ bool AnimationController::EnableExclusiveAnimation(const String& name, bool loop
 
 bool AnimationController::HasAnimationFinished(const String& name) const
 {
-    auto i = animations_.Find(name);
-    if (i != animations_.End())
+    const Animation* anim = FindAnimation(name);
+    if (anim)
     {
-        if (!i->second_.animationState_)
+        if (!anim->animationState_)
             return true;
 
-        if ((!i->second_.animationState_->IsLooped()) && ((i->second_.speed_factor_ >= 0.f && i->second_.animationState_->GetTime() >= i->second_.animationState_->GetLength()) ||
-            (i->second_.speed_factor_ < 0.f && i->second_.animationState_->GetTime() <= 0.f)))
+        if ((!anim->animationState_->IsLooped()) && ((anim->speed_factor_ >= 0.f && anim->animationState_->GetTime() >= anim->animationState_->GetLength()) ||
+            (anim->speed_factor_ < 0.f && anim->animationState_->GetTime() <= 0.f)))
             return true;
         else
             return false;
@@ -312,14 +343,14 @@ bool AnimationController::HasAnimationFinished(const String& name) const
 
 bool AnimationController::IsAnimationActive(const String& name, bool check_fadeout) const
 {
-    auto i = animations_.Find(name);
-    if (i != animations_.End())
+    const Animation* anim = FindAnimation(name);
+    if (anim)
     {
         if (check_fadeout)
             return true;
         else 
         {
-            if (i->second_.phase_ != FadeOutPhase)
+            if (anim->phase_ != FadeOutPhase)
                 return true;
             else
                 return false;
@@ -331,10 +362,10 @@ bool AnimationController::IsAnimationActive(const String& name, bool check_fadeo
 
 bool AnimationController::SetAnimationAutoStop(const String& name, bool enable)
 {
-    auto i = animations_.Find(name);
-    if (i != animations_.End())
+    Animation* anim = FindAnimation(name);
+    if (anim)
     {
-        i->second_.auto_stop_ = enable;
+        anim->auto_stop_ = enable;
         return true;
     }
 
@@ -344,10 +375,10 @@ bool AnimationController::SetAnimationAutoStop(const String& name, bool enable)
 
 bool AnimationController::SetAnimationNumLoops(const String& name, uint repeats)
 {
-    auto i = animations_.Find(name);
-    if (i != animations_.End())
+    Animation* anim = FindAnimation(name);
+    if (anim)
     {
-        i->second_.num_repeats_ = repeats;
+        anim->num_repeats_ = repeats;
         return true;
     }
     // Animation not active
@@ -367,10 +398,10 @@ StringVector AnimationController::ActiveAnimations() const
 {
     StringVector activeList;
 
-    for(auto i = animations_.Begin(); i != animations_.End(); ++i)
+    for(uint i = 0; i < animations_.Size(); ++i)
     {
-        if (i->second_.phase_ != StopPhase)
-            activeList.Push(i->first_);
+        if (animations_[i].phase_ != StopPhase)
+            activeList.Push(animations_[i].name_);
     }
     
     return activeList;
@@ -378,11 +409,11 @@ StringVector AnimationController::ActiveAnimations() const
 
 bool AnimationController::DisableAnimation(const String& name, float fadeout)
 {
-    auto i = animations_.Find(name);
-    if (i != animations_.End())
+    Animation* anim = FindAnimation(name);
+    if (anim)
     {
-        i->second_.phase_ = FadeOutPhase;
-        i->second_.fade_period_ = fadeout;
+        anim->phase_ = FadeOutPhase;
+        anim->fade_period_ = fadeout;
         return true;
     }
     // Animation not active
@@ -391,30 +422,28 @@ bool AnimationController::DisableAnimation(const String& name, float fadeout)
 
 void AnimationController::DisableAllAnimations(float fadeout)
 {
-    auto i = animations_.Begin();
-    while(i != animations_.End())
+    for(uint i = 0; i < animations_.Size(); ++i)
     {
-        i->second_.phase_ = FadeOutPhase;
-        i->second_.fade_period_ = fadeout;
-        ++i;
+        animations_[i].phase_ = FadeOutPhase;
+        animations_[i].fade_period_ = fadeout;
     }
 }
 
 void AnimationController::SetAnimationToEnd(const String& name)
 {
-    auto i = animations_.Find(name);
-    if (i != animations_.End() && i->second_.animationState_)
+    Animation* anim = FindAnimation(name);
+    if (anim && anim->animationState_)
     {
-        SetAnimationTimePosition(name, i->second_.animationState_->GetLength());
+        SetAnimationTimePosition(name, anim->animationState_->GetLength());
     }
 }
 
 bool AnimationController::SetAnimationSpeed(const String& name, float speedfactor)
 {
-    auto i = animations_.Find(name);
-    if (i != animations_.End())
+    Animation* anim = FindAnimation(name);
+    if (anim)
     {
-        i->second_.speed_factor_ = speedfactor;
+        anim->speed_factor_ = speedfactor;
         return true;
     }
     // Animation not active
@@ -423,10 +452,10 @@ bool AnimationController::SetAnimationSpeed(const String& name, float speedfacto
 
 bool AnimationController::SetAnimationWeight(const String& name, float weight)
 {
-    auto i = animations_.Find(name);
-    if (i != animations_.End())
+    Animation* anim = FindAnimation(name);
+    if (anim)
     {
-        i->second_.weight_factor_ = weight;
+        anim->weight_factor_ = weight;
         return true;
     }
     // Animation not active
@@ -435,10 +464,10 @@ bool AnimationController::SetAnimationWeight(const String& name, float weight)
 
 bool AnimationController::SetAnimationPriority(const String& name, bool high_priority)
 {
-    auto i = animations_.Find(name);
-    if (i != animations_.End())
+    Animation* anim = FindAnimation(name);
+    if (anim)
     {
-        i->second_.high_priority_ = high_priority;
+        anim->high_priority_ = high_priority;
         return true;
     }
     // Animation not active
@@ -447,10 +476,10 @@ bool AnimationController::SetAnimationPriority(const String& name, bool high_pri
 
 bool AnimationController::SetAnimationTimePosition(const String& name, float newPosition)
 {
-    auto i = animations_.Find(name);
-    if (i != animations_.End() && i->second_.animationState_)
+    Animation* anim = FindAnimation(name);
+    if (anim && anim->animationState_)
     {
-        i->second_.animationState_->SetTime(newPosition);
+        anim->animationState_->SetTime(newPosition);
         return true;
     }
     // Animation not active
@@ -459,10 +488,10 @@ bool AnimationController::SetAnimationTimePosition(const String& name, float new
 
 bool AnimationController::SetAnimationRelativeTimePosition(const String& name, float newPosition)
 {
-    auto i = animations_.Find(name);
-    if (i != animations_.End() && i->second_.animationState_)
+    Animation* anim = FindAnimation(name);
+    if (anim && anim->animationState_)
     {
-        i->second_.animationState_->SetTime(Clamp(newPosition, 0.0f, 1.0f) * i->second_.animationState_->GetLength());
+        anim->animationState_->SetTime(Clamp(newPosition, 0.0f, 1.0f) * anim->animationState_->GetLength());
         return true;
     }
     // Animation not active
@@ -471,27 +500,27 @@ bool AnimationController::SetAnimationRelativeTimePosition(const String& name, f
 
 float AnimationController::AnimationLength(const String& name)
 {
-    auto i = animations_.Find(name);
-    if (i != animations_.End() && i->second_.animationState_)
-        return i->second_.animationState_->GetLength();
+    Animation* anim = FindAnimation(name);
+    if (anim && anim->animationState_)
+        return anim->animationState_->GetLength();
     else
         return 0.0f;
 }
 
 float AnimationController::AnimationTimePosition(const String& name)
 {
-    auto i = animations_.Find(name);
-    if (i != animations_.End() && i->second_.animationState_)
-        return i->second_.animationState_->GetTime();
+    Animation* anim = FindAnimation(name);
+    if (anim && anim->animationState_)
+        return anim->animationState_->GetTime();
     else
         return 0.0f;
 }
 
 float AnimationController::AnimationRelativeTimePosition(const String& name)
 {
-    auto i = animations_.Find(name);
-    if (i != animations_.End() && i->second_.animationState_)
-        return i->second_.animationState_->GetTime() / i->second_.animationState_->GetLength();
+    Animation* anim = FindAnimation(name);
+    if (anim && anim->animationState_)
+        return anim->animationState_->GetTime() / anim->animationState_->GetLength();
     else
         return 0.0f;
 }
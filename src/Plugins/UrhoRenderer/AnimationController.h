@@ -118,6 +118,9 @@ public:
         /// The corresponding Urho animation state. Is strongly owned by the AnimatedModel component
         WeakPtr<Urho3D::AnimationState> animationState_;
 
+        /// Animation name
+        String name_;
+
         Animation() :
             auto_stop_(false),
             fade_period_(0.0),
@@ -130,12 +133,13 @@ public:
         {
         }
     };
-    typedef HashMap<String, Animation> AnimationMap;
+    typedef Vector<Animation> AnimationVector;
 
     /// Returns all running animations
-    const AnimationMap& RunningAnimations() const { return animations_; }
+    const AnimationVector& RunningAnimations() const { return animations_; }
 
     /// Updates animation(s) by elapsed time
+    /** Called by the AnimationSystem of the scene, at a reduced rate when the model is not seen up close. */
     void Update(float frametime);
 
     /// Draws the mesh skeleton
@@ -268,6 +272,8 @@ public:
     Signal1<const String & ARG(animationName)> AnimationCycled;
 
 private:
+    friend class AnimationSystem;
+
     /// Called when the parent entity has been set.
     void UpdateSignals();
 
@@ -278,6 +284,13 @@ private:
 
     Urho3D::Animation* AnimationByName(const String& name);
 
+    /// Returns the running animation with the name, or null if not running
+    Animation* FindAnimation(const String& name);
+    const Animation* FindAnimation(const String& name) const; ///< @overload
+
+    /// Returns the Urho animated model of the mesh, or null if none
+    Urho3D::AnimatedModel* UrhoModel() const;
+
     /// Mesh component
     MeshWeakPtr mesh_;
 
@@ -287,8 +300,14 @@ private:
     /// World ptr
     GraphicsWorldWeakPtr world_;
 
-    /// Map of animations
-    AnimationMap animations_;
+    /// Running animations. There are only a few per model, so they are looked up by name linearly
+    AnimationVector animations_;
+
+    /// Animation system of the world that updates this controller
+    SharedPtr<AnimationSystem> animationSystem_;
+
+    /// Slot of this controller in the animation system
+    uint animationSlot_;
 };
 
 COMPONENT_TYPEDEFS(AnimationController)
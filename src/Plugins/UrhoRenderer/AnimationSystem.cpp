@@ -0,0 +1,159 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "AnimationSystem.h"
+#include "AnimationController.h"
+#include "GraphicsWorld.h"
+#include "Placeable.h"
+#include "UrhoRenderer.h"
+#include "Entity.h"
+
+#include <Urho3D/Core/Profiler.h>
+#include <Urho3D/Graphics/AnimatedModel.h>
+
+namespace Tundra
+{
+
+AnimationSystem::AnimationSystem(GraphicsWorld *world) :
+    world_(world),
+    serverMode_(false),
+    lodDistance_(50.f),
+    distantUpdateInterval_(1.f / 15.f),
+    invisibleUpdateInterval_(0.25f),
+    serverUpdateInterval_(0.1f),
+    numUpdated_(0)
+{
+}
+
+AnimationSystem::~AnimationSystem()
+{
+}
+
+uint AnimationSystem::Add(AnimationController *controller)
+{
+    uint slot;
+    if (!freeSlots_.Empty())
+    {
+        slot = freeSlots_.Back();
+        freeSlots_.Pop();
+    }
+    else
+    {
+        slot = controllers_.Size();
+        controllers_.Resize(slot + 1);
+        elapsed_.Resize(slot + 1);
+        posePending_.Resize(slot + 1);
+    }
+
+    controllers_[slot] = controller;
+    // Spread the reduced rate updates of controllers created on the same frame, eg. by a scene load, over different frames.
+    elapsed_[slot] = (float)(slot & 7) * (serverMode_ ? serverUpdateInterval_ : invisibleUpdateInterval_) / 8.f;
+    posePending_[slot] = 0;
+    return slot;
+}
+
+void AnimationSystem::Remove(uint slot)
+{
+    if (slot >= controllers_.Size() || !controllers_[slot])
+        return;
+
+    controllers_[slot] = 0;
+    if (posePending_[slot])
+    {
+        pendingPoses_.Remove(slot);
+        posePending_[slot] = 0;
+    }
+    freeSlots_.Push(slot);
+}
+
+void AnimationSystem::Update(float frametime)
+{
+    numUpdated_ = 0;
+    if (!NumControllers())
+        return;
+
+    URHO3D_PROFILE(AnimationSystem_Update);
+
+    // The camera only matters when this world is being rendered.
+    bool haveCamera = false;
+    float3 cameraPosition = float3::zero;
+    if (!serverMode_ && world_->IsActive())
+    {
+        Entity *cameraEntity = world_->Renderer()->MainCamera();
+        Placeable *cameraPlaceable = cameraEntity ? cameraEntity->Component<Placeable>().Get() : 0;
+        if (cameraPlaceable)
+        {
+            cameraPosition = cameraPlaceable->WorldPosition();
+            haveCamera = true;
+        }
+    }
+
+    // The controllers may be added and removed by the signals emitted during the update, so index the arrays anew each time.
+    for(uint slot = 0; slot < controllers_.Size(); ++slot)
+    {
+        AnimationController *controller = controllers_[slot];
+        if (!controller)
+            continue;
+
+        elapsed_[slot] += frametime;
+        if (elapsed_[slot] < UpdateInterval(controller, haveCamera, cameraPosition))
+            continue;
+
+        const float elapsed = elapsed_[slot];
+        elapsed_[slot] = 0.f;
+        const bool animated = !controller->animations_.Empty();
+        controller->Update(elapsed);
+        ++numUpdated_;
+
+        // The controller may have removed itself
+        if (serverMode_ && animated && controllers_[slot] == controller && !posePending_[slot])
+        {
+            posePending_[slot] = 1;
+            pendingPoses_.Push(slot);
+        }
+    }
+}
+
+void AnimationSystem::ApplyPoses()
+{
+    if (pendingPoses_.Empty())
+        return;
+
+    URHO3D_PROFILE(AnimationSystem_ApplyPoses);
+
+    for(uint i = 0; i < pendingPoses_.Size(); ++i)
+    {
+        const uint slot = pendingPoses_[i];
+        posePending_[slot] = 0;
+        Urho3D::AnimatedModel *model = controllers_[slot]->UrhoModel();
+        if (model)
+            model->ApplyAnimation();
+    }
+    pendingPoses_.Clear();
+}
+
+void AnimationSystem::SetServerMode(bool enable)
+{
+    if (enable == serverMode_)
+        return;
+
+    // Leaving server mode, the models are posed by Urho3D again when rendered.
+    if (!enable)
+        ApplyPoses();
+    serverMode_ = enable;
+}
+
+float AnimationSystem::UpdateInterval(AnimationController *controller, bool haveCamera, const float3 &cameraPosition) const
+{
+    if (serverMode_)
+        return serverUpdateInterval_;
+    if (!haveCamera || !world_->IsEntityVisible(controller->ParentEntity()))
+        return invisibleUpdateInterval_;
+
+    Placeable *placeable = controller->placeable_.Get();
+    if (placeable && placeable->WorldPosition().DistanceSq(cameraPosition) > lodDistance_ * lodDistance_)
+        return distantUpdateInterval_;
+    return 0.f;
+}
+
+}
@@ -0,0 +1,96 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "CoreTypes.h"
+#include "UrhoRendererApi.h"
+#include "UrhoRendererFwd.h"
+#include "Math/float3.h"
+
+#include <Urho3D/Container/RefCounted.h>
+
+namespace Tundra
+{
+
+/// Updates the animation controllers of a scene in one pass, reducing the update rate of the models that are not seen up close.
+/** Each AnimationController of a GraphicsWorld owns a slot. Instead of every controller listening to the frame update, the
+    GraphicsWorld updates them all here once per frame. The frame time of a controller accumulates in its slot until its update
+    interval has passed, and the controller is then advanced by the accumulated time, so the animations do not slow down.
+
+    The update interval depends on how the model is seen from the main camera: visible models nearer than the LOD distance
+    are updated every frame, visible models farther away every distant update interval, and models outside the view every
+    invisible update interval.
+
+    On a headless server nothing is rendered, so the controllers are advanced every server update interval and the animation
+    time is kept current without posing the skeletons. The skeleton of an advanced model is posed only when one of its bones
+    is queried, either through Mesh or by a placeable attached to a bone. */
+class URHORENDERER_API AnimationSystem : public RefCounted
+{
+public:
+    /// @param world Graphics world whose main camera and visible entities determine the update rates.
+    explicit AnimationSystem(GraphicsWorld *world);
+    ~AnimationSystem();
+
+    /// Slot index of no controller.
+    static const uint NoSlot = 0xffffffff;
+
+    /// Allocates a slot for a controller.
+    uint Add(AnimationController *controller);
+    /// Frees the slot of a controller.
+    void Remove(uint slot);
+
+    /// Advances the controllers whose update interval has passed.
+    void Update(float frametime);
+
+    /// Poses the skeletons of the models advanced since their last pose. Only needed on a headless server.
+    void ApplyPoses();
+    /// Returns whether some skeletons do not have the current pose of their animations yet.
+    bool HasPendingPoses() const { return !pendingPoses_.Empty(); }
+
+    /// Sets whether the skeletons are posed only on demand, as is done on a headless server.
+    void SetServerMode(bool enable);
+    /// Returns whether the skeletons are posed only on demand.
+    bool ServerMode() const { return serverMode_; }
+
+    /// Sets the distance from the main camera beyond which visible models are updated every distant update interval.
+    void SetLodDistance(float distance) { lodDistance_ = distance; }
+    float LodDistance() const { return lodDistance_; } ///< @copydoc SetLodDistance
+    /// Sets the update interval in seconds of the visible models beyond the LOD distance. 0 updates them every frame.
+    void SetDistantUpdateInterval(float interval) { distantUpdateInterval_ = interval; }
+    float DistantUpdateInterval() const { return distantUpdateInterval_; } ///< @copydoc SetDistantUpdateInterval
+    /// Sets the update interval in seconds of the models outside the view. 0 updates them every frame.
+    void SetInvisibleUpdateInterval(float interval) { invisibleUpdateInterval_ = interval; }
+    float InvisibleUpdateInterval() const { return invisibleUpdateInterval_; } ///< @copydoc SetInvisibleUpdateInterval
+    /// Sets the update interval in seconds of all models in server mode. 0 updates them every frame.
+    void SetServerUpdateInterval(float interval) { serverUpdateInterval_ = interval; }
+    float ServerUpdateInterval() const { return serverUpdateInterval_; } ///< @copydoc SetServerUpdateInterval
+
+    /// Returns the number of slots in use.
+    uint NumControllers() const { return controllers_.Size() - freeSlots_.Size(); }
+    /// Returns the number of controllers advanced by the last Update.
+    uint NumUpdatedControllers() const { return numUpdated_; }
+
+private:
+    /// Returns the update interval of a controller.
+    float UpdateInterval(AnimationController *controller, bool haveCamera, const float3 &cameraPosition) const;
+
+    GraphicsWorld *world_;
+    bool serverMode_;
+    float lodDistance_;
+    float distantUpdateInterval_;
+    float invisibleUpdateInterval_;
+    float serverUpdateInterval_;
+    uint numUpdated_;
+
+    PODVector<AnimationController*> controllers_;
+    /// Frame time accumulated since the controller was last advanced
+    PODVector<float> elapsed_;
+    /// Whether the skeleton of the controller is in pendingPoses_
+    PODVector<u8> posePending_;
+    /// Unused slots, reused before growing the arrays
+    PODVector<uint> freeSlots_;
+    /// Slots whose skeleton does not have the current pose
+    PODVector<uint> pendingPoses_;
+};
+
+}
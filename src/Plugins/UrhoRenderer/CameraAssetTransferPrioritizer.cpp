@@ -0,0 +1,180 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "CameraAssetTransferPrioritizer.h"
+#include "UrhoRenderer.h"
+#include "Placeable.h"
+#include "Mesh.h"
+#include "Entity.h"
+#include "IAssetTransfer.h"
+
+#include <Math/Quat.h>
+#include <Math/MathFunc.h>
+#include <Geometry/AABB.h>
+
+#include <Urho3D/Container/Sort.h>
+
+namespace Tundra
+{
+
+/// Multiplier applied to the score of requesters that are behind the camera.
+static const float cBehindCameraFactor = 0.25f;
+
+CameraAssetTransferPrioritizer::CameraAssetTransferPrioritizer(UrhoRenderer *renderer) :
+    renderer_(renderer),
+    lastCameraPos_(float3::zero),
+    lastCameraDir_(-float3::unitZ),
+    hasCamera_(false),
+    reevaluateDistance_(5.f),
+    reevaluateAngleCos_(Cos(DegToRad(15.f))),
+    maxTransfersInFlight_(0)
+{
+}
+
+void CameraAssetTransferPrioritizer::SetReevaluationThresholds(float distance, float angle)
+{
+    reevaluateDistance_ = Max(0.f, distance);
+    reevaluateAngleCos_ = Cos(Clamp(angle, 0.f, pi));
+}
+
+uint CameraAssetTransferPrioritizer::MaxTransfersInFlight(IAssetProvider * /*provider*/) const
+{
+    return maxTransfersInFlight_;
+}
+
+AssetTransferPtrVector CameraAssetTransferPrioritizer::Prioritize(const AssetTransferPtrVector &transfers)
+{
+    float3 cameraPos = lastCameraPos_;
+    float3 cameraDir = lastCameraDir_;
+    bool hasCamera = false;
+    Entity *cameraEntity = (renderer_ ? renderer_->MainCamera() : 0);
+    Placeable *cameraPlaceable = (cameraEntity ? cameraEntity->Component<Placeable>().Get() : 0);
+    if (cameraPlaceable)
+    {
+        cameraPos = cameraPlaceable->WorldPosition();
+        cameraDir = cameraPlaceable->WorldOrientation() * -float3::unitZ;
+        hasCamera = true;
+    }
+
+    // Drop all cached scores if the camera has moved or turned enough, otherwise only score new transfers.
+    if (hasCamera != hasCamera_ || cameraPos.DistanceSq(lastCameraPos_) > reevaluateDistance_ * reevaluateDistance_ ||
+        cameraDir.Dot(lastCameraDir_) < reevaluateAngleCos_)
+    {
+        scores_.Clear();
+        lastCameraPos_ = cameraPos;
+        lastCameraDir_ = cameraDir;
+        hasCamera_ = hasCamera;
+    }
+
+    HashMap<IAssetTransfer*, CachedScore> scores;
+    Vector<PrioritizedTransfer> prioritized;
+    prioritized.Reserve(transfers.Size());
+    for(uint i = 0; i < transfers.Size(); ++i)
+    {
+        IAssetTransfer *transfer = transfers[i].Get();
+        CachedScore &cachedScore = scores[transfer];
+        RequesterPositions(transfer, cachedScore.requesterPositions);
+        // Rescore if the requesters have moved since the cached score was computed
+        auto cached = scores_.Find(transfer);
+        if (cached != scores_.End() && !RequestersMoved(cachedScore.requesterPositions, cached->second_.requesterPositions))
+            cachedScore = cached->second_;
+        else
+            cachedScore.score = (hasCamera_ ? Score(transfer, lastCameraPos_, lastCameraDir_) : -1.f);
+        float score = cachedScore.score;
+
+        PrioritizedTransfer entry;
+        entry.transfer = transfers[i];
+        entry.score = score;
+        entry.typeRank = TypeRank(transfer->assetType);
+        entry.order = i;
+        prioritized.Push(entry);
+    }
+    // Only keep scores of transfers that are still pending.
+    scores_ = scores;
+
+    Urho3D::Sort(prioritized.Begin(), prioritized.End(), &CameraAssetTransferPrioritizer::CompareTransfers);
+
+    AssetTransferPtrVector sorted;
+    sorted.Reserve(prioritized.Size());
+    for(uint i = 0; i < prioritized.Size(); ++i)
+        sorted.Push(prioritized[i].transfer);
+    return sorted;
+}
+
+void CameraAssetTransferPrioritizer::RequesterPositions(IAssetTransfer *transfer, PODVector<float3> &positions)
+{
+    positions.Clear();
+    for(uint i = 0; i < transfer->requesters.Size(); ++i)
+    {
+        Entity *entity = transfer->requesters[i].Get();
+        Placeable *placeable = (entity ? entity->Component<Placeable>().Get() : 0);
+        if (placeable)
+            positions.Push(placeable->WorldPosition());
+    }
+}
+
+bool CameraAssetTransferPrioritizer::RequestersMoved(const PODVector<float3> &positions, const PODVector<float3> &cachedPositions) const
+{
+    if (positions.Size() != cachedPositions.Size())
+        return true;
+    for(uint i = 0; i < positions.Size(); ++i)
+        if (positions[i].DistanceSq(cachedPositions[i]) > reevaluateDistance_ * reevaluateDistance_)
+            return true;
+    return false;
+}
+
+float CameraAssetTransferPrioritizer::Score(IAssetTransfer *transfer, const float3 &cameraPos, const float3 &cameraDir) const
+{
+    float best = -1.f;
+    for(uint i = 0; i < transfer->requesters.Size(); ++i)
+    {
+        Entity *entity = transfer->requesters[i].Get();
+        Placeable *placeable = (entity ? entity->Component<Placeable>().Get() : 0);
+        if (!placeable)
+            continue;
+
+        float3 center = placeable->WorldPosition();
+        float3 scale = placeable->WorldScale().Abs();
+        float radius = Max(scale.x, Max(scale.y, scale.z));
+        Mesh *mesh = entity->Component<Mesh>().Get();
+        if (mesh && mesh->HasMesh())
+        {
+            AABB box = mesh->WorldAABB();
+            if (box.IsFinite() && !box.IsDegenerate())
+            {
+                center = box.CenterPoint();
+                radius = box.HalfDiagonal().Length();
+            }
+        }
+
+        float3 toEntity = center - cameraPos;
+        float distance = toEntity.Length();
+        float score = (distance > radius ? radius / distance : 1.f);
+        if (distance > radius && toEntity.Dot(cameraDir) < 0.f)
+            score *= cBehindCameraFactor;
+        best = Max(best, score);
+    }
+    return best;
+}
+
+uint CameraAssetTransferPrioritizer::TypeRank(const String &assetType)
+{
+    if (assetType.Contains("mesh", false))
+        return 0;
+    if (assetType.Contains("material", false))
+        return 1;
+    if (assetType.Contains("texture", false))
+        return 2;
+    return 3;
+}
+
+bool CameraAssetTransferPrioritizer::CompareTransfers(const PrioritizedTransfer &a, const PrioritizedTransfer &b)
+{
+    if (a.score != b.score)
+        return a.score > b.score;
+    if (a.typeRank != b.typeRank)
+        return a.typeRank < b.typeRank;
+    return a.order < b.order;
+}
+
+}
@@ -0,0 +1,84 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "IAssetTransferPrioritizer.h"
+#include "UrhoRendererApi.h"
+#include "UrhoRendererFwd.h"
+#include "Math/float3.h"
+
+namespace Tundra
+{
+
+/// Orders asset transfers by the projected size of their requesting entities as seen from the active camera.
+/** Each transfer is scored by the largest bounding radius / distance ratio of the entities in IAssetTransfer::requesters.
+    Entities behind the camera are scored lower than ones in front of it. Ties, and transfers without any located
+    requesters, are ordered by asset type (meshes, materials, textures, others) and then by request order.
+
+    Scores are cached per transfer together with the positions of its requesters. A score is recomputed for new
+    transfers, for transfers whose requesters have moved more than the re-evaluation distance since they were scored,
+    and for all transfers once the camera has moved or turned more than the re-evaluation thresholds since the last
+    full evaluation.
+
+    Installed by UrhoRenderer when running with a renderer. The number of simultaneous transfers per provider
+    can be limited with the --maxTransfersPerProvider command line parameter. */
+class URHORENDERER_API CameraAssetTransferPrioritizer : public IAssetTransferPrioritizer
+{
+public:
+    explicit CameraAssetTransferPrioritizer(UrhoRenderer *renderer);
+
+    /// IAssetTransferPrioritizer override
+    AssetTransferPtrVector Prioritize(const AssetTransferPtrVector &transfers) override;
+
+    /// IAssetTransferPrioritizer override
+    uint MaxTransfersInFlight(IAssetProvider *provider) const override;
+
+    /// Sets the maximum number of simultaneous transfers per provider. 0 means no limit.
+    void SetMaxTransfersInFlight(uint maxTransfers) { maxTransfersInFlight_ = maxTransfers; }
+
+    /// Sets the camera movement distance and rotation angle (in radians) that trigger re-evaluation of all cached scores.
+    /** Requesters moving more than the distance trigger re-evaluation of the scores of their transfers. */
+    void SetReevaluationThresholds(float distance, float angle);
+
+private:
+    struct PrioritizedTransfer
+    {
+        AssetTransferPtr transfer;
+        float score;
+        uint typeRank;
+        uint order;
+    };
+
+    struct CachedScore
+    {
+        float score;
+        /// World positions of the located requesters when the score was computed
+        PODVector<float3> requesterPositions;
+    };
+
+    /// Fills the world positions of the requesters of @c transfer that have a placeable.
+    static void RequesterPositions(IAssetTransfer *transfer, PODVector<float3> &positions);
+
+    /// Returns whether the requester positions differ from the cached ones by more than the re-evaluation distance.
+    bool RequestersMoved(const PODVector<float3> &positions, const PODVector<float3> &cachedPositions) const;
+
+    /// Returns the priority score of @c transfer, or a negative value if none of its requesters could be located.
+    float Score(IAssetTransfer *transfer, const float3 &cameraPos, const float3 &cameraDir) const;
+
+    /// Returns a rank for the asset type used as a tiebreak, lower goes first.
+    static uint TypeRank(const String &assetType);
+
+    /// Sort predicate for PrioritizedTransfer.
+    static bool CompareTransfers(const PrioritizedTransfer &a, const PrioritizedTransfer &b);
+
+    UrhoRenderer *renderer_;
+    HashMap<IAssetTransfer*, CachedScore> scores_;
+    float3 lastCameraPos_;
+    float3 lastCameraDir_;
+    bool hasCamera_;
+    float reevaluateDistance_;
+    float reevaluateAngleCos_;
+    uint maxTransfersInFlight_;
+};
+
+}
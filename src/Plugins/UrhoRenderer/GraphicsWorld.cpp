@@ -11,6 +11,8 @@
 #include "LoggingFunctions.h"
 #include "Camera.h"
 #include "Placeable.h"
+#include "TransformCache.h"
+#include "AnimationSystem.h"
 #include "Framework.h"
 #include "Math/Transform.h"
 #include "Math/Color.h"
@@ -27,6 +29,7 @@
 #include <Geometry/Sphere.h>
 
 #include <Urho3D/Core/Profiler.h>
+#include <Urho3D/Core/StringUtils.h>
 #include <Urho3D/Scene/Scene.h>
 #include <Urho3D/Graphics/Camera.h>
 #include <Urho3D/Core/CoreEvents.h>
@@ -52,6 +55,9 @@ GraphicsWorld::GraphicsWorld(UrhoRenderer* owner, Scene* scene) :
     scene_(scene)
 {
     urhoScene_ = new Urho3D::Scene(context_);
+    transforms_ = new TransformCache();
+    animations_ = new AnimationSystem(this);
+    transforms_->SetAnimationSystem(animations_);
     urhoScene_->CreateComponent<Urho3D::Octree>();
     urhoScene_->CreateComponent<Urho3D::DebugRenderer>();
 
@@ -64,6 +70,21 @@ GraphicsWorld::GraphicsWorld(UrhoRenderer* owner, Scene* scene) :
     
     SetDefaultSceneFog();
 
+    // A headless server only needs the animation time, and the skeletons posed for bone attachments
+    animations_->SetServerMode(framework_->IsHeadless());
+    StringVector lodDistanceParam = framework_->CommandLineParameters("--animationLodDistance");
+    if (!lodDistanceParam.Empty())
+        animations_->SetLodDistance(Urho3D::ToFloat(lodDistanceParam.Back()));
+    StringVector intervalParam = framework_->CommandLineParameters("--animationUpdateInterval");
+    if (!intervalParam.Empty())
+    {
+        const float interval = Max(Urho3D::ToFloat(intervalParam.Back()), 0.f);
+        animations_->SetDistantUpdateInterval(interval);
+        animations_->SetInvisibleUpdateInterval(interval);
+        animations_->SetServerUpdateInterval(interval);
+    }
+
+    framework_->Frame()->Updated.Connect(this, &GraphicsWorld::OnUpdated);
     SubscribeToEvent(Urho3D::E_POSTRENDERUPDATE, URHO3D_HANDLER(GraphicsWorld, HandlePostRenderUpdate));
 }
 
@@ -72,10 +93,18 @@ GraphicsWorld::~GraphicsWorld()
     urhoScene_.Reset();
 }
 
+void GraphicsWorld::OnUpdated(float frameTime)
+{
+    animations_->Update(frameTime);
+}
+
 void GraphicsWorld::HandlePostRenderUpdate(StringHash /*eventType*/, VariantMap& /*eventData*/)
 {
     URHO3D_PROFILE(GraphicsWorld_PostRenderUpdate);
 
+    // Bring the scene nodes of the moved placeables up to date once per frame. The nodes nothing is attached to can stay stale.
+    transforms_->ApplyNodeTransforms(true);
+
     visibleEntities_.Clear();
 
     Urho3D::Renderer* renderer = GetSubsystem<Urho3D::Renderer>();
@@ -120,6 +120,12 @@ public:
     /// Returns the Urho3D engine scene
     Urho3D::Scene* UrhoScene() const { return urhoScene_; }
 
+    /// Returns the transform cache of the placeables in this scene. [noscript]
+    TransformCache* Transforms() const { return transforms_; }
+
+    /// Returns the system that updates the animation controllers of this scene. [noscript]
+    AnimationSystem* Animations() const { return animations_; }
+
     /// Returns the Zone used for ambient light and fog settings.
     Urho3D::Zone* UrhoZone() const;
 
@@ -192,6 +198,9 @@ public:
     static StringHash componentLink;
 
 private:
+    /// Handle frame update. Used for updating the animation controllers
+    void OnUpdated(float frameTime);
+
     /// Handle Urho postrender update event. Used for entity visibility tracking
     void HandlePostRenderUpdate(StringHash eventType, VariantMap& eventData);
 
@@ -212,6 +221,12 @@ private:
     
     /// Urho3D scene
     SharedPtr<Urho3D::Scene> urhoScene_;
+
+    /// World transforms of the placeables
+    SharedPtr<TransformCache> transforms_;
+
+    /// Updates the animation controllers
+    SharedPtr<AnimationSystem> animations_;
     
     /// Visible entities during this frame. Acquired from the active camera
     HashSet<EntityWeakPtr> visibleEntities_;
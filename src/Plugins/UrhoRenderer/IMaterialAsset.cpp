@@ -33,6 +33,17 @@ bool IMaterialAsset::IsLoaded() const
     return material != nullptr;
 }
 
+uint IMaterialAsset::CpuMemoryUsage() const
+{
+    if (!material)
+        return 0;
+
+    // Materials are created in code rather than by Material::Load, so Resource::GetMemoryUse is not set.
+    return sizeof(Urho3D::Material) + material->GetNumTechniques() * sizeof(Urho3D::TechniqueEntry) +
+        material->GetShaderParameters().Size() * sizeof(Urho3D::MaterialShaderParameter) +
+        textures_.Size() * sizeof(Pair<int, AssetReference>);
+}
+
 Urho3D::Material* IMaterialAsset::UrhoMaterial() const
 {
     return material;
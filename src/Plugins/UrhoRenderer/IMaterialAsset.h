@@ -26,6 +26,10 @@ public:
     /// IAsset override.
     bool IsLoaded() const override;
 
+    /// IAsset override.
+    /** The textures are separate assets and report their own memory usage. */
+    uint CpuMemoryUsage() const override;
+
     /// Textures and the units they belong to.
     Vector<Pair<int, AssetReference> > textures_;
 
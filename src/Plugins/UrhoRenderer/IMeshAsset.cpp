@@ -3,15 +3,20 @@
 #include "StableHeaders.h"
 #include "AssetAPI.h"
 #include "AssetCache.h"
+#include "Framework.h"
 #include <Urho3D/Core/Profiler.h>
 #include "LoggingFunctions.h"
 #include "IMeshAsset.h"
 
 #include <Urho3D/Graphics/Model.h>
+#include <Urho3D/Graphics/VertexBuffer.h>
+#include <Urho3D/Graphics/IndexBuffer.h>
 
 namespace Tundra
 {
 
+static MeshLodSettings lodSettings;
+
 IMeshAsset::IMeshAsset(AssetAPI *owner, const String &type_, const String &name_) :
     IAsset(owner, type_, name_)
 {
@@ -38,9 +43,56 @@ bool IMeshAsset::IsLoaded() const
     return model != nullptr;
 }
 
+uint IMeshAsset::CpuMemoryUsage() const
+{
+    return boneBoundingBoxes.Size() * sizeof(Urho3D::BoundingBox);
+}
+
+uint IMeshAsset::GpuMemoryUsage() const
+{
+    if (!model)
+        return 0;
+
+    uint bytes = 0;
+    const Vector<SharedPtr<Urho3D::VertexBuffer> > &vertexBuffers = model->GetVertexBuffers();
+    for(uint i = 0; i < vertexBuffers.Size(); ++i)
+        if (vertexBuffers[i])
+            bytes += vertexBuffers[i]->GetVertexCount() * vertexBuffers[i]->GetVertexSize();
+    const Vector<SharedPtr<Urho3D::IndexBuffer> > &indexBuffers = model->GetIndexBuffers();
+    for(uint i = 0; i < indexBuffers.Size(); ++i)
+        if (indexBuffers[i])
+            bytes += indexBuffers[i]->GetIndexCount() * indexBuffers[i]->GetIndexSize();
+    return bytes;
+}
+
 Urho3D::Model* IMeshAsset::UrhoModel() const
 {
     return model;
 }
 
+void IMeshAsset::SetLodSettings(const MeshLodSettings &settings)
+{
+    lodSettings = settings;
+}
+
+const MeshLodSettings &IMeshAsset::LodSettings()
+{
+    return lodSettings;
+}
+
+bool IMeshAsset::LodGenerationEnabled() const
+{
+    return lodSettings.enabled && !lodSettings.reductions.Empty() && !assetAPI->GetFramework()->HasCommandLineParameter("--noMeshLod");
+}
+
+void IMeshAsset::GenerateMissingLodLevels()
+{
+    if (!model || !LodGenerationEnabled())
+        return;
+
+    uint levels = GenerateLodLevels(model, lodSettings);
+    if (levels > 0)
+        LogDebug("IMeshAsset: Generated " + String(levels) + " LOD levels for " + Name());
+}
+
 }
@@ -4,6 +4,7 @@
 
 #include "Math/MathNamespace.h"
 #include "IAsset.h"
+#include "MeshSimplification.h"
 #include "UrhoRendererApi.h"
 #include "UrhoRendererFwd.h"
 
@@ -26,16 +27,33 @@ public:
     /// IAsset override.
     bool IsLoaded() const override;
 
+    /// Returns the size of the bone bounding boxes. IAsset override.
+    uint CpuMemoryUsage() const override;
+
+    /// Returns the size of the vertex and index buffers. IAsset override.
+    uint GpuMemoryUsage() const override;
+
     /// Returns submesh count.
     uint NumSubmeshes() const;
 
     /// Return bone bounding boxes. Not needed by implementations that already contain a fully working skeleton within the Urho model itself
     const Vector<Urho3D::BoundingBox>& BoneBoundingBoxes() const { return boneBoundingBoxes; }
 
+    /// Sets the settings used for generating LOD levels for meshes loaded after this call.
+    static void SetLodSettings(const MeshLodSettings &settings);
+    /// Returns the current LOD generation settings.
+    static const MeshLodSettings &LodSettings();
+
 protected:
     /// Unload mesh. IAsset override.
     void DoUnload() override;
 
+    /// Returns whether LOD levels are generated for loaded meshes. Disabled by the settings or the --noMeshLod command line parameter.
+    bool LodGenerationEnabled() const;
+
+    /// Generates LOD levels for the submeshes of the loaded model that have none, if LOD generation is enabled.
+    void GenerateMissingLodLevels();
+
     /// Urho model resource. Filled by the loading implementations in subclasses.
     SharedPtr<Urho3D::Model> model;
 
@@ -35,4 +35,17 @@ bool IParticleAsset::IsLoaded() const
     return particleEffects_.Size() > 0;
 }
 
+uint IParticleAsset::CpuMemoryUsage() const
+{
+    uint bytes = materials_.Size() * sizeof(Pair<int, AssetReference>);
+    foreach(const SharedPtr<Urho3D::ParticleEffect> &effect, particleEffects_)
+    {
+        if (!effect)
+            continue;
+        bytes += sizeof(Urho3D::ParticleEffect) + effect->GetColorFrames().Size() * sizeof(Urho3D::ColorFrame) +
+            effect->GetTextureFrames().Size() * sizeof(Urho3D::TextureFrame);
+    }
+    return bytes;
+}
+
 }
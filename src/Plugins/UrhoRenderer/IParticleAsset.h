@@ -22,6 +22,10 @@ public:
     /// IAsset override.
     bool IsLoaded() const override;
 
+    /// IAsset override.
+    /** The materials of the effects are separate assets and report their own memory usage. */
+    uint CpuMemoryUsage() const override;
+
     /// Material and index to the particle system they belong to.
     Vector<Pair<int, AssetReference> > materials_;
 
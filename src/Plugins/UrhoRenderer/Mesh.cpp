@@ -5,6 +5,8 @@
 #include "Framework.h"
 #include "GraphicsWorld.h"
 #include "Placeable.h"
+#include "TransformCache.h"
+#include "AnimationSystem.h"
 #include "Scene/Scene.h"
 #include "AttributeMetadata.h"
 #include "LoggingFunctions.h"
@@ -70,6 +72,7 @@ float3x4 Mesh::LocalToWorld() const
     if (!adjustmentNode_)
         return float3x4::identity;
 
+    ApplyPendingNodeTransforms();
     return float3x4::FromTRS(adjustmentNode_->GetWorldPosition(), adjustmentNode_->GetWorldRotation(), adjustmentNode_->GetWorldScale());
 }
 
@@ -136,6 +139,7 @@ Urho3D::Node* Mesh::BoneNode(const String& name) const
 {
     if (!mesh_)
         return nullptr;
+    ApplyPendingNodeTransforms();
     Urho3D::Bone* bone = mesh_->GetSkeleton().GetBone(name);
     return bone ? bone->node_.Get() : nullptr;
 }
@@ -176,6 +180,16 @@ Quat Mesh::BoneWorldOrientation(const String& name) const
     return bone ? Quat(bone->GetWorldRotation()) : Quat::identity;
 }
 
+void Mesh::ApplyPendingNodeTransforms() const
+{
+    // On a headless server the placeables update their scene nodes, and the animations pose the skeletons, lazily.
+    if (world_)
+    {
+        world_->Transforms()->ApplyNodeTransforms();
+        world_->Animations()->ApplyPoses();
+    }
+}
+
 void Mesh::DeserializeFrom(Urho3D::XMLElement& element, AttributeChange::Type change)
 {
     if (!BeginDeserialization(element))
@@ -252,6 +266,7 @@ void Mesh::UpdateSignals()
     meshRefListener_ = new AssetRefListener();
     skeletonRefListener_ = new AssetRefListener();
     materialRefListListener_ = new AssetRefListListener(framework->Asset());
+    materialRefListListener_->SetRequester(parent);
     
     parent->ComponentAdded.Connect(this, &Mesh::OnComponentStructureChanged);
     parent->ComponentRemoved.Connect(this, &Mesh::OnComponentStructureChanged);
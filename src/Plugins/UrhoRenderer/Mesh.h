@@ -179,6 +179,9 @@ private:
     /// Detaches mesh from placeable
     void DetachMesh();
 
+    /// Applies the transforms of placeables that have not been copied to their scene nodes yet, and the pending skeleton poses, before reading node transforms.
+    void ApplyPendingNodeTransforms() const;
+
     /// React to attribute changes
     void AttributesChanged() override;
 
@@ -0,0 +1,402 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "MeshOptimization.h"
+
+#include <Urho3D/Core/Profiler.h>
+#include <Urho3D/Graphics/Geometry.h>
+#include <Urho3D/Graphics/IndexBuffer.h>
+#include <Urho3D/Graphics/Model.h>
+#include <Urho3D/Graphics/VertexBuffer.h>
+
+#include <cmath>
+#include <cstring>
+
+namespace Tundra
+{
+
+namespace
+{
+
+/// Size of the LRU cache modelled by the vertex scoring.
+const uint cMaxCacheSize = 32;
+const float cCacheDecayPower = 1.5f;
+const float cLastTriangleScore = 0.75f;
+const float cValenceBoostScale = 2.0f;
+const float cValenceBoostPower = 0.5f;
+
+/// Returns the Forsyth score of a vertex at @c cachePosition (-1 if not in the cache) with @c activeTriangles triangles still to be emitted.
+float VertexScore(int cachePosition, uint activeTriangles)
+{
+    if (!activeTriangles)
+        return -1.0f;
+
+    float score = 0.0f;
+    if (cachePosition >= 0)
+    {
+        // The vertices of the last triangle get a fixed score, so that the next triangle does not favour any edge of it
+        if (cachePosition < 3)
+            score = cLastTriangleScore;
+        else
+            score = powf(1.0f - (cachePosition - 3) / (float)(cMaxCacheSize - 3), cCacheDecayPower);
+    }
+    // Boost vertices with few triangles left, so that lone triangles are not left behind
+    return score + cValenceBoostScale * powf((float)activeTriangles, -cValenceBoostPower);
+}
+
+/// Reads the indices of a geometry's draw range.
+PODVector<unsigned> ReadIndices(Urho3D::Geometry *geometry)
+{
+    Urho3D::IndexBuffer *ib = geometry->GetIndexBuffer();
+    PODVector<unsigned> indices(geometry->GetIndexCount());
+    const u8 *data = ib->GetShadowData() + geometry->GetIndexStart() * ib->GetIndexSize();
+    for (uint i = 0; i < indices.Size(); ++i)
+        indices[i] = ib->GetIndexSize() == sizeof(unsigned) ? ((const unsigned*)data)[i] : ((const unsigned short*)data)[i];
+    return indices;
+}
+
+/// Writes the indices of a geometry's draw range.
+void WriteIndices(Urho3D::Geometry *geometry, const PODVector<unsigned> &indices)
+{
+    Urho3D::IndexBuffer *ib = geometry->GetIndexBuffer();
+    if (ib->GetIndexSize() == sizeof(unsigned))
+        ib->SetDataRange(&indices[0], geometry->GetIndexStart(), indices.Size());
+    else
+    {
+        PODVector<unsigned short> shortIndices(indices.Size());
+        for (uint i = 0; i < indices.Size(); ++i)
+            shortIndices[i] = (unsigned short)indices[i];
+        ib->SetDataRange(&shortIndices[0], geometry->GetIndexStart(), shortIndices.Size());
+    }
+}
+
+/// Returns whether the geometry is a triangle list with shadowed buffers that can be optimized.
+bool IsOptimizable(Urho3D::Geometry *geometry)
+{
+    return geometry && geometry->GetPrimitiveType() == Urho3D::TRIANGLE_LIST && geometry->GetIndexCount() &&
+        geometry->GetIndexBuffer() && geometry->GetIndexBuffer()->GetShadowData() &&
+        geometry->GetVertexBuffer(0) && geometry->GetVertexBuffer(0)->GetShadowData();
+}
+
+struct IndexRange
+{
+    Urho3D::IndexBuffer *ib;
+    unsigned start;
+    unsigned count;
+};
+
+/// Reorders the vertices of @c vb in the order of their first use by @c geometries, and remaps their indices.
+void OptimizeVertexFetch(Urho3D::VertexBuffer *vb, const PODVector<Urho3D::Geometry*> &geometries)
+{
+    const uint vertexCount = vb->GetVertexCount();
+    const uint vertexSize = vb->GetVertexSize();
+    const unsigned unused = 0xffffffff;
+
+    PODVector<unsigned> remap(vertexCount);
+    for (uint i = 0; i < vertexCount; ++i)
+        remap[i] = unused;
+    unsigned next = 0;
+    for (uint g = 0; g < geometries.Size(); ++g)
+    {
+        const PODVector<unsigned> indices = ReadIndices(geometries[g]);
+        for (uint i = 0; i < indices.Size(); ++i)
+        {
+            if (indices[i] >= vertexCount)
+                return;
+            if (remap[indices[i]] == unused)
+                remap[indices[i]] = next++;
+        }
+    }
+    // Vertices not used by any geometry keep their relative order at the end
+    bool identity = true;
+    for (uint i = 0; i < vertexCount; ++i)
+    {
+        if (remap[i] == unused)
+            remap[i] = next++;
+        identity = identity && remap[i] == i;
+    }
+    if (identity)
+        return;
+
+    const u8 *src = vb->GetShadowData();
+    PODVector<u8> vertices(vertexCount * vertexSize);
+    for (uint i = 0; i < vertexCount; ++i)
+        memcpy(&vertices[remap[i] * vertexSize], src + i * vertexSize, vertexSize);
+    vb->SetData(&vertices[0]);
+
+    // Geometries can share index ranges, for example LOD levels that could not be simplified, so remap each range only once
+    PODVector<IndexRange> remapped;
+    for (uint g = 0; g < geometries.Size(); ++g)
+    {
+        Urho3D::Geometry *geometry = geometries[g];
+        bool done = false;
+        for (uint r = 0; r < remapped.Size() && !done; ++r)
+            done = remapped[r].ib == geometry->GetIndexBuffer() && remapped[r].start == geometry->GetIndexStart() &&
+                remapped[r].count == geometry->GetIndexCount();
+        if (!done)
+        {
+            PODVector<unsigned> indices = ReadIndices(geometry);
+            for (uint i = 0; i < indices.Size(); ++i)
+                indices[i] = remap[indices[i]];
+            WriteIndices(geometry, indices);
+            IndexRange range = { geometry->GetIndexBuffer(), geometry->GetIndexStart(), geometry->GetIndexCount() };
+            remapped.Push(range);
+        }
+        // Refresh the used vertex range
+        geometry->SetDrawRange(geometry->GetPrimitiveType(), geometry->GetIndexStart(), geometry->GetIndexCount());
+    }
+}
+
+}
+
+VertexCacheStatistics AnalyzeVertexCache(const PODVector<unsigned> &indices, uint vertexCount, uint cacheSize)
+{
+    VertexCacheStatistics stats;
+    stats.triangles = indices.Size() / 3;
+
+    // A vertex is in the FIFO cache if fewer than cacheSize misses have happened since it was loaded
+    PODVector<unsigned> timestamps(vertexCount);
+    for (uint i = 0; i < vertexCount; ++i)
+        timestamps[i] = 0;
+    unsigned timestamp = cacheSize + 1;
+    for (uint i = 0; i < indices.Size(); ++i)
+    {
+        const unsigned v = indices[i];
+        if (v >= vertexCount)
+            continue;
+        if (!timestamps[v])
+            ++stats.vertices;
+        if (!timestamps[v] || timestamp - timestamps[v] > cacheSize)
+        {
+            timestamps[v] = timestamp++;
+            ++stats.misses;
+        }
+    }
+    return stats;
+}
+
+void OptimizeVertexCache(PODVector<unsigned> &indices, uint vertexCount)
+{
+    const uint numTriangles = indices.Size() / 3;
+    if (numTriangles < 2 || indices.Size() % 3 != 0)
+        return;
+    for (uint i = 0; i < indices.Size(); ++i)
+        if (indices[i] >= vertexCount)
+            return;
+
+    URHO3D_PROFILE(OptimizeVertexCache);
+
+    // Triangles around each vertex. The not yet emitted triangles of a vertex are kept first in its list.
+    PODVector<unsigned> offsets(vertexCount + 1);
+    PODVector<unsigned> activeTriangles(vertexCount);
+    for (uint i = 0; i <= vertexCount; ++i)
+        offsets[i] = 0;
+    for (uint i = 0; i < indices.Size(); ++i)
+        ++offsets[indices[i] + 1];
+    for (uint i = 0; i < vertexCount; ++i)
+    {
+        activeTriangles[i] = offsets[i + 1];
+        offsets[i + 1] += offsets[i];
+    }
+    PODVector<unsigned> vertexTriangles(indices.Size());
+    {
+        PODVector<unsigned> fill(vertexCount);
+        for (uint i = 0; i < vertexCount; ++i)
+            fill[i] = offsets[i];
+        for (uint i = 0; i < indices.Size(); ++i)
+            vertexTriangles[fill[indices[i]]++] = i / 3;
+    }
+
+    PODVector<float> vertexScores(vertexCount);
+    PODVector<int> cachePositions(vertexCount);
+    for (uint i = 0; i < vertexCount; ++i)
+    {
+        cachePositions[i] = -1;
+        vertexScores[i] = VertexScore(-1, activeTriangles[i]);
+    }
+
+    PODVector<u8> emitted(numTriangles);
+    int bestTriangle = -1;
+    float bestScore = -1.0f;
+    for (uint t = 0; t < numTriangles; ++t)
+    {
+        emitted[t] = 0;
+        const float score = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+        if (score > bestScore)
+        {
+            bestScore = score;
+            bestTriangle = t;
+        }
+    }
+
+    PODVector<unsigned> output(indices.Size());
+    unsigned cache[cMaxCacheSize + 3];
+    unsigned newCache[cMaxCacheSize + 3];
+    uint cacheCount = 0;
+    uint nextUnemitted = 0;
+
+    for (uint n = 0; n < numTriangles; ++n)
+    {
+        if (bestTriangle < 0)
+        {
+            // None of the cached vertices has triangles left, continue from the first triangle not emitted yet
+            while (emitted[nextUnemitted])
+                ++nextUnemitted;
+            bestTriangle = nextUnemitted;
+        }
+
+        const unsigned *tri = &indices[bestTriangle * 3];
+        emitted[bestTriangle] = 1;
+        uint newCount = 0;
+        for (uint k = 0; k < 3; ++k)
+        {
+            const unsigned v = tri[k];
+            output[n * 3 + k] = v;
+            newCache[newCount++] = v;
+
+            // Move the triangle past the active triangles of the vertex
+            unsigned *triangles = &vertexTriangles[offsets[v]];
+            for (uint j = 0; j < activeTriangles[v]; ++j)
+            {
+                if (triangles[j] == (unsigned)bestTriangle)
+                {
+                    triangles[j] = triangles[activeTriangles[v] - 1];
+                    triangles[activeTriangles[v] - 1] = bestTriangle;
+                    --activeTriangles[v];
+                    break;
+                }
+            }
+        }
+
+        // The vertices of the emitted triangle move to the front of the LRU cache
+        for (uint i = 0; i < cacheCount; ++i)
+        {
+            const unsigned v = cache[i];
+            if (v != tri[0] && v != tri[1] && v != tri[2])
+                newCache[newCount++] = v;
+        }
+        for (uint i = 0; i < newCount; ++i)
+        {
+            const unsigned v = newCache[i];
+            cachePositions[v] = i < cMaxCacheSize ? (int)i : -1;
+            vertexScores[v] = VertexScore(cachePositions[v], activeTriangles[v]);
+        }
+
+        // Rescore the triangles of the vertices that were in the cache, including the ones just evicted, and pick the best one
+        bestTriangle = -1;
+        bestScore = -1.0f;
+        for (uint i = 0; i < newCount; ++i)
+        {
+            const unsigned v = newCache[i];
+            for (uint j = 0; j < activeTriangles[v]; ++j)
+            {
+                const unsigned t = vertexTriangles[offsets[v] + j];
+                const float score = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    bestTriangle = t;
+                }
+            }
+        }
+
+        cacheCount = Urho3D::Min(newCount, cMaxCacheSize);
+        memcpy(cache, newCache, cacheCount * sizeof(unsigned));
+    }
+
+    indices = output;
+}
+
+void OptimizeVertexCache(Urho3D::Model *model, VertexCacheStatistics *before, VertexCacheStatistics *after)
+{
+    if (!model)
+        return;
+
+    URHO3D_PROFILE(OptimizeModelVertexCache);
+
+    if (before)
+        *before = VertexCacheStatistics();
+    if (after)
+        *after = VertexCacheStatistics();
+
+    // Reorder the triangles of every geometry. Full detail levels come first, so that their vertices come first in the vertex buffers.
+    PODVector<Urho3D::Geometry*> geometries;
+    for (uint l = 0; ; ++l)
+    {
+        bool found = false;
+        for (uint i = 0; i < model->GetNumGeometries(); ++i)
+        {
+            if (l >= model->GetNumGeometryLodLevels(i))
+                continue;
+            found = true;
+            Urho3D::Geometry *geometry = model->GetGeometry(i, l);
+            if (!IsOptimizable(geometry))
+                continue;
+
+            const uint vertexCount = geometry->GetVertexBuffer(0)->GetVertexCount();
+            PODVector<unsigned> indices = ReadIndices(geometry);
+            if (before && l == 0)
+                before->Add(AnalyzeVertexCache(indices, vertexCount));
+            OptimizeVertexCache(indices, vertexCount);
+            WriteIndices(geometry, indices);
+            geometries.Push(geometry);
+        }
+        if (!found)
+            break;
+    }
+
+    // Morph data refers to vertex indices, so morphed vertex buffers keep their vertex order
+    const Vector<SharedPtr<Urho3D::VertexBuffer> > &vertexBuffers = model->GetVertexBuffers();
+    PODVector<Urho3D::VertexBuffer*> morphed;
+    const Vector<Urho3D::ModelMorph> &morphs = model->GetMorphs();
+    for (uint m = 0; m < morphs.Size(); ++m)
+        for (Urho3D::HashMap<unsigned, Urho3D::VertexBufferMorph>::ConstIterator it = morphs[m].buffers_.Begin(); it != morphs[m].buffers_.End(); ++it)
+            if (it->first_ < vertexBuffers.Size())
+                morphed.Push(vertexBuffers[it->first_]);
+
+    for (uint b = 0; b < vertexBuffers.Size(); ++b)
+    {
+        Urho3D::VertexBuffer *vb = vertexBuffers[b];
+        if (!vb || !vb->GetShadowData() || morphed.Contains(vb))
+            continue;
+
+        // The vertices can only be reordered if every geometry using the buffer can be remapped with it
+        bool reorderable = true;
+        for (uint i = 0; i < model->GetNumGeometries() && reorderable; ++i)
+            for (uint l = 0; l < model->GetNumGeometryLodLevels(i) && reorderable; ++l)
+            {
+                Urho3D::Geometry *geometry = model->GetGeometry(i, l);
+                if (!geometry)
+                    continue;
+                for (uint j = 0; j < geometry->GetNumVertexBuffers(); ++j)
+                    if (geometry->GetVertexBuffer(j) == vb && (geometry->GetNumVertexBuffers() != 1 || !geometries.Contains(geometry)))
+                        reorderable = false;
+            }
+        PODVector<Urho3D::Geometry*> users;
+        for (uint g = 0; g < geometries.Size(); ++g)
+            if (geometries[g]->GetVertexBuffer(0) == vb && !users.Contains(geometries[g]))
+                users.Push(geometries[g]);
+        // Nor if its index buffers are also used with other vertex buffers
+        for (uint g = 0; g < geometries.Size() && reorderable; ++g)
+        {
+            if (geometries[g]->GetVertexBuffer(0) == vb)
+                continue;
+            for (uint u = 0; u < users.Size() && reorderable; ++u)
+                reorderable = geometries[g]->GetIndexBuffer() != users[u]->GetIndexBuffer();
+        }
+        if (reorderable && !users.Empty())
+            OptimizeVertexFetch(vb, users);
+    }
+
+    if (after)
+    {
+        for (uint i = 0; i < model->GetNumGeometries(); ++i)
+        {
+            Urho3D::Geometry *geometry = model->GetGeometry(i, 0);
+            if (IsOptimizable(geometry))
+                after->Add(AnalyzeVertexCache(ReadIndices(geometry), geometry->GetVertexBuffer(0)->GetVertexCount()));
+        }
+    }
+}
+
+}
@@ -0,0 +1,54 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "CoreTypes.h"
+#include "UrhoRendererApi.h"
+#include "UrhoRendererFwd.h"
+
+#include <Urho3D/Container/Vector.h>
+
+namespace Tundra
+{
+
+/// Post-transform vertex cache statistics of triangle lists, simulated with a FIFO cache.
+struct URHORENDERER_API VertexCacheStatistics
+{
+    VertexCacheStatistics() : triangles(0), vertices(0), misses(0) {}
+
+    /// Average cache miss ratio: transformed vertices per triangle. 0.5 is the ideal for large regular meshes, 3 the worst case.
+    float Acmr() const { return triangles ? (float)misses / triangles : 0.0f; }
+    /// Average transform to vertex ratio: transformed vertices per used vertex. 1 is the ideal.
+    float Atvr() const { return vertices ? (float)misses / vertices : 0.0f; }
+
+    /// Adds the statistics of another triangle list.
+    void Add(const VertexCacheStatistics &other)
+    {
+        triangles += other.triangles;
+        vertices += other.vertices;
+        misses += other.misses;
+    }
+
+    /// Number of triangles.
+    uint triangles;
+    /// Number of distinct vertices used by the triangles.
+    uint vertices;
+    /// Number of vertex cache misses, i.e. vertex shader invocations.
+    uint misses;
+};
+
+/// Simulates a FIFO post-transform vertex cache of @c cacheSize entries for a triangle list.
+URHORENDERER_API VertexCacheStatistics AnalyzeVertexCache(const PODVector<unsigned> &indices, uint vertexCount, uint cacheSize = 16);
+
+/// Reorders the triangles of a triangle list for post-transform vertex cache efficiency.
+/** Uses Tom Forsyth's linear-speed vertex cache optimisation, which is not tied to an exact cache size. */
+URHORENDERER_API void OptimizeVertexCache(PODVector<unsigned> &indices, uint vertexCount);
+
+/// Reorders the triangles of all triangle list geometries of @c model, and then the vertices in the order of their first use for fetch locality.
+/** The vertex buffers and index buffers must be shadowed. Vertex buffers that are morphed, or whose index buffers are also used with other
+    vertex buffers, only get their triangles reordered.
+    @param before If non-null, receives the vertex cache statistics of the full detail geometries before the optimization.
+    @param after If non-null, receives the vertex cache statistics of the full detail geometries after the optimization. */
+URHORENDERER_API void OptimizeVertexCache(Urho3D::Model *model, VertexCacheStatistics *before = 0, VertexCacheStatistics *after = 0);
+
+}
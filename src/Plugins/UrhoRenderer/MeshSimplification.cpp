@@ -0,0 +1,434 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "MeshSimplification.h"
+
+#include <Urho3D/Container/Sort.h>
+#include <Urho3D/Core/Profiler.h>
+#include <Urho3D/Graphics/Geometry.h>
+#include <Urho3D/Graphics/IndexBuffer.h>
+#include <Urho3D/Graphics/Model.h>
+#include <Urho3D/Graphics/VertexBuffer.h>
+#include <Urho3D/Math/Vector3.h>
+
+#include <cmath>
+#include <cstring>
+
+namespace Tundra
+{
+
+namespace
+{
+
+/// Symmetric 4x4 matrix of the weighted squared distance to a set of planes, with the total weight of the planes.
+struct Quadric
+{
+    void Reset()
+    {
+        a2 = b2 = c2 = d2 = ab = ac = ad = bc = bd = cd = w = 0.0;
+    }
+
+    /// Sets the quadric of the plane ax + by + cz + d = 0 with a normalized plane normal.
+    void SetPlane(double a, double b, double c, double d, double weight)
+    {
+        a2 = a * a * weight; b2 = b * b * weight; c2 = c * c * weight; d2 = d * d * weight;
+        ab = a * b * weight; ac = a * c * weight; ad = a * d * weight;
+        bc = b * c * weight; bd = b * d * weight; cd = c * d * weight;
+        w = weight;
+    }
+
+    void Add(const Quadric &q)
+    {
+        a2 += q.a2; b2 += q.b2; c2 += q.c2; d2 += q.d2;
+        ab += q.ab; ac += q.ac; ad += q.ad;
+        bc += q.bc; bd += q.bd; cd += q.cd;
+        w += q.w;
+    }
+
+    /// Returns the weighted mean squared distance of @c p to the planes.
+    double Error(const Urho3D::Vector3 &p) const
+    {
+        const double x = p.x_, y = p.y_, z = p.z_;
+        const double e = a2 * x * x + b2 * y * y + c2 * z * z + 2.0 * (ab * x * y + ac * x * z + bc * y * z) +
+            2.0 * (ad * x + bd * y + cd * z) + d2;
+        return w > 0.0 ? Urho3D::Max(e, 0.0) / w : 0.0;
+    }
+
+    double a2, b2, c2, d2, ab, ac, ad, bc, bd, cd, w;
+};
+
+enum VertexKind
+{
+    VK_Manifold, ///< Interior vertex, can collapse along any edge.
+    VK_Border, ///< Vertex on an open border, can collapse only along the border.
+    VK_Locked ///< Vertex on an attribute seam, stays in place.
+};
+
+struct Edge
+{
+    unsigned a, b;
+};
+
+bool EdgeLess(const Edge &lhs, const Edge &rhs)
+{
+    return lhs.a < rhs.a || (lhs.a == rhs.a && lhs.b < rhs.b);
+}
+
+/// Returns whether the directed edge exists in the sorted edge list.
+bool HasEdge(const PODVector<Edge> &edges, unsigned a, unsigned b)
+{
+    uint first = 0, last = edges.Size();
+    while (first < last)
+    {
+        const uint middle = (first + last) / 2;
+        if (edges[middle].a < a || (edges[middle].a == a && edges[middle].b < b))
+            first = middle + 1;
+        else
+            last = middle;
+    }
+    return first < edges.Size() && edges[first].a == a && edges[first].b == b;
+}
+
+struct PositionEntry
+{
+    Urho3D::Vector3 position;
+    unsigned vertex;
+};
+
+bool PositionLess(const PositionEntry &lhs, const PositionEntry &rhs)
+{
+    if (lhs.position.x_ != rhs.position.x_)
+        return lhs.position.x_ < rhs.position.x_;
+    if (lhs.position.y_ != rhs.position.y_)
+        return lhs.position.y_ < rhs.position.y_;
+    return lhs.position.z_ < rhs.position.z_;
+}
+
+struct Collapse
+{
+    unsigned from, to;
+    double cost;
+};
+
+bool CollapseLess(const Collapse &lhs, const Collapse &rhs)
+{
+    return lhs.cost < rhs.cost;
+}
+
+/// Border edges are weighted heavily so that the border keeps its shape.
+const double cBorderWeight = 10.0;
+/// Upper bound for the simplification passes. Each pass does a set of independent collapses.
+const uint cMaxPasses = 64;
+
+}
+
+PODVector<unsigned> SimplifyMesh(const PODVector<unsigned> &indices, const u8 *positions, uint stride, uint vertexCount,
+    uint targetIndexCount, float maxError, float *resultError)
+{
+    URHO3D_PROFILE(SimplifyMesh);
+
+    PODVector<unsigned> result(indices);
+    double largestCost = 0.0;
+    if (resultError)
+        *resultError = 0.0f;
+    if (!positions || indices.Size() % 3 != 0 || indices.Size() <= targetIndexCount)
+        return result;
+    for (uint i = 0; i < indices.Size(); ++i)
+        if (indices[i] >= vertexCount)
+            return result;
+
+    PODVector<Urho3D::Vector3> pos(vertexCount);
+    for (uint i = 0; i < vertexCount; ++i)
+        memcpy(&pos[i], positions + i * stride, sizeof(Urho3D::Vector3));
+
+    // Vertices that share their position with another vertex lie on an attribute (UV, normal) seam and are locked
+    PODVector<u8> kinds(vertexCount);
+    {
+        PODVector<PositionEntry> sorted(vertexCount);
+        for (uint i = 0; i < vertexCount; ++i)
+        {
+            sorted[i].position = pos[i];
+            sorted[i].vertex = i;
+            kinds[i] = VK_Manifold;
+        }
+        Urho3D::Sort(sorted.Begin(), sorted.End(), &PositionLess);
+        for (uint i = 1; i < vertexCount; ++i)
+            if (sorted[i].position == sorted[i - 1].position)
+                kinds[sorted[i].vertex] = kinds[sorted[i - 1].vertex] = VK_Locked;
+    }
+
+    PODVector<Quadric> quadrics(vertexCount);
+    for (uint i = 0; i < vertexCount; ++i)
+        quadrics[i].Reset();
+
+    PODVector<Edge> edges;
+    PODVector<unsigned> triangleOffsets, vertexTriangles;
+    PODVector<unsigned> remap(vertexCount);
+    PODVector<u8> touched(vertexCount);
+    PODVector<Collapse> collapses;
+    const double maxCost = (double)maxError * (double)maxError;
+
+    for (uint pass = 0; pass < cMaxPasses && result.Size() > targetIndexCount; ++pass)
+    {
+        const uint numTriangles = result.Size() / 3;
+
+        // Directed edges of the current mesh, sorted for finding the opposite edges
+        edges.Resize(result.Size());
+        for (uint t = 0; t < numTriangles; ++t)
+            for (uint k = 0; k < 3; ++k)
+            {
+                edges[t * 3 + k].a = result[t * 3 + k];
+                edges[t * 3 + k].b = result[t * 3 + (k + 1) % 3];
+            }
+        Urho3D::Sort(edges.Begin(), edges.End(), &EdgeLess);
+
+        // Edges without an opposite edge are on the border
+        for (uint i = 0; i < edges.Size(); ++i)
+        {
+            if (HasEdge(edges, edges[i].b, edges[i].a))
+                continue;
+            if (kinds[edges[i].a] == VK_Manifold)
+                kinds[edges[i].a] = VK_Border;
+            if (kinds[edges[i].b] == VK_Manifold)
+                kinds[edges[i].b] = VK_Border;
+        }
+
+        if (pass == 0)
+        {
+            // Accumulate the area weighted triangle planes, and planes perpendicular to the border edges
+            for (uint t = 0; t < numTriangles; ++t)
+            {
+                const unsigned *tri = &result[t * 3];
+                Urho3D::Vector3 normal = (pos[tri[1]] - pos[tri[0]]).CrossProduct(pos[tri[2]] - pos[tri[0]]);
+                const float length = normal.Length();
+                if (length <= 0.0f)
+                    continue;
+                normal /= length;
+
+                Quadric q;
+                q.SetPlane(normal.x_, normal.y_, normal.z_, -normal.DotProduct(pos[tri[0]]), length * 0.5f);
+                for (uint k = 0; k < 3; ++k)
+                    quadrics[tri[k]].Add(q);
+
+                for (uint k = 0; k < 3; ++k)
+                {
+                    const unsigned a = tri[k], b = tri[(k + 1) % 3];
+                    if (HasEdge(edges, b, a))
+                        continue;
+                    const Urho3D::Vector3 edge = pos[b] - pos[a];
+                    Urho3D::Vector3 borderNormal = edge.CrossProduct(normal);
+                    const float borderLength = borderNormal.Length();
+                    if (borderLength <= 0.0f)
+                        continue;
+                    borderNormal /= borderLength;
+                    q.SetPlane(borderNormal.x_, borderNormal.y_, borderNormal.z_, -borderNormal.DotProduct(pos[a]), edge.LengthSquared() * cBorderWeight);
+                    quadrics[a].Add(q);
+                    quadrics[b].Add(q);
+                }
+            }
+        }
+
+        // Triangles around each vertex
+        triangleOffsets.Resize(vertexCount + 1);
+        for (uint i = 0; i <= vertexCount; ++i)
+            triangleOffsets[i] = 0;
+        for (uint i = 0; i < result.Size(); ++i)
+            ++triangleOffsets[result[i] + 1];
+        for (uint i = 0; i < vertexCount; ++i)
+            triangleOffsets[i + 1] += triangleOffsets[i];
+        vertexTriangles.Resize(result.Size());
+        for (uint i = 0; i < result.Size(); ++i)
+            vertexTriangles[triangleOffsets[result[i]]++] = i / 3;
+        for (uint i = vertexCount; i > 0; --i)
+            triangleOffsets[i] = triangleOffsets[i - 1];
+        triangleOffsets[0] = 0;
+
+        // Collapse candidates: each edge once, in the cheaper valid direction
+        collapses.Clear();
+        for (uint i = 0; i < edges.Size(); ++i)
+        {
+            const unsigned a = edges[i].a, b = edges[i].b;
+            const bool border = !HasEdge(edges, b, a);
+            if (!border && a > b)
+                continue;
+
+            Collapse collapse;
+            collapse.cost = -1.0;
+            for (uint direction = 0; direction < 2; ++direction)
+            {
+                const unsigned from = direction ? b : a;
+                const unsigned to = direction ? a : b;
+                if (kinds[from] == VK_Locked || (kinds[from] == VK_Border && !border))
+                    continue;
+                Quadric q = quadrics[from];
+                q.Add(quadrics[to]);
+                const double cost = q.Error(pos[to]);
+                if (collapse.cost < 0.0 || cost < collapse.cost)
+                {
+                    collapse.from = from;
+                    collapse.to = to;
+                    collapse.cost = cost;
+                }
+            }
+            if (collapse.cost >= 0.0 && collapse.cost <= maxCost)
+                collapses.Push(collapse);
+        }
+        if (collapses.Empty())
+            break;
+        Urho3D::Sort(collapses.Begin(), collapses.End(), &CollapseLess);
+
+        // Do the cheapest collapses that do not touch the same vertices twice, until the target is reached
+        for (uint i = 0; i < vertexCount; ++i)
+        {
+            remap[i] = i;
+            touched[i] = 0;
+        }
+        const uint trianglesToRemove = numTriangles - targetIndexCount / 3;
+        uint removedTriangles = 0;
+        uint numCollapses = 0;
+        for (uint c = 0; c < collapses.Size() && removedTriangles < trianglesToRemove; ++c)
+        {
+            const unsigned from = collapses[c].from, to = collapses[c].to;
+            if (touched[from] || touched[to])
+                continue;
+
+            // Reject collapses that would flip a triangle around the moved vertex
+            bool flips = false;
+            uint removes = 0;
+            for (uint t = triangleOffsets[from]; t < triangleOffsets[from + 1] && !flips; ++t)
+            {
+                const unsigned *tri = &result[vertexTriangles[t] * 3];
+                unsigned v0 = remap[tri[0]], v1 = remap[tri[1]], v2 = remap[tri[2]];
+                if (v0 == v1 || v1 == v2 || v0 == v2)
+                    continue;
+                if (v0 == to || v1 == to || v2 == to)
+                {
+                    ++removes;
+                    continue;
+                }
+                // Rotate the moved vertex first
+                while (v0 != from)
+                {
+                    const unsigned temp = v0;
+                    v0 = v1; v1 = v2; v2 = temp;
+                }
+                const Urho3D::Vector3 before = (pos[v1] - pos[from]).CrossProduct(pos[v2] - pos[from]);
+                const Urho3D::Vector3 after = (pos[v1] - pos[to]).CrossProduct(pos[v2] - pos[to]);
+                flips = before.DotProduct(after) <= 0.0f;
+            }
+            if (flips)
+                continue;
+
+            remap[from] = to;
+            quadrics[to].Add(quadrics[from]);
+            touched[from] = touched[to] = 1;
+            removedTriangles += removes;
+            largestCost = Urho3D::Max(largestCost, collapses[c].cost);
+            ++numCollapses;
+        }
+        if (!numCollapses)
+            break;
+
+        // Apply the collapses and drop the degenerate triangles
+        uint write = 0;
+        for (uint t = 0; t < numTriangles; ++t)
+        {
+            const unsigned v0 = remap[result[t * 3]], v1 = remap[result[t * 3 + 1]], v2 = remap[result[t * 3 + 2]];
+            if (v0 == v1 || v1 == v2 || v0 == v2)
+                continue;
+            result[write++] = v0;
+            result[write++] = v1;
+            result[write++] = v2;
+        }
+        result.Resize(write);
+    }
+
+    if (resultError)
+        *resultError = (float)sqrt(largestCost);
+    return result;
+}
+
+uint GenerateLodLevels(Urho3D::Model *model, const MeshLodSettings &settings)
+{
+    if (!model || !settings.enabled || settings.reductions.Empty())
+        return 0;
+
+    URHO3D_PROFILE(GenerateLodLevels);
+
+    const Urho3D::BoundingBox &box = model->GetBoundingBox();
+    const float maxError = settings.maxError * (box.max_ - box.min_).Length();
+    Vector<SharedPtr<Urho3D::IndexBuffer> > indexBuffers = model->GetIndexBuffers();
+    uint generated = 0;
+
+    for (uint i = 0; i < model->GetNumGeometries(); ++i)
+    {
+        if (model->GetNumGeometryLodLevels(i) != 1)
+            continue;
+        Urho3D::Geometry *geometry = model->GetGeometry(i, 0);
+        if (!geometry || geometry->GetPrimitiveType() != Urho3D::TRIANGLE_LIST || geometry->GetIndexCount() < settings.minTriangles * 3)
+            continue;
+        Urho3D::IndexBuffer *ib = geometry->GetIndexBuffer();
+        Urho3D::VertexBuffer *vb = geometry->GetVertexBuffer(0);
+        if (!ib || !vb || !ib->GetShadowData() || !vb->GetShadowData() || !(vb->GetElementMask() & Urho3D::MASK_POSITION))
+            continue;
+
+        PODVector<unsigned> indices(geometry->GetIndexCount());
+        const u8 *indexData = ib->GetShadowData() + geometry->GetIndexStart() * ib->GetIndexSize();
+        for (uint j = 0; j < indices.Size(); ++j)
+            indices[j] = ib->GetIndexSize() == sizeof(unsigned) ? ((const unsigned*)indexData)[j] : ((const unsigned short*)indexData)[j];
+        const u8 *positions = vb->GetShadowData() + vb->GetElementOffset(Urho3D::ELEMENT_POSITION);
+
+        // Every level is simplified from the full detail level, so that the error limit applies to the difference from it
+        Vector<SharedPtr<Urho3D::Geometry> > levels;
+        uint previousSize = indices.Size();
+        for (uint l = 0; l < settings.reductions.Size(); ++l)
+        {
+            const uint target = (uint)(indices.Size() * settings.reductions[l]) / 3 * 3;
+            PODVector<unsigned> lodIndices = SimplifyMesh(indices, positions, vb->GetVertexSize(), vb->GetVertexCount(), target, maxError);
+            // A level that is not clearly simpler than the previous one is not worth switching to
+            if (lodIndices.Empty() || lodIndices.Size() > previousSize * 9 / 10)
+                break;
+            previousSize = lodIndices.Size();
+
+            SharedPtr<Urho3D::IndexBuffer> lodIb(new Urho3D::IndexBuffer(model->GetContext()));
+            lodIb->SetShadowed(true);
+            if (vb->GetVertexCount() <= 0x10000)
+            {
+                PODVector<unsigned short> shortIndices(lodIndices.Size());
+                for (uint j = 0; j < lodIndices.Size(); ++j)
+                    shortIndices[j] = (unsigned short)lodIndices[j];
+                lodIb->SetSize(shortIndices.Size(), false);
+                lodIb->SetData(&shortIndices[0]);
+            }
+            else
+            {
+                lodIb->SetSize(lodIndices.Size(), true);
+                lodIb->SetData(&lodIndices[0]);
+            }
+
+            SharedPtr<Urho3D::Geometry> lodGeometry(new Urho3D::Geometry(model->GetContext()));
+            lodGeometry->SetNumVertexBuffers(geometry->GetNumVertexBuffers());
+            for (uint j = 0; j < geometry->GetNumVertexBuffers(); ++j)
+                lodGeometry->SetVertexBuffer(j, geometry->GetVertexBuffer(j));
+            lodGeometry->SetIndexBuffer(lodIb);
+            lodGeometry->SetDrawRange(Urho3D::TRIANGLE_LIST, 0, lodIndices.Size());
+            lodGeometry->SetLodDistance(l < settings.distances.Size() ? settings.distances[l] : (l + 1) * 50.0f);
+            levels.Push(lodGeometry);
+            indexBuffers.Push(lodIb);
+        }
+
+        if (levels.Empty())
+            continue;
+        model->SetNumGeometryLodLevels(i, levels.Size() + 1);
+        for (uint l = 0; l < levels.Size(); ++l)
+            model->SetGeometry(i, l + 1, levels[l]);
+        generated += levels.Size();
+    }
+
+    // Register the new index buffers so that they are saved along with the model
+    if (generated)
+        model->SetIndexBuffers(indexBuffers);
+    return generated;
+}
+
+}
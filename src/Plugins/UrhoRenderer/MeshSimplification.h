@@ -0,0 +1,65 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "CoreTypes.h"
+#include "UrhoRendererApi.h"
+#include "UrhoRendererFwd.h"
+
+#include <Urho3D/Container/Vector.h>
+
+namespace Tundra
+{
+
+/// Settings for generating LOD levels for meshes that have none.
+/** @sa IMeshAsset::SetLodSettings */
+struct URHORENDERER_API MeshLodSettings
+{
+    MeshLodSettings() :
+        enabled(true),
+        maxError(0.02f),
+        minTriangles(256)
+    {
+        reductions.Push(0.5f);
+        reductions.Push(0.25f);
+        reductions.Push(0.125f);
+        distances.Push(30.0f);
+        distances.Push(60.0f);
+        distances.Push(120.0f);
+    }
+
+    /// Whether LOD levels are generated at all.
+    bool enabled;
+    /// Target index count of each generated level as a fraction of the full detail level, from highest to lowest detail.
+    PODVector<float> reductions;
+    /// View distance at which each generated level is taken into use. Must have as many entries as @c reductions.
+    PODVector<float> distances;
+    /// Largest allowed simplification error as a fraction of the mesh bounding box diagonal.
+    /** A level that can not reach its target within the error is cut short, and further levels are not generated if it was not reduced enough. */
+    float maxError;
+    /// Submeshes with fewer triangles are left without generated LOD levels.
+    uint minTriangles;
+};
+
+/// Simplifies a triangle list by collapsing edges in the order of their quadric error.
+/** Vertices are only collapsed onto other existing vertices, so the result indexes the original vertex data and can share its vertex buffer.
+    Border vertices only collapse along the border, and vertices on attribute seams (several vertices with the same position) are kept in place,
+    so that the simplified mesh does not crack open.
+    @param indices Triangle list indices.
+    @param positions Vertex positions as three floats, @c stride bytes apart.
+    @param stride Distance between consecutive positions in bytes.
+    @param vertexCount Number of vertices in @c positions.
+    @param targetIndexCount Simplification stops when the index count reaches this.
+    @param maxError Largest allowed error as a distance in position units. Collapses exceeding it are not done.
+    @param resultError If non-null, receives the largest error of the done collapses.
+    @return Simplified triangle list indices. */
+URHORENDERER_API PODVector<unsigned> SimplifyMesh(const PODVector<unsigned> &indices, const u8 *positions, uint stride, uint vertexCount,
+    uint targetIndexCount, float maxError, float *resultError = 0);
+
+/// Generates LOD levels with SimplifyMesh for the triangle list geometries of @c model that have only one LOD level.
+/** The generated levels share the vertex buffers of the full detail level and get new index buffers, which are also added to the model's
+    index buffers so that they are saved along with the model. The vertex and index buffers must be shadowed.
+    @return Number of LOD levels generated over all geometries. */
+URHORENDERER_API uint GenerateLodLevels(Urho3D::Model *model, const MeshLodSettings &settings);
+
+}
@@ -43,12 +43,16 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "StableHeaders.h"
 #include "AssetAPI.h"
 #include "AssetCache.h"
+#include "Framework.h"
 #include "LoggingFunctions.h"
+#include "MemoryMappedFile.h"
+#include "MeshOptimization.h"
 #include "OgreMeshAsset.h"
 #include "OgreMeshDefines.h"
 
 #include <Urho3D/Graphics/Model.h>
 #include <Urho3D/Core/Profiler.h>
+#include <Urho3D/IO/FileSystem.h>
 #include <Urho3D/IO/MemoryBuffer.h>
 #include <Urho3D/IO/VectorBuffer.h>
 #include <Urho3D/Graphics/VertexBuffer.h>
@@ -59,6 +63,14 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <cstring>
 #include <stdexcept>
 
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define TUNDRA_SIMD_SSE
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define TUNDRA_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
 namespace Tundra
 {
 
@@ -868,11 +880,15 @@ static Urho3D::PrimitiveType ConvertPrimitiveType(Ogre::ISubMesh::OperationType
     }
 }
 
+static OgreMeshConversionOptions conversionOptions;
+
 struct VertexElementSource
 {
     VertexElementSource() :
         enabled(false),
         src(0),
+        base(0),
+        bufferSize(0),
         stride(0),
         ogreType(Ogre::VertexElement::VET_FLOAT1)
     {
@@ -885,6 +901,9 @@ struct VertexElementSource
 
     bool enabled;
     u8* src;
+    /// Start of the Ogre source buffer and its size in bytes.
+    u8* base;
+    uint bufferSize;
     Ogre::VertexElement::Type ogreType;
     uint stride;
 };
@@ -985,8 +1004,10 @@ static void CheckVertexElement(unsigned& elementMask, VertexElementSource* sourc
 
     elementMask |= 1 << ((uint)urhoElement);
     desc->enabled = true;
-    desc->src = &ogreVb->At(0) + (size_t)(ogreDesc->offset);
-    desc->ogreType = ogreType;
+    desc->base = &ogreVb->At(0);
+    desc->bufferSize = ogreVb->Size();
+    desc->src = desc->base + (size_t)(ogreDesc->offset);
+    desc->ogreType = ogreDesc->type;
     desc->stride = 0;
 
     // To find out the stride in this Ogre source buffer we need to iterate all the vertex elements in that particular buffer
@@ -998,6 +1019,212 @@ static void CheckVertexElement(unsigned& elementMask, VertexElementSource* sourc
     }
 }
 
+/// Reference vertex conversion: fills all enabled elements vertex by vertex, forming interleaved Urho vertices.
+static void ConvertVerticesScalar(unsigned elementMask, float* dest, uint count, VertexElementSource* sources, const Vector<VertexBlendWeights>& blendWeights, Urho3D::BoundingBox& outBox)
+{
+    bool tangentIsFloat4 = sources[Urho3D::ELEMENT_TANGENT].ogreType == Ogre::VertexElement::VET_FLOAT4;
+    for (uint index = 0; index < count; ++index)
+    {
+        if (elementMask & Urho3D::MASK_POSITION)
+        {
+            *dest++ = ((float*)sources[Urho3D::ELEMENT_POSITION].src)[0];
+            *dest++ = ((float*)sources[Urho3D::ELEMENT_POSITION].src)[1];
+            *dest++ = ((float*)sources[Urho3D::ELEMENT_POSITION].src)[2];
+            outBox.Merge(*(reinterpret_cast<Urho3D::Vector3*>(sources[Urho3D::ELEMENT_POSITION].src)));
+            sources[Urho3D::ELEMENT_POSITION].MoveToNext();
+        }
+        if (elementMask & Urho3D::MASK_NORMAL)
+        {
+            *dest++ = ((float*)sources[Urho3D::ELEMENT_NORMAL].src)[0];
+            *dest++ = ((float*)sources[Urho3D::ELEMENT_NORMAL].src)[1];
+            *dest++ = ((float*)sources[Urho3D::ELEMENT_NORMAL].src)[2];
+            sources[Urho3D::ELEMENT_NORMAL].MoveToNext();
+        }
+        if (elementMask & Urho3D::MASK_COLOR)
+        {
+            *dest++ = ((float*)sources[Urho3D::ELEMENT_COLOR].src)[0];
+            sources[Urho3D::ELEMENT_COLOR].MoveToNext();
+        }
+        if (elementMask & Urho3D::MASK_TEXCOORD1)
+        {
+            *dest++ = ((float*)sources[Urho3D::ELEMENT_TEXCOORD1].src)[0];
+            *dest++ = ((float*)sources[Urho3D::ELEMENT_TEXCOORD1].src)[1];
+            sources[Urho3D::ELEMENT_TEXCOORD1].MoveToNext();
+        }
+        if (elementMask & Urho3D::MASK_TEXCOORD2)
+        {
+            *dest++ = ((float*)sources[Urho3D::ELEMENT_TEXCOORD2].src)[0];
+            *dest++ = ((float*)sources[Urho3D::ELEMENT_TEXCOORD2].src)[1];
+            sources[Urho3D::ELEMENT_TEXCOORD2].MoveToNext();
+        }
+        if (elementMask & Urho3D::MASK_TANGENT)
+        {
+            *dest++ = ((float*)sources[Urho3D::ELEMENT_TANGENT].src)[0];
+            *dest++ = ((float*)sources[Urho3D::ELEMENT_TANGENT].src)[1];
+            *dest++ = ((float*)sources[Urho3D::ELEMENT_TANGENT].src)[2];
+            if (tangentIsFloat4)
+                *dest++ = ((float*)sources[Urho3D::ELEMENT_TANGENT].src)[3];
+            else
+                *dest++ = 1.0f;
+            sources[Urho3D::ELEMENT_TANGENT].MoveToNext();
+        }
+        if (elementMask & Urho3D::MASK_BLENDWEIGHTS)
+        {
+            *dest++ = blendWeights[index].weights[0];
+            *dest++ = blendWeights[index].weights[1];
+            *dest++ = blendWeights[index].weights[2];
+            *dest++ = blendWeights[index].weights[3];
+            *dest++ = *(reinterpret_cast<float*>(blendWeights[index].indices));
+        }
+    }
+
+}
+
+/// Copies one vertex element of @c size bytes from a strided Ogre source to the interleaved Urho vertices.
+static void CopyVertexElement(u8* dest, uint destStride, const u8* src, uint srcStride, uint size, uint count)
+{
+    if (size == 16)
+    {
+        for (uint i = 0; i < count; ++i, dest += destStride, src += srcStride)
+        {
+#if defined(TUNDRA_SIMD_SSE)
+            _mm_storeu_ps((float*)dest, _mm_loadu_ps((const float*)src));
+#elif defined(TUNDRA_SIMD_NEON)
+            vst1q_f32((float*)dest, vld1q_f32((const float*)src));
+#else
+            memcpy(dest, src, 16);
+#endif
+        }
+    }
+    else
+    {
+        for (uint i = 0; i < count; ++i, dest += destStride, src += srcStride)
+            memcpy(dest, src, size);
+    }
+}
+
+/// Copies the vertex positions and merges them to @c outBox, keeping the running minimum and maximum in SIMD registers.
+static void CopyVertexPositions(u8* dest, uint destStride, const u8* src, uint srcStride, uint count, Urho3D::BoundingBox& outBox)
+{
+    float minPos[4], maxPos[4];
+#if defined(TUNDRA_SIMD_SSE)
+    __m128 vMin = _mm_set1_ps(Urho3D::M_INFINITY);
+    __m128 vMax = _mm_set1_ps(-Urho3D::M_INFINITY);
+    for (uint i = 0; i < count; ++i, dest += destStride, src += srcStride)
+    {
+        __m128 z = _mm_load_ss((const float*)src + 2);
+        __m128 pos = _mm_movelh_ps(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)src), z);
+        vMin = _mm_min_ps(vMin, pos);
+        vMax = _mm_max_ps(vMax, pos);
+        _mm_storel_pi((__m64*)dest, pos);
+        _mm_store_ss((float*)dest + 2, z);
+    }
+    _mm_storeu_ps(minPos, vMin);
+    _mm_storeu_ps(maxPos, vMax);
+#elif defined(TUNDRA_SIMD_NEON)
+    float32x4_t vMin = vdupq_n_f32(Urho3D::M_INFINITY);
+    float32x4_t vMax = vdupq_n_f32(-Urho3D::M_INFINITY);
+    for (uint i = 0; i < count; ++i, dest += destStride, src += srcStride)
+    {
+        float32x2_t xy = vld1_f32((const float*)src);
+        float32x4_t pos = vcombine_f32(xy, vld1_dup_f32((const float*)src + 2));
+        vMin = vminq_f32(vMin, pos);
+        vMax = vmaxq_f32(vMax, pos);
+        vst1_f32((float*)dest, xy);
+        ((float*)dest)[2] = ((const float*)src)[2];
+    }
+    vst1q_f32(minPos, vMin);
+    vst1q_f32(maxPos, vMax);
+#else
+    for (uint j = 0; j < 3; ++j)
+    {
+        minPos[j] = Urho3D::M_INFINITY;
+        maxPos[j] = -Urho3D::M_INFINITY;
+    }
+    for (uint i = 0; i < count; ++i, dest += destStride, src += srcStride)
+    {
+        memcpy(dest, src, 3 * sizeof(float));
+        for (uint j = 0; j < 3; ++j)
+        {
+            const float value = ((const float*)src)[j];
+            minPos[j] = Urho3D::Min(minPos[j], value);
+            maxPos[j] = Urho3D::Max(maxPos[j], value);
+        }
+    }
+#endif
+    if (count)
+        outBox.Merge(Urho3D::BoundingBox(Urho3D::Vector3(minPos), Urho3D::Vector3(maxPos)));
+}
+
+/// Returns whether the enabled elements already are a single Ogre buffer in the Urho vertex layout, so that the whole buffer can be copied as is.
+static bool IsUrhoVertexLayout(Urho3D::VertexBuffer* vb, const VertexElementSource* sources, bool hasBlendWeights)
+{
+    if (hasBlendWeights)
+        return false;
+    const VertexElementSource& position = sources[Urho3D::ELEMENT_POSITION];
+    if (!position.enabled || position.stride != vb->GetVertexSize() || position.bufferSize < vb->GetVertexCount() * position.stride)
+        return false;
+    for (uint i = 0; i < Urho3D::MAX_VERTEX_ELEMENTS; ++i)
+    {
+        const VertexElementSource& source = sources[i];
+        if (!source.enabled)
+            continue;
+        if (source.base != position.base || source.src != position.base + vb->GetElementOffset((Urho3D::VertexElement)i))
+            return false;
+        if (i == Urho3D::ELEMENT_TANGENT && source.ogreType != Ogre::VertexElement::VET_FLOAT4)
+            return false;
+    }
+    return true;
+}
+
+/// Vectorized vertex conversion: copies the vertices element by element with tight strided loops.
+/** Produces identical data to ConvertVerticesScalar. The common case of a single interleaved Ogre buffer that is already
+    in the Urho vertex layout is copied with one memcpy. */
+static void ConvertVerticesVectorized(Urho3D::VertexBuffer* vb, u8* dest, const VertexElementSource* sources, const Vector<VertexBlendWeights>& blendWeights, Urho3D::BoundingBox& outBox)
+{
+    const uint count = vb->GetVertexCount();
+    const uint vertexSize = vb->GetVertexSize();
+    const VertexElementSource& position = sources[Urho3D::ELEMENT_POSITION];
+
+    if (IsUrhoVertexLayout(vb, sources, !blendWeights.Empty()))
+    {
+        memcpy(dest, position.base, count * vertexSize);
+        // The positions still need to be visited for the bounding box, but copying them again into place is harmless
+        CopyVertexPositions(dest, vertexSize, position.src, position.stride, count, outBox);
+        return;
+    }
+
+    if (position.enabled)
+        CopyVertexPositions(dest + vb->GetElementOffset(Urho3D::ELEMENT_POSITION), vertexSize, position.src, position.stride, count, outBox);
+
+    static const Urho3D::VertexElement cCopiedElements[] = { Urho3D::ELEMENT_NORMAL, Urho3D::ELEMENT_COLOR, Urho3D::ELEMENT_TEXCOORD1, Urho3D::ELEMENT_TEXCOORD2 };
+    for (uint i = 0; i < sizeof(cCopiedElements) / sizeof(cCopiedElements[0]); ++i)
+    {
+        const VertexElementSource& source = sources[cCopiedElements[i]];
+        if (source.enabled)
+            CopyVertexElement(dest + vb->GetElementOffset(cCopiedElements[i]), vertexSize, source.src, source.stride, Urho3D::VertexBuffer::elementSize[cCopiedElements[i]], count);
+    }
+
+    const VertexElementSource& tangent = sources[Urho3D::ELEMENT_TANGENT];
+    if (tangent.enabled)
+    {
+        u8* tangentDest = dest + vb->GetElementOffset(Urho3D::ELEMENT_TANGENT);
+        if (tangent.ogreType == Ogre::VertexElement::VET_FLOAT4)
+            CopyVertexElement(tangentDest, vertexSize, tangent.src, tangent.stride, 4 * sizeof(float), count);
+        else
+        {
+            // Float3 tangents get a positive binormal direction
+            CopyVertexElement(tangentDest, vertexSize, tangent.src, tangent.stride, 3 * sizeof(float), count);
+            for (uint i = 0; i < count; ++i, tangentDest += vertexSize)
+                ((float*)tangentDest)[3] = 1.0f;
+        }
+    }
+
+    // Blend weights and indices are adjacent both in VertexBlendWeights and in the Urho vertex
+    if (!blendWeights.Empty())
+        CopyVertexElement(dest + vb->GetElementOffset(Urho3D::ELEMENT_BLENDWEIGHTS), vertexSize, (const u8*)&blendWeights[0], sizeof(VertexBlendWeights), sizeof(VertexBlendWeights), count);
+}
+
 static SharedPtr<Urho3D::VertexBuffer> MakeVertexBuffer(Urho3D::Context* context, Ogre::VertexData* vertexData, Urho3D::BoundingBox& outBox, PODVector<uint>& localToGlobalBoneMapping, Vector<Urho3D::BoundingBox>& boneBoundingBoxes)
 {
     SharedPtr<Urho3D::VertexBuffer> ret;
@@ -1077,68 +1304,110 @@ static SharedPtr<Urho3D::VertexBuffer> MakeVertexBuffer(Urho3D::Context* context
 
     ret->SetSize(vertexData->count, elementMask);
     void* data = ret->Lock(0, vertexData->count, true);
-    uint count = vertexData->count;
+    if (conversionOptions.vectorized)
+        ConvertVerticesVectorized(ret, (u8*)data, sources, blendWeights, outBox);
+    else
+        ConvertVerticesScalar(elementMask, (float*)data, vertexData->count, sources, blendWeights, outBox);
+    ret->Unlock();
+    return ret;
+}
 
-    // Fill all enabled elements with source data, forming interleaved Urho vertices
-    float* dest = (float*)data;
-    bool tangentIsFloat4 = sources[Urho3D::ELEMENT_TANGENT].ogreType == Ogre::VertexElement::VET_FLOAT4;
-    for (uint index = 0; index < count; ++index)
+static const unsigned cConvertedMeshFileId = 0x434D4F54; // "TOMC"
+/// Version of the converted mesh cache files. Increment when the conversion output changes, to discard the old files.
+static const unsigned cConvertedMeshVersion = 4;
+
+/// Returns the converted mesh cache file for Ogre mesh data, or an empty string if the cache is disabled.
+/** The file is keyed by AssetCache::ContentKey of the source data, so that identical meshes share the file regardless of their asset name.
+    The cache is stored in the meshes subdirectory of the asset cache and can be disabled with the --noMeshCache command line parameter
+    or OgreMeshConversionOptions::useCache. Meshes converted without compact indices or vertex cache optimization are stored in separate files,
+    and the LOD generation settings are included in the hash. */
+static String ConvertedMeshCacheFile(AssetAPI *assetAPI, const u8 *data, uint numBytes, bool generateLods)
+{
+    AssetCache *cache = assetAPI->Cache();
+    if (!cache || !conversionOptions.useCache || assetAPI->GetFramework()->HasCommandLineParameter("--noMeshCache"))
+        return String();
+
+    Urho3D::FileSystem *fileSystem = assetAPI->GetSubsystem<Urho3D::FileSystem>();
+    const String directory = cache->CacheDirectory() + "meshes/";
+    if (!fileSystem->DirExists(directory) && !fileSystem->CreateDir(directory))
+        return String();
+
+    // The LOD generation settings are hashed as well, so that changing them converts the meshes again
+    PODVector<float> lodValues;
+    if (generateLods)
     {
-        if (elementMask & Urho3D::MASK_POSITION)
-        {
-            *dest++ = ((float*)sources[Urho3D::ELEMENT_POSITION].src)[0];
-            *dest++ = ((float*)sources[Urho3D::ELEMENT_POSITION].src)[1];
-            *dest++ = ((float*)sources[Urho3D::ELEMENT_POSITION].src)[2];
-            outBox.Merge(*(reinterpret_cast<Urho3D::Vector3*>(sources[Urho3D::ELEMENT_POSITION].src)));
-            sources[Urho3D::ELEMENT_POSITION].MoveToNext();
-        }
-        if (elementMask & Urho3D::MASK_NORMAL)
-        {
-            *dest++ = ((float*)sources[Urho3D::ELEMENT_NORMAL].src)[0];
-            *dest++ = ((float*)sources[Urho3D::ELEMENT_NORMAL].src)[1];
-            *dest++ = ((float*)sources[Urho3D::ELEMENT_NORMAL].src)[2];
-            sources[Urho3D::ELEMENT_NORMAL].MoveToNext();
-        }
-        if (elementMask & Urho3D::MASK_COLOR)
-        {
-            *dest++ = ((float*)sources[Urho3D::ELEMENT_COLOR].src)[0];
-            sources[Urho3D::ELEMENT_COLOR].MoveToNext();
-        }
-        if (elementMask & Urho3D::MASK_TEXCOORD1)
-        {
-            *dest++ = ((float*)sources[Urho3D::ELEMENT_TEXCOORD1].src)[0];
-            *dest++ = ((float*)sources[Urho3D::ELEMENT_TEXCOORD1].src)[1];
-            sources[Urho3D::ELEMENT_TEXCOORD1].MoveToNext();
-        }
-        if (elementMask & Urho3D::MASK_TEXCOORD2)
-        {
-            *dest++ = ((float*)sources[Urho3D::ELEMENT_TEXCOORD2].src)[0];
-            *dest++ = ((float*)sources[Urho3D::ELEMENT_TEXCOORD2].src)[1];
-            sources[Urho3D::ELEMENT_TEXCOORD2].MoveToNext();
-        }
-        if (elementMask & Urho3D::MASK_TANGENT)
-        {
-            *dest++ = ((float*)sources[Urho3D::ELEMENT_TANGENT].src)[0];
-            *dest++ = ((float*)sources[Urho3D::ELEMENT_TANGENT].src)[1];
-            *dest++ = ((float*)sources[Urho3D::ELEMENT_TANGENT].src)[2];
-            if (tangentIsFloat4)
-                *dest++ = ((float*)sources[Urho3D::ELEMENT_TANGENT].src)[3];
-            else
-                *dest++ = 1.0f;
-            sources[Urho3D::ELEMENT_TANGENT].MoveToNext();
-        }
-        if (elementMask & Urho3D::MASK_BLENDWEIGHTS)
-        {
-            *dest++ = blendWeights[index].weights[0];
-            *dest++ = blendWeights[index].weights[1];
-            *dest++ = blendWeights[index].weights[2];
-            *dest++ = blendWeights[index].weights[3];
-            *dest++ = *(reinterpret_cast<float*>(blendWeights[index].indices));
-        }
+        const MeshLodSettings &lodSettings = IMeshAsset::LodSettings();
+        lodValues.Push(lodSettings.maxError);
+        lodValues.Push((float)lodSettings.minTriangles);
+        lodValues.Push(lodSettings.reductions);
+        lodValues.Push(lodSettings.distances);
     }
+    return directory + AssetCache::ContentKey(data, numBytes, lodValues.Buffer(), lodValues.Size() * sizeof(float)) +
+        (conversionOptions.compactIndices ? "" : "_i32") + (conversionOptions.optimizeVertexCache ? "" : "_unopt") + ".tmesh";
+}
 
-    ret->Unlock();
-    return ret;
+/// Loads a converted mesh from the cache. Returns false if the cache file is missing or invalid.
+/** The file is memory-mapped and the model deserialized straight from the mapping: the buffers are stored in their final Urho3D layout,
+    so Urho3D copies them to the vertex and index buffers without an intermediate read of the whole file. */
+static bool LoadConvertedMesh(Urho3D::Context *context, const String &fileName, SharedPtr<Urho3D::Model> &model, Vector<Urho3D::BoundingBox> &boneBoundingBoxes)
+{
+    SharedPtr<MemoryMappedFile> file = AssetCache::MapVersionedFile(context, fileName, cConvertedMeshFileId, cConvertedMeshVersion);
+    if (!file)
+        return false;
+    const unsigned size = (unsigned)file->Size() - AssetCache::VersionedFileHeaderSize;
+    if (size < sizeof(unsigned))
+        return false;
+
+    Urho3D::MemoryBuffer buffer(file->Data() + AssetCache::VersionedFileHeaderSize, size);
+    const unsigned numBoneBoxes = buffer.ReadUInt();
+    if (numBoneBoxes > (size - buffer.GetPosition()) / sizeof(Urho3D::BoundingBox))
+        return false;
+    boneBoundingBoxes.Resize(numBoneBoxes);
+    for(unsigned i = 0; i < numBoneBoxes; ++i)
+        boneBoundingBoxes[i] = buffer.ReadBoundingBox();
+
+    model = new Urho3D::Model(context);
+    if (!model->Load(buffer))
+    {
+        model.Reset();
+        boneBoundingBoxes.Clear();
+        return false;
+    }
+    return true;
+}
+
+/// Stores a converted mesh to the cache.
+static void SaveConvertedMesh(Urho3D::Context *context, const String &fileName, Urho3D::Model *model, const Vector<Urho3D::BoundingBox> &boneBoundingBoxes)
+{
+    if (fileName.Empty())
+        return;
+
+    // Serialize to memory first, so that a failed save does not leave a partial file behind
+    Urho3D::VectorBuffer buffer;
+    buffer.WriteUInt(boneBoundingBoxes.Size());
+    for(uint i = 0; i < boneBoundingBoxes.Size(); ++i)
+        buffer.WriteBoundingBox(boneBoundingBoxes[i]);
+    if (!model->Save(buffer))
+    {
+        LogWarning("OgreMeshAsset: Failed to serialize converted mesh for " + fileName);
+        return;
+    }
+
+    AssetCache::WriteVersionedFile(context, fileName, cConvertedMeshFileId, cConvertedMeshVersion, buffer.GetData(), buffer.GetSize());
+}
+
+/// Returns whether all the 32-bit indices of the index data fit into 16 bits.
+static bool CanUse16BitIndices(const Ogre::IndexData *indexData)
+{
+    if (!indexData->count)
+        return false;
+    const u32 *indices = reinterpret_cast<const u32*>(&indexData->buffer[0]);
+    for (uint i = 0; i < indexData->count; ++i)
+    {
+        if (indices[i] > 0xffff)
+            return false;
+    }
+    return true;
 }
 
 OgreMeshAsset::OgreMeshAsset(AssetAPI *owner, const String &type_, const String &name_) :
@@ -1146,6 +1415,16 @@ OgreMeshAsset::OgreMeshAsset(AssetAPI *owner, const String &type_, const String
 {
 }
 
+void OgreMeshAsset::SetConversionOptions(const OgreMeshConversionOptions &options)
+{
+    conversionOptions = options;
+}
+
+const OgreMeshConversionOptions &OgreMeshAsset::ConversionOptions()
+{
+    return conversionOptions;
+}
+
 bool OgreMeshAsset::DeserializeFromData(const u8 *data_, uint numBytes, bool /*allowAsynchronous*/)
 {
     URHO3D_PROFILE(OgreMeshAsset_LoadFromFileInMemory);
@@ -1153,6 +1432,14 @@ bool OgreMeshAsset::DeserializeFromData(const u8 *data_, uint numBytes, bool /*a
     /// Force an unload of previous data first.
     Unload();
 
+    // Meshes converted on an earlier run are loaded from the converted mesh cache without parsing the Ogre data
+    const String cacheFile = ConvertedMeshCacheFile(assetAPI, data_, numBytes, LodGenerationEnabled());
+    if (LoadConvertedMesh(GetContext(), cacheFile, model, boneBoundingBoxes))
+    {
+        assetAPI->AssetLoadCompleted(Name());
+        return true;
+    }
+
     Urho3D::MemoryBuffer buffer(data_, numBytes);
 
     u16 id = ReadHeader(buffer, false);
@@ -1218,9 +1505,21 @@ bool OgreMeshAsset::DeserializeFromData(const u8 *data_, uint numBytes, bool /*a
         SharedPtr<Urho3D::Geometry> geom(new Urho3D::Geometry(GetContext()));
         SharedPtr<Urho3D::IndexBuffer> ib(new Urho3D::IndexBuffer(GetContext()));
         ib->SetShadowed(true); // Allow CPU-side raycasts and auto-restore on GPU context loss
-        ib->SetSize(subMesh->indexData->count, subMesh->indexData->is32bit);
-        if (ib->GetIndexCount())
-            ib->SetData(&subMesh->indexData->buffer[0]);
+        if (conversionOptions.compactIndices && subMesh->indexData->is32bit && CanUse16BitIndices(subMesh->indexData))
+        {
+            PODVector<u16> indices(subMesh->indexData->count);
+            const u32 *src = reinterpret_cast<const u32*>(&subMesh->indexData->buffer[0]);
+            for (uint j = 0; j < indices.Size(); ++j)
+                indices[j] = (u16)src[j];
+            ib->SetSize(indices.Size(), false);
+            ib->SetData(&indices[0]);
+        }
+        else
+        {
+            ib->SetSize(subMesh->indexData->count, subMesh->indexData->is32bit);
+            if (ib->GetIndexCount())
+                ib->SetData(&subMesh->indexData->buffer[0]);
+        }
         geom->SetIndexBuffer(ib);
         ibs.Push(ib);
         if (!subMesh->usesSharedVertexData)
@@ -1370,6 +1669,19 @@ bool OgreMeshAsset::DeserializeFromData(const u8 *data_, uint numBytes, bool /*a
     model->SetVertexBuffers(vbs, morphRangeStarts, morphRangeCounts);
     model->SetIndexBuffers(ibs);
 
+    // Ogre LOD levels are not read, so generate them. They are stored in the converted mesh cache along with the full detail level.
+    GenerateMissingLodLevels();
+
+    if (conversionOptions.optimizeVertexCache)
+    {
+        VertexCacheStatistics before, after;
+        OptimizeVertexCache(model, &before, &after);
+        LogDebug("OgreMeshAsset: Vertex cache optimized " + Name() + ": ACMR " + String(before.Acmr()) + " -> " + String(after.Acmr()) +
+            ", ATVR " + String(before.Atvr()) + " -> " + String(after.Atvr()));
+    }
+
+    SaveConvertedMesh(GetContext(), cacheFile, model, boneBoundingBoxes);
+
     assetAPI->AssetLoadCompleted(Name());
     return true;
 }
@@ -10,6 +10,21 @@
 namespace Tundra
 {
 
+/// Options for converting Ogre meshes to Urho3D vertex and index buffers.
+struct URHORENDERER_API OgreMeshConversionOptions
+{
+    OgreMeshConversionOptions() : vectorized(true), compactIndices(true), optimizeVertexCache(true), useCache(true) {}
+
+    /// Convert vertices element by element using SSE or NEON where available. The per-vertex scalar conversion produces identical data.
+    bool vectorized;
+    /// Store 32-bit index data as 16-bit indices when all the indices fit.
+    bool compactIndices;
+    /// Reorder triangles for the post-transform vertex cache and vertices for fetch locality. The vertex cache statistics are logged on debug level.
+    bool optimizeVertexCache;
+    /// Load and store converted meshes in the converted mesh cache. The cache also requires an asset cache and no --noMeshCache parameter.
+    bool useCache;
+};
+
 /// Represents a mesh asset loaded from Ogre binary format
 class URHORENDERER_API OgreMeshAsset : public IMeshAsset
 {
@@ -20,6 +35,11 @@ public:
 
     /// Load mesh from memory. IAsset override.
     bool DeserializeFromData(const u8 *data_, uint numBytes, bool allowAsynchronous) override;
+
+    /// Sets the conversion options used for Ogre meshes loaded after this call.
+    static void SetConversionOptions(const OgreMeshConversionOptions &options);
+    /// Returns the current conversion options.
+    static const OgreMeshConversionOptions &ConversionOptions();
 };
 
 }
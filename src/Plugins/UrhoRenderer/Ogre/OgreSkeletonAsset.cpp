@@ -430,6 +430,18 @@ bool OgreSkeletonAsset::IsLoaded() const
     return skeleton.GetNumBones() > 0;
 }
 
+uint OgreSkeletonAsset::CpuMemoryUsage() const
+{
+    uint bytes = skeleton.GetNumBones() * sizeof(Urho3D::Bone);
+    for(auto animIter = animations.Begin(); animIter != animations.End(); ++animIter)
+    {
+        const HashMap<StringHash, Urho3D::AnimationTrack> &tracks = animIter->second_->GetTracks();
+        for(auto trackIter = tracks.Begin(); trackIter != tracks.End(); ++trackIter)
+            bytes += sizeof(Urho3D::AnimationTrack) + trackIter->second_.keyFrames_.Size() * sizeof(Urho3D::AnimationKeyFrame);
+    }
+    return bytes;
+}
+
 Urho3D::Animation* OgreSkeletonAsset::AnimationByName(const String& name) const
 {
     HashMap<String, SharedPtr<Urho3D::Animation> >::ConstIterator i = animations.Find(name);
@@ -37,6 +37,9 @@ public:
     /// IAsset override.
     bool IsLoaded() const override;
 
+    /// Returns the size of the bones and animation keyframes. IAsset override.
+    uint CpuMemoryUsage() const override;
+
 protected:
     /// Unload skeleton and animations. IAsset override.
     void DoUnload() override;
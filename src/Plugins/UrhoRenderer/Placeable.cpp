@@ -3,10 +3,12 @@
 #include "StableHeaders.h"
 #include "Placeable.h"
 #include "GraphicsWorld.h"
+#include "TransformCache.h"
 #include "Mesh.h"
 #include "AttributeMetadata.h"
 #include "Entity.h"
 #include "Scene/Scene.h"
+#include "Framework.h"
 #include "LoggingFunctions.h"
 
 #include <Math/Quat.h>
@@ -22,6 +24,8 @@ namespace Tundra
 Placeable::Placeable(Urho3D::Context* context, Scene* scene) :
     IComponent(context, scene),
     attached_(false),
+    transformSlot_(TransformCache::NoSlot),
+    deferNodeTransforms_(false),
     INIT_ATTRIBUTE(transform, "Transform"),
     INIT_ATTRIBUTE_VALUE(drawDebug, "Show bounding box", false),
     INIT_ATTRIBUTE_VALUE(visible, "Visible", true),
@@ -46,6 +50,12 @@ Placeable::Placeable(Urho3D::Context* context, Scene* scene) :
 
 Placeable::~Placeable()
 {
+    if (transforms_)
+    {
+        transforms_->Remove(transformSlot_);
+        transforms_.Reset();
+    }
+
     if (world_.Expired())
     {
         if (sceneNode_)
@@ -228,6 +238,9 @@ float3 Placeable::Scale() const
 
 float3x4 Placeable::LocalToWorld() const
 {
+    if (transforms_)
+        return transforms_->WorldTransform(transformSlot_);
+
     // If we are parented to a bone, we can't (yet) compute the local-to-world matrix ourselves,
     // so query Urho for the world matrix.
     if (!parentBone.Get().Empty() && sceneNode_)
@@ -373,23 +386,7 @@ void Placeable::AttributesChanged()
         AttachNode();
     
     if (transform.ValueChanged())
-    {
-        transform.ClearChangedFlag();
-
-        const Transform& trans = transform.Get();
-        if (trans.pos.IsFinite())
-            sceneNode_->SetPosition(trans.pos);
-
-        Quat orientation = trans.Orientation();
-        if (orientation.IsFinite())
-            sceneNode_->SetRotation(orientation);
-        else
-            LogError("Placeable: transform attribute changed, but orientation not valid!");
-
-        sceneNode_->SetScale(trans.scale);
-
-        TransformChanged.Emit();
-    }
+        ApplyTransformToNode();
 
     /// \todo Implement DrawDebug
 
@@ -402,6 +399,82 @@ void Placeable::AttributesChanged()
     }
 }
 
+void Placeable::ApplyTransformToNode()
+{
+    transform.ClearChangedFlag();
+    if (!sceneNode_)
+        return;
+
+    if (transforms_)
+    {
+        transforms_->SetLocalTransform(transformSlot_, transform.Get().ToFloat3x4());
+        if (deferNodeTransforms_)
+            transforms_->MarkNodeStale(transformSlot_);
+        else
+            SetNodeTransform();
+    }
+    else
+        SetNodeTransform();
+
+    // When PhysicsWorld applies a batch of simulated transforms, this is called for every moved body, while only a few
+    // placeables usually have listeners. The batch itself is signaled once by PhysicsWorld::TransformsUpdated.
+    if (!TransformChanged.Empty())
+        TransformChanged.Emit();
+}
+
+void Placeable::WorldTransforms(const PODVector<Placeable*> &placeables, PODVector<float3x4> &transforms)
+{
+    URHO3D_PROFILE(Placeable_WorldTransforms);
+
+    // Usually all the placeables are in the same scene, so this updates a single cache.
+    TransformCache *updated = 0;
+    for(uint i = 0; i < placeables.Size(); ++i)
+    {
+        TransformCache *cache = placeables[i] ? placeables[i]->transforms_.Get() : 0;
+        if (cache && cache != updated)
+        {
+            cache->UpdateWorldTransforms();
+            updated = cache;
+        }
+    }
+
+    transforms.Resize(placeables.Size());
+    for(uint i = 0; i < placeables.Size(); ++i)
+        transforms[i] = placeables[i] ? placeables[i]->LocalToWorld() : float3x4::identity;
+}
+
+Urho3D::Node* Placeable::UrhoSceneNode() const
+{
+    if (transforms_ && transforms_->HasStaleNodes())
+        transforms_->ApplyNodeTransforms();
+    return sceneNode_;
+}
+
+void Placeable::SetNodeTransform()
+{
+    const Transform& trans = transform.Get();
+    if (trans.pos.IsFinite())
+        sceneNode_->SetPosition(trans.pos);
+
+    Quat orientation = trans.Orientation();
+    if (orientation.IsFinite())
+        sceneNode_->SetRotation(orientation);
+    else
+        LogError("Placeable: transform attribute changed, but orientation not valid!");
+
+    sceneNode_->SetScale(trans.scale);
+}
+
+void Placeable::UpdateCachedParent()
+{
+    if (!transforms_)
+        return;
+
+    Placeable *parent = (attached_ ? parentPlaceable_.Get() : 0);
+    transforms_->SetParent(transformSlot_, (parent && parent->transforms_ == transforms_) ? parent->transformSlot_ : TransformCache::NoSlot,
+        attached_ && parentMesh_);
+}
+
 void Placeable::AttachNode()
 {
     if (!sceneNode_)
@@ -449,6 +522,7 @@ void Placeable::AttachNode()
             // If we refer to self, attach to the root
             Reparent(root_node);
             attached_ = true;
+            UpdateCachedParent();
             return;
         }
         if (parentEntity)
@@ -479,6 +553,7 @@ void Placeable::AttachNode()
                         }
 
                         attached_ = true;
+                        UpdateCachedParent();
                         return;
                     }
                     else
@@ -510,6 +585,7 @@ void Placeable::AttachNode()
                         LogWarning("Placeable::AttachNode: Cyclic scene node parenting attempt detected! Parenting to the scene root node instead.");
                         Reparent(root_node);
                         attached_ = true;
+                        UpdateCachedParent();
                         return;
                     }
                     parentCheck = parentCheck->parentPlaceable_;
@@ -522,6 +598,7 @@ void Placeable::AttachNode()
                 // Connect to destruction of the placeable to be able to detach gracefully
                 parentPlaceable_->AboutToBeDestroyed.Connect(this, &Placeable::OnParentPlaceableDestroyed);
                 attached_ = true;
+                UpdateCachedParent();
                 return;
             }
             else
@@ -541,6 +618,7 @@ void Placeable::AttachNode()
         
     Reparent(root_node);
     attached_ = true;
+    UpdateCachedParent();
 }
 
 void Placeable::DetachNode()
@@ -579,6 +657,7 @@ void Placeable::DetachNode()
     Reparent(world->UrhoScene());
 
     attached_ = false;
+    UpdateCachedParent();
 }
 
 void Placeable::CleanExpiredChildren()
@@ -694,6 +773,11 @@ void Placeable::RegisterActions()
         if (world)
         {
             sceneNode_ = world->UrhoScene()->CreateChild();
+            transforms_ = world->Transforms();
+            transformSlot_ = transforms_->Add(this);
+            transforms_->SetLocalTransform(transformSlot_, transform.Get().ToFloat3x4());
+            // A headless server does not render, so the scene nodes need to be up to date only when someone uses them.
+            deferNodeTransforms_ = GetFramework()->IsHeadless();
             AttachNode();
         }
 
@@ -84,8 +84,9 @@ public:
     Attribute<String> parentBone;
 
     /// Returns the Urho scene node for attaching geometry.
-    /** Do not manipulate the pos/orientation/scale of this node directly, but instead use the Transform property. */
-    Urho3D::Node* UrhoSceneNode() const { return sceneNode_; }
+    /** Do not manipulate the pos/orientation/scale of this node directly, but instead use the Transform property.
+        On a headless server the transforms of the scene nodes are updated lazily, this applies any pending ones. */
+    Urho3D::Node* UrhoSceneNode() const;
 
     /// Sets the translation part of this placeable's transform.
     /// @note This function sets the Transform attribute of this component, and synchronizes to network.
@@ -169,6 +170,7 @@ public:
     float3 Scale() const;
 
     /// Returns the concatenated world transformation of this placeable.
+    /** The world transforms are cached in the TransformCache of the scene, and recomputed only after this placeable or its parents have moved. */
     float3x4 LocalToWorld() const;
     /// Returns the matrix that transforms objects from world space into the local coordinate space of this placeable.
     float3x4 WorldToLocal() const;
@@ -193,6 +195,17 @@ public:
     /** @note Doesn't alter the component's visible attribute. */
     void ToggleVisibility();
 
+    /// Applies the transform attribute to the scene node and emits TransformChanged if anything is connected to it. [noscript]
+    /** Normally done when the transform attribute changes. Used by systems that set the transform attribute without
+        signaling, eg. PhysicsWorld when updating the transforms of a large number of bodies at once.
+        On a headless server the scene node is updated later, see UrhoSceneNode(). */
+    void ApplyTransformToNode();
+
+    /// Returns the world transforms of a number of placeables at once. [noscript]
+    /** The dirty world transforms of each scene are updated in a single pass first, which is faster than querying
+        LocalToWorld() of each placeable when many of them have moved. Null placeables get an identity transform. */
+    static void WorldTransforms(const PODVector<Placeable*> &placeables, PODVector<float3x4> &transforms);
+
     /// Re-parents this scene node to the given parent scene node. The parent entity must contain an Placeable component.
     /// Detaches this placeable from its previous parent.
     /// @param preserveWorldTransform If true, the world space position of this placeable is preserved.
@@ -247,6 +260,8 @@ public:
     Signal0<void> TransformChanged;
 
 private:
+    friend class TransformCache;
+
     /// Registers the action this EC provides to the parent entity, when it's set.
     void RegisterActions();
     
@@ -304,6 +319,12 @@ private:
 
     /// Reparent to another Urho scene node without adjusting local transform. Called internally
     void Reparent(Urho3D::Node* newParent);
+
+    /// Copies the transform attribute to the scene node.
+    void SetNodeTransform();
+
+    /// Sets the parent of this placeable in the transform cache to match the current attachment.
+    void UpdateCachedParent();
     
     /// Graphics world ptr
     GraphicsWorldWeakPtr world_;
@@ -323,6 +344,15 @@ private:
 
     /// Attached to scene hierarchy flag
     bool attached_;
+
+    /// Transform cache of the graphics world
+    SharedPtr<TransformCache> transforms_;
+
+    /// Slot of this placeable in the transform cache
+    uint transformSlot_;
+
+    /// Whether copying the transform to the scene node is deferred, on a headless server
+    bool deferNodeTransforms_;
 };
 
 COMPONENT_TYPEDEFS(Placeable)
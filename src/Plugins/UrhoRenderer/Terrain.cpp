@@ -8,6 +8,7 @@
 #include "LoggingFunctions.h"
 #include "AssetRefListener.h"
 #include "Framework.h"
+#include "FrameAPI.h"
 #include <Urho3D/Core/Profiler.h>
 #include "Math/Transform.h"
 #include "BinaryAsset.h"
@@ -15,11 +16,17 @@
 #include "IMaterialAsset.h"
 #include "Placeable.h"
 #include "AssetAPI.h"
+#include "UrhoRenderer.h"
+#include "Camera.h"
 
 #include <Math/MathFunc.h>
 
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Core/WorkQueue.h>
 #include <Urho3D/Scene/Scene.h>
 #include <Urho3D/Resource/ResourceCache.h>
+#include <Urho3D/Graphics/Camera.h>
+#include <Urho3D/Graphics/Graphics.h>
 #include <Urho3D/Graphics/Material.h>
 #include <Urho3D/Scene/Node.h>
 #include <Urho3D/Graphics/StaticModel.h>
@@ -28,12 +35,109 @@
 #include <Urho3D/Graphics/IndexBuffer.h>
 #include <Urho3D/Graphics/Geometry.h>
 #include <Urho3D/Resource/Image.h>
+#include <Urho3D/IO/File.h>
 #include <Urho3D/IO/MemoryBuffer.h>
 
 
 namespace Tundra
 {
 
+/// Number of floats per patch vertex: position, normal and two texture coordinates.
+static const uint cPatchVertexFloats = 10;
+/// Number of patches built by one work item.
+static const uint cPatchesPerJob = 16;
+/// Largest number of patch jobs in flight. Bounds the memory of the built geometry waiting to be committed when the whole terrain is regenerated.
+static const uint cMaxPatchJobs = 32;
+/// Patches further from the camera than this times the streaming distance have their geometry released, so that the patches at the
+/// streaming distance are not created and released over and over as the camera moves back and forth.
+static const float cStreamOutFactor = 1.25f;
+
+/// First word of a row-major .ntf file, "NTF2". The original format starts with the patch count in the x direction instead.
+static const u32 cRowMajorNtfMagic = 0x3246544E;
+/// Size of the row-major .ntf header: the magic, the patch counts and a reserved word keeping the height grid 16-byte aligned.
+static const uint cRowMajorNtfHeaderSize = 16;
+
+/// Vertex and index data of one patch, built on a worker thread and committed to the GPU on the main thread.
+struct Terrain::PatchGeometry
+{
+    PatchGeometry() : patchX(0), patchY(0), request(0), numVertices(0) {}
+
+    uint patchX;
+    uint patchY;
+    /// Patch::geometry_request of the patch at the time the geometry was scheduled.
+    uint request;
+    uint numVertices;
+    /// cPatchVertexFloats floats per vertex. The index data comes from the LOD index buffers shared by all patches.
+    PODVector<float> vertices;
+    Urho3D::BoundingBox bounds;
+    float lodErrors[cNumTerrainLodLevels];
+};
+
+/// Patches whose geometry is built by one work item.
+struct Terrain::PatchJob
+{
+    PatchJob() : owner(0), uScale(0.f), vScale(0.f), numCommitted(0) {}
+
+    Terrain *owner;
+    /// Texture coordinate scales, captured on the main thread as the attributes are not read from the worker threads.
+    float uScale;
+    float vScale;
+    Vector<PatchGeometry*> patches;
+    /// Number of patches committed to the GPU, as committing a job can be split over several frames.
+    uint numCommitted;
+};
+
+u32 ReadU32(const char *dataPtr, size_t numBytes, int &offset)
+{
+    if (offset + 4 > (int)numBytes)
+    {
+        LogError("Terrain::ReadU32: Not enough bytes to deserialize!");
+        return 0;
+    }
+    u32 data = *(u32*)(dataPtr + offset); ///@note Requires unaligned load support from the CPU and assumes data storage endianness to be the same for loader and saver.
+    offset += 4;
+    return data;
+}
+
+/// Reads the header of an .ntf file. Returns false if the data is too short for the number of patches in the header.
+/** @param heightsOffset Receives the offset of the height data from the start of the file.
+    @param rowMajor Receives whether the height data is a row-major grid, or the patches one after another as in the original format. */
+static bool ReadNtfHeader(const char *data, size_t numBytes, u32 &xPatches, u32 &yPatches, size_t &heightsOffset, bool &rowMajor)
+{
+    int offset = 0;
+    const u32 first = ReadU32(data, numBytes, offset);
+    rowMajor = (first == cRowMajorNtfMagic);
+    if (rowMajor)
+    {
+        xPatches = ReadU32(data, numBytes, offset);
+        yPatches = ReadU32(data, numBytes, offset);
+        offset = cRowMajorNtfHeaderSize;
+    }
+    else
+    {
+        xPatches = first;
+        yPatches = ReadU32(data, numBytes, offset);
+    }
+    heightsOffset = (size_t)offset;
+
+    const unsigned long long numHeights = (unsigned long long)xPatches * yPatches * Terrain::cPatchSize * Terrain::cPatchSize;
+    return heightsOffset <= numBytes && numHeights * sizeof(float) <= numBytes - heightsOffset;
+}
+
+/// Copies the patches of an original format .ntf file, stored one after another, to their blocks in a row-major height grid.
+static void CopyPatchMajorHeights(const char *src, uint xPatches, uint yPatches, float *dest)
+{
+    const uint cPatchSize = Terrain::cPatchSize;
+    const uint rowWidth = xPatches * cPatchSize;
+    for(uint y = 0; y < yPatches; ++y)
+        for(uint x = 0; x < xPatches; ++x)
+            for(uint row = 0; row < cPatchSize; ++row)
+            {
+                memcpy(&dest[(y * cPatchSize + row) * rowWidth + x * cPatchSize], src, cPatchSize * sizeof(float));
+                src += cPatchSize * sizeof(float);
+            }
+}
+
 Terrain::Terrain(Urho3D::Context* context, Scene* scene) :
     IComponent(context, scene),
     INIT_ATTRIBUTE_VALUE(nodeTransformation, "Transform", Transform(float3(0,0,0),float3(0,0,0),float3(1,1,1))),
@@ -44,9 +148,19 @@ Terrain::Terrain(Urho3D::Context* context, Scene* scene) :
     INIT_ATTRIBUTE_VALUE(material, "Material", AssetReference("", "Material")),
     INIT_ATTRIBUTE_VALUE(heightMap, "Heightmap", AssetReference("", "Heightmap")),
     patchWidth_(1),
-    patchHeight_(1)
+    patchHeight_(1),
+    nextQueuedPatch_(0),
+    numPatchJobs_(0),
+    commitTimeBudget_(4.f),
+    lodPixelError_(2.f),
+    cameraHorizontalScale_(1.f),
+    hasCameraPosition_(false),
+    lodsDirty_(true),
+    streamingDistance_(0.f)
 {
     patches_.Resize(1);
+    heights_.Resize(cPatchSize * cPatchSize);
+    heightData_ = &heights_[0];
     MakePatchFlat(0, 0, 0.f);
 
     materialAsset_ = new AssetRefListener();
@@ -57,6 +171,15 @@ Terrain::Terrain(Urho3D::Context* context, Scene* scene) :
 
 Terrain::~Terrain()
 {
+    // The worker threads refer to the terrain and its height grid.
+    CancelPatchGeneration();
+    HeightsAboutToChange.Emit(true);
+    if (GetFramework())
+        GetFramework()->Frame()->Updated.Disconnect(this, &Terrain::UpdateView);
+    for(uint i = 0; i < patchGeometryPool_.Size(); ++i)
+        delete patchGeometryPool_[i];
+    patchGeometryPool_.Clear();
+
     if (world_.Expired())
     {
         if (rootNode_ != 0)
@@ -98,6 +221,7 @@ void Terrain::UpdateSignals()
         materialAsset_->Loaded.Connect(this, &Terrain::OnMaterialAssetLoaded);
         materialAsset_->TransferFailed.Connect(this, &Terrain::OnMaterialAssetFailed);
         heightMapAsset_->Loaded.Connect(this, &Terrain::OnTerrainAssetLoaded);
+        GetFramework()->Frame()->Updated.Connect(this, &Terrain::UpdateView);
     }
 }
 
@@ -141,6 +265,8 @@ void Terrain::ResizeTerrain(uint newPatchWidth, uint newPatchHeight)
     if (newPatchWidth == patchWidth_ && newPatchHeight == patchHeight_)
         return;
 
+    CancelPatchGeneration();
+
     // If the width changes, we need to also regenerate the old right-most column to generate the new seams. (If we are shrinking, this is not necessary)
     if (patchWidth_ < newPatchWidth)
         for(uint y = 0; y < patchHeight_; ++y)
@@ -165,6 +291,14 @@ void Terrain::ResizeTerrain(uint newPatchWidth, uint newPatchHeight)
         for(uint x = 0; x < Min(patchWidth_, newPatchWidth); ++x)
             newPatches[y * newPatchWidth + x] = GetPatch(x, y);
     patches_ = newPatches;
+
+    // Copy the old height values over to the new height grid.
+    PODVector<float> newHeights(newPatchWidth * newPatchHeight * cPatchSize * cPatchSize);
+    const uint copyWidth = Min(patchWidth_, newPatchWidth) * cPatchSize;
+    for(uint row = 0; row < Min(patchHeight_, newPatchHeight) * cPatchSize; ++row)
+        memcpy(&newHeights[row * newPatchWidth * cPatchSize], &heightData_[row * patchWidth_ * cPatchSize], copyWidth * sizeof(float));
+    SetHeightGrid(newHeights);
+
     uint oldPatchWidth = patchWidth_;
     uint oldPatchHeight = patchHeight_;
     patchWidth_ = newPatchWidth;
@@ -210,6 +344,8 @@ void Terrain::DestroyPatch(uint x, uint y)
 
 void Terrain::Destroy()
 {
+    CancelPatchGeneration();
+
     for(uint y = 0; y < patchHeight_; ++y)
         for(uint x = 0; x < patchWidth_; ++x)
             DestroyPatch(x, y);
@@ -227,13 +363,19 @@ void Terrain::Destroy()
 
 void Terrain::MakePatchFlat(uint x, uint y, float heightValue)
 {
+    WaitForPatchJobs();
+    HeightsAboutToChange.Emit(false);
     Patch &patch = GetPatch(x, y);
-    patch.heightData.Clear();
-    patch.heightData.Reserve(cPatchSize * cPatchSize);
-    for (uint i=0 ; i<cPatchSize * cPatchSize ; ++i)
-        patch.heightData.Push(heightValue);
+    const uint rowWidth = VerticesWidth();
+    for(uint row = 0; row < cPatchSize; ++row)
+    {
+        float *dest = &heightData_[(y * cPatchSize + row) * rowWidth + x * cPatchSize];
+        for(uint i = 0; i < cPatchSize; ++i)
+            dest[i] = heightValue;
+    }
     
-    patch.patch_geometry_dirty = true;
+    DirtyPatchGeometryAround(x * cPatchSize, y * cPatchSize, (x + 1) * cPatchSize - 1, (y + 1) * cPatchSize - 1);
+    patch.patch_heights_dirty = true;
 }
 
 void Terrain::OnComponentStructureChanged(IComponent*, AttributeChange::Type)
@@ -327,7 +469,14 @@ void Terrain::OnTerrainAssetLoaded(AssetPtr asset_)
     }
 
     if (assetData)
-        LoadFromDataInMemory((const char*)&assetData->data[0], assetData->data.Size());
+    {
+        // A row-major terrain file on disk is mapped and used in place. The asset is shared by all terrains referring to it,
+        // so its copy of the file is left to the asset memory budget to evict.
+        int offset = 0;
+        const bool rowMajor = (ReadU32((const char*)&assetData->data[0], assetData->data.Size(), offset) == cRowMajorNtfMagic);
+        if (!rowMajor || assetData->DiskSource().Empty() || !LoadFromFile(assetData->DiskSource()))
+            LoadFromDataInMemory((const char*)&assetData->data[0], assetData->data.Size());
+    }
 
     if (textureData)
     {
@@ -369,37 +518,60 @@ float Terrain::GetTerrainMinHeight() const
 {
     float minHeight = std::numeric_limits<float>::max();
 
-    for(uint i = 0; i < patches_.Size(); ++i)
-        for(uint j = 0; j < patches_[i].heightData.Size(); ++j)
-            minHeight = Min(minHeight, patches_[i].heightData[j]);
+    const uint numHeights = VerticesWidth() * VerticesHeight();
+    for(uint i = 0; i < numHeights; ++i)
+        minHeight = Min(minHeight, heightData_[i]);
 
     return minHeight;
 }
 
 float Terrain::GetTerrainMaxHeight() const
 {
-    float maxHeight = std::numeric_limits<float>::min();
+    float maxHeight = -std::numeric_limits<float>::max();
 
-    for(uint i = 0; i < patches_.Size(); ++i)
-        for(uint j = 0; j < patches_[i].heightData.Size(); ++j)
-            maxHeight = Max(maxHeight, patches_[i].heightData[j]);
+    const uint numHeights = VerticesWidth() * VerticesHeight();
+    for(uint i = 0; i < numHeights; ++i)
+        maxHeight = Max(maxHeight, heightData_[i]);
 
     return maxHeight;
 }
 
 void Terrain::Resize(uint newWidth, uint newHeight, uint oldPatchStartX, uint oldPatchStartY)
 {
+    CancelPatchGeneration();
+
     Vector<Patch> newPatches(newWidth * newHeight);
-    for(uint y = 0; y < newHeight && y + oldPatchStartY < yPatches.Get(); ++y)
-        for(uint x = 0; x < newWidth && x + oldPatchStartX < xPatches.Get(); ++x)
-            newPatches[y * newWidth + x] = patches_[(y + oldPatchStartY) * xPatches.Get() + x + oldPatchStartX];
+    PODVector<float> newHeights(newWidth * newHeight * cPatchSize * cPatchSize);
+    for(uint y = 0; y < newHeight; ++y)
+        for(uint x = 0; x < newWidth; ++x)
+        {
+            Patch &patch = newPatches[y * newWidth + x];
+            const bool copyOld = (y + oldPatchStartY < patchHeight_ && x + oldPatchStartX < patchWidth_);
+            if (copyOld)
+                patch = GetPatch(x + oldPatchStartX, y + oldPatchStartY);
+            patch.x = x;
+            patch.y = y;
+
+            // Patches outside the old terrain are flat.
+            for(uint row = 0; row < cPatchSize; ++row)
+            {
+                float *dest = &newHeights[(y * cPatchSize + row) * newWidth * cPatchSize + x * cPatchSize];
+                if (copyOld)
+                    memcpy(dest, &heightData_[((y + oldPatchStartY) * cPatchSize + row) * VerticesWidth() + (x + oldPatchStartX) * cPatchSize], cPatchSize * sizeof(float));
+                else
+                    for(uint i = 0; i < cPatchSize; ++i)
+                        dest[i] = 0.f;
+            }
+        }
 
     patches_ = newPatches;
+    SetHeightGrid(newHeights);
     xPatches.Set(newWidth, AttributeChange::Disconnected);
     yPatches.Set(newHeight, AttributeChange::Disconnected);
     patchWidth_ = newWidth;
     patchHeight_ = newHeight;
     DirtyAllTerrainPatches();
+    DirtyAllPatchHeights();
     RegenerateDirtyTerrainPatches();
 }
 
@@ -410,7 +582,7 @@ float Terrain::GetPoint(uint x, uint y) const
     if (y >= cPatchSize * patchHeight_)
         y = cPatchSize * patchHeight_ - 1;
 
-    return GetPatch(x / cPatchSize, y / cPatchSize).heightData[(y % cPatchSize) * cPatchSize + (x % cPatchSize)];
+    return heightData_[y * VerticesWidth() + x];
 }
 
 void Terrain::SetPointHeight(uint x, uint y, float height)
@@ -418,7 +590,23 @@ void Terrain::SetPointHeight(uint x, uint y, float height)
     if (x >= cPatchSize * patchWidth_ || y >= cPatchSize * patchHeight_)
         return; // Out of bounds signals are silently ignored.
 
-    GetPatch(x / cPatchSize, y / cPatchSize).heightData[(y % cPatchSize) * cPatchSize + (x % cPatchSize)] = height;
+    WaitForPatchJobs();
+    HeightsAboutToChange.Emit(false);
+    heightData_[y * VerticesWidth() + x] = height;
+    GetPatch(x / cPatchSize, y / cPatchSize).patch_heights_dirty = true;
+    DirtyPatchGeometryAround(x, y, x, y);
+}
+
+void Terrain::DirtyPatchGeometryAround(uint minX, uint minY, uint maxX, uint maxY)
+{
+    // The normals of the vertices next to the range also change. Patch p uses the vertices [p * cPatchSize, (p + 1) * cPatchSize], the last ones being the seam to the next patch.
+    const uint minPatchX = (minX > 1 ? (minX - 2) / cPatchSize : 0);
+    const uint minPatchY = (minY > 1 ? (minY - 2) / cPatchSize : 0);
+    const uint maxPatchX = Min((maxX + 1) / cPatchSize, patchWidth_ - 1);
+    const uint maxPatchY = Min((maxY + 1) / cPatchSize, patchHeight_ - 1);
+    for(uint y = minPatchY; y <= maxPatchY; ++y)
+        for(uint x = minPatchX; x <= maxPatchX; ++x)
+            GetPatch(x, y).patch_geometry_dirty = true;
 }
 
 float3 Terrain::CalculateNormal(uint x, uint y, uint xinside, uint yinside) const
@@ -442,18 +630,6 @@ float3 Terrain::CalculateNormal(uint x, uint y, uint xinside, uint yinside) cons
     return float3(x_slope, 2.0f, y_slope).Normalized();
 }
 
-u32 ReadU32(const char *dataPtr, size_t numBytes, int &offset)
-{
-    if (offset + 4 > (int)numBytes)
-    {
-        LogError("Terrain::ReadU32: Not enough bytes to deserialize!");
-        return 0;
-    }
-    u32 data = *(u32*)(dataPtr + offset); ///@note Requires unaligned load support from the CPU and assumes data storage endianness to be the same for loader and saver.
-    offset += 4;
-    return data;
-}
-
 bool Terrain::LoadFromImageFile(String filename, float offset, float scale)
 {
     SharedPtr<Urho3D::Image> image = SharedPtr<Urho3D::Image>(new Urho3D::Image(GetContext()));
@@ -490,47 +666,106 @@ bool Terrain::LoadFromImageFile(String filename, float offset, float scale)
 
 bool Terrain::LoadFromDataInMemory(const char *data, size_t numBytes)
 {
-    int offset = 0;
-    u32 xPatches = ReadU32(data, numBytes, offset);
-    u32 yPatches = ReadU32(data, numBytes, offset);
-
-    // Load all the data from the file to an intermediate buffer first, so that we can first see
-    // if the file is not broken, and reject it without losing the old terrain.
-    Vector<Patch> newPatches(xPatches * yPatches);
-
-    // Initialize the new height data structure.
-    for(u32 y = 0; y < yPatches; ++y)
-        for(u32 x = 0; x < xPatches; ++x)
-        {
-            newPatches[y * xPatches + x].x = x;
-            newPatches[y * xPatches + x].y = y;
-        }
-
     assert(sizeof(float) == 4);
 
-    // Load the new data.
-    for(uint i = 0; i < newPatches.Size(); ++i)
+    u32 newPatchWidth, newPatchHeight;
+    size_t offset;
+    bool rowMajor;
+    if (!ReadNtfHeader(data, numBytes, newPatchWidth, newPatchHeight, offset, rowMajor))
     {
-        newPatches[i].heightData.Resize(cPatchSize * cPatchSize);
-        newPatches[i].patch_geometry_dirty = true;
-        if ((offset + cPatchSize * cPatchSize * sizeof(float)) > numBytes)
-        {
-            LogError("Terrain::LoadFromDataInMemory: Not enough bytes to deserialize!");
-            //throw Exception("Not enough bytes to deserialize!");
-            return false;
-        }
+        LogError("Terrain::LoadFromDataInMemory: Not enough bytes to deserialize!");
+        return false;
+    }
 
-        memcpy(&newPatches[i].heightData[0], data + offset, cPatchSize * cPatchSize * sizeof(float));
-        offset += cPatchSize * cPatchSize * sizeof(float);
+    // Load all the data from the file to a new height grid first, so that a broken file is rejected without losing the old terrain.
+    PODVector<float> newHeights(newPatchWidth * newPatchHeight * cPatchSize * cPatchSize);
+    if (!newHeights.Empty())
+    {
+        if (rowMajor)
+            memcpy(&newHeights[0], data + offset, newHeights.Size() * sizeof(float));
+        else
+            CopyPatchMajorHeights(data + offset, newPatchWidth, newPatchHeight, &newHeights[0]);
     }
 
     // The terrain asset loaded ok. We are good to set that terrain as the active terrain.
     Destroy();
     CreateRootNode();
+    SetHeightGrid(newHeights);
+    SetLoadedTerrain(newPatchWidth, newPatchHeight);
+    return true;
+}
 
-    patches_ = newPatches;
-    patchWidth_ = xPatches;
-    patchHeight_ = yPatches;
+bool Terrain::LoadFromFile(const String &filename)
+{
+    SharedPtr<MemoryMappedFile> file(new MemoryMappedFile());
+    if (!file->Open(filename))
+        return false;
+
+    u32 newPatchWidth, newPatchHeight;
+    size_t offset;
+    bool rowMajor;
+    if (!ReadNtfHeader((const char*)file->Data(), file->Size(), newPatchWidth, newPatchHeight, offset, rowMajor))
+    {
+        LogError("Terrain::LoadFromFile: Not enough bytes in \"" + filename + "\" to deserialize!");
+        return false;
+    }
+
+    // The patches of the original format need to be rearranged to the row-major height grid, copy them out of the mapping.
+    if (!rowMajor)
+        return LoadFromDataInMemory((const char*)file->Data(), file->Size());
+
+    Destroy();
+    CreateRootNode();
+    HeightsAboutToChange.Emit(true);
+    PODVector<float>().Swap(heights_);
+    heightFile_ = file;
+    heightData_ = (newPatchWidth > 0 && newPatchHeight > 0 ? (float*)(file->Data() + offset) : 0);
+    SetLoadedTerrain(newPatchWidth, newPatchHeight);
+    return true;
+}
+
+bool Terrain::SaveToFile(const String &filename) const
+{
+    Urho3D::File file(GetContext(), filename, Urho3D::FILE_WRITE);
+    if (!file.IsOpen())
+    {
+        LogError("Terrain::SaveToFile: Failed to open file \"" + filename + "\" for writing.");
+        return false;
+    }
+
+    const u32 header[4] = { cRowMajorNtfMagic, patchWidth_, patchHeight_, 0 };
+    const uint numBytes = VerticesWidth() * VerticesHeight() * sizeof(float);
+    if (file.Write(header, sizeof(header)) != sizeof(header) || (numBytes > 0 && file.Write(heightData_, numBytes) != numBytes))
+    {
+        LogError("Terrain::SaveToFile: Failed to write to file \"" + filename + "\".");
+        return false;
+    }
+    return true;
+}
+
+void Terrain::SetHeightGrid(PODVector<float> &heights)
+{
+    // The old height grid is freed, and all patches are generated again from the new one.
+    CancelPatchGeneration();
+    HeightsAboutToChange.Emit(true);
+    heights_.Swap(heights);
+    heightFile_.Reset();
+    heightData_ = (heights_.Empty() ? 0 : &heights_[0]);
+}
+
+void Terrain::SetLoadedTerrain(uint newPatchWidth, uint newPatchHeight)
+{
+    // New patches are dirty, so all of them are generated.
+    patches_.Clear();
+    patches_.Resize(newPatchWidth * newPatchHeight);
+    for(uint y = 0; y < newPatchHeight; ++y)
+        for(uint x = 0; x < newPatchWidth; ++x)
+        {
+            patches_[y * newPatchWidth + x].x = x;
+            patches_[y * newPatchWidth + x].y = y;
+        }
+    patchWidth_ = newPatchWidth;
+    patchHeight_ = newPatchHeight;
 
     // Re-do all the geometry on the GPU.
     RegenerateDirtyTerrainPatches();
@@ -543,8 +778,6 @@ bool Terrain::LoadFromDataInMemory(const char *data, size_t numBytes)
 
     this->xPatches.Changed(AttributeChange::LocalOnly);
     this->yPatches.Changed(AttributeChange::LocalOnly);
-
-    return true;
 }
 
 void Terrain::DirtyAllTerrainPatches()
@@ -553,58 +786,79 @@ void Terrain::DirtyAllTerrainPatches()
         patches_[i].patch_geometry_dirty = true;
 }
 
+void Terrain::DirtyAllPatchHeights()
+{
+    for(uint i = 0; i < patches_.Size(); ++i)
+        patches_[i].patch_heights_dirty = true;
+}
+
 void Terrain::RegenerateDirtyTerrainPatches()
 {
     URHO3D_PROFILE(Terrain_RegenerateDirtyTerrainPatches);
 
-    Entity *parentEntity = ParentEntity();
-    if (!parentEntity)
+    if (!ParentEntity())
         return;
 
-    Placeable *position = parentEntity->Component<Placeable>().Get();
-    if (!GetFramework()->IsHeadless() && (!position || position->visible.Get())) // Only need to create GPU resources if the placeable itself is visible.
-    {
-        for(uint y = 0; y < patchHeight_; ++y)
-            for(uint x = 0; x < patchWidth_; ++x)
-            {
-                Terrain::Patch &scenePatch = GetPatch(x, y);
-                if (!scenePatch.patch_geometry_dirty || scenePatch.heightData.Size() == 0)
-                    continue;
-
-                bool neighborsLoaded = true;
-
-                const int neighbors[8][2] = 
-                { 
-                    { -1, -1 }, { -1, 0 }, { -1, 1 },
-                    {  0, -1 },            {  0, 1 },
-                    {  1, -1 }, {  1, 0 }, {  1, 1 }
-                };
-
-                for(uint i = 0; i < 8; ++i)
-                {
-                    uint nX = x + neighbors[i][0];
-                    uint nY = y + neighbors[i][1];
-                    if (nX < patchWidth_ &&
-                        nY < patchHeight_ &&
-                        GetPatch(nX, nY).heightData.Size() == 0)
-                    {
-                        neighborsLoaded = false;
-                        break;
-                    }
-                }
-
-                if (neighborsLoaded)
-                    GenerateTerrainGeometryForOnePatch(x, y);
-            }
-    }
+    QueueDirtyPatches();
     
     // All the new geometry we created will be visible for Urho3D by default. If the Placeable's visible attribute is false,
     // we need to hide all newly created geometry.
     AttachTerrainRootNode();
 
+    // Report the patches whose height values have changed, e.g. to a physics heightfield sharing the height grid.
+    uint minX = patchWidth_, minY = patchHeight_, maxX = 0, maxY = 0;
+    for(uint y = 0; y < patchHeight_; ++y)
+        for(uint x = 0; x < patchWidth_; ++x)
+        {
+            Terrain::Patch &patch = GetPatch(x, y);
+            if (!patch.patch_heights_dirty)
+                continue;
+            patch.patch_heights_dirty = false;
+            minX = Min(minX, x);
+            minY = Min(minY, y);
+            maxX = Max(maxX, x);
+            maxY = Max(maxY, y);
+        }
+    if (minX <= maxX && minY <= maxY)
+        HeightsChanged.Emit(minX, minY, maxX, maxY);
+
     TerrainRegenerated.Emit();
 }
 
+void Terrain::QueueDirtyPatches()
+{
+    Placeable *position = ParentEntity() ? ParentEntity()->Component<Placeable>().Get() : 0;
+    if (GetFramework()->IsHeadless() || (position && !position->visible.Get()) || // Only need to create GPU resources if the placeable itself is visible.
+        !ViewEnabled() || world_.Expired())
+        return;
+
+    // When streaming, the patches wait for the camera to come close. Patches that still have geometry are regenerated up to the distance they are released at.
+    const bool streaming = (streamingDistance_ > 0.f);
+    if (streaming && !hasCameraPosition_)
+        return;
+
+    const bool wasGenerating = IsGeneratingPatches();
+    for(uint y = 0; y < patchHeight_; ++y)
+        for(uint x = 0; x < patchWidth_; ++x)
+        {
+            // The height grid always holds the data of all patches, so the neighbors needed for the seams are present.
+            Terrain::Patch &scenePatch = GetPatch(x, y);
+            if (!scenePatch.patch_geometry_dirty)
+                continue;
+            if (streaming && PatchCameraDistance(x, y) > (scenePatch.node ? streamingDistance_ * cStreamOutFactor : streamingDistance_))
+                continue;
+            scenePatch.patch_geometry_dirty = false;
+            queuedPatches_.Push(QueuedPatch(y * patchWidth_ + x, ++scenePatch.geometry_request));
+        }
+    SchedulePatchJobs();
+
+    // Without worker threads there is nothing to gain from spreading the work over frames.
+    if (!GetSubsystem<Urho3D::WorkQueue>())
+        FinishPatchGeneration();
+    else if (!wasGenerating && IsGeneratingPatches())
+        GetFramework()->Frame()->Updated.Connect(this, &Terrain::UpdatePatchGeneration);
+}
+
 void Terrain::AttachTerrainRootNode()
 {
     if (world_.Expired()) 
@@ -656,169 +910,510 @@ Urho3D::Node* Terrain::CreateUrho3DTerrainPatchNode(Urho3D::Node* parent, uint p
     return node;
 }
 
-void Terrain::GenerateTerrainGeometryForOnePatch(uint patchX, uint patchY)
+void Terrain::FinishPatchGeneration()
 {
-    URHO3D_PROFILE(Terrain_GenerateTerrainGeometryForOnePatch);
+    if (!IsGeneratingPatches())
+        return;
 
-    Terrain::Patch &patch = GetPatch(patchX, patchY);
+    URHO3D_PROFILE(Terrain_FinishPatchGeneration);
 
-    if (!ViewEnabled())
+    Urho3D::WorkQueue *workQueue = GetSubsystem<Urho3D::WorkQueue>();
+    while(IsGeneratingPatches())
+    {
+        if (workQueue)
+            workQueue->Complete(0);
+        CommitCompletedPatchJobs(0.f);
+        SchedulePatchJobs();
+    }
+
+    GetFramework()->Frame()->Updated.Disconnect(this, &Terrain::UpdatePatchGeneration);
+    AttachTerrainRootNode();
+    GeometryCommitted.Emit();
+}
+
+void Terrain::UpdatePatchGeneration(float /*frameTime*/)
+{
+    URHO3D_PROFILE(Terrain_UpdatePatchGeneration);
+
+    CommitCompletedPatchJobs(commitTimeBudget_);
+    SchedulePatchJobs();
+    if (IsGeneratingPatches())
         return;
-    if (world_.Expired())
+
+    GetFramework()->Frame()->Updated.Disconnect(this, &Terrain::UpdatePatchGeneration);
+    // The committed geometry is visible for Urho3D by default, re-apply the visibility of the Placeable.
+    AttachTerrainRootNode();
+    GeometryCommitted.Emit();
+}
+
+void Terrain::CancelPatchGeneration()
+{
+    if (!IsGeneratingPatches())
         return;
 
+    URHO3D_PROFILE(Terrain_CancelPatchGeneration);
 
-    if (patch.node)
+    if (numPatchJobs_ > 0)
     {
-        patch.node->Remove();
-        patch.node = 0;
-        patch.urhoModel.Reset();
+        // Wait for the jobs in flight, as they read the height grid.
+        Urho3D::WorkQueue *workQueue = GetSubsystem<Urho3D::WorkQueue>();
+        if (workQueue)
+            workQueue->Complete(0);
+
+        Vector<PatchJob*> completed;
+        {
+            Urho3D::MutexLock lock(completedPatchJobsMutex_);
+            completed.Swap(completedPatchJobs_);
+        }
+        completed.Push(committingPatchJobs_);
+        committingPatchJobs_.Clear();
+        for(uint i = 0; i < completed.Size(); ++i)
+            ReleasePatchJob(completed[i]);
+        numPatchJobs_ = 0;
     }
+    queuedPatches_.Clear();
+    nextQueuedPatch_ = 0;
 
-    patch.node = CreateUrho3DTerrainPatchNode(rootNode_, patch.x, patch.y);
-    assert(patch.node);
+    if (GetFramework())
+        GetFramework()->Frame()->Updated.Disconnect(this, &Terrain::UpdatePatchGeneration);
+}
 
-    Urho3D::StaticModel* staticModel = patch.node->CreateComponent<Urho3D::StaticModel>();
-    staticModel->SetCastShadows(false);
-    SharedPtr<Urho3D::Model> manual = SharedPtr<Urho3D::Model>(new Urho3D::Model(GetContext()));
-    patch.urhoModel = manual;
-    manual->SetNumGeometries(1);
+void Terrain::WaitForPatchJobs()
+{
+    // Jobs that are not yet completed or being committed are in flight.
+    uint numDone = committingPatchJobs_.Size();
+    {
+        Urho3D::MutexLock lock(completedPatchJobsMutex_);
+        numDone += completedPatchJobs_.Size();
+    }
+    if (numPatchJobs_ <= numDone)
+        return;
 
-    Vector<unsigned short> indexData;
-    Vector<float> vertexData;
+    URHO3D_PROFILE(Terrain_WaitForPatchJobs);
+    Urho3D::WorkQueue *workQueue = GetSubsystem<Urho3D::WorkQueue>();
+    if (workQueue)
+        workQueue->Complete(0);
+}
 
-    const float vertexSpacingX = 1.f;
-    const float vertexSpacingY = 1.f;
-    const float patchSpacingX = cPatchSize * vertexSpacingX;
-    const float patchSpacingY = cPatchSize * vertexSpacingY;
-    const Urho3D::Vector3 patchOrigin(patch.x * patchSpacingX, 0.f, patch.y * patchSpacingY);
+Terrain::PatchGeometry *Terrain::AllocatePatchGeometry()
+{
+    if (patchGeometryPool_.Empty())
+        return new PatchGeometry();
+    PatchGeometry *geometry = patchGeometryPool_.Back();
+    patchGeometryPool_.Pop();
+    return geometry;
+}
 
-    unsigned short curIndex = 0;
+void Terrain::ReleasePatchJob(PatchJob *job)
+{
+    // The pool never holds more geometries than there can be in flight, as that many are needed again on the next full regeneration.
+    for(uint i = 0; i < job->patches.Size(); ++i)
+    {
+        if (patchGeometryPool_.Size() < cMaxPatchJobs * cPatchesPerJob)
+            patchGeometryPool_.Push(job->patches[i]);
+        else
+            delete job->patches[i];
+    }
+    delete job;
+}
 
-    const int cPatchVertexWidth = cPatchSize; // The number of vertices in the patch in horizontal direction. We use the fixed value of cPatchSize==16.
-    const int cPatchVertexHeight = cPatchSize; // The number of vertices in the patch in vertical  direction. We use the fixed value of cPatchSize==16.
-    // If we assume each patch is 16x16 vertices, then all the internal patches will get a 17x17 grid, since we need to connect seams.
-    // But, the outermost patch row and column at the terrain edge will not have this, since they do not need to connect to a next patch.
-    // This is the vertex stride for the terrain.
-    const unsigned short stride = (patch.x + 1 >= patchWidth_) ? cPatchVertexWidth : (cPatchVertexWidth + 1);
+void Terrain::SchedulePatchJobs()
+{
+    if (nextQueuedPatch_ >= queuedPatches_.Size())
+        return;
 
-    const float cFloatMax = std::numeric_limits<float>::max();
-    const float cFloatMin = std::numeric_limits<float>::min();
-    float3 boundsMin = float3(cFloatMax, cFloatMax, cFloatMax);
-    float3 boundsMax = float3(cFloatMin, cFloatMin, cFloatMin);
-    const float uScale = this->uScale.Get();
-    const float vScale = this->vScale.Get();
-    int skip = 0;
-    for(int y = 0; y <= cPatchVertexHeight; ++y)
+    Urho3D::WorkQueue *workQueue = GetSubsystem<Urho3D::WorkQueue>();
+    while(numPatchJobs_ < cMaxPatchJobs && nextQueuedPatch_ < queuedPatches_.Size())
     {
-        for(int x = 0; x <= cPatchVertexWidth; ++x)
+        PatchJob *job = new PatchJob();
+        job->owner = this;
+        job->uScale = uScale.Get();
+        job->vScale = vScale.Get();
+        for(; nextQueuedPatch_ < queuedPatches_.Size() && job->patches.Size() < cPatchesPerJob; ++nextQueuedPatch_)
         {
-            if ((patch.x + 1 >= patchWidth_ && x == cPatchVertexWidth) ||
-                (patch.y + 1 >= patchHeight_ && y == cPatchVertexHeight))
-            {
-                skip++;
-                continue; // We are at the single corner-most vertex of the whole terrain. That is to be skipped.
-            }
+            const QueuedPatch &queued = queuedPatches_[nextQueuedPatch_];
+            const Patch &patch = patches_[queued.index];
+            if (patch.geometry_request != queued.request)
+                continue; // Queued again later on, build it then.
+
+            PatchGeometry *geometry = AllocatePatchGeometry();
+            geometry->patchX = patch.x;
+            geometry->patchY = patch.y;
+            geometry->request = queued.request;
+            job->patches.Push(geometry);
+        }
+        if (job->patches.Empty())
+        {
+            delete job;
+            break;
+        }
 
-            Urho3D::Vector3 pos;
-            pos.x_ = vertexSpacingX * x;
-            pos.z_ = vertexSpacingY * y;
+        ++numPatchJobs_;
+        if (workQueue)
+        {
+            SharedPtr<Urho3D::WorkItem> item(new Urho3D::WorkItem());
+            item->workFunction_ = &Terrain::ProcessPatchJob;
+            item->aux_ = job;
+            workQueue->AddWorkItem(item);
+        }
+        else
+        {
+            Urho3D::WorkItem item;
+            item.aux_ = job;
+            ProcessPatchJob(&item, 0);
+        }
+    }
 
-            Terrain::Patch *thisPatch;
-            int X = x;
-            int Y = y;
-            if (x < cPatchVertexWidth && y < cPatchVertexHeight)
-            {
-                thisPatch = &patch;
+    if (nextQueuedPatch_ >= queuedPatches_.Size())
+    {
+        queuedPatches_.Clear();
+        nextQueuedPatch_ = 0;
+    }
+}
 
-                if ((patch.x + 1 < patchWidth_ || x + 1 < cPatchVertexWidth) &&
-                    (patch.y + 1 < patchHeight_ || y + 1 < cPatchVertexHeight))
-                {
-                    // Note: winding needs to be flipped when terrain X axis goes along world X axis and terrain Y axis along world Z
-                    indexData.Push(curIndex + stride);
-                    indexData.Push(curIndex + 1);
-                    indexData.Push(curIndex);
-
-                    indexData.Push(curIndex + stride);
-                    indexData.Push(curIndex + stride + 1);
-                    indexData.Push(curIndex + 1);
-                }
-            }
-            else if (x == cPatchVertexWidth && y == cPatchVertexHeight)
-            {
-                thisPatch = &GetPatch(patch.x + 1, patch.y + 1);
-                X = 0;
-                Y = 0;
-            }
-            else if (x == cPatchVertexWidth)
-            {
-                thisPatch = &GetPatch(patch.x + 1, patch.y);
-                X = 0;
-            }
-            else // (y == patchHeight)
+void Terrain::ProcessPatchJob(const Urho3D::WorkItem *item, unsigned /*threadIndex*/)
+{
+    PatchJob *job = static_cast<PatchJob*>(item->aux_);
+    for(uint i = 0; i < job->patches.Size(); ++i)
+        job->owner->BuildPatchGeometry(job->uScale, job->vScale, *job->patches[i]);
+
+    Urho3D::MutexLock lock(job->owner->completedPatchJobsMutex_);
+    job->owner->completedPatchJobs_.Push(job);
+}
+
+void Terrain::CommitCompletedPatchJobs(float timeBudget)
+{
+    {
+        Urho3D::MutexLock lock(completedPatchJobsMutex_);
+        committingPatchJobs_.Push(completedPatchJobs_);
+        completedPatchJobs_.Clear();
+    }
+    if (committingPatchJobs_.Empty())
+        return;
+
+    URHO3D_PROFILE(Terrain_CommitPatchGeometry);
+
+    // Commit at least one patch per call so that the generation always progresses.
+    Urho3D::HiresTimer timer;
+    const long long timeBudgetUSec = (long long)(timeBudget * 1000.f);
+    bool outOfTime = false;
+    while(!committingPatchJobs_.Empty() && !outOfTime)
+    {
+        PatchJob *job = committingPatchJobs_.Front();
+        while(job->numCommitted < job->patches.Size())
+        {
+            CommitPatchGeometry(*job->patches[job->numCommitted++]);
+            if (timeBudgetUSec > 0 && timer.GetUSec(false) >= timeBudgetUSec)
             {
-                thisPatch = &GetPatch(patch.x, patch.y + 1);
-                Y = 0;
+                outOfTime = true;
+                break;
             }
+        }
+        if (job->numCommitted < job->patches.Size())
+            break;
 
-            pos.y_ = thisPatch->heightData[Y * cPatchVertexWidth + X];
+        committingPatchJobs_.Erase(0);
+        ReleasePatchJob(job);
+        --numPatchJobs_;
+    }
+}
 
-            vertexData.Push(pos.x_);
-            vertexData.Push(pos.y_);
-            vertexData.Push(pos.z_);
-            boundsMin = boundsMin.Min(float3(pos));
-            boundsMax = boundsMax.Max(float3(pos));
+void Terrain::BuildPatchGeometry(float uScale, float vScale, PatchGeometry &geometry) const
+{
+    const uint patchX = geometry.patchX;
+    const uint patchY = geometry.patchY;
 
-            float3 normal = CalculateNormal(thisPatch->x, thisPatch->y, X, Y);
-            vertexData.Push(normal.x);
-            vertexData.Push(normal.y);
-            vertexData.Push(normal.z);
+    // If we assume each patch is 16x16 vertices, then all the internal patches will get a 17x17 grid, since we need to connect seams.
+    // But, the outermost patch row and column at the terrain edge will not have this, since they do not need to connect to a next patch.
+    const uint patchVertexWidth = (patchX + 1 >= patchWidth_) ? cPatchSize : (cPatchSize + 1);
+    const uint patchVertexHeight = (patchY + 1 >= patchHeight_) ? cPatchSize : (cPatchSize + 1);
 
-            vertexData.Push((patchOrigin.x_ + pos.x_) * uScale);
-            vertexData.Push((patchOrigin.z_ + pos.z_) * vScale);
+    const float vertexSpacingX = 1.f;
+    const float vertexSpacingY = 1.f;
+    const float patchSpacingX = cPatchSize * vertexSpacingX;
+    const float patchSpacingY = cPatchSize * vertexSpacingY;
+    const Urho3D::Vector3 patchOrigin(patchX * patchSpacingX, 0.f, patchY * patchSpacingY);
 
-            vertexData.Push((float)(patch.x * cPatchSize + x) / (VerticesWidth() - 1));
-            vertexData.Push((float)(patch.y * cPatchSize + y) / (VerticesHeight() - 1));
+    const float cFloatMax = std::numeric_limits<float>::max();
+    float3 boundsMin = float3(cFloatMax, cFloatMax, cFloatMax);
+    float3 boundsMax = float3(-cFloatMax, -cFloatMax, -cFloatMax);
+
+    CalculateTerrainLodErrors(&heightData_[patchY * cPatchSize * VerticesWidth() + patchX * cPatchSize], VerticesWidth(), patchVertexWidth,
+        patchVertexHeight, geometry.lodErrors);
 
-            ++curIndex;
+    geometry.numVertices = patchVertexWidth * patchVertexHeight;
+    geometry.vertices.Resize(geometry.numVertices * cPatchVertexFloats);
+    float *vertexData = &geometry.vertices[0];
+    for(uint y = 0; y < patchVertexHeight; ++y)
+        for(uint x = 0; x < patchVertexWidth; ++x)
+        {
+            // The seam vertices are read from the next patches.
+            const float3 pos(vertexSpacingX * x, GetPoint(patchX * cPatchSize + x, patchY * cPatchSize + y), vertexSpacingY * y);
+            boundsMin = boundsMin.Min(pos);
+            boundsMax = boundsMax.Max(pos);
+            const float3 normal = CalculateNormal(patchX, patchY, x, y);
+
+            *vertexData++ = pos.x;
+            *vertexData++ = pos.y;
+            *vertexData++ = pos.z;
+            *vertexData++ = normal.x;
+            *vertexData++ = normal.y;
+            *vertexData++ = normal.z;
+            *vertexData++ = (patchOrigin.x_ + pos.x) * uScale;
+            *vertexData++ = (patchOrigin.z_ + pos.z) * vScale;
+            *vertexData++ = (float)(patchX * cPatchSize + x) / (VerticesWidth() - 1);
+            *vertexData++ = (float)(patchY * cPatchSize + y) / (VerticesHeight() - 1);
         }
-    }
-    int numVertices = curIndex;
 
+    geometry.bounds = Urho3D::BoundingBox(Urho3D::Vector3(boundsMin), Urho3D::Vector3(boundsMax));
+}
 
-    SharedPtr<Urho3D::Geometry> geom(new Urho3D::Geometry(GetContext()));
-    SharedPtr<Urho3D::IndexBuffer> ib(new Urho3D::IndexBuffer(GetContext()));
-    SharedPtr<Urho3D::VertexBuffer> vb(new Urho3D::VertexBuffer(GetContext()));
-    
-    ib->SetShadowed(true);  // Allow CPU-side raycasts and auto-restore on GPU context loss
-    vb->SetShadowed(true); // Allow CPU raycasts and auto-restore on GPU context loss
-
-    ib->SetSize(indexData.Size(), false);
-    ib->SetData(&indexData[0]);
-    vb->SetSize(numVertices, Urho3D::MASK_POSITION | Urho3D::MASK_NORMAL | Urho3D::MASK_TEXCOORD1 | Urho3D::MASK_TEXCOORD2);
-    vb->SetData(&vertexData[0]);
-    geom->SetIndexBuffer(ib);
-    geom->SetVertexBuffer(0, vb);
-    geom->SetDrawRange(Urho3D::TRIANGLE_LIST, 0, ib->GetIndexCount());
-    manual->SetNumGeometryLodLevels(0, 1);
+void Terrain::CommitPatchGeometry(const PatchGeometry &geometry)
+{
+    if (!PatchExists(geometry.patchX, geometry.patchY) || !rootNode_ || world_.Expired())
+        return;
+
+    Terrain::Patch &patch = GetPatch(geometry.patchX, geometry.patchY);
+    if (patch.geometry_request != geometry.request)
+        return; // The patch has been scheduled again since, the newer geometry is committed instead.
+
+    Urho3D::StaticModel *staticModel = (patch.node ? patch.node->GetComponent<Urho3D::StaticModel>() : 0);
+    Urho3D::Geometry *geom = (patch.urhoModel ? patch.urhoModel->GetGeometry(0, 0) : 0);
+    Urho3D::VertexBuffer *vb = (geom ? geom->GetVertexBuffer(0) : 0);
+
+    // A new model each time, as the static model only picks up the bounding box of a newly set model.
+    SharedPtr<Urho3D::Model> manual = SharedPtr<Urho3D::Model>(new Urho3D::Model(GetContext()));
     manual->SetNumGeometries(1);
-    manual->SetGeometry(0, 0, geom);
-    manual->SetBoundingBox(Urho3D::BoundingBox(Urho3D::Vector3(boundsMin), Urho3D::Vector3(boundsMax)));
+    manual->SetNumGeometryLodLevels(0, 1);
 
-    staticModel->SetModel(manual);
+    if (staticModel && vb && vb->GetVertexCount() == geometry.numVertices)
+    {
+        // The patch dimensions have not changed, e.g. after a height edit, so the existing vertex buffer is updated in place.
+        vb->SetData(&geometry.vertices[0]);
+        manual->SetGeometry(0, 0, geom);
+    }
+    else
+    {
+        if (patch.node)
+        {
+            patch.node->Remove();
+            patch.node = 0;
+            patch.urhoModel.Reset();
+        }
+
+        patch.node = CreateUrho3DTerrainPatchNode(rootNode_, patch.x, patch.y);
+        assert(patch.node);
 
-    // Make the entity & component links for identifying raycasts
-    patch.node->SetVar(GraphicsWorld::entityLink, Variant(WeakPtr<RefCounted>(ParentEntity())));
-    patch.node->SetVar(GraphicsWorld::componentLink, Variant(WeakPtr<RefCounted>(this)));
+        staticModel = patch.node->CreateComponent<Urho3D::StaticModel>();
+        staticModel->SetCastShadows(false);
 
-    patch.patch_geometry_dirty = false;
+        SharedPtr<Urho3D::Geometry> newGeom(new Urho3D::Geometry(GetContext()));
+        SharedPtr<Urho3D::VertexBuffer> newVb(new Urho3D::VertexBuffer(GetContext()));
+
+        newVb->SetShadowed(true); // Allow CPU raycasts and auto-restore on GPU context loss
+        newVb->SetSize(geometry.numVertices, Urho3D::MASK_POSITION | Urho3D::MASK_NORMAL | Urho3D::MASK_TEXCOORD1 | Urho3D::MASK_TEXCOORD2);
+        newVb->SetData(&geometry.vertices[0]);
+        newGeom->SetVertexBuffer(0, newVb);
+        manual->SetGeometry(0, 0, newGeom);
+
+        // Make the entity & component links for identifying raycasts
+        patch.node->SetVar(GraphicsWorld::entityLink, Variant(WeakPtr<RefCounted>(ParentEntity())));
+        patch.node->SetVar(GraphicsWorld::componentLink, Variant(WeakPtr<RefCounted>(this)));
+    }
+
+    manual->SetBoundingBox(geometry.bounds);
+    patch.urhoModel = manual;
+    staticModel->SetModel(manual);
+
+    // The index range is set by the LOD level, which is selected again with the new errors on the next frame.
+    for(uint i = 0; i < cNumTerrainLodLevels; ++i)
+        patch.lod_errors[i] = geometry.lodErrors[i];
+    ApplyPatchLod(patch, patch.lod, patch.lod_edges);
+    lodsDirty_ = true;
 
     // Set material if available
     IMaterialAsset* mAsset = dynamic_cast<IMaterialAsset*>(materialAsset_->Asset().Get());
     if (mAsset)
         staticModel->SetMaterial(mAsset->UrhoMaterial());
+}
 
-    AttachTerrainRootNode();
+
+void Terrain::SetLodPixelError(float pixels)
+{
+    lodPixelError_ = Max(pixels, 0.f);
+    lodsDirty_ = true;
+}
+
+void Terrain::SetStreamingDistance(float distance)
+{
+    const bool wasStreaming = (streamingDistance_ > 0.f);
+    streamingDistance_ = Max(distance, 0.f);
+    // Streams the patches again on the next frame.
+    lodsDirty_ = true;
+
+    // The patches left out while streaming are dirty, generate them now that all the patches have geometry.
+    if (wasStreaming && streamingDistance_ == 0.f)
+        QueueDirtyPatches();
+}
+
+void Terrain::UpdateView(float /*frameTime*/)
+{
+    if (!rootNode_ || world_.Expired())
+        return;
+
+    Camera *camera = world_->Renderer()->MainCameraComponent();
+    Urho3D::Camera *urhoCamera = (camera ? camera->UrhoCamera() : 0);
+    if (!urhoCamera || !urhoCamera->GetNode())
+        return;
+
+    // The errors and bounds of the patches are in the terrain space.
+    const Urho3D::Vector3 cameraPosition = rootNode_->GetWorldTransform().Inverse() * urhoCamera->GetNode()->GetWorldPosition();
+    if (!lodsDirty_ && hasCameraPosition_ && cameraPosition.Equals(cameraPosition_))
+        return;
+    lodsDirty_ = false;
+    cameraPosition_ = cameraPosition;
+    hasCameraPosition_ = true;
+    const Urho3D::Vector3 scale = rootNode_->GetWorldScale();
+    cameraHorizontalScale_ = Min(Urho3D::Abs(scale.x_), Urho3D::Abs(scale.z_));
+
+    if (streamingDistance_ > 0.f)
+        StreamPatches();
+    UpdatePatchLods(urhoCamera);
+}
+
+float Terrain::PatchCameraDistance(uint patchX, uint patchY) const
+{
+    const float dx = Max(Max(patchX * cPatchSize - cameraPosition_.x_, cameraPosition_.x_ - (patchX + 1) * cPatchSize), 0.f);
+    const float dz = Max(Max(patchY * cPatchSize - cameraPosition_.z_, cameraPosition_.z_ - (patchY + 1) * cPatchSize), 0.f);
+    return sqrtf(dx * dx + dz * dz) * cameraHorizontalScale_;
+}
+
+void Terrain::StreamPatches()
+{
+    URHO3D_PROFILE(Terrain_StreamPatches);
+
+    bool streamIn = false;
+    for(uint y = 0; y < patchHeight_; ++y)
+        for(uint x = 0; x < patchWidth_; ++x)
+        {
+            Patch &patch = GetPatch(x, y);
+            const float distance = PatchCameraDistance(x, y);
+            if (distance <= streamingDistance_)
+                streamIn = streamIn || patch.patch_geometry_dirty;
+            else if (!patch.patch_geometry_dirty && distance > streamingDistance_ * cStreamOutFactor)
+            {
+                // The patch has geometry or is being built. Bumping the request discards the geometry being built.
+                DestroyPatch(x, y);
+                patch.patch_geometry_dirty = true;
+                ++patch.geometry_request;
+            }
+        }
+
+    if (streamIn)
+        QueueDirtyPatches();
+}
+
+void Terrain::UpdatePatchLods(Urho3D::Camera *urhoCamera)
+{
+    Urho3D::Graphics *graphics = GetSubsystem<Urho3D::Graphics>();
+    if (!graphics || graphics->GetHeight() <= 0)
+        return;
+
+    URHO3D_PROFILE(Terrain_UpdatePatchLods);
+
+    // The largest error in the terrain space that stays within the pixel error, per unit of distance from the camera.
+    const Urho3D::Vector3 scale = rootNode_->GetWorldScale();
+    const float horizontalScale = cameraHorizontalScale_;
+    const float verticalScale = Max(Urho3D::Abs(scale.y_), Urho3D::M_EPSILON);
+    const float viewHeight = urhoCamera->GetZoom() * graphics->GetHeight();
+    const float errorPerDistance = lodPixelError_ * 2.f * tanf(urhoCamera->GetFov() * 0.5f * Urho3D::M_DEGTORAD) / viewHeight * horizontalScale / verticalScale;
+    const float orthoError = lodPixelError_ * urhoCamera->GetOrthoSize() / viewHeight / verticalScale;
+
+    lodLevels_.Resize(patches_.Size());
+    for(uint y = 0; y < patchHeight_; ++y)
+        for(uint x = 0; x < patchWidth_; ++x)
+        {
+            const Patch &patch = GetPatch(x, y);
+            uint level = 0;
+            if (lodPixelError_ > 0.f && patch.node && patch.urhoModel)
+            {
+                float maxError = orthoError;
+                if (!urhoCamera->IsOrthographic())
+                {
+                    const Urho3D::BoundingBox &bounds = patch.urhoModel->GetBoundingBox();
+                    const Urho3D::Vector3 local = cameraPosition_ - patch.node->GetPosition();
+                    const Urho3D::Vector3 outside(Max(Max(bounds.min_.x_ - local.x_, local.x_ - bounds.max_.x_), 0.f),
+                        Max(Max(bounds.min_.y_ - local.y_, local.y_ - bounds.max_.y_), 0.f),
+                        Max(Max(bounds.min_.z_ - local.z_, local.z_ - bounds.max_.z_), 0.f));
+                    maxError = outside.Length() * errorPerDistance;
+                }
+                level = SelectTerrainLod(patch.lod_errors, maxError);
+            }
+            else if (!patch.node && streamingDistance_ > 0.f)
+                level = cNumTerrainLodLevels - 1; // Streamed out patches do not pull their neighbors to a finer level.
+            lodLevels_[y * patchWidth_ + x] = (u8)level;
+        }
+
+    LimitTerrainLodDifference(lodLevels_, patchWidth_, patchHeight_);
+
+    for(uint y = 0; y < patchHeight_; ++y)
+        for(uint x = 0; x < patchWidth_; ++x)
+        {
+            Patch &patch = GetPatch(x, y);
+            const uint level = lodLevels_[y * patchWidth_ + x];
+            const uint coarserEdges = TerrainLodCoarserEdges(lodLevels_, patchWidth_, patchHeight_, x, y);
+            if (level != patch.lod || coarserEdges != patch.lod_edges)
+                ApplyPatchLod(patch, level, coarserEdges);
+        }
+}
+
+void Terrain::ApplyPatchLod(Patch &patch, uint level, uint coarserEdges)
+{
+    patch.lod = (u8)level;
+    patch.lod_edges = (u8)coarserEdges;
+
+    Urho3D::Geometry *geom = (patch.urhoModel ? patch.urhoModel->GetGeometry(0, 0) : 0);
+    Urho3D::VertexBuffer *vb = (geom ? geom->GetVertexBuffer(0) : 0);
+    if (!vb)
+        return;
+
+    // The outermost patch row and column at the terrain edge have no seam vertices.
+    const uint vertexWidth = (patch.x + 1 >= patchWidth_) ? cPatchSize : (cPatchSize + 1);
+    const uint vertexHeight = (patch.y + 1 >= patchHeight_) ? cPatchSize : (cPatchSize + 1);
+    if (vb->GetVertexCount() != vertexWidth * vertexHeight)
+        return; // The terrain has been resized, but the patch has not been regenerated yet.
+
+    const uint sizeIndex = (vertexWidth == cPatchSize ? 1 : 0) + (vertexHeight == cPatchSize ? 2 : 0);
+    if (!lodIndexBuffers_[sizeIndex])
+        CreateLodIndexBuffer(sizeIndex, vertexWidth, vertexHeight);
+
+    const PODVector<uint> &offsets = lodIndexOffsets_[sizeIndex];
+    const uint range = level * cNumTerrainLodEdgeMasks + coarserEdges;
+    geom->SetIndexBuffer(lodIndexBuffers_[sizeIndex]);
+    geom->SetDrawRange(Urho3D::TRIANGLE_LIST, offsets[range], offsets[range + 1] - offsets[range], 0, vb->GetVertexCount());
+}
+
+void Terrain::CreateLodIndexBuffer(uint sizeIndex, uint vertexWidth, uint vertexHeight)
+{
+    URHO3D_PROFILE(Terrain_CreateLodIndexBuffer);
+
+    PODVector<unsigned short> indices, rangeIndices;
+    PODVector<uint> &offsets = lodIndexOffsets_[sizeIndex];
+    offsets.Clear();
+    for(uint level = 0; level < cNumTerrainLodLevels; ++level)
+        for(uint edges = 0; edges < cNumTerrainLodEdgeMasks; ++edges)
+        {
+            offsets.Push(indices.Size());
+            GenerateTerrainLodIndices(vertexWidth, vertexHeight, level, edges, rangeIndices);
+            indices.Push(rangeIndices);
+        }
+    offsets.Push(indices.Size());
+
+    SharedPtr<Urho3D::IndexBuffer> ib(new Urho3D::IndexBuffer(GetContext()));
+    ib->SetShadowed(true); // Allow CPU-side raycasts and auto-restore on GPU context loss
+    ib->SetSize(indices.Size(), false);
+    ib->SetData(&indices[0]);
+    lodIndexBuffers_[sizeIndex] = ib;
 }
 
 }
@@ -8,12 +8,20 @@
 #include "UrhoRendererFwd.h"
 #include "AssetReference.h"
 #include "AssetRefListener.h"
+#include "MemoryMappedFile.h"
 #include "CoreTypes.h"
+#include "TerrainLod.h"
 #include "Math/Transform.h"
 
 #include <Math/float3.h>
+#include <Urho3D/Core/Mutex.h>
 #include <Urho3D/Graphics/Model.h>
 
+namespace Urho3D
+{
+    struct WorkItem;
+}
+
 namespace Tundra
 {
 
@@ -53,6 +61,8 @@ typedef WeakPtr<Placeable> PlaceableWeakPtr;
     only uses the texture channels 0-3, and blends between those based on the terrain height values.
 
     Emits TerrainRegenerated-signal once terrain has been succesfully generated.
+
+    Patches far from the camera are rendered at coarser geomipmap LOD levels, see SetLodPixelError().
     
     <b>Does not depend on any other components</b>. Currently Terrain stores its own transform matrix, so it does not depend on the Placeable component. It might be more consistent
     to create a dependency to Placeable, so that the position of the terrain is editable in the same way the position of other placeables is done.
@@ -96,14 +106,16 @@ public:
     static const uint cPatchSize = 16;
 
     /// Describes a single patch that is present in the scene.
-    /** A patch can be in one of the following three states:
-        - not loaded. The height data nor the GPU data is present, but the Patch struct itself is initialized. heightData.size() == 0, node == entity == 0. meshGeometryName == "".
-        - heightmap data loaded. The heightData vector contains the heightmap data, but the visible GPU vertex data itself has not been generated yet, due to the neighbors
-          of this patch not being present yet. node == entity == 0, meshGeometryName == "". patch_geometry_dirty == true.
-        - fully loaded. The GPU data is also loaded and the node, entity and meshGeometryName fields specify the used GPU resources. */
+    /** The height values of the patch are stored in the height grid of the terrain, see HeightData(). A patch can be in one of the following two states:
+        - heightmap data loaded. The visible GPU vertex data has not been generated yet. node == 0, patch_geometry_dirty == true.
+        - fully loaded. The GPU data is also loaded and the node and urhoModel fields specify the used GPU resources. */
     struct Patch
     {
-        Patch():x(0), y(0), node(0), patch_geometry_dirty(true) {}
+        Patch():x(0), y(0), node(0), patch_geometry_dirty(true), patch_heights_dirty(true), geometry_request(0), lod(0), lod_edges(0)
+        {
+            for(uint i = 0; i < cNumTerrainLodLevels; ++i)
+                lod_errors[i] = 0.f;
+        }
 
         /// X-coordinate on the grid of patches. In the range [0, Terrain::PatchWidth()].
         uint x;
@@ -111,10 +123,6 @@ public:
         /// Y-coordinate on the grid of patches. In the range [0, Terrain::PatchHeight()].
         uint y;
 
-        /// Typically this will be a 16x16 array of height values in world coordinates.
-        /// If the length is zero, this patch hasn't been loaded in yet.
-        Urho3D::Vector<float> heightData;
-
         /// Urho3D -specific: Store a reference to the actual render hierarchy node.
         Urho3D::Node *node;
 
@@ -126,8 +134,20 @@ public:
         /// in yet.
         bool patch_geometry_dirty;
 
-        /// Call only when you've checked that this patch has been loaded in.
-        float GetHeightValue(uint x, uint y) const { return heightData[y * cPatchSize + x]; }
+        /// If true, the height values of this patch have changed since the last HeightsChanged signal.
+        bool patch_heights_dirty;
+
+        /// Incremented each time the geometry of this patch is scheduled to be built. Only the geometry of the latest request is committed to the GPU.
+        uint geometry_request;
+
+        /// Geometric error of each geomipmap LOD level of the committed geometry, see CalculateTerrainLodErrors.
+        float lod_errors[cNumTerrainLodLevels];
+
+        /// The LOD level the patch is rendered at.
+        u8 lod;
+
+        /// TerrainLodEdge bits of the edges that are stitched to a neighbor of a coarser LOD level.
+        u8 lod_edges;
     };
     
     /// @return The patch at given (x,y) coordinates. Pass in values in range [0, PatchWidth()/PatchHeight[.
@@ -158,7 +178,7 @@ public:
     {
         for(uint y = 0; y < patchHeight_; ++y)
             for(uint x = 0; x < patchWidth_; ++x)
-                if (!PatchExists(x,y) || GetPatch(x,y).heightData.Size() == 0 || GetPatch(x,y).node == 0)
+                if (!PatchExists(x,y) || GetPatch(x,y).node == 0)
                     return false;
 
         return true;
@@ -188,9 +208,19 @@ public:
     /// @param y In the range [0, Terrain::PatchHeight * Terrain::cPatchSize [.
     float GetPoint(uint x, uint y) const;
 
-    /// Sets a new height value to the given terrain map vertex. Marks the patch that vertex is part of dirty,
+    /// Returns the height values of the whole terrain as a row-major grid of VerticesWidth() x VerticesHeight() values. [noscript]
+    /** Patch (x,y) occupies the cPatchSize x cPatchSize block starting at row y * cPatchSize and column x * cPatchSize.
+        The grid is shared with the physics heightfield of the terrain without copying, and may be a memory-mapped terrain file,
+        see LoadFromFile(). The pointer stays valid until the terrain is resized or reloaded, after which TerrainRegenerated is emitted.
+        HeightsAboutToChange is emitted before the grid is written to or reallocated. */
+    const float *HeightData() const { return heightData_; }
+
+    /// Returns whether the height grid is used in place from a memory-mapped terrain file.
+    bool IsHeightDataMapped() const { return heightFile_ != 0; }
+
+    /// Sets a new height value to the given terrain map vertex. Marks the patches whose geometry uses the vertex dirty,
     /// but does not immediately recreate the GPU surfaces. Use the RegenerateDirtyTerrainPatches() function
-    /// to regenerate the visible Ogre mesh geometry.
+    /// to regenerate the visible Urho3D geometry.
     void SetPointHeight(uint x, uint y, float height);
 
     /// Loads the terrain from the given image file.
@@ -202,14 +232,56 @@ public:
     bool LoadFromImageFile(String filename, float offset, float scale);
 
     /// Loads the terrain height map data from the given in-memory .ntf file buffer.
+    /** Both the original .ntf format, which stores the patches one after another, and the row-major format written by SaveToFile()
+        are accepted. The height data is copied to the height grid in one pass. */
     bool LoadFromDataInMemory(const char *data, size_t numBytes);
 
+    /// Loads the terrain height map data from the given .ntf file.
+    /** A file in the row-major format written by SaveToFile() is memory-mapped and used as the height grid in place, so the operating
+        system only reads in the parts of the height grid that are accessed. Files in the original format are read and copied. Height
+        edits only change the mapped memory, never the file. A row-major heightMap asset that has a disk source is loaded this way. */
+    bool LoadFromFile(const String &filename);
+
+    /// Saves the terrain height map data to the given file in the row-major .ntf format, which LoadFromFile() can memory-map.
+    bool SaveToFile(const String &filename) const;
+
     /// Marks all terrain patches dirty.
     void DirtyAllTerrainPatches();
 
     /// Recreate terrain patches that are marked dirty.
+    /** The patch geometry is built on the worker threads of the Urho3D work queue and committed to the GPU over the following frames,
+        at most CommitTimeBudget() milliseconds per frame. HeightsChanged and TerrainRegenerated are emitted immediately, as the height
+        grid is already up to date, and GeometryCommitted once all the patches are visible. */
     void RegenerateDirtyTerrainPatches();
 
+    /// Waits for the patch geometry being built and commits all of it to the GPU immediately.
+    void FinishPatchGeneration();
+
+    /// Returns whether there is patch geometry waiting to be built or committed to the GPU.
+    bool IsGeneratingPatches() const { return numPatchJobs_ > 0 || nextQueuedPatch_ < queuedPatches_.Size(); }
+
+    /// Sets the time in milliseconds that committing built patch geometry to the GPU may take per frame. 0 commits all the built patches at once.
+    void SetCommitTimeBudget(float milliseconds) { commitTimeBudget_ = Urho3D::Max(milliseconds, 0.0f); }
+
+    /// Returns the time in milliseconds that committing built patch geometry to the GPU may take per frame.
+    float CommitTimeBudget() const { return commitTimeBudget_; }
+
+    /// Sets the largest screen space error in pixels that the geomipmap LOD levels of the patches may cause. 0 renders all the patches at full detail.
+    /** The LOD level of each patch is selected every frame the main camera moves, from the precomputed errors of the levels and the distance of the patch. */
+    void SetLodPixelError(float pixels);
+
+    /// Returns the largest screen space error in pixels that the geomipmap LOD levels of the patches may cause.
+    float LodPixelError() const { return lodPixelError_; }
+
+    /// Sets the horizontal distance from the main camera, in world units, within which the patches have GPU geometry. 0 creates the geometry of all the patches.
+    /** For very large terrains. The geometry of the patches is created as the camera approaches them and released once the camera is
+        further than 1.25 times the distance away. While streaming, dirty patches within the distance are regenerated as the camera moves.
+        The height grid always holds the whole terrain, so GetPoint() and the physics heightfield are not affected. */
+    void SetStreamingDistance(float distance);
+
+    /// Returns the horizontal distance from the main camera within which the patches have GPU geometry, or 0 if the geometry of all the patches is created.
+    float StreamingDistance() const { return streamingDistance_; }
+
     /// Returns the minimum height value in the whole terrain.
     /** This function blindly iterates through the whole terrain, so avoid calling it in performance-critical code. */
     float GetTerrainMinHeight() const;
@@ -230,7 +302,34 @@ public:
      /// Emitted when the terrain data is regenerated.
     Signal0<void> TerrainRegenerated;
 
+    /// Emitted before the height grid returned by HeightData() is written to or reallocated. [noscript]
+    /** Readers of the grid on other threads, such as an asynchronously stepped physics heightfield, must stop reading it before
+        returning. If the parameter is true, the grid is freed or unmapped, and the old pointer must not be used anymore. */
+    Signal1<bool> HeightsAboutToChange;
+
+    /// Emitted before TerrainRegenerated when the height values of patches have changed. [noscript]
+    /** The parameters are the inclusive patch range minX, minY, maxX, maxY containing all the changed patches. */
+    Signal4<uint, uint, uint, uint> HeightsChanged;
+
+    /// Emitted when all the patch geometry scheduled by RegenerateDirtyTerrainPatches has been committed to the GPU. [noscript]
+    Signal0<void> GeometryCommitted;
+
 private:
+    struct PatchGeometry;
+    struct PatchJob;
+
+    /// A dirty patch waiting to be scheduled for building.
+    struct QueuedPatch
+    {
+        QueuedPatch() : index(0), request(0) {}
+        QueuedPatch(uint index_, uint request_) : index(index_), request(request_) {}
+
+        /// Index of the patch in the patch grid.
+        uint index;
+        /// Patch::geometry_request at the time the patch was queued. The entry is skipped if the patch has been queued again since.
+        uint request;
+    };
+
     /// Called when the parent entity has been set.
     void UpdateSignals();
 
@@ -284,9 +383,71 @@ private:
     /// @param textureName The Ogre texture resource name to set.
     void SetTerrainMaterialTexture(uint index, const String &textureName);
 
-    /// Creates Ogre geometry data for the single given patch, or updates the geometry for an existing
-    /// patch if the associated Ogre resources already exist.
-    void GenerateTerrainGeometryForOnePatch(uint patchX, uint patchY);
+    /// Builds the vertex and index data of the given patch.
+    /** Only reads the height grid, so this is called from the worker threads. */
+    void BuildPatchGeometry(float uScale, float vScale, PatchGeometry &geometry) const;
+
+    /// Creates the Urho3D geometry for the patch of the built geometry, or updates the buffers of the patch in place if the associated Urho3D resources already exist.
+    void CommitPatchGeometry(const PatchGeometry &geometry);
+
+    /// Builds the geometry of the patches of a job. Called by the Urho3D work queue.
+    static void ProcessPatchJob(const Urho3D::WorkItem *item, unsigned threadIndex);
+
+    /// Schedules jobs for the queued patches, limiting the number of jobs in flight so that the built geometry waiting to be committed stays bounded.
+    /** The jobs are added to the work queue, or processed immediately if there is no work queue. */
+    void SchedulePatchJobs();
+
+    /// Commits the geometry of the completed patch jobs to the GPU, until @c timeBudget milliseconds have passed. 0 commits all of it.
+    void CommitCompletedPatchJobs(float timeBudget);
+
+    /// Commits built patch geometry each frame while patches are being generated.
+    void UpdatePatchGeneration(float frameTime);
+
+    /// Waits for the patch jobs in flight and discards all the geometry that has not been committed yet.
+    /** Called before the height grid or the patches are reallocated, as the worker threads read them. */
+    void CancelPatchGeneration();
+
+    /// Waits for the patch jobs in flight, as they read the height grid. Their geometry is still committed.
+    /** Called before height values are written in place. The edited patches are dirtied, so their stale geometry is replaced
+        when they are regenerated. */
+    void WaitForPatchJobs();
+
+    /// Marks the geometry of all the patches that use the given inclusive range of height grid vertices dirty.
+    /** A patch uses a vertex either as a position, including the seam to the next patches, or for the normals of the vertices next to it. */
+    void DirtyPatchGeometryAround(uint minX, uint minY, uint maxX, uint maxY);
+
+    /// Returns a patch geometry from the pool, or a new one if the pool is empty.
+    PatchGeometry *AllocatePatchGeometry();
+
+    /// Returns the patch geometries of a job to the pool and deletes the job.
+    void ReleasePatchJob(PatchJob *job);
+
+    /// Streams the patches and selects their LOD levels each frame the main camera moves.
+    void UpdateView(float frameTime);
+
+    /// Selects the LOD levels of the patches for the camera, and stitches the patches next to coarser ones.
+    void UpdatePatchLods(Urho3D::Camera *urhoCamera);
+
+    /// Releases the geometry of the patches too far from the camera, and queues the dirty patches within the streaming distance.
+    void StreamPatches();
+
+    /// Returns the horizontal distance in world units from the last known main camera position to the given patch.
+    float PatchCameraDistance(uint patchX, uint patchY) const;
+
+    /// Queues the dirty patches for building if the terrain is visible, skipping the patches outside the streaming distance.
+    void QueueDirtyPatches();
+
+    /// Uses the given heights as the height grid, releasing a mapped terrain file.
+    void SetHeightGrid(PODVector<float> &heights);
+
+    /// Makes the loaded height grid of the given size the active terrain and marks all the patches dirty.
+    void SetLoadedTerrain(uint xPatches, uint yPatches);
+
+    /// Sets the index range of the given LOD level and stitched edges to the geometry of a patch.
+    void ApplyPatchLod(Patch &patch, uint level, uint coarserEdges);
+
+    /// Creates the shared index buffer holding the indices of all the LOD levels and edge combinations for patches of the given vertex dimensions.
+    void CreateLodIndexBuffer(uint sizeIndex, uint vertexWidth, uint vertexHeight);
 
     SharedPtr<AssetRefListener> materialAsset_;
     SharedPtr<AssetRefListener> heightMapAsset_;
@@ -304,8 +465,71 @@ private:
     /// Specifies the Ogre material name of the material that is currently being used to display the terrain.
     String currentMaterial_;
 
+    /// Marks the height values of all patches changed.
+    void DirtyAllPatchHeights();
+
     /// Stores the actual height patches.
     Vector<Patch> patches_;
+
+    /// Height values of all patches, unless the height grid is mapped from a file.
+    PODVector<float> heights_;
+
+    /// Terrain file whose contents are used as the height grid, if any.
+    SharedPtr<MemoryMappedFile> heightFile_;
+
+    /// Height values of all patches, see HeightData(). Points either to heights_ or into heightFile_.
+    float *heightData_;
+
+    /// Dirty patches waiting to be scheduled for building, from nextQueuedPatch_ onwards.
+    PODVector<QueuedPatch> queuedPatches_;
+
+    /// Index of the next patch in queuedPatches_ to schedule.
+    uint nextQueuedPatch_;
+
+    /// Number of patch jobs scheduled whose geometry has not been committed yet.
+    uint numPatchJobs_;
+
+    /// Patch jobs whose geometry has been built, in the order they completed.
+    Vector<PatchJob*> completedPatchJobs_;
+
+    /// Protects completedPatchJobs_, which the worker threads push to.
+    Urho3D::Mutex completedPatchJobsMutex_;
+
+    /// Completed jobs taken from completedPatchJobs_ whose geometry has only partly been committed.
+    Vector<PatchJob*> committingPatchJobs_;
+
+    /// Patch geometries whose buffers are reused for the next patches to build.
+    Vector<PatchGeometry*> patchGeometryPool_;
+
+    /// Time in milliseconds that committing patch geometry may take per frame.
+    float commitTimeBudget_;
+
+    /// Index buffers shared by all the patches, one for each combination of 16 or 17 vertices wide and high.
+    SharedPtr<Urho3D::IndexBuffer> lodIndexBuffers_[4];
+
+    /// Start of the indices of each LOD level and edge combination in lodIndexBuffers_, and the total index count as the last element.
+    PODVector<uint> lodIndexOffsets_[4];
+
+    /// LOD levels of the patches being selected in UpdatePatchLods.
+    PODVector<u8> lodLevels_;
+
+    /// Largest allowed screen space error in pixels.
+    float lodPixelError_;
+
+    /// Main camera position in the terrain space at the last LOD selection.
+    Urho3D::Vector3 cameraPosition_;
+
+    /// Smaller of the world scales of the terrain along the x and z axes at the last LOD selection.
+    float cameraHorizontalScale_;
+
+    /// Whether cameraPosition_ has been set.
+    bool hasCameraPosition_;
+
+    /// Whether the patches need to be streamed and their LOD levels selected again even if the camera has not moved.
+    bool lodsDirty_;
+
+    /// Horizontal distance from the main camera within which the patches have geometry, 0 for all the patches.
+    float streamingDistance_;
     
      /// Graphics world ptr
     GraphicsWorldWeakPtr world_;
@@ -0,0 +1,187 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "TerrainLod.h"
+
+#include <Urho3D/Math/MathDefs.h>
+
+namespace Tundra
+{
+
+namespace
+{
+
+/// Fills @c samples with the vertex coordinates used at @c level along an axis of @c count vertices: every 2^level:th vertex and the last one.
+void LodSamples(uint count, uint level, PODVector<uint> &samples)
+{
+    samples.Clear();
+    const uint step = 1U << level;
+    for(uint i = 0; i + 1 < count; i += step)
+        samples.Push(i);
+    samples.Push(count - 1);
+}
+
+/// Returns the sample nearest to @c value. A tie goes towards the nearer end of the axis, which keeps the corner triangles from collapsing into slivers.
+uint SnapToSamples(const PODVector<uint> &samples, uint value)
+{
+    for(uint i = 1; i < samples.Size(); ++i)
+        if (samples[i] >= value)
+        {
+            const uint below = value - samples[i - 1], above = samples[i] - value;
+            if (below != above)
+                return below < above ? samples[i - 1] : samples[i];
+            return 2 * value <= samples.Back() ? samples[i - 1] : samples[i];
+        }
+    return samples.Back();
+}
+
+/// Maps grid coordinates to vertex indices, moving the vertices on the stitched edges onto the coarser level.
+struct LodVertexGrid
+{
+    uint width;
+    uint height;
+    uint coarserEdges;
+    PODVector<uint> coarseXs;
+    PODVector<uint> coarseYs;
+
+    unsigned short Index(uint x, uint y) const
+    {
+        if (((coarserEdges & TerrainLodEdgeLeft) && x == 0) || ((coarserEdges & TerrainLodEdgeRight) && x == width - 1))
+            y = SnapToSamples(coarseYs, y);
+        if (((coarserEdges & TerrainLodEdgeTop) && y == 0) || ((coarserEdges & TerrainLodEdgeBottom) && y == height - 1))
+            x = SnapToSamples(coarseXs, x);
+        return (unsigned short)(y * width + x);
+    }
+};
+
+/// Adds a triangle of a vertex grid @c width vertices wide, unless stitching has collapsed it to a line or a point.
+void AddTriangle(PODVector<unsigned short> &indices, uint width, unsigned short a, unsigned short b, unsigned short c)
+{
+    const int ax = a % width, ay = a / width;
+    const int bx = b % width, by = b / width;
+    const int cx = c % width, cy = c / width;
+    if ((bx - ax) * (cy - ay) == (cx - ax) * (by - ay))
+        return;
+    indices.Push(a);
+    indices.Push(b);
+    indices.Push(c);
+}
+
+}
+
+void GenerateTerrainLodIndices(uint vertexWidth, uint vertexHeight, uint level, uint coarserEdges, PODVector<unsigned short> &indices)
+{
+    indices.Clear();
+    if (vertexWidth < 2 || vertexHeight < 2)
+        return;
+
+    level = Urho3D::Min(level, cNumTerrainLodLevels - 1);
+    PODVector<uint> xs, ys;
+    LodSamples(vertexWidth, level, xs);
+    LodSamples(vertexHeight, level, ys);
+
+    LodVertexGrid grid;
+    grid.width = vertexWidth;
+    grid.height = vertexHeight;
+    grid.coarserEdges = coarserEdges;
+    LodSamples(vertexWidth, level + 1, grid.coarseXs);
+    LodSamples(vertexHeight, level + 1, grid.coarseYs);
+
+    for(uint j = 0; j + 1 < ys.Size(); ++j)
+        for(uint i = 0; i + 1 < xs.Size(); ++i)
+        {
+            const unsigned short v00 = grid.Index(xs[i], ys[j]);
+            const unsigned short v10 = grid.Index(xs[i + 1], ys[j]);
+            const unsigned short v01 = grid.Index(xs[i], ys[j + 1]);
+            const unsigned short v11 = grid.Index(xs[i + 1], ys[j + 1]);
+            // Same diagonal and winding as the full detail patch geometry.
+            AddTriangle(indices, vertexWidth, v01, v10, v00);
+            AddTriangle(indices, vertexWidth, v01, v11, v10);
+        }
+}
+
+void CalculateTerrainLodErrors(const float *heights, uint rowStride, uint vertexWidth, uint vertexHeight, float *errors)
+{
+    errors[0] = 0.0f;
+    PODVector<uint> xs, ys;
+    for(uint level = 1; level < cNumTerrainLodLevels; ++level)
+    {
+        float maxError = errors[level - 1];
+        LodSamples(vertexWidth, level, xs);
+        LodSamples(vertexHeight, level, ys);
+        for(uint j = 0; j + 1 < ys.Size(); ++j)
+            for(uint i = 0; i + 1 < xs.Size(); ++i)
+            {
+                const uint x0 = xs[i], x1 = xs[i + 1], y0 = ys[j], y1 = ys[j + 1];
+                const float h00 = heights[y0 * rowStride + x0];
+                const float h10 = heights[y0 * rowStride + x1];
+                const float h01 = heights[y1 * rowStride + x0];
+                const float h11 = heights[y1 * rowStride + x1];
+                for(uint y = y0; y <= y1; ++y)
+                    for(uint x = x0; x <= x1; ++x)
+                    {
+                        // Interpolate on the triangle of the cell the vertex is on, split along the (x0,y1)-(x1,y0) diagonal.
+                        const float u = (float)(x - x0) / (x1 - x0);
+                        const float v = (float)(y - y0) / (y1 - y0);
+                        const float surface = (u + v <= 1.0f) ? h00 + u * (h10 - h00) + v * (h01 - h00) :
+                            h11 + (1.0f - u) * (h01 - h11) + (1.0f - v) * (h10 - h11);
+                        maxError = Urho3D::Max(maxError, Urho3D::Abs(heights[y * rowStride + x] - surface));
+                    }
+            }
+        errors[level] = maxError;
+    }
+}
+
+uint SelectTerrainLod(const float *errors, float maxError)
+{
+    uint level = 0;
+    while(level + 1 < cNumTerrainLodLevels && errors[level + 1] <= maxError)
+        ++level;
+    return level;
+}
+
+void LimitTerrainLodDifference(PODVector<u8> &levels, uint width, uint height)
+{
+    // Lowering a level can require lowering its neighbors in turn, so repeat until nothing changes.
+    bool changed = true;
+    while(changed)
+    {
+        changed = false;
+        for(uint y = 0; y < height; ++y)
+            for(uint x = 0; x < width; ++x)
+            {
+                u8 &level = levels[y * width + x];
+                uint limit = level;
+                if (x > 0)
+                    limit = Urho3D::Min(limit, levels[y * width + x - 1] + 1U);
+                if (x + 1 < width)
+                    limit = Urho3D::Min(limit, levels[y * width + x + 1] + 1U);
+                if (y > 0)
+                    limit = Urho3D::Min(limit, levels[(y - 1) * width + x] + 1U);
+                if (y + 1 < height)
+                    limit = Urho3D::Min(limit, levels[(y + 1) * width + x] + 1U);
+                if (limit < level)
+                {
+                    level = (u8)limit;
+                    changed = true;
+                }
+            }
+    }
+}
+
+uint TerrainLodCoarserEdges(const PODVector<u8> &levels, uint width, uint height, uint x, uint y)
+{
+    const u8 level = levels[y * width + x];
+    uint edges = 0;
+    if (x > 0 && levels[y * width + x - 1] > level)
+        edges |= TerrainLodEdgeLeft;
+    if (x + 1 < width && levels[y * width + x + 1] > level)
+        edges |= TerrainLodEdgeRight;
+    if (y > 0 && levels[(y - 1) * width + x] > level)
+        edges |= TerrainLodEdgeTop;
+    if (y + 1 < height && levels[(y + 1) * width + x] > level)
+        edges |= TerrainLodEdgeBottom;
+    return edges;
+}
+
+}
@@ -0,0 +1,54 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "CoreTypes.h"
+#include "UrhoRendererApi.h"
+
+#include <Urho3D/Container/Vector.h>
+
+namespace Tundra
+{
+
+/// Number of geomipmap LOD levels of a terrain patch.
+/** Level n uses every 2^n:th vertex of the patch, so the coarsest level covers a 16x16 patch with two triangles. */
+static const uint cNumTerrainLodLevels = 5;
+
+/// Bits telling which edges of a terrain patch border a patch of the next coarser LOD level.
+enum TerrainLodEdge
+{
+    TerrainLodEdgeLeft = 1, ///< The x == 0 edge.
+    TerrainLodEdgeRight = 2, ///< The x == vertexWidth - 1 edge.
+    TerrainLodEdgeTop = 4, ///< The y == 0 edge.
+    TerrainLodEdgeBottom = 8, ///< The y == vertexHeight - 1 edge.
+    cNumTerrainLodEdgeMasks = 16 ///< Number of edge bit combinations.
+};
+
+/// Generates the triangle list indices of a terrain patch vertex grid at the given LOD level.
+/** The vertices on the edges in @c coarserEdges are stitched to the vertices of the next coarser level, so that the patch does not crack
+    open against a neighbor of that level. The triangles have the winding of the full detail terrain patch geometry.
+    @param vertexWidth Number of vertices in the x direction, at most cPatchSize + 1.
+    @param vertexHeight Number of vertices in the y direction, at most cPatchSize + 1.
+    @param level LOD level in the range [0, cNumTerrainLodLevels[.
+    @param coarserEdges Combination of TerrainLodEdge bits.
+    @param indices Receives the indices of the row-major vertex grid. */
+URHORENDERER_API void GenerateTerrainLodIndices(uint vertexWidth, uint vertexHeight, uint level, uint coarserEdges, PODVector<unsigned short> &indices);
+
+/// Calculates the geometric error of each LOD level of a terrain patch.
+/** The error of a level is the largest vertical distance of the patch vertices from the surface of that level, and it never decreases
+    towards the coarser levels. The error of level 0 is always 0.
+    @param heights Height of the first vertex of the patch. The rows of the grid are @c rowStride floats apart.
+    @param errors Receives cNumTerrainLodLevels errors. */
+URHORENDERER_API void CalculateTerrainLodErrors(const float *heights, uint rowStride, uint vertexWidth, uint vertexHeight, float *errors);
+
+/// Returns the coarsest LOD level whose error from CalculateTerrainLodErrors is at most @c maxError.
+URHORENDERER_API uint SelectTerrainLod(const float *errors, float maxError);
+
+/// Lowers the LOD levels of a grid of patches so that the levels of adjacent patches differ by at most one, which the stitching relies on.
+/** @param levels Row-major grid of @c width x @c height LOD levels. */
+URHORENDERER_API void LimitTerrainLodDifference(PODVector<u8> &levels, uint width, uint height);
+
+/// Returns the TerrainLodEdge bits of the neighbors of patch (x,y) that have a coarser LOD level.
+URHORENDERER_API uint TerrainLodCoarserEdges(const PODVector<u8> &levels, uint width, uint height, uint x, uint y);
+
+}
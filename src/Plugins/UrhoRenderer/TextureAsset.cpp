@@ -6,23 +6,22 @@
 #include <Urho3D/Core/Profiler.h>
 #include "LoggingFunctions.h"
 #include "TextureAsset.h"
+#include "TextureTranscodeCache.h"
+#include "UrhoRenderer.h"
 
-#include "Crunch/crn_decomp.h"
-#include "Crunch/dds_defs.h"
-
+#include <Urho3D/Core/WorkQueue.h>
 #include <Urho3D/Graphics/GraphicsEvents.h>
 #include <Urho3D/Resource/Image.h>
 #include <Urho3D/IO/MemoryBuffer.h>
 #include <Urho3D/Graphics/Texture2D.h>
 #include <Urho3D/Graphics/Material.h>
 
-#include <algorithm>
-
 namespace Tundra
 {
 
 TextureAsset::TextureAsset(AssetAPI *owner, const String &type_, const String &name_) :
-    IAsset(owner, type_, name_)
+    IAsset(owner, type_, name_),
+    transcodeRequest_(0)
 {
 }
 
@@ -31,44 +30,62 @@ TextureAsset::~TextureAsset()
     Unload();
 }
 
-bool TextureAsset::DeserializeFromData(const u8 *data_, uint numBytes, bool /*allowAsynchronous*/)
+bool TextureAsset::DeserializeFromData(const u8 *data_, uint numBytes, bool allowAsynchronous)
 {
     URHO3D_PROFILE(TextureAsset_LoadFromFileInMemory);
 
-    bool success = false;
-
     // Delete previous data first
     Unload();
-    texture = new Urho3D::Texture2D(context_);
 
     if (!Name().EndsWith(".crn", false))
+        return CompleteLoad(CreateTexture(data_, numBytes));
+
+    // Crunch textures are transcoded to DDS. Use a previously transcoded texture from the disk cache if there is one,
+    // otherwise transcode in the background when allowed.
+    UrhoRenderer *renderer = assetAPI->GetFramework()->Module<UrhoRenderer>();
+    TextureTranscodeCache *transcoder = renderer ? renderer->TextureTranscoder() : 0;
+    Vector<u8> ddsData;
+    if (transcoder && transcoder->FindCached(data_, numBytes, ddsData))
+        return CompleteLoad(CreateTexture(&ddsData[0], ddsData.Size()));
+
+    if (transcoder && allowAsynchronous && GetSubsystem<Urho3D::WorkQueue>())
     {
-        Urho3D::MemoryBuffer imageBuffer(data_, numBytes);
-        SharedPtr<Urho3D::Image> image(new Urho3D::Image(context_));
-        success = image->Load(imageBuffer);
-        if (success)
-        {
-            DetermineMipsToSkip(image, texture);
-            success = texture->SetData(image);
-        }
+        if (transcoder->TranscodeAsync(data_, numBytes, this, transcodeRequest_))
+            return true; // AssetLoadCompleted is signaled from TranscodeFinished
+        return CompleteLoad(false);
     }
-    else
+
+    bool success = (transcoder ? transcoder->Transcode(data_, numBytes, ddsData) : TranscodeCrnToDds(data_, numBytes, ddsData));
+    return CompleteLoad(success && CreateTexture(&ddsData[0], ddsData.Size()));
+}
+
+void TextureAsset::TranscodeFinished(uint request, const Vector<u8> &ddsData, bool success)
+{
+    // Superseded by an unload or a newer load
+    if (request != transcodeRequest_)
+        return;
+
+    if (!CompleteLoad(success && CreateTexture(&ddsData[0], ddsData.Size())))
+        assetAPI->AssetLoadFailed(Name());
+}
+
+bool TextureAsset::CreateTexture(const u8 *data, uint numBytes)
+{
+    texture = new Urho3D::Texture2D(context_);
+
+    Urho3D::MemoryBuffer imageBuffer(data, numBytes);
+    SharedPtr<Urho3D::Image> image(new Urho3D::Image(context_));
+    bool success = image->Load(imageBuffer);
+    if (success)
     {
-        Vector<u8> ddsData;
-        success = DecompressCRNtoDDS(data_, numBytes, ddsData);
-        if (success)
-        {
-            Urho3D::MemoryBuffer imageBuffer(&ddsData[0], ddsData.Size());
-            SharedPtr<Urho3D::Image> image(new Urho3D::Image(context_));
-            success = image->Load(imageBuffer);
-            if (success)
-            {
-                DetermineMipsToSkip(image, texture);
-                success = texture->SetData(image);
-            }
-        }
+        DetermineMipsToSkip(image, texture);
+        success = texture->SetData(image);
     }
+    return success;
+}
 
+bool TextureAsset::CompleteLoad(bool success)
+{
     if (success)
     {
         // Once data has been loaded, subscribe to device reset events to be able to restore the data if necessary
@@ -77,114 +94,17 @@ bool TextureAsset::DeserializeFromData(const u8 *data_, uint numBytes, bool /*al
     }
     else
     {
-        LogError("TextureAsset::DeserializeFromData: Failed to load texture asset " + Name());
+        LogError("TextureAsset: Failed to load texture asset " + Name());
         texture.Reset();
     }
 
     return success;
 }
 
-bool TextureAsset::DecompressCRNtoDDS(const u8 *crnData, uint crnNumBytes, Vector<u8> &ddsData) const
-{
-    URHO3D_PROFILE(TextureAsset_DecompressCRNtoDDS);
-
-    // Texture data
-    crnd::crn_texture_info textureInfo;
-    if (!crnd::crnd_get_texture_info((void*)crnData, (crnd::uint32)crnNumBytes, &textureInfo))
-    {
-        LogError("CRN texture info parsing failed, invalid input data.");
-        return false;
-    }
-    // Begin unpack
-    crnd::crnd_unpack_context crnContext = crnd::crnd_unpack_begin((void*)crnData, (crnd::uint32)crnNumBytes);
-    if (!crnContext)
-    {
-        LogError("CRN texture data unpacking failed, invalid input data.");
-        return false;
-    }
-
-    // DDS header
-    crnlib::DDSURFACEDESC2 header;
-    memset(&header, 0, sizeof(header));
-    header.dwSize = sizeof(header);
-    // - Size and flags
-    header.dwFlags = crnlib::DDSD_CAPS | crnlib::DDSD_HEIGHT | crnlib::DDSD_WIDTH | crnlib::DDSD_PIXELFORMAT | ((textureInfo.m_levels > 1) ? crnlib::DDSD_MIPMAPCOUNT : 0);
-    header.ddsCaps.dwCaps = crnlib::DDSCAPS_TEXTURE;
-    header.dwWidth = textureInfo.m_width;
-    header.dwHeight = textureInfo.m_height;
-    // - Pixelformat
-    header.ddpfPixelFormat.dwSize = sizeof(crnlib::DDPIXELFORMAT);
-    header.ddpfPixelFormat.dwFlags = crnlib::DDPF_FOURCC;
-    crn_format fundamentalFormat = crnd::crnd_get_fundamental_dxt_format(textureInfo.m_format);
-    header.ddpfPixelFormat.dwFourCC = crnd::crnd_crn_format_to_fourcc(fundamentalFormat);
-    if (fundamentalFormat != textureInfo.m_format)
-        header.ddpfPixelFormat.dwRGBBitCount = crnd::crnd_crn_format_to_fourcc(textureInfo.m_format);
-    // - Mipmaps
-    header.dwMipMapCount = (textureInfo.m_levels > 1) ? textureInfo.m_levels : 0;
-    if (textureInfo.m_levels > 1)
-        header.ddsCaps.dwCaps |= (crnlib::DDSCAPS_COMPLEX | crnlib::DDSCAPS_MIPMAP);
-    // - Cubemap with 6 faces
-    if (textureInfo.m_faces == 6)
-    {
-        header.ddsCaps.dwCaps2 = crnlib::DDSCAPS2_CUBEMAP |
-            crnlib::DDSCAPS2_CUBEMAP_POSITIVEX | crnlib::DDSCAPS2_CUBEMAP_NEGATIVEX | crnlib::DDSCAPS2_CUBEMAP_POSITIVEY |
-            crnlib::DDSCAPS2_CUBEMAP_NEGATIVEY | crnlib::DDSCAPS2_CUBEMAP_POSITIVEZ | crnlib::DDSCAPS2_CUBEMAP_NEGATIVEZ;
-    }
-
-    // Set pitch/linear size field (some DDS readers require this field to be non-zero).
-    int bits_per_pixel = crnd::crnd_get_crn_format_bits_per_texel(textureInfo.m_format);
-    header.lPitch = (((header.dwWidth + 3) & ~3) * ((header.dwHeight + 3) & ~3) * bits_per_pixel) >> 3;
-    header.dwFlags |= crnlib::DDSD_LINEARSIZE;
-
-    // Prepare output data
-    uint totalSize = sizeof(crnlib::cDDSFileSignature) + header.dwSize;
-    uint writePos = 0;
-    ddsData.Resize(totalSize);
-
-    // Write signature. Note: Not endian safe.
-    memcpy(&ddsData[0] + writePos, &crnlib::cDDSFileSignature, sizeof(crnlib::cDDSFileSignature));
-    writePos += sizeof(crnlib::cDDSFileSignature);
-
-    // Write header
-    memcpy(&ddsData[0] + writePos, &header, header.dwSize);
-    writePos += header.dwSize;
-
-    // Now transcode all face and mipmap levels into memory, one mip level at a time.
-    for (crn_uint32 iLevel = 0; iLevel < textureInfo.m_levels; iLevel++)
-    {
-        // Compute the face's width, height, number of DXT blocks per row/col, etc.
-        const crn_uint32 width = std::max(1U, textureInfo.m_width >> iLevel);
-        const crn_uint32 height = std::max(1U, textureInfo.m_height >> iLevel);
-        const crn_uint32 blocksX = std::max(1U, (width + 3) >> 2);
-        const crn_uint32 blocksY = std::max(1U, (height + 3) >> 2);
-        const crn_uint32 rowPitch = blocksX * crnd::crnd_get_bytes_per_dxt_block(textureInfo.m_format);
-        const crn_uint32 faceSize = rowPitch * blocksY;
-
-        totalSize += faceSize;
-        if (ddsData.Size() < totalSize)
-            ddsData.Resize(totalSize);
-
-        // Now transcode the level to raw DXTn
-        void *dest = (void*)(&ddsData[0] + writePos);
-        if (!crnd::crnd_unpack_level(crnContext, &dest, faceSize, rowPitch, iLevel))
-        {
-            ddsData.Clear();
-            break;
-        }
-        writePos += faceSize;
-    }
-    crnd::crnd_unpack_end(crnContext);
-
-    if (ddsData.Empty())
-    {
-        LogError("CRN uncompression failed!");
-        return false;
-    }
-    return true;
-}
-
 void TextureAsset::DoUnload()
 {
+    // Discard the result of any pending background transcode
+    ++transcodeRequest_;
     texture.Reset();
 }
 
@@ -193,6 +113,11 @@ bool TextureAsset::IsLoaded() const
     return texture != nullptr;
 }
 
+uint TextureAsset::GpuMemoryUsage() const
+{
+    return texture ? texture->GetMemoryUse() : 0;
+}
+
 Urho3D::Texture2D* TextureAsset::UrhoTexture() const
 {
     return texture;
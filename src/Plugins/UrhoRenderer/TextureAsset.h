@@ -25,6 +25,9 @@ public:
     /// IAsset override.
     bool IsLoaded() const override;
 
+    /// IAsset override.
+    uint GpuMemoryUsage() const override;
+
     /// Returns Urho3D texture
     Urho3D::Texture2D* UrhoTexture() const;
 
@@ -34,6 +37,10 @@ public:
     /// Get height of the texture. Returns 0 if not loaded.
     size_t Height() const;
 
+    /// Called by TextureTranscodeCache once the background transcoding of a .crn texture has finished. [noscript]
+    /** Creates the texture from the transcoded DDS data, unless the asset has been unloaded or reloaded since the transcode was requested. */
+    void TranscodeFinished(uint request, const Vector<u8> &ddsData, bool success);
+
 protected:
     /// Unload asset. IAsset override.
     void DoUnload() override;
@@ -44,10 +51,16 @@ protected:
 private:
     void HandleDeviceReset(StringHash eventType, VariantMap& eventData);
 
-    bool DecompressCRNtoDDS(const u8 *crnData, uint crnNumBytes, Vector<u8> &ddsData) const;
+    /// Creates the texture from image file data.
+    bool CreateTexture(const u8 *data, uint numBytes);
+    /// Finishes loading the asset once the texture has been created or has failed to load.
+    bool CompleteLoad(bool success);
 
     int MaxTextureSize() const;
     void DetermineMipsToSkip(Urho3D::Image* image, Urho3D::Texture2D* texture) const;
+
+    /// Identifies the latest background transcode request, changed whenever the asset is loaded or unloaded.
+    uint transcodeRequest_;
 };
 
 }
@@ -0,0 +1,380 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "TextureTranscodeCache.h"
+#include "TextureAsset.h"
+#include "AssetCache.h"
+#include "MemoryMappedFile.h"
+#include "Framework.h"
+#include "LoggingFunctions.h"
+
+#include "Crunch/crn_decomp.h"
+#include "Crunch/dds_defs.h"
+
+#include <Urho3D/Core/Profiler.h>
+#include <Urho3D/Core/StringUtils.h>
+#include <Urho3D/Core/WorkQueue.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+
+#include <algorithm>
+
+namespace Tundra
+{
+
+/// Mip levels with at least this many bytes of DXT blocks per face are transcoded by work items of their own.
+static const uint cMinParallelLevelSize = 64 * 1024;
+
+/// Layout of the DDS file transcoded from a .crn file: the header, followed by the levels of each face.
+struct DdsLayout
+{
+    crnd::crn_texture_info info;
+    /// Size of the DDS file header, including the signature.
+    uint headerSize;
+    /// Size in bytes of all the levels of one face.
+    uint faceSize;
+    /// Offset of each level from the start of its face.
+    PODVector<uint> levelOffsets;
+    /// Size in bytes of each level of one face.
+    PODVector<uint> levelSizes;
+    /// Size in bytes of one row of DXT blocks of each level.
+    PODVector<uint> rowPitches;
+
+    uint Offset(uint face, uint level) const { return headerSize + face * faceSize + levelOffsets[level]; }
+};
+
+/// Parses the texture info of .crn file contents, resizes @c ddsData to hold the transcoded texture and writes the DDS header to it.
+static bool BeginDds(const u8 *crnData, uint crnNumBytes, DdsLayout &layout, Vector<u8> &ddsData)
+{
+    // Texture data
+    crnd::crn_texture_info &textureInfo = layout.info;
+    if (!crnd::crnd_get_texture_info((void*)crnData, (crnd::uint32)crnNumBytes, &textureInfo))
+    {
+        LogError("CRN texture info parsing failed, invalid input data.");
+        return false;
+    }
+    if (textureInfo.m_faces != 1 && textureInfo.m_faces != 6)
+    {
+        LogError("CRN texture has an unsupported number of faces.");
+        return false;
+    }
+
+    // DDS header
+    crnlib::DDSURFACEDESC2 header;
+    memset(&header, 0, sizeof(header));
+    header.dwSize = sizeof(header);
+    // - Size and flags
+    header.dwFlags = crnlib::DDSD_CAPS | crnlib::DDSD_HEIGHT | crnlib::DDSD_WIDTH | crnlib::DDSD_PIXELFORMAT | ((textureInfo.m_levels > 1) ? crnlib::DDSD_MIPMAPCOUNT : 0);
+    header.ddsCaps.dwCaps = crnlib::DDSCAPS_TEXTURE;
+    header.dwWidth = textureInfo.m_width;
+    header.dwHeight = textureInfo.m_height;
+    // - Pixelformat
+    header.ddpfPixelFormat.dwSize = sizeof(crnlib::DDPIXELFORMAT);
+    header.ddpfPixelFormat.dwFlags = crnlib::DDPF_FOURCC;
+    crn_format fundamentalFormat = crnd::crnd_get_fundamental_dxt_format(textureInfo.m_format);
+    header.ddpfPixelFormat.dwFourCC = crnd::crnd_crn_format_to_fourcc(fundamentalFormat);
+    if (fundamentalFormat != textureInfo.m_format)
+        header.ddpfPixelFormat.dwRGBBitCount = crnd::crnd_crn_format_to_fourcc(textureInfo.m_format);
+    // - Mipmaps
+    header.dwMipMapCount = (textureInfo.m_levels > 1) ? textureInfo.m_levels : 0;
+    if (textureInfo.m_levels > 1)
+        header.ddsCaps.dwCaps |= (crnlib::DDSCAPS_COMPLEX | crnlib::DDSCAPS_MIPMAP);
+    // - Cubemap with 6 faces
+    if (textureInfo.m_faces == 6)
+    {
+        header.ddsCaps.dwCaps2 = crnlib::DDSCAPS2_CUBEMAP |
+            crnlib::DDSCAPS2_CUBEMAP_POSITIVEX | crnlib::DDSCAPS2_CUBEMAP_NEGATIVEX | crnlib::DDSCAPS2_CUBEMAP_POSITIVEY |
+            crnlib::DDSCAPS2_CUBEMAP_NEGATIVEY | crnlib::DDSCAPS2_CUBEMAP_POSITIVEZ | crnlib::DDSCAPS2_CUBEMAP_NEGATIVEZ;
+    }
+
+    // Set pitch/linear size field (some DDS readers require this field to be non-zero).
+    int bits_per_pixel = crnd::crnd_get_crn_format_bits_per_texel(textureInfo.m_format);
+    header.lPitch = (((header.dwWidth + 3) & ~3) * ((header.dwHeight + 3) & ~3) * bits_per_pixel) >> 3;
+    header.dwFlags |= crnlib::DDSD_LINEARSIZE;
+
+    // The DDS file stores all the levels of the first face, then all the levels of the next face.
+    layout.headerSize = sizeof(crnlib::cDDSFileSignature) + header.dwSize;
+    layout.faceSize = 0;
+    layout.levelOffsets.Clear();
+    layout.levelSizes.Clear();
+    layout.rowPitches.Clear();
+    for (crn_uint32 iLevel = 0; iLevel < textureInfo.m_levels; iLevel++)
+    {
+        // Compute the face's width, height, number of DXT blocks per row/col, etc.
+        const crn_uint32 width = std::max(1U, textureInfo.m_width >> iLevel);
+        const crn_uint32 height = std::max(1U, textureInfo.m_height >> iLevel);
+        const crn_uint32 blocksX = std::max(1U, (width + 3) >> 2);
+        const crn_uint32 blocksY = std::max(1U, (height + 3) >> 2);
+        const crn_uint32 rowPitch = blocksX * crnd::crnd_get_bytes_per_dxt_block(textureInfo.m_format);
+
+        layout.levelOffsets.Push(layout.faceSize);
+        layout.levelSizes.Push(rowPitch * blocksY);
+        layout.rowPitches.Push(rowPitch);
+        layout.faceSize += rowPitch * blocksY;
+    }
+
+    ddsData.Resize(layout.headerSize + textureInfo.m_faces * layout.faceSize);
+
+    // Write signature and header. Note: Not endian safe.
+    memcpy(&ddsData[0], &crnlib::cDDSFileSignature, sizeof(crnlib::cDDSFileSignature));
+    memcpy(&ddsData[0] + sizeof(crnlib::cDDSFileSignature), &header, header.dwSize);
+    return true;
+}
+
+/// Transcodes @c numLevels levels of all the faces of .crn file contents to raw DXTn, to a DDS buffer laid out by BeginDds.
+static bool TranscodeLevels(const u8 *crnData, uint crnNumBytes, const DdsLayout &layout, uint firstLevel, uint numLevels, u8 *ddsData)
+{
+    // Begin unpack
+    crnd::crnd_unpack_context crnContext = crnd::crnd_unpack_begin((void*)crnData, (crnd::uint32)crnNumBytes);
+    if (!crnContext)
+    {
+        LogError("CRN texture data unpacking failed, invalid input data.");
+        return false;
+    }
+
+    bool success = true;
+    for(uint level = firstLevel; level < firstLevel + numLevels && success; ++level)
+    {
+        void *faces[crnd::cCRNMaxFaces];
+        for(uint face = 0; face < layout.info.m_faces; ++face)
+            faces[face] = ddsData + layout.Offset(face, level);
+        success = crnd::crnd_unpack_level(crnContext, faces, layout.levelSizes[level], layout.rowPitches[level], level);
+    }
+    crnd::crnd_unpack_end(crnContext);
+
+    if (!success)
+        LogError("CRN uncompression failed!");
+    return success;
+}
+
+/// Stores a transcoded texture to the disk cache.
+static void SaveToCache(Urho3D::Context *context, const String &fileName, const Vector<u8> &ddsData)
+{
+    if (!ddsData.Empty())
+        AssetCache::WriteVersionedFile(context, fileName, TextureTranscodeCache::CacheFileId, TextureTranscodeCache::CacheFileVersion,
+            &ddsData[0], ddsData.Size());
+}
+
+bool TranscodeCrnToDds(const u8 *crnData, uint crnNumBytes, Vector<u8> &ddsData)
+{
+    URHO3D_PROFILE(TranscodeCrnToDds);
+
+    DdsLayout layout;
+    if (!BeginDds(crnData, crnNumBytes, layout, ddsData) ||
+        !TranscodeLevels(crnData, crnNumBytes, layout, 0, layout.info.m_levels, &ddsData[0]))
+    {
+        ddsData.Clear();
+        return false;
+    }
+    return true;
+}
+
+/// Mip levels of a job transcoded by one work item.
+struct TextureTranscodeCache::LevelTask
+{
+    Job *job;
+    uint firstLevel;
+    uint numLevels;
+};
+
+struct TextureTranscodeCache::Job
+{
+    Job() : owner(0), request(0), numUnfinishedTasks(0), failed(false) {}
+
+    TextureTranscodeCache *owner;
+    WeakPtr<TextureAsset> asset;
+    /// Request of the asset, passed back to it
+    uint request;
+    /// Copy of the .crn file contents, as the asset does not keep them
+    Vector<u8> crnData;
+    /// Cache file path, empty if the disk cache is disabled
+    String cacheFile;
+    DdsLayout layout;
+    /// Transcoded texture, each level task writes its own levels
+    Vector<u8> ddsData;
+    PODVector<LevelTask> tasks;
+    /// Number of level tasks not finished yet, protected by the completed jobs mutex
+    uint numUnfinishedTasks;
+    /// Whether transcoding any of the levels failed, protected by the completed jobs mutex
+    bool failed;
+};
+
+TextureTranscodeCache::TextureTranscodeCache(Framework *framework, const String &cacheDirectory) :
+    Object(framework->GetContext()),
+    framework_(framework)
+{
+    if (!cacheDirectory.Empty())
+    {
+        Urho3D::FileSystem *fileSystem = GetSubsystem<Urho3D::FileSystem>();
+        String directory = Urho3D::AddTrailingSlash(cacheDirectory);
+        if (fileSystem->DirExists(directory) || fileSystem->CreateDir(directory))
+            cacheDirectory_ = directory;
+        else
+            LogWarning("TextureTranscodeCache: Failed to create cache directory " + directory + ", transcoded textures are not cached.");
+    }
+}
+
+TextureTranscodeCache::~TextureTranscodeCache()
+{
+    // Finish the background jobs, as they refer to the cache
+    if (!jobs_.Empty())
+    {
+        Urho3D::WorkQueue *workQueue = GetSubsystem<Urho3D::WorkQueue>();
+        if (workQueue)
+            workQueue->Complete(0);
+    }
+    for(uint i = 0; i < jobs_.Size(); ++i)
+        delete jobs_[i];
+    jobs_.Clear();
+    completedJobs_.Clear();
+}
+
+String TextureTranscodeCache::CacheFile(const u8 *crnData, uint crnNumBytes) const
+{
+    return cacheDirectory_.Empty() ? String() : cacheDirectory_ + AssetCache::ContentKey(crnData, crnNumBytes) + ".tdds";
+}
+
+bool TextureTranscodeCache::FindCached(const u8 *crnData, uint crnNumBytes, Vector<u8> &ddsData) const
+{
+    const String fileName = CacheFile(crnData, crnNumBytes);
+    if (fileName.Empty())
+        return false;
+
+    URHO3D_PROFILE(TextureTranscodeCache_FindCached);
+
+    SharedPtr<MemoryMappedFile> file = AssetCache::MapVersionedFile(context_, fileName, CacheFileId, CacheFileVersion);
+    if (!file)
+        return false;
+    const u8 *dds = file->Data() + AssetCache::VersionedFileHeaderSize;
+    const uint ddsSize = (uint)file->Size() - AssetCache::VersionedFileHeaderSize;
+    if (ddsSize <= sizeof(crnlib::cDDSFileSignature) + sizeof(crnlib::DDSURFACEDESC2) ||
+        memcmp(dds, &crnlib::cDDSFileSignature, sizeof(crnlib::cDDSFileSignature)) != 0)
+    {
+        LogWarning("TextureTranscodeCache: Ignoring invalid cache file " + fileName);
+        return false;
+    }
+    ddsData = Vector<u8>(dds, ddsSize);
+    return true;
+}
+
+bool TextureTranscodeCache::Transcode(const u8 *crnData, uint crnNumBytes, Vector<u8> &ddsData)
+{
+    if (FindCached(crnData, crnNumBytes, ddsData))
+        return true;
+    if (!TranscodeCrnToDds(crnData, crnNumBytes, ddsData))
+        return false;
+    SaveToCache(context_, CacheFile(crnData, crnNumBytes), ddsData);
+    return true;
+}
+
+bool TextureTranscodeCache::TranscodeAsync(const u8 *crnData, uint crnNumBytes, TextureAsset *asset, uint request)
+{
+    Job *job = new Job();
+    if (!BeginDds(crnData, crnNumBytes, job->layout, job->ddsData))
+    {
+        delete job;
+        return false;
+    }
+    job->owner = this;
+    job->asset = asset;
+    job->request = request;
+    job->crnData.Resize(crnNumBytes);
+    memcpy(&job->crnData[0], crnData, crnNumBytes);
+    job->cacheFile = CacheFile(crnData, crnNumBytes);
+
+    // The large levels get work items of their own, the rest are transcoded together.
+    const uint numLevels = job->layout.info.m_levels;
+    uint level = 0;
+    for(; level < numLevels && job->layout.levelSizes[level] >= cMinParallelLevelSize; ++level)
+    {
+        LevelTask task = { job, level, 1 };
+        job->tasks.Push(task);
+    }
+    if (level < numLevels)
+    {
+        LevelTask task = { job, level, numLevels - level };
+        job->tasks.Push(task);
+    }
+    job->numUnfinishedTasks = job->tasks.Size();
+
+    Urho3D::WorkQueue *workQueue = GetSubsystem<Urho3D::WorkQueue>();
+    if (!workQueue)
+    {
+        for(uint i = 0; i < job->tasks.Size(); ++i)
+        {
+            Urho3D::WorkItem item;
+            item.aux_ = &job->tasks[i];
+            ProcessLevelTask(&item, 0);
+        }
+        {
+            Urho3D::MutexLock lock(completedJobsMutex_);
+            completedJobs_.Remove(job);
+        }
+        Publish(job);
+        delete job;
+        return true;
+    }
+
+    jobs_.Push(job);
+    for(uint i = 0; i < job->tasks.Size(); ++i)
+    {
+        SharedPtr<Urho3D::WorkItem> item(new Urho3D::WorkItem());
+        item->workFunction_ = &TextureTranscodeCache::ProcessLevelTask;
+        item->aux_ = &job->tasks[i];
+        workQueue->AddWorkItem(item);
+    }
+    return true;
+}
+
+void TextureTranscodeCache::ProcessLevelTask(const Urho3D::WorkItem *item, unsigned /*threadIndex*/)
+{
+    LevelTask *task = static_cast<LevelTask*>(item->aux_);
+    Job *job = task->job;
+    TextureTranscodeCache *owner = job->owner;
+    const bool success = TranscodeLevels(&job->crnData[0], job->crnData.Size(), job->layout, task->firstLevel, task->numLevels, &job->ddsData[0]);
+
+    // The last task of the job to finish stores the texture and hands the job over to the main thread.
+    {
+        Urho3D::MutexLock lock(owner->completedJobsMutex_);
+        job->failed = job->failed || !success;
+        if (--job->numUnfinishedTasks > 0)
+            return;
+    }
+    if (!job->failed)
+        SaveToCache(owner->GetContext(), job->cacheFile, job->ddsData);
+
+    Urho3D::MutexLock lock(owner->completedJobsMutex_);
+    owner->completedJobs_.Push(job);
+}
+
+void TextureTranscodeCache::Publish(Job *job)
+{
+    if (job->failed)
+        job->ddsData.Clear();
+    if (job->asset)
+        job->asset->TranscodeFinished(job->request, job->ddsData, !job->failed);
+}
+
+void TextureTranscodeCache::Update()
+{
+    if (jobs_.Empty())
+        return;
+
+    URHO3D_PROFILE(TextureTranscodeCache_Update);
+
+    Vector<Job*> completed;
+    {
+        Urho3D::MutexLock lock(completedJobsMutex_);
+        completed.Swap(completedJobs_);
+    }
+    // Remove all completed jobs before publishing, as the assets may start new transcodes
+    for(uint i = 0; i < completed.Size(); ++i)
+        jobs_.Remove(completed[i]);
+    for(uint i = 0; i < completed.Size(); ++i)
+    {
+        Publish(completed[i]);
+        delete completed[i];
+    }
+}
+
+}
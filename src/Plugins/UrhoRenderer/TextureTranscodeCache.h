@@ -0,0 +1,93 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "CoreTypes.h"
+#include "FrameworkFwd.h"
+#include "UrhoRendererApi.h"
+#include "UrhoRendererFwd.h"
+
+#include <Urho3D/Core/Mutex.h>
+#include <Urho3D/Core/Object.h>
+
+namespace Urho3D
+{
+    struct WorkItem;
+}
+
+namespace Tundra
+{
+
+/// Transcodes .crn file contents to a DDS file with DXTn blocks, without the disk cache. Returns false if the data is not a valid .crn file.
+bool URHORENDERER_API TranscodeCrnToDds(const u8 *crnData, uint crnNumBytes, Vector<u8> &ddsData);
+
+/// Transcodes Crunch (.crn) textures to DDS on the Urho3D worker threads, and caches the transcoded textures on disk.
+/** The transcoded textures are keyed by AssetCache::ContentKey of the .crn file contents, so they are shared by assets with identical
+    content regardless of their name and stay valid between runs. Crunch only transcodes to the DXT block formats, which the DDS files
+    hold as is; on GPUs without DXT support Urho3D decompresses the blocks when the texture is created.
+
+    The large mip levels of a texture are transcoded by work items of their own, so the levels of a texture are transcoded in
+    parallel. The small levels are transcoded together, as each work item needs to unpack the Crunch palettes again.
+
+    The disk cache is stored in the transcodedtextures subdirectory of the asset cache and is disabled when running without an
+    asset cache or with the --noTextureTranscodeCache command line parameter. */
+class URHORENDERER_API TextureTranscodeCache : public Object
+{
+    URHO3D_OBJECT(TextureTranscodeCache, Object);
+
+public:
+    /// @param cacheDirectory Directory of the disk cache. If empty, transcoded textures are not cached.
+    TextureTranscodeCache(Framework *framework, const String &cacheDirectory);
+    ~TextureTranscodeCache();
+
+    /// File identifier and format version of the disk cache files.
+    static const unsigned CacheFileId = 0x53444454; // "TDDS"
+    static const unsigned CacheFileVersion = 1;
+
+    /// Returns the disk cache file of .crn file contents, or an empty string if the disk cache is disabled.
+    /** The file is written with AssetCache::WriteVersionedFile and holds the DDS file after the header. */
+    String CacheFile(const u8 *crnData, uint crnNumBytes) const;
+
+    /// Reads the transcoded DDS of .crn file contents from the disk cache. Returns false if it is not cached.
+    bool FindCached(const u8 *crnData, uint crnNumBytes, Vector<u8> &ddsData) const;
+
+    /// Transcodes .crn file contents to DDS immediately, using and filling the disk cache. Returns false if the data is not a valid .crn file.
+    bool Transcode(const u8 *crnData, uint crnNumBytes, Vector<u8> &ddsData);
+
+    /// Starts transcoding .crn file contents to DDS in the background, and stores the result to the disk cache.
+    /** Once done, TextureAsset::TranscodeFinished of the asset is called on the main thread from Update(), unless the asset has been
+        destroyed. Without a work queue the texture is transcoded and the asset called immediately.
+        @param request Passed back to TextureAsset::TranscodeFinished, to tell apart the results of superseded requests.
+        @return False if the data is not a valid .crn file, in which case the asset is not called. */
+    bool TranscodeAsync(const u8 *crnData, uint crnNumBytes, TextureAsset *asset, uint request);
+
+    /// Passes the textures whose background transcoding has completed to their assets.
+    void Update();
+
+    /// Returns the number of textures being transcoded in the background.
+    uint NumPendingTranscodes() const { return jobs_.Size(); }
+
+    /// Returns the disk cache directory, or an empty string if the disk cache is disabled.
+    const String &CacheDirectory() const { return cacheDirectory_; }
+
+private:
+    struct Job;
+    struct LevelTask;
+
+    /// Calls the asset of a completed job.
+    void Publish(Job *job);
+
+    /// Urho3D work queue function. Transcodes the mip levels of a level task, and stores the texture to the disk cache once all the levels of the job are done.
+    static void ProcessLevelTask(const Urho3D::WorkItem *item, unsigned threadIndex);
+
+    Framework *framework_;
+    String cacheDirectory_;
+    /// Jobs that are being processed in the background
+    Vector<Job*> jobs_;
+    /// Jobs completed by the worker threads, waiting to be published on the main thread
+    Vector<Job*> completedJobs_;
+    /// Protects completedJobs_ and the counts of unfinished level tasks of the jobs.
+    Urho3D::Mutex completedJobsMutex_;
+};
+
+}
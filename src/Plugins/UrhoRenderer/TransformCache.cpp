@@ -0,0 +1,226 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "TransformCache.h"
+#include "Placeable.h"
+#include "AnimationSystem.h"
+
+#include <Urho3D/Core/Profiler.h>
+#include <Urho3D/Scene/Node.h>
+
+namespace Tundra
+{
+
+TransformCache::TransformCache()
+{
+}
+
+TransformCache::~TransformCache()
+{
+}
+
+uint TransformCache::Add(Placeable *placeable)
+{
+    uint slot;
+    if (!freeSlots_.Empty())
+    {
+        slot = freeSlots_.Back();
+        freeSlots_.Pop();
+    }
+    else
+    {
+        slot = placeables_.Size();
+        local_.Resize(slot + 1);
+        world_.Resize(slot + 1);
+        parent_.Resize(slot + 1);
+        firstChild_.Resize(slot + 1);
+        nextSibling_.Resize(slot + 1);
+        flags_.Resize(slot + 1);
+        placeables_.Resize(slot + 1);
+    }
+
+    local_[slot] = float3x4::identity;
+    world_[slot] = float3x4::identity;
+    parent_[slot] = NoSlot;
+    firstChild_[slot] = NoSlot;
+    nextSibling_[slot] = NoSlot;
+    flags_[slot] = Used;
+    placeables_[slot] = placeable;
+    return slot;
+}
+
+void TransformCache::Remove(uint slot)
+{
+    if (slot >= flags_.Size() || !(flags_[slot] & Used))
+        return;
+
+    Unlink(slot);
+    for(uint child = firstChild_[slot]; child != NoSlot;)
+    {
+        const uint next = nextSibling_[child];
+        parent_[child] = NoSlot;
+        nextSibling_[child] = NoSlot;
+        flags_[child] &= ~BoneAttached;
+        MarkDirty(child);
+        child = next;
+    }
+    firstChild_[slot] = NoSlot;
+    flags_[slot] = 0;
+    placeables_[slot] = 0;
+    staleNodes_.Remove(slot);
+    freeSlots_.Push(slot);
+}
+
+void TransformCache::SetLocalTransform(uint slot, const float3x4 &localToParent)
+{
+    local_[slot] = localToParent;
+    MarkDirty(slot);
+}
+
+void TransformCache::SetParent(uint slot, uint parentSlot, bool boneAttached)
+{
+    if (parentSlot == slot)
+        parentSlot = NoSlot;
+    if (parentSlot != parent_[slot])
+    {
+        Unlink(slot);
+        parent_[slot] = parentSlot;
+        if (parentSlot != NoSlot)
+        {
+            nextSibling_[slot] = firstChild_[parentSlot];
+            firstChild_[parentSlot] = slot;
+        }
+    }
+    if (boneAttached)
+        flags_[slot] |= BoneAttached;
+    else
+        flags_[slot] &= ~BoneAttached;
+    // Force the descendants dirty too, as they may have been clean while this slot was already dirty
+    flags_[slot] &= ~WorldDirty;
+    MarkDirty(slot);
+}
+
+float3x4 TransformCache::WorldTransform(uint slot)
+{
+    if (flags_[slot] & (WorldDirty | BoneAttached))
+        UpdateWorld(slot);
+    return world_[slot];
+}
+
+void TransformCache::UpdateWorldTransforms()
+{
+    if (dirtySlots_.Empty())
+        return;
+
+    URHO3D_PROFILE(TransformCache_UpdateWorldTransforms);
+
+    for(uint i = 0; i < dirtySlots_.Size(); ++i)
+    {
+        const uint slot = dirtySlots_[i];
+        if ((flags_[slot] & (Used | WorldDirty)) == (Used | WorldDirty))
+            UpdateWorld(slot);
+    }
+    dirtySlots_.Clear();
+}
+
+void TransformCache::MarkNodeStale(uint slot)
+{
+    if (flags_[slot] & NodeStale)
+        return;
+    flags_[slot] |= NodeStale;
+    staleNodes_.Push(slot);
+}
+
+void TransformCache::ApplyNodeTransforms(bool usedOnly)
+{
+    if (staleNodes_.Empty())
+        return;
+
+    URHO3D_PROFILE(TransformCache_ApplyNodeTransforms);
+
+    // Parents first is not needed, as Urho3D computes the node world transforms lazily as well.
+    uint numKept = 0;
+    for(uint i = 0; i < staleNodes_.Size(); ++i)
+    {
+        const uint slot = staleNodes_[i];
+        Placeable *placeable = placeables_[slot];
+        Urho3D::Node *node = placeable->sceneNode_;
+        if (usedOnly && node && node->GetNumChildren() == 0 && node->GetNumComponents() == 0)
+        {
+            staleNodes_[numKept++] = slot;
+            continue;
+        }
+        flags_[slot] &= ~NodeStale;
+        placeable->SetNodeTransform();
+    }
+    staleNodes_.Resize(numKept);
+}
+
+void TransformCache::SetAnimationSystem(AnimationSystem *animations)
+{
+    animations_ = animations;
+}
+
+void TransformCache::MarkDirty(uint slot)
+{
+    if (flags_[slot] & WorldDirty)
+        return;
+    flags_[slot] |= WorldDirty;
+    dirtySlots_.Push(slot);
+    for(uint child = firstChild_[slot]; child != NoSlot; child = nextSibling_[child])
+        MarkDirty(child);
+}
+
+bool TransformCache::UpdateWorld(uint slot)
+{
+    // Bone attachments are animated outside Tundra, use the scene node.
+    if (flags_[slot] & BoneAttached)
+    {
+        // The bone, and thus the world transform, depends on the scene nodes of the parents, so they all need to be up to date.
+        ApplyNodeTransforms();
+        if (animations_)
+            animations_->ApplyPoses();
+        Placeable *placeable = placeables_[slot];
+        world_[slot] = placeable->sceneNode_ ? float3x4(placeable->sceneNode_->GetWorldTransform()) : local_[slot];
+        return false;
+    }
+    if (!(flags_[slot] & WorldDirty))
+        return true;
+
+    const uint parent = parent_[slot];
+    bool cacheable = true;
+    if (parent != NoSlot)
+    {
+        if (flags_[parent] & (WorldDirty | BoneAttached))
+            cacheable = UpdateWorld(parent);
+        world_[slot] = world_[parent] * local_[slot];
+    }
+    else
+        world_[slot] = local_[slot];
+
+    if (cacheable)
+        flags_[slot] &= ~WorldDirty;
+    return cacheable;
+}
+
+void TransformCache::Unlink(uint slot)
+{
+    const uint parent = parent_[slot];
+    if (parent == NoSlot)
+        return;
+
+    if (firstChild_[parent] == slot)
+        firstChild_[parent] = nextSibling_[slot];
+    else
+    {
+        uint child = firstChild_[parent];
+        while (child != NoSlot && nextSibling_[child] != slot)
+            child = nextSibling_[child];
+        if (child != NoSlot)
+            nextSibling_[child] = nextSibling_[slot];
+    }
+    parent_[slot] = NoSlot;
+    nextSibling_[slot] = NoSlot;
+}
+
+}
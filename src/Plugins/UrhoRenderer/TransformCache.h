@@ -0,0 +1,102 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "CoreTypes.h"
+#include "UrhoRendererApi.h"
+#include "UrhoRendererFwd.h"
+#include "Math/float3x4.h"
+
+#include <Urho3D/Container/RefCounted.h>
+
+namespace Tundra
+{
+
+/// Stores the local and world transforms of the placeables of a scene in contiguous arrays.
+/** Each Placeable of a GraphicsWorld owns a slot. The world transform of a slot is computed from the parent chain the first time it is
+    queried after the slot or any of its parents has changed, and cached until the next change. Changes mark the slot and its descendants
+    dirty, stopping at descendants that are already dirty, so repeated edits to the same hierarchy cost nothing until the next query.
+
+    The world transforms of placeables attached to bones are animated by Urho3D and read from their scene nodes instead, and so are
+    never cached for them or their descendants. On a headless server the skeletons are posed on demand by the AnimationSystem
+    before reading the nodes.
+
+    On a headless server the scene nodes are not needed for the world transforms, so Placeable defers copying its transform to the scene
+    node. The slots with stale nodes are tracked here and applied once per frame, or as soon as someone asks for a scene node. */
+class URHORENDERER_API TransformCache : public RefCounted
+{
+public:
+    TransformCache();
+    ~TransformCache();
+
+    /// Slot index of no placeable, eg. the parent of a root placeable.
+    static const uint NoSlot = 0xffffffff;
+
+    /// Allocates a slot for a placeable, with an identity transform and no parent.
+    uint Add(Placeable *placeable);
+    /// Frees the slot of a placeable. Its children are detached to the root.
+    void Remove(uint slot);
+
+    /// Sets the local-to-parent transform of a slot.
+    void SetLocalTransform(uint slot, const float3x4 &localToParent);
+    /// Sets the parent of a slot, or NoSlot to make it a root.
+    /** @param boneAttached If true, the world transform of the slot is read from the scene node of its placeable, as it is attached to a bone. */
+    void SetParent(uint slot, uint parentSlot, bool boneAttached);
+
+    /// Returns the local-to-parent transform of a slot.
+    const float3x4 &LocalTransform(uint slot) const { return local_[slot]; }
+    /// Returns the local-to-world transform of a slot, updating it and its parents if dirty.
+    float3x4 WorldTransform(uint slot);
+    /// Updates the world transforms of all the dirty slots in one pass.
+    void UpdateWorldTransforms();
+
+    /// Marks the scene node of a slot as not having the current transform yet.
+    void MarkNodeStale(uint slot);
+    /// Applies the transforms of the slots marked stale to their scene nodes.
+    /** @param usedOnly If true, the nodes that have no children and no components are left stale, as their transform affects nothing. */
+    void ApplyNodeTransforms(bool usedOnly = false);
+    /// Returns whether some scene nodes do not have the current transform of their placeable yet.
+    bool HasStaleNodes() const { return !staleNodes_.Empty(); }
+
+    /// Sets the animation system whose pending skeleton poses are applied before reading the scene nodes of bone-attached placeables.
+    void SetAnimationSystem(AnimationSystem *animations);
+
+    /// Returns the number of slots in use.
+    uint NumPlaceables() const { return placeables_.Size() - freeSlots_.Size(); }
+
+private:
+    enum Flags
+    {
+        Used = 1,
+        WorldDirty = 2,
+        BoneAttached = 4,
+        NodeStale = 8
+    };
+
+    /// Marks the world transform of a slot and its descendants dirty.
+    void MarkDirty(uint slot);
+    /// Updates the world transform of a slot from its parents. Returns false if the result can not be cached.
+    bool UpdateWorld(uint slot);
+    /// Removes a slot from the child list of its parent.
+    void Unlink(uint slot);
+
+    PODVector<float3x4> local_;
+    PODVector<float3x4> world_;
+    /// Parent slot of each slot
+    PODVector<uint> parent_;
+    /// First child of each slot, with the rest linked through nextSibling_
+    PODVector<uint> firstChild_;
+    PODVector<uint> nextSibling_;
+    PODVector<u8> flags_;
+    PODVector<Placeable*> placeables_;
+    /// Unused slots, reused before growing the arrays
+    PODVector<uint> freeSlots_;
+    /// Slots that have been marked dirty since the last UpdateWorldTransforms, may contain already updated or freed slots
+    PODVector<uint> dirtySlots_;
+    /// Slots whose scene node does not have the current transform
+    PODVector<uint> staleNodes_;
+    /// Poses the skeletons that bone-attached placeables read from
+    WeakPtr<AnimationSystem> animations_;
+};
+
+}
@@ -30,6 +30,7 @@ bool UrhoMeshAsset::DeserializeFromData(const u8 *data_, uint numBytes, bool /*a
     model = new Urho3D::Model(GetContext());
     if (model->Load(buffer))
     {
+        GenerateMissingLodLevels();
         assetAPI->AssetLoadCompleted(Name());
         return true;
     }
@@ -19,6 +19,7 @@
 #include "ConfigAPI.h"
 #include "SceneAPI.h"
 #include "AssetAPI.h"
+#include "AssetCache.h"
 #include "Entity.h"
 #include "Scene/Scene.h"
 #include "LoggingFunctions.h"
@@ -26,7 +27,9 @@
 #include "JavaScriptInstance.h"
 #include "UrhoRendererBindings/UrhoRendererBindings.h"
 
+#include "CameraAssetTransferPrioritizer.h"
 #include "TextureAsset.h"
+#include "TextureTranscodeCache.h"
 #include "UrhoMeshAsset.h"
 #include "Ogre/OgreMeshAsset.h"
 #include "Ogre/OgreMaterialAsset.h"
@@ -34,10 +37,12 @@
 #include "Ogre/DefaultOgreMaterialProcessor.h"
 #include "Ogre/OgreParticleAsset.h"
 #include "GenericAssetFactory.h"
+#include "DefaultAssetTransferPrioritizer.h"
 
 #include <Urho3D/Core/CoreEvents.h>
 #include <Urho3D/Core/ProcessUtils.h>
 #include <Urho3D/Core/Profiler.h>
+#include <Urho3D/Core/StringUtils.h>
 #include <Urho3D/Graphics/Camera.h>
 #include <Urho3D/Graphics/Graphics.h>
 #include <Urho3D/Graphics/GraphicsEvents.h>
@@ -77,7 +82,7 @@ void UrhoRenderer::Load()
 
     /// \todo Check and add new supported texture extensions
     StringList textureExtensions;
-    textureExtensions.Push(".crn"); // CRN to DDS decompression implemented in TextureAsset
+    textureExtensions.Push(".crn"); // CRN to DDS transcoding implemented in TextureTranscodeCache
     textureExtensions.Push(".dds");
     textureExtensions.Push(".png");
     textureExtensions.Push(".jpeg");
@@ -99,6 +104,22 @@ void UrhoRenderer::Initialize()
 {
     framework->RegisterRenderer(this);
 
+    // Prioritize asset transfers by their visibility from the main camera
+    if (!framework->IsHeadless())
+    {
+        SharedPtr<CameraAssetTransferPrioritizer> prioritizer(new CameraAssetTransferPrioritizer(this));
+        StringVector maxTransfersParam = framework->CommandLineParameters("--maxTransfersPerProvider");
+        if (!maxTransfersParam.Empty())
+            prioritizer->SetMaxTransfersInFlight(Urho3D::ToUInt(maxTransfersParam.Back()));
+        framework->Asset()->SetAssetTransferPrioritizer(prioritizer);
+    }
+
+    // Transcoded Crunch textures are cached on disk in the asset cache, unless disabled with --noTextureTranscodeCache
+    String transcodeCacheDirectory;
+    if (framework->Asset()->Cache() && !framework->HasCommandLineParameter("--noTextureTranscodeCache"))
+        transcodeCacheDirectory = framework->Asset()->Cache()->CacheDirectory() + "transcodedtextures/";
+    textureTranscoder_ = new TextureTranscodeCache(framework, transcodeCacheDirectory);
+
     // Connect to scene change signals.
     framework->Scene()->SceneCreated.Connect(this, &UrhoRenderer::CreateGraphicsWorld);
     framework->Scene()->SceneAboutToBeRemoved.Connect(this, &UrhoRenderer::RemoveGraphicsWorld);
@@ -131,13 +152,22 @@ void UrhoRenderer::Initialize()
 
 void UrhoRenderer::Uninitialize()
 {
+    textureTranscoder_.Reset();
     framework->RegisterRenderer(0);
+    if (dynamic_cast<CameraAssetTransferPrioritizer*>(framework->Asset()->AssetTransferPrioritizer().Get()))
+        framework->Asset()->SetAssetTransferPrioritizer(AssetTransferPrioritizerPtr(new DefaultAssetTransferPrioritizer()));
     Urho3D::Renderer* rend = GetSubsystem<Urho3D::Renderer>();
     // Let go of the viewport that we created. If done later at Urho Context destruction time, may cause a crash
     if (rend)
         rend->SetViewport(0, nullptr);
 }
 
+void UrhoRenderer::Update(float /*frameTime*/)
+{
+    if (textureTranscoder_)
+        textureTranscoder_->Update();
+}
+
 void UrhoRenderer::HandleScreenModeChange(StringHash /*eventType*/, VariantMap& /*eventData*/)
 {
     ConfigAPI *config = framework->Config();
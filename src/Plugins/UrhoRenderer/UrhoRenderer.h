@@ -59,10 +59,14 @@ public:
     /// Find an available material processor for a material. Return null if none acceptable.
     IOgreMaterialProcessor* FindOgreMaterialProcessor(const Ogre::MaterialParser& material) const;
 
+    /// Returns the transcoder and disk cache of Crunch textures, or null if the module is not initialized. [noscript]
+    TextureTranscodeCache *TextureTranscoder() const { return textureTranscoder_; }
+
 private:
     void Load() override;
     void Initialize() override;
     void Uninitialize() override;
+    void Update(float frameTime) override;
 
     // Handles Urho3D::Graphics E_SCREENMODE & E_WINDOWPOS events.
     void HandleScreenModeChange(StringHash eventType, VariantMap &eventData);
@@ -78,6 +82,9 @@ private:
 
     /// Registered Ogre material processors.
     Vector<SharedPtr<IOgreMaterialProcessor> > materialProcessors;
+
+    /// Crunch texture transcoder and cache.
+    SharedPtr<TextureTranscodeCache> textureTranscoder_;
 };
 
 }
@@ -28,8 +28,12 @@ namespace Tundra
     class GraphicsWorld;
     class Placeable;
     class Mesh;
+    class AnimationController;
+    class AnimationSystem;
     class Camera;
     class TextureAsset;
+    class TextureTranscodeCache;
+    class TransformCache;
     class IOgreMaterialProcessor;
     class IMaterialAsset;
     class IMeshAsset;
@@ -4,6 +4,7 @@
 #include "ZipAssetBundle.h"
 #include "ZipHelpers.h"
 #include "ZipWorker.h"
+#include "ZipMemoryIO.h"
 
 #include "CoreDefines.h"
 #include "Framework.h"
@@ -11,18 +12,26 @@
 #include "AssetAPI.h"
 #include "AssetCache.h"
 #include "LoggingFunctions.h"
+#include "Math/MathFunc.h"
 
 #include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/Core/ProcessUtils.h>
+#include <Urho3D/Container/Sort.h>
 #include <zzip/zzip.h>
 
 namespace Tundra
 {
 
+/// Upper limit for worker threads uncompressing a single bundle.
+static const uint cMaxWorkers = 8;
+
 ZipAssetBundle::ZipAssetBundle(AssetAPI *owner, const String &type, const String &name) :
     IAssetBundle(owner, type, name),
-    worker_(0),
     archive_(0),
+    extractToCache_(owner->GetFramework()->HasCommandLineParameter("--zipExtractToCache")),
+    numActiveWorkers_(0),
     fileCount_(-1),
+    numWorkersRunning_(0),
     done_(false),
     success_(false)
 {
@@ -35,9 +44,14 @@ ZipAssetBundle::~ZipAssetBundle()
 
 void ZipAssetBundle::DoUnload()
 {
+    StopWorkers(true);
     Close();
-    StopThread();
 
+    files_.Clear();
+    fileIndex_.Clear();
+    prefetched_.Clear();
+    prefetching_.Clear();
+    archiveData_.Clear();
     fileCount_ = -1;
 }
 
@@ -50,16 +64,31 @@ void ZipAssetBundle::Close()
     }
 }
 
+zzip_dir *ZipAssetBundle::OpenArchive() const
+{
+    zzip_error_t error = ZZIP_NO_ERROR;
+    zzip_dir *archive = (!archiveData_.Empty() ? OpenZipMemoryArchive(&archiveData_[0], archiveData_.Size(), &error) :
+        zzip_dir_open(archivePath_.CString(), &error));
+    if (CheckAndLogZzipError(error) || CheckAndLogArchiveError(archive) || !archive)
+    {
+        if (archive)
+            zzip_dir_close(archive);
+        return 0;
+    }
+    return archive;
+}
+
 bool ZipAssetBundle::DeserializeFromDiskSource()
 {
-    if (!assetAPI_->Cache())
+    if (!assetAPI_->Cache() && extractToCache_)
     {
         LogError("ZipAssetBundle::DeserializeFromDiskSource: Cannot process archive, AssetAPI cache is null.");
         return false;
     }
     else if (DiskSource().Empty())
     {
-        LogError("ZipAssetBundle::DeserializeFromDiskSource: Cannot process archive, no disk source for " + Name());
+        if (extractToCache_)
+            LogError("ZipAssetBundle::DeserializeFromDiskSource: Cannot process archive, no disk source for " + Name());
         return false;
     }
 
@@ -75,19 +104,40 @@ bool ZipAssetBundle::DeserializeFromDiskSource()
        the asset cache. For local scenes this should be fine as there is no real need to
        zip the scene up as you already have the disk sources right there in the storage.
        The last modified query will fail if the file is open with zziplib, do it first. */
-    uint zipLastModified = assetAPI_->Cache()->LastModified(Name());
+    uint zipLastModified = (extractToCache_ ? assetAPI_->Cache()->LastModified(Name()) : 0);
 
-    const String diskSourceInternal = Urho3D::GetInternalPath(DiskSource());
+    archiveData_.Clear();
+    archivePath_ = Urho3D::GetInternalPath(DiskSource());
+    archive_ = OpenArchive();
+    if (!archive_)
+        return false;
+    return ReadDirectory(zipLastModified);
+}
 
-    zzip_error_t error = ZZIP_NO_ERROR;
-    archive_ = zzip_dir_open(diskSourceInternal.CString(), &error);
-    if (CheckAndLogZzipError(error) || CheckAndLogArchiveError(archive_) || !archive_)
+bool ZipAssetBundle::DeserializeFromData(const u8 *data, uint numBytes)
+{
+    // Extracting requires the disk source for the last modified checks.
+    if (extractToCache_ || !data || numBytes == 0)
+        return false;
+
+    archivePath_.Clear();
+    archiveData_ = Vector<u8>(data, numBytes);
+    archive_ = OpenArchive();
+    if (!archive_)
     {
-        archive_ = 0;
+        archiveData_.Clear();
         return false;
     }
-    
-    int uncompressing = 0;
+    return ReadDirectory(0);
+}
+
+bool ZipAssetBundle::ReadDirectory(uint zipLastModified)
+{
+    files_.Clear();
+    fileIndex_.Clear();
+    fileCount_ = 0;
+
+    uint uncompressing = 0;
     
     ZZIP_DIRENT archiveEntry;
     while(zzip_dir_read(archive_, &archiveEntry))
@@ -95,28 +145,43 @@ bool ZipAssetBundle::DeserializeFromDiskSource()
         String relativePath = Urho3D::GetInternalPath(archiveEntry.d_name);
         if (!relativePath.EndsWith("/"))
         {
-            String subAssetRef = GetFullAssetReference(relativePath);
-            
             ZipArchiveFile file;
             file.relativePath = relativePath;
-            file.cachePath = Urho3D::GetInternalPath(assetAPI_->Cache()->DiskSourceByRef(subAssetRef));
-            file.lastModified = assetAPI_->Cache()->LastModified(subAssetRef);
             file.compressedSize = archiveEntry.d_csize;
             file.uncompressedSize = archiveEntry.st_size;
-            
-            /* Mark this file for extraction. If both cache files have valid dates
-               and they differ extract. If they have the same date stamp skip extraction.
-               Note that file.lastModified will be non-valid for non cached files so we 
-               will cover also missing files. */
-            file.doExtract = (zipLastModified > 0 && file.lastModified > 0) ? (zipLastModified != file.lastModified) : true;
-            if (file.doExtract)
-                uncompressing++;
+            file.lastModified = 0;
+            file.doExtract = false;
 
+            if (extractToCache_)
+            {
+                String subAssetRef = GetFullAssetReference(relativePath);
+                file.cachePath = Urho3D::GetInternalPath(assetAPI_->Cache()->DiskSourceByRef(subAssetRef));
+                file.lastModified = assetAPI_->Cache()->LastModified(subAssetRef);
+
+                /* Mark this file for extraction. If both cache files have valid dates
+                   and they differ extract. If they have the same date stamp skip extraction.
+                   Note that file.lastModified will be non-valid for non cached files so we 
+                   will cover also missing files. */
+                file.doExtract = (zipLastModified > 0 && file.lastModified > 0) ? (zipLastModified != file.lastModified) : true;
+                if (file.doExtract)
+                    uncompressing++;
+            }
+
+            fileIndex_[relativePath.ToLower()] = files_.Size();
             files_.Push(file);
             fileCount_++;
         }
     }
     
+    // Sub assets are read from the open archive on request, the bundle is ready.
+    if (!extractToCache_)
+    {
+        if (files_.Empty())
+            LogWarning("ZipAssetBundle: Bundle loaded but does not contain any files " + Name());
+        Loaded.Emit(this);
+        return true;
+    }
+
     // Close the zzip directory ptr
     Close();
     
@@ -130,15 +195,20 @@ bool ZipAssetBundle::DeserializeFromDiskSource()
         return true;
     }
     
-    // Don't spin the worker if all sub assets are up to date in cache.
+    // Don't spin the workers if all sub assets are up to date in cache.
     if (uncompressing > 0)
     {   
-        // Now that the file info has been read, continue in a worker thread.
-        LogDebug("ZipAssetBundle: File information read for " + Name() + ". File count: " + String(files_.Size()) + ". Starting worker thread to uncompress " + String(uncompressing) + " files.");
-        
-        // ZipWorker is a QRunnable we can pass to QThreadPool, it will handle scheduling it and deletes it when done.
-        worker_ = new ZipWorker(this, zipLastModified, diskSourceInternal, files_);   
-        if (!worker_->Run())
+        // Now that the file info has been read, continue in worker threads.
+        LogDebug("ZipAssetBundle: File information read for " + Name() + ". File count: " + String(files_.Size()) + ". Starting worker threads to uncompress " + String(uncompressing) + " files.");
+
+        {
+            Urho3D::MutexLock m(mutexJobs_);
+            jobs_.Clear();
+            foreach(const ZipArchiveFile &file, files_)
+                if (file.doExtract)
+                    jobs_.Push(file);
+        }
+        if (!StartWorkers(zipLastModified))
         {
             LogError("ZipAssetBundle: Failed to start worker thread for " + Name());
             files_.Clear();
@@ -153,20 +223,187 @@ bool ZipAssetBundle::DeserializeFromDiskSource()
     return true;
 }
 
-bool ZipAssetBundle::DeserializeFromData(const u8* /*data*/, uint /*numBytes*/)
+void ZipAssetBundle::PrefetchSubAssets(const StringVector &subAssetNames)
+{
+    if (extractToCache_ || !archive_)
+        return;
+
+    uint numJobs = 0;
+    bool workersActive = false;
+    {
+        Urho3D::MutexLock m(mutexJobs_);
+        foreach(const String &subAssetName, subAssetNames)
+        {
+            String key = subAssetName.ToLower();
+            auto index = fileIndex_.Find(key);
+            if (index == fileIndex_.End() || prefetched_.Contains(key) || prefetching_.Contains(key))
+                continue;
+            prefetching_.Insert(key);
+            jobs_.Push(files_[index->second_]);
+        }
+        // Start with the largest entries to keep all workers busy until the end.
+        Urho3D::Sort(jobs_.Begin(), jobs_.End(), &ZipAssetBundle::CompareUncompressedSize);
+        numJobs = jobs_.Size();
+        workersActive = (numActiveWorkers_ > 0);
+    }
+
+    // The workers of a previous prefetch take the new jobs as well.
+    if (workersActive)
+        return;
+
+    // A single entry is not worth a thread, GetSubAssetData will read it directly.
+    if (numJobs < 2)
+    {
+        ClearJobs();
+        return;
+    }
+    // Join the workers of a previous prefetch. They have run out of jobs, so this does not wait for them to uncompress anything.
+    StopWorkers(false);
+    if (!StartWorkers(0))
+        ClearJobs();
+}
+
+bool ZipAssetBundle::IsSubAssetDataReady(const String &subAssetName) const
 {
-    /** @note At this point it seems zzip needs a disk source to do processing
-        so we require disk source for the archive. This might change in the future by changing the lib. */
-    return false;
+    if (extractToCache_)
+        return true;
+
+    Urho3D::MutexLock m(mutexJobs_);
+    return !prefetching_.Contains(subAssetName.ToLower());
+}
+
+bool ZipAssetBundle::StartWorkers(uint zipLastModified)
+{
+    uint numJobs = 0;
+    {
+        Urho3D::MutexLock m(mutexJobs_);
+        numJobs = jobs_.Size();
+    }
+    uint numWorkers = Min(Min(numJobs, cMaxWorkers), Max(Urho3D::GetNumLogicalCPUs(), 1u));
+    if (numWorkers == 0)
+        return false;
+
+    {
+        Urho3D::MutexLock m(mutexDone_);
+        done_ = false;
+        success_ = true;
+        numWorkersRunning_ = numWorkers;
+    }
+    {
+        Urho3D::MutexLock m(mutexJobs_);
+        numActiveWorkers_ = numWorkers;
+    }
+
+    for(uint i = 0; i < numWorkers; ++i)
+    {
+        ZipWorker *worker = new ZipWorker(this, zipLastModified);
+        if (worker->Run())
+            workers_.Push(worker);
+        else
+        {
+            delete worker;
+            {
+                Urho3D::MutexLock m(mutexJobs_);
+                numActiveWorkers_--;
+            }
+            Urho3D::MutexLock m(mutexDone_);
+            numWorkersRunning_--;
+        }
+    }
+    return !workers_.Empty();
+}
+
+void ZipAssetBundle::StopWorkers(bool cancel)
+{
+    if (cancel)
+        ClearJobs();
+    // Workers exit once the job queue is empty, Stop joins them.
+    foreach(ZipWorker *worker, workers_)
+    {
+        worker->Stop();
+        delete worker;
+    }
+    workers_.Clear();
+}
+
+void ZipAssetBundle::ClearJobs()
+{
+    Urho3D::MutexLock m(mutexJobs_);
+    foreach(const ZipArchiveFile &file, jobs_)
+        prefetching_.Erase(file.relativePath.ToLower());
+    jobs_.Clear();
+}
+
+bool ZipAssetBundle::NextJob(ZipArchiveFile &file)
+{
+    // Invoked in worker thread context
+
+    Urho3D::MutexLock m(mutexJobs_);
+    if (jobs_.Empty())
+    {
+        // The worker exits, PrefetchSubAssets starts new workers for the jobs queued after this.
+        if (numActiveWorkers_ > 0)
+            numActiveWorkers_--;
+        return false;
+    }
+    file = jobs_.Front();
+    jobs_.Erase(0);
+    return true;
+}
+
+void ZipAssetBundle::JobDone(const ZipArchiveFile &file, Vector<u8> &data)
+{
+    // Invoked in worker thread context
+
+    String key = file.relativePath.ToLower();
+    Urho3D::MutexLock m(mutexJobs_);
+    // The sub asset may have been read directly by GetSubAssetData meanwhile.
+    if (!prefetching_.Erase(key))
+        return;
+    if (!data.Empty())
+        prefetched_[key].Swap(data);
+}
+
+bool ZipAssetBundle::CompareUncompressedSize(const ZipArchiveFile &f1, const ZipArchiveFile &f2)
+{
+    return (f1.uncompressedSize > f2.uncompressedSize);
 }
 
 Vector<u8> ZipAssetBundle::GetSubAssetData(const String &subAssetName)
 {
+    if (!extractToCache_)
+    {
+        String key = subAssetName.ToLower();
+
+        // Data uncompressed by PrefetchSubAssets is handed over once.
+        Vector<u8> data;
+        bool workersActive = false;
+        {
+            Urho3D::MutexLock m(mutexJobs_);
+            auto prefetched = prefetched_.Find(key);
+            if (prefetched != prefetched_.End())
+            {
+                data.Swap(prefetched->second_);
+                prefetched_.Erase(prefetched);
+            }
+            else // Requested before the prefetch is done, the worker result is discarded.
+                prefetching_.Erase(key);
+            workersActive = (numActiveWorkers_ > 0);
+        }
+        // Join the workers that have run out of jobs.
+        if (!workersActive && !workers_.Empty())
+            StopWorkers(false);
+
+        // Uncompress only the requested entry directly from the archive.
+        auto index = fileIndex_.Find(key);
+        if (data.Empty() && archive_ && index != fileIndex_.End())
+            ReadZipArchiveFile(archive_, files_[index->second_], data);
+        return data;
+    }
+
     /* Makes no sense to keep the whole zip file contents in memory as only
        few files could be wanted from a 100mb bundle. Additionally all asset would take 2x the memory.
-       We could make this function also open the zip file and uncompress the data for every sub asset request. 
-       But that would be rather pointless, not to mention slower, as we already have the unpacked individual 
-       assets on disk. If the unpacking to disk changes we might need to rethink this. */
+       When extracting to cache we already have the unpacked individual assets on disk. */
 
     String filePath = GetSubAssetDiskSource(subAssetName);
     if (filePath.Empty())
@@ -178,6 +415,9 @@ Vector<u8> ZipAssetBundle::GetSubAssetData(const String &subAssetName)
 
 String ZipAssetBundle::GetSubAssetDiskSource(const String &subAssetName)
 {
+    // Sub assets are not extracted to disk, AssetAPI will query GetSubAssetData.
+    if (!extractToCache_)
+        return "";
     return assetAPI_->Cache()->FindInCache(GetFullAssetReference(subAssetName));
 }
 
@@ -204,7 +444,7 @@ void ZipAssetBundle::CheckDone(float /*frametime*/)
         else
             Failed.Emit(this);
     }
-    StopThread();
+    StopWorkers(false);
 
     assetAPI_->GetFramework()->Frame()->Updated.Disconnect(this, &ZipAssetBundle::CheckDone);
 }
@@ -214,15 +454,10 @@ void ZipAssetBundle::WorkerDone(bool successful)
     // Invoked in worker thread context
     
     Urho3D::MutexLock m(mutexDone_);
-    done_ = true;
-    success_ = successful;
-}
-
-void ZipAssetBundle::StopThread()
-{
-    if (worker_)
-        worker_->Stop();
-    SAFE_DELETE(worker_);
+    success_ = success_ && successful;
+    if (numWorkersRunning_ > 0)
+        numWorkersRunning_--;
+    done_ = (numWorkersRunning_ == 0);
 }
 
 Urho3D::Context *ZipAssetBundle::Context() const
@@ -24,6 +24,13 @@ namespace Tundra
 {
 
 /// Provides zip packed asset bundles.
+/** By default the archive is kept open once its directory has been read and sub assets are uncompressed directly
+    from it on request, so the bundle is usable right away. Only the requested entries are uncompressed. When AssetAPI
+    announces several sub assets at once they are uncompressed in parallel by ZipWorker threads. Archives without a disk
+    source, eg. when the asset cache is disabled, are read from memory.
+
+    With the --zipExtractToCache command line parameter all files are instead extracted to the asset cache before the
+    bundle is loaded, and sub assets are loaded from their cache files. */
 class TUNDRA_ZIP_API ZipAssetBundle : public IAssetBundle
 {
     URHO3D_OBJECT(ZipAssetBundle, IAssetBundle);
@@ -36,20 +43,17 @@ public:
     bool IsLoaded() const override;
 
     /// IAssetBundle override.
-    /** Our current zziplib implementation requires disk source for processing. */
-    bool RequiresDiskSource() override { return true; }
+    /** Disk source is only required when extracting to the asset cache. */
+    bool RequiresDiskSource() override { return extractToCache_; }
 
     /// IAssetBundle override.
-    /** Our current zziplib implementation requires disk source for processing.
-        So we fail DeserializeFromData and try our best here to.
-        This function unpacks the archive content to asset cache to normal cache files
-        and provides the sub asset data via GetSubAssetData and GetSubAssetDiskSource. */
+    /** Reads the archive directory. When extracting to cache, unpacks the archive content to asset cache
+        to normal cache files and provides the sub asset data via GetSubAssetData and GetSubAssetDiskSource. */
     bool DeserializeFromDiskSource() override;
 
     /// IAssetBundle override.
-    /** @todo If we must support this in memory method with zzip 
-        we could store the data to disk and open it. Be sure to change RequiresDiskSource to false.
-        @return Currently not applicable, so false always. */
+    /** Keeps a copy of @c data and reads the archive from memory.
+        @return False when extracting to cache, which requires a disk source. */
     bool DeserializeFromData(const u8 *data, uint numBytes) override;
 
     /// IAssetBundle override.
@@ -61,10 +65,49 @@ public:
 
     /// IAssetBundle override.
     String GetSubAssetDiskSource(const String &subAssetName) override;
+
+    /// IAssetBundle override.
+    /** Uncompresses the sub assets in parallel to memory in worker threads and returns right away. Once a sub asset is done,
+        IsSubAssetDataReady returns true for it and the following GetSubAssetData call returns the prepared data. */
+    void PrefetchSubAssets(const StringVector &subAssetNames) override;
+
+    /// IAssetBundle override.
+    bool IsSubAssetDataReady(const String &subAssetName) const override;
+
+    /// Returns if the archive content is extracted to the asset cache instead of read on request.
+    bool ExtractsToCache() const { return extractToCache_; }
     
 private:
     friend class ZipWorker;
 
+    /// Reads the archive directory from the opened archive_ and completes the loading.
+    bool ReadDirectory(uint zipLastModified);
+
+    /// Opens a new zziplib handle to the archive, from disk or memory.
+    /** Each thread reading the archive needs its own handle. Returns null on failure. */
+    zzip_dir *OpenArchive() const;
+
+    /// Starts worker threads for the queued jobs.
+    bool StartWorkers(uint zipLastModified);
+
+    /// Stops and destroys worker threads. If @c cancel is true the remaining jobs are dropped, otherwise waits for them to finish.
+    /** @note Only call in main thread context. */
+    void StopWorkers(bool cancel);
+
+    /// Drops the queued jobs. The sub assets whose prefetch is dropped are read directly by GetSubAssetData.
+    void ClearJobs();
+
+    /// Takes the next job to @c file. Returns false if there are no jobs left.
+    /** Invoked in worker thread context. */
+    bool NextJob(ZipArchiveFile &file);
+
+    /// Stores the uncompressed @c data of @c file for GetSubAssetData. Empty @c data marks a failed prefetch.
+    /** Invoked in worker thread context. */
+    void JobDone(const ZipArchiveFile &file, Vector<u8> &data);
+
+    /// Sort predicate for ordering jobs from largest to smallest.
+    static bool CompareUncompressedSize(const ZipArchiveFile &f1, const ZipArchiveFile &f2);
+
     /// Returns full asset reference for a sub asset.
     String GetFullAssetReference(const String &subAssetName);
     
@@ -81,10 +124,6 @@ private:
     /** Invoked in worker thread context. */
     void WorkerDone(bool successful);
 
-    /// Stops and destroys thread.
-    /** @note Only call in main thread context. */
-    void StopThread();
-
     Urho3D::Context *Context() const;
     Urho3D::FileSystem *FileSystem() const;
 
@@ -94,14 +133,36 @@ private:
     /// Zip sub assets.
     ZipFileVector files_;
 
-    /// Worker
-    ZipWorker *worker_;
+    /// Index to files_ by lower case relative path.
+    HashMap<String, uint> fileIndex_;
+
+    /// Archive disk source, empty if read from archiveData_.
+    String archivePath_;
+
+    /// Archive data when loaded from memory.
+    Vector<u8> archiveData_;
+
+    /// If true archive content is extracted to the asset cache.
+    bool extractToCache_;
+
+    /// Workers
+    Vector<ZipWorker*> workers_;
+
+    /// Mutex for the job queue and prefetched data.
+    mutable Urho3D::Mutex mutexJobs_;
+    ZipFileVector jobs_;
+    HashMap<String, Vector<u8> > prefetched_;
+    /// Sub assets queued or being uncompressed by PrefetchSubAssets.
+    HashSet<String> prefetching_;
+    /// Number of workers that have not yet found the job queue empty. Jobs queued meanwhile are taken by them.
+    uint numActiveWorkers_;
 
     /// Count of files inside this zip.
     int fileCount_;
 
-    /// Mutex for polling completion of worker thread.
+    /// Mutex for polling completion of worker threads.
     Urho3D::Mutex mutexDone_;
+    uint numWorkersRunning_;
     bool done_;
     bool success_;
 };
@@ -2,6 +2,7 @@
 
 #pragma once
 
+#include "ZipPluginFwd.h"
 #include "LoggingFunctions.h"
 
 #include <zzip/zzip.h>
@@ -48,4 +49,31 @@ static bool CheckAndLogArchiveError(ZZIP_DIR *archive)
     return true;
 }
 
+/// Decompresses @c file from @c archive to @c dest in one go.
+static bool ReadZipArchiveFile(ZZIP_DIR *archive, const ZipArchiveFile &file, Vector<u8> &dest)
+{
+    ZZIP_FILE *zzipFile = zzip_file_open(archive, file.relativePath.CString(), ZZIP_ONLYZIP | ZZIP_CASELESS);
+    if (!zzipFile)
+    {
+        CheckAndLogArchiveError(archive);
+        return false;
+    }
+
+    // The uncompressed size is known from the central directory, read the whole entry with a single buffer.
+    dest.Resize(file.uncompressedSize);
+    uint total = 0;
+    zzip_ssize_t chunkRead = 0;
+    while (total < file.uncompressedSize && 0 < (chunkRead = zzip_read(zzipFile, &dest[total], file.uncompressedSize - total)))
+        total += (uint)chunkRead;
+    zzip_file_close(zzipFile);
+
+    if (total != file.uncompressedSize)
+    {
+        LogError("[ZipAssetBundle] Failed to uncompress " + file.relativePath);
+        dest.Clear();
+        return false;
+    }
+    return true;
+}
+
 }
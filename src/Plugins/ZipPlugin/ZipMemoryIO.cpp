@@ -0,0 +1,180 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "ZipMemoryIO.h"
+
+#include <Urho3D/Core/Mutex.h>
+#include <Urho3D/Core/StringUtils.h>
+#include <Urho3D/Container/HashMap.h>
+
+#include <zzip/plugin.h>
+
+#include <stdio.h>
+#include <string.h>
+
+namespace Tundra
+{
+
+/// @cond PRIVATE
+
+namespace
+{
+
+struct MemoryStream
+{
+    const u8 *data;
+    uint size;
+    uint pos;
+    /// Locks only this stream. It is read by the archive that opened it, so the lock is normally uncontended.
+    Urho3D::Mutex mutex;
+};
+
+const char *cMemoryPrefix = "memory:";
+
+/// Maximum number of simultaneously open streams, ie. memory archives including the handles of the worker threads.
+const int cMaxStreams = 1024;
+
+/* zziplib IO plugins operate on integer file descriptors. Buffers are registered under an id that is
+   passed as the file name to open, which then creates a stream with its own read position. The file
+   descriptor indexes a fixed table of streams, so reading does not need to look up the stream under the
+   global lock that guards opening and closing. */
+Urho3D::Mutex mutexStreams;
+HashMap<uint, Pair<const u8*, uint> > buffers;
+MemoryStream *streams[cMaxStreams];
+uint nextBufferId = 1;
+
+MemoryStream *Stream(int fd)
+{
+    return (fd >= 1 && fd <= cMaxStreams ? streams[fd - 1] : 0);
+}
+
+int MemoryOpen(zzip_char_t *name, int /*flags*/, ...)
+{
+    String str(name);
+    if (!str.StartsWith(cMemoryPrefix))
+        return -1;
+    uint id = Urho3D::ToUInt(str.Substring(String(cMemoryPrefix).Length()));
+
+    Urho3D::MutexLock m(mutexStreams);
+    auto buffer = buffers.Find(id);
+    if (buffer == buffers.End())
+        return -1;
+    for(int i = 0; i < cMaxStreams; ++i)
+    {
+        if (streams[i])
+            continue;
+        MemoryStream *s = new MemoryStream();
+        s->data = buffer->second_.first_;
+        s->size = buffer->second_.second_;
+        s->pos = 0;
+        streams[i] = s;
+        return i + 1;
+    }
+    return -1;
+}
+
+int MemoryClose(int fd)
+{
+    Urho3D::MutexLock m(mutexStreams);
+    MemoryStream *s = Stream(fd);
+    if (!s)
+        return -1;
+    streams[fd - 1] = 0;
+    delete s;
+    return 0;
+}
+
+zzip_ssize_t MemoryRead(int fd, void *buf, zzip_size_t len)
+{
+    MemoryStream *s = Stream(fd);
+    if (!s)
+        return -1;
+    Urho3D::MutexLock m(s->mutex);
+    uint num = (len < (zzip_size_t)(s->size - s->pos) ? (uint)len : s->size - s->pos);
+    if (num > 0)
+        memcpy(buf, s->data + s->pos, num);
+    s->pos += num;
+    return (zzip_ssize_t)num;
+}
+
+zzip_off_t MemorySeek(int fd, zzip_off_t offset, int whence)
+{
+    MemoryStream *s = Stream(fd);
+    if (!s)
+        return -1;
+    Urho3D::MutexLock m(s->mutex);
+    zzip_off_t base = (whence == SEEK_SET ? 0 : (whence == SEEK_CUR ? (zzip_off_t)s->pos : (zzip_off_t)s->size));
+    zzip_off_t target = base + offset;
+    if (target < 0 || target > (zzip_off_t)s->size)
+        return -1;
+    s->pos = (uint)target;
+    return target;
+}
+
+zzip_off_t MemoryFileSize(int fd)
+{
+    MemoryStream *s = Stream(fd);
+    return (s ? (zzip_off_t)s->size : -1);
+}
+
+zzip_ssize_t MemoryWrite(int /*fd*/, _zzip_const void* /*buf*/, zzip_size_t /*len*/)
+{
+    return -1;
+}
+
+zzip_plugin_io_handlers *MemoryIO()
+{
+    static zzip_plugin_io_handlers io;
+    static bool initialized = false;
+
+    Urho3D::MutexLock m(mutexStreams);
+    if (!initialized)
+    {
+        zzip_init_io(&io, 0);
+        io.fd.open = &MemoryOpen;
+        io.fd.close = &MemoryClose;
+        io.fd.read = &MemoryRead;
+        io.fd.seeks = &MemorySeek;
+        io.fd.filesize = &MemoryFileSize;
+        io.fd.write = &MemoryWrite;
+        initialized = true;
+    }
+    return &io;
+}
+
+}
+
+/// @endcond
+
+ZZIP_DIR *OpenZipMemoryArchive(const u8 *data, uint numBytes, zzip_error_t *error)
+{
+    if (!data || numBytes == 0)
+    {
+        if (error)
+            *error = ZZIP_DIR_OPEN;
+        return 0;
+    }
+
+    zzip_plugin_io_handlers *io = MemoryIO();
+
+    uint id = 0;
+    {
+        Urho3D::MutexLock m(mutexStreams);
+        id = nextBufferId++;
+        buffers[id] = Urho3D::MakePair(data, numBytes);
+    }
+
+    // Do not let zziplib try file name extensions, the name is only used to look up the buffer.
+    static zzip_strings_t noExtensions[] = { "", 0 };
+    String name = cMemoryPrefix + String(id);
+    ZZIP_DIR *archive = zzip_dir_open_ext_io(name.CString(), error, noExtensions, &io->fd);
+
+    // The archive keeps its own stream open, the registration is no longer needed.
+    {
+        Urho3D::MutexLock m(mutexStreams);
+        buffers.Erase(id);
+    }
+    return archive;
+}
+
+}
@@ -0,0 +1,18 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "ZipPluginFwd.h"
+
+#include <zzip/zzip.h>
+
+namespace Tundra
+{
+
+/// Opens a zip archive from memory using a zziplib IO plugin.
+/** Every returned archive reads the buffer through its own file position, so separate archives
+    can be opened over the same buffer and read from different threads simultaneously.
+    @note The buffer must stay valid and unmodified until all archives opened over it are closed with zzip_dir_close. */
+ZZIP_DIR *OpenZipMemoryArchive(const u8 *data, uint numBytes, zzip_error_t *error);
+
+}
@@ -10,23 +10,15 @@
 
 #include <Urho3D/IO/File.h>
 #include <Urho3D/IO/FileSystem.h>
-#include <Urho3D/Container/Sort.h>
 
 #include <zzip/zzip.h>
 
 namespace Tundra
 {
 
-bool ArchiveFileSizeCompare(const ZipArchiveFile &f1, const ZipArchiveFile &f2)
-{
-    return (f1.uncompressedSize < f2.uncompressedSize);
-}
-
-ZipWorker::ZipWorker(ZipAssetBundle *owner, uint zipLastModified, const String &diskSource, const ZipFileVector &files) :
+ZipWorker::ZipWorker(ZipAssetBundle *owner, uint zipLastModified) :
     owner_(owner),
     zipLastModified_(zipLastModified),
-    diskSource_(diskSource),
-    files_(files),
     archive_(0)
 {
 }
@@ -38,83 +30,42 @@ ZipWorker::~ZipWorker()
 
 void ZipWorker::ThreadFunction()
 {
-    zzip_error_t error = ZZIP_NO_ERROR;
-    archive_ = zzip_dir_open(diskSource_.CString(), &error);
-    if (CheckAndLogZzipError(error) || CheckAndLogArchiveError(archive_) || !archive_)
+    archive_ = owner_->OpenArchive();
+    if (!archive_)
     {
-        archive_ = 0;
         owner_->WorkerDone(false);
         return;
     }
 
-    Urho3D::FileSystem *fs = owner_->FileSystem();
-    
-    // Sort by size so we can resize the buffer less often.
-    Urho3D::Sort(files_.Begin(), files_.End(), ArchiveFileSizeCompare);
-
-    // Read file contents
     bool success = true;
-    zzip_ssize_t chunkLen = 0;
-    zzip_ssize_t chunkRead = 0;
-    Vector<u8> buffer;
+    ZipArchiveFile file;
+    Vector<u8> data;
 
-    foreach(const ZipArchiveFile &file, files_)
+    while(owner_->NextJob(file))
     {
-        if (!file.doExtract)
-            continue;
-
-        // Open file from zip
-        ZZIP_FILE *zzipFile = zzip_file_open(archive_, file.relativePath.CString(), ZZIP_ONLYZIP | ZZIP_CASELESS);
-        if (!zzipFile || CheckAndLogArchiveError(archive_))
+        if (!ReadZipArchiveFile(archive_, file, data))
         {
+            // A failed prefetch is retried by GetSubAssetData, keep going with the rest.
+            if (!owner_->ExtractsToCache())
+            {
+                data.Clear();
+                owner_->JobDone(file, data);
+                continue;
+            }
             success = false;
             break;
         }
 
-        // Create cache file
-        Urho3D::File cacheFile(owner_->Context(), file.cachePath, Urho3D::FILE_WRITE);
-        if (!cacheFile.IsOpen())
-        {
-            LogError("ZipWorker: Failed to open cache file: " + file.cachePath + ". Cannot unzip " + file.relativePath);
-            continue;
-        }
-
-        // Detect file size and adjust buffer (quite naive atm but is a slight speed improvement)
-        if (file.uncompressedSize > 1000*1024)
-            chunkLen = 500*1024;
-        else if (file.uncompressedSize > 500*1024)
-            chunkLen = 250*1024;
-        else if (file.uncompressedSize > 100*1024)
-            chunkLen = 50*1024;
-        else if (file.uncompressedSize > 20*1024)
-            chunkLen = 10*1024;
-        else
-            chunkLen = 5*1024;
-
-        if (buffer.Size() < (uint)chunkLen)
-            buffer.Resize(chunkLen);
-
-        // Read zip file content to cache file
-        while (0 < (chunkRead = zzip_read(zzipFile, &buffer[0], chunkLen)))
+        if (owner_->ExtractsToCache())
         {
-            if (cacheFile.Write((void*)&buffer[0], (uint)chunkRead) != (uint)chunkRead)
+            if (!WriteCacheFile(file, data))
             {
-                LogError("Failed to write cache file + " + file.cachePath);
                 success = false;
                 break;
             }
         }
-
-        // Close zip and cache file.
-        zzip_file_close(zzipFile);
-        cacheFile.Close();
-
-        if (!success)
-            break;
-
-        // Update last modified same to the parent zip file.
-        if (success && zipLastModified_ > 0)
-            fs->SetLastModifiedTime(file.cachePath, zipLastModified_);
+        else
+            owner_->JobDone(file, data);
     }
 
     // Close the zzip directory ptr
@@ -123,6 +74,27 @@ void ZipWorker::ThreadFunction()
     owner_->WorkerDone(success);
 }
 
+bool ZipWorker::WriteCacheFile(const ZipArchiveFile &file, const Vector<u8> &data)
+{
+    Urho3D::File cacheFile(owner_->Context(), file.cachePath, Urho3D::FILE_WRITE);
+    if (!cacheFile.IsOpen())
+    {
+        LogError("ZipWorker: Failed to open cache file: " + file.cachePath + ". Cannot unzip " + file.relativePath);
+        return true; // Skip this file, like a missing sub asset.
+    }
+    if (!data.Empty() && cacheFile.Write(&data[0], data.Size()) != data.Size())
+    {
+        LogError("Failed to write cache file + " + file.cachePath);
+        return false;
+    }
+    cacheFile.Close();
+
+    // Update last modified same to the parent zip file.
+    if (zipLastModified_ > 0)
+        owner_->FileSystem()->SetLastModifiedTime(file.cachePath, zipLastModified_);
+    return true;
+}
+
 void ZipWorker::Close()
 {
     if (archive_)
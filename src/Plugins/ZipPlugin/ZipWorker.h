@@ -14,23 +14,28 @@ struct zzip_dir;
 namespace Tundra
 {
 
-/// Worker thread that unpacks zip file contents.
+/// Worker thread that uncompresses zip file contents.
+/** Takes files from the owning bundle's job queue until it is empty. Every worker reads the archive
+    through its own zziplib handle, so multiple workers uncompress different entries in parallel.
+    Depending on the bundle mode the files are either extracted to the asset cache or handed back
+    to the bundle in memory. */
 class TUNDRA_ZIP_API ZipWorker : public Urho3D::Thread
 {
 public:
-    ZipWorker(ZipAssetBundle *owner, uint zipLastModified, const String &diskSource, const ZipFileVector &files);
+    ZipWorker(ZipAssetBundle *owner, uint zipLastModified);
     ~ZipWorker();
 
     /// Urho3D::Thread override
     void ThreadFunction() override;
     
 private:
+    /// Writes @c data of @c file to its cache path.
+    bool WriteCacheFile(const ZipArchiveFile &file, const Vector<u8> &data);
+
     void Close();
 
     ZipAssetBundle *owner_;
     
-    String diskSource_;
-    ZipFileVector files_;
     zzip_dir *archive_;
     uint zipLastModified_;
 };
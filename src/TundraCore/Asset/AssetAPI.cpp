@@ -25,6 +25,7 @@
 #include "LoggingFunctions.h"
 #include "CoreStringUtils.h"
 
+#include <Urho3D/Container/Sort.h>
 #include <Urho3D/Core/Context.h>
 #include <Urho3D/Core/Profiler.h>
 #include <Urho3D/Core/StringUtils.h>
@@ -39,7 +40,9 @@ AssetAPI::AssetAPI(Framework *framework, bool headless) :
     Object(framework->GetContext()),
     fw(framework),
     isHeadless(headless),
-    assetCache(0)
+    assetCache(0),
+    memoryBudget_(0),
+    memoryBudgetCheckTimer_(0.f)
 {
     transferPrioritizer_ = new DefaultAssetTransferPrioritizer();
 
@@ -61,6 +64,16 @@ AssetAPI::AssetAPI(Framework *framework, bool headless) :
         LogWarning("--no_async_asset_load: this format of the command-line parameter is deprecated and support for it will be removed. Use --noAsyncAssetLoad instead.");
     if (fw->HasCommandLineParameter("--clear-asset-cache"))
         LogWarning("--clear-asset-cache: this format of the command-line parameter is deprecated and support for it will be removed. Use --clearAssetCache instead.");
+
+    StringVector budgetParam = fw->CommandLineParameters("--assetMemoryBudget");
+    if (!budgetParam.Empty())
+    {
+        uint budgetMB = Urho3D::ToUInt(budgetParam.Back());
+        if (budgetMB > 0)
+            SetMemoryBudget((ulonglong)budgetMB * 1024 * 1024);
+        else
+            LogWarning("--assetMemoryBudget: expected a positive memory budget in megabytes, got \"" + budgetParam.Back() + "\".");
+    }
 }
 
 AssetAPI::~AssetAPI()
@@ -191,6 +204,134 @@ AssetMap AssetAPI::AssetsOfType(const String& type) const
     return ret;
 }
 
+HashMap<String, ulonglong> AssetAPI::MemoryUsageByType() const
+{
+    HashMap<String, ulonglong> usage;
+    for(AssetMap::const_iterator i = assets.begin(); i != assets.end(); ++i)
+        if (i->second->IsLoaded())
+            usage[i->second->Type()] += i->second->MemoryUsage();
+    return usage;
+}
+
+ulonglong AssetAPI::TotalMemoryUsage() const
+{
+    ulonglong usage = 0;
+    for(AssetMap::const_iterator i = assets.begin(); i != assets.end(); ++i)
+        if (i->second->IsLoaded())
+            usage += i->second->MemoryUsage();
+    return usage;
+}
+
+void AssetAPI::SetMemoryBudget(ulonglong bytes)
+{
+    memoryBudget_ = bytes;
+    memoryBudgetCheckTimer_ = 0.f;
+    if (memoryBudget_ > 0)
+        LogInfoF("AssetAPI: Asset memory budget set to %.1f MB", memoryBudget_ / (1024.0 * 1024.0));
+}
+
+bool AssetAPI::CanUnloadAsset(const AssetPtr &asset) const
+{
+    // The asset is in use if anyone else than the assets map and the caller holds a reference to it.
+    if (!asset->IsLoaded() || asset->NumRefListeners() > 0 || asset->Refs() > 2 || asset->IsModified())
+        return false;
+    // It must be possible to reload the asset from its disk source, or for a sub asset without one, from its bundle.
+    const String diskSource = asset->DiskSource();
+    if (diskSource.Empty())
+    {
+        if (asset->DiskSourceType() != IAsset::Bundle || !ParentBundle(asset))
+            return false;
+    }
+    else if (!GetSubsystem<Urho3D::FileSystem>()->FileExists(diskSource))
+        return false;
+    if (FindTransferIterator(asset->Name()) != currentTransfers.end())
+        return false;
+    return true;
+}
+
+IAssetBundle *AssetAPI::ParentBundle(const AssetPtr &asset) const
+{
+    String subAssetPart, mainAssetPart;
+    ParseAssetRef(asset->Name(), 0, 0, 0, 0, 0, 0, 0, &subAssetPart, 0, &mainAssetPart);
+    if (subAssetPart.Empty())
+        return 0;
+    AssetBundleMap::const_iterator bundleIter = assetBundles.find(mainAssetPart);
+    return (bundleIter != assetBundles.end() && bundleIter->second->IsLoaded() ? bundleIter->second.Get() : 0);
+}
+
+bool AssetAPI::ReloadUnloadedAsset(const AssetPtr &asset)
+{
+    // The caller completes the request from the reloaded asset right away, so neither path may load asynchronously.
+    // LoadFromCache loads synchronously.
+    if (!asset->DiskSource().Empty())
+        return asset->LoadFromCache();
+
+    IAssetBundle *bundle = ParentBundle(asset);
+    if (!bundle)
+        return false;
+    String subAssetPart;
+    ParseAssetRef(asset->Name(), 0, 0, 0, 0, 0, 0, 0, &subAssetPart);
+    Vector<u8> data = bundle->GetSubAssetData(subAssetPart);
+    if (data.Empty() || !asset->LoadFromFileInMemory(&data[0], data.Size(), false))
+        return false;
+
+    // Same as IAsset::LoadFromCache
+    if (HasPendingDependencies(asset))
+        RequestAssetDependencies(asset);
+    return true;
+}
+
+uint AssetAPI::UnloadUnusedAssets(ulonglong targetBytes)
+{
+    URHO3D_PROFILE(AssetAPI_UnloadUnusedAssets);
+
+    ulonglong usage = 0;
+    Vector<Pair<float, String> > candidates;
+    for(AssetMap::const_iterator i = assets.begin(); i != assets.end(); ++i)
+    {
+        IAsset *asset = i->second.Get();
+        if (!asset->IsLoaded())
+            continue;
+        usage += asset->MemoryUsage();
+        // Check the reference count before taking any new references to the asset.
+        if (asset->NumRefListeners() == 0 && asset->Refs() == 1 && asset->MemoryUsage() > 0)
+            candidates.Push(MakePair(asset->LastUsed(), i->first));
+    }
+    if (usage <= targetBytes)
+        return 0;
+
+    Urho3D::Sort(candidates.Begin(), candidates.End());
+
+    uint numUnloaded = 0;
+    for(uint i = 0; i < candidates.Size() && usage > targetBytes; ++i)
+    {
+        AssetPtr asset = FindAsset(candidates[i].second_);
+        if (!asset || !CanUnloadAsset(asset))
+            continue;
+
+        // Assets that loaded assets depend on, eg. textures of a loaded material, are still in use.
+        bool hasLoadedDependents = false;
+        Vector<AssetPtr> dependents = FindDependents(asset->Name());
+        for(uint j = 0; j < dependents.Size() && !hasLoadedDependents; ++j)
+            hasLoadedDependents = dependents[j]->IsLoaded();
+        if (hasLoadedDependents)
+            continue;
+
+        uint assetUsage = asset->MemoryUsage();
+        asset->Unload();
+        if (asset->IsLoaded())
+            continue;
+
+        usage = (usage > assetUsage ? usage - assetUsage : 0);
+        unloadedAssets_.Insert(asset->Name());
+        ++numUnloaded;
+    }
+
+    if (numUnloaded > 0)
+        LogDebugF("AssetAPI: Unloaded %d unused assets, estimated asset memory usage is now %.1f MB", numUnloaded, usage / (1024.0 * 1024.0));
+    return numUnloaded;
+}
+
 Vector<AssetStoragePtr> AssetAPI::AssetStorages() const
 {
     Vector<AssetStoragePtr> storages;
@@ -520,6 +661,7 @@ bool AssetAPI::ForgetAsset(AssetPtr asset, bool removeDiskSource)
         currentTransfers.erase(transferIter);
 
     // Remove the asset from internal state.
+    unloadedAssets_.Erase(asset->Name());
     AssetMap::iterator iter = assets.find(asset->Name());
     if (iter == assets.end())
     {
@@ -700,6 +842,8 @@ void AssetAPI::ForgetAllAssets()
 {
     readyTransfers.Clear();
     readySubTransfers.Clear();
+    prefetchingSubTransfers_.Clear();
+    pendingTransfers_.Clear();
 
     // ForgetBundle removes the bundle it is given to from the assetBundles map, so this loop terminates.
     // All bundle sub assets are unloaded from the assets map below.
@@ -732,6 +876,8 @@ void AssetAPI::ForgetAllAssets()
             currentTransfers.erase(iter);
     }
     currentTransfers.clear();
+    transfersInFlight_.Clear();
+    numTransfersInFlight_.Clear();
 }
 
 void AssetAPI::Reset()
@@ -747,9 +893,11 @@ void AssetAPI::Reset()
     defaultStorage.Reset();
     readyTransfers.Clear();
     readySubTransfers.Clear();
+    prefetchingSubTransfers_.Clear();
     assetDependencies.Clear();
     currentUploadTransfers.clear();
     currentTransfers.clear();
+    unloadedAssets_.Clear();
     providers.Clear();
 }
 
@@ -871,6 +1019,15 @@ AssetTransferPtr AssetAPI::RequestAsset(String assetRef, String assetType, bool
         if (!assetType.Empty() && assetType != existingAsset->Type())
             LogDebug("AssetAPI::RequestAsset: Tried to request asset \"" + assetRef + "\" by type \"" + assetType + "\". Asset by that name exists, but it is of type \"" + existingAsset->Type() + "\"!");
         assetType = existingAsset->Type();
+        existingAsset->MarkUsed();
+
+        // Assets unloaded to stay within the memory budget are reloaded from their disk source or bundle without a new transfer.
+        // If the reload fails, the asset is fetched from its provider below.
+        if (unloadedAssets_.Erase(existingAsset->Name()) && !existingAsset->IsLoaded() && !forceTransfer)
+        {
+            if (!ReloadUnloadedAsset(existingAsset))
+                LogDebug("AssetAPI::RequestAsset: Failed to reload unloaded asset \"" + existingAsset->Name() + "\" from disk source \"" + existingAsset->DiskSource() + "\".");
+        }
     }
     else
     {
@@ -928,6 +1085,12 @@ AssetTransferPtr AssetAPI::RequestAsset(String assetRef, String assetType, bool
                 if (subTransfer.Get() && subTransfer->source.ref.Compare(fullAssetRef, false) == 0)
                     return subTransfer;
             }
+            for(uint i = 0; i < prefetchingSubTransfers_.Size(); ++i)
+            {
+                AssetTransferPtr subTransfer = prefetchingSubTransfers_[i].subAssetTransfer;
+                if (subTransfer.Get() && subTransfer->source.ref.Compare(fullAssetRef, false) == 0)
+                    return subTransfer;
+            }
             // Create a loader for this sub asset.
             AssetTransferPtr transfer(new VirtualAssetTransfer(context_));
             transfer->asset = existingAsset;
@@ -1477,6 +1640,32 @@ AssetBundlePtr AssetAPI::FindBundle(String bundleRef) const
     return AssetBundlePtr();
 }
 
+uint AssetAPI::NumTransfersInFlight(IAssetProvider *provider) const
+{
+    auto iter = numTransfersInFlight_.Find(provider);
+    return (iter != numTransfersInFlight_.End() ? iter->second_ : 0);
+}
+
+void AssetAPI::AddTransferInFlight(IAssetTransfer *transfer, IAssetProvider *provider)
+{
+    // A transfer executed again is counted once
+    RemoveTransferInFlight(transfer);
+    transfersInFlight_[transfer] = provider;
+    ++numTransfersInFlight_[provider];
+}
+
+void AssetAPI::RemoveTransferInFlight(IAssetTransfer *transfer)
+{
+    auto iter = transfersInFlight_.Find(transfer);
+    if (iter == transfersInFlight_.End())
+        return;
+
+    auto count = numTransfersInFlight_.Find(iter->second_);
+    if (count != numTransfersInFlight_.End() && --count->second_ == 0)
+        numTransfersInFlight_.Erase(count);
+    transfersInFlight_.Erase(iter);
+}
+
 void AssetAPI::Update(float frametime)
 {
     URHO3D_PROFILE(AssetAPI_Update);
@@ -1494,20 +1683,47 @@ void AssetAPI::Update(float frametime)
             else
                 LogErrorF("AssetAPI: IAssetTransferPrioritizer implementation returned incorrect amount of transfers. Returned %d when expecting %d", sorted.Size(), pendingTransfers_.Size());
         }
-        foreach(AssetTransferPtr transfer, pendingTransfers_)
+        // Transfers exceeding the prioritizer's in-flight limit for their provider are kept pending for the next frame.
+        // Executing a transfer may request or fail other transfers synchronously, so iterate over a copy.
+        AssetTransferPtrVector transfers = pendingTransfers_;
+        AssetTransferPtrVector deferredTransfers;
+        pendingTransfers_.Clear();
+        foreach(AssetTransferPtr transfer, transfers)
         {
-            if (transfer->provider)
-                transfer->provider->ExecuteTransfer(transfer);
-            else
+            IAssetProvider *provider = transfer->provider.Get();
+            if (!provider)
+            {
                 LogErrorF("AssetAPI: Cannot execute asset transfer '%s' as it has no provider", transfer->SourceUrl().CString());
+                continue;
+            }
+            uint maxInFlight = (transferPrioritizer_ ? transferPrioritizer_->MaxTransfersInFlight(provider) : 0);
+            if (maxInFlight > 0 && NumTransfersInFlight(provider) >= maxInFlight)
+            {
+                deferredTransfers.Push(transfer);
+                continue;
+            }
+            AddTransferInFlight(transfer.Get(), provider);
+            provider->ExecuteTransfer(transfer);
         }
-        pendingTransfers_.Clear();
+        pendingTransfers_.Insert(0, deferredTransfers);
     }
 
     // Update providers
     for(uint i = 0, num = providers.Size(); i<num; ++i)
         providers[i]->Update(frametime);
 
+    // Unload unused assets if over the memory budget. Unload down to 90% of the budget so that this is not done every check.
+    if (memoryBudget_ > 0)
+    {
+        memoryBudgetCheckTimer_ += frametime;
+        if (memoryBudgetCheckTimer_ >= 1.f)
+        {
+            memoryBudgetCheckTimer_ = 0.f;
+            if (TotalMemoryUsage() > memoryBudget_)
+                UnloadUnusedAssets(memoryBudget_ / 10 * 9);
+        }
+    }
+
     // Proceed with ready transfers.
     if (readyTransfers.Size() > 0)
     {
@@ -1542,6 +1758,33 @@ void AssetAPI::Update(float frametime)
         }
         readySubTransfers.Clear();
     }
+
+    // Proceed with the sub asset transfers whose data has been prepared by their bundle in the background.
+    if (prefetchingSubTransfers_.Size() > 0)
+    {
+        URHO3D_PROFILE(AssetAPI_Process_PrefetchedSubTransfers);
+
+        for(uint i = 0; i < prefetchingSubTransfers_.Size();)
+        {
+            AssetTransferPtr subTransfer = prefetchingSubTransfers_[i].subAssetTransfer;
+            String bundleRef = prefetchingSubTransfers_[i].parentBundleRef;
+            // If the bundle has been forgotten meanwhile, LoadSubAssetToTransfer reports the error.
+            AssetBundleMap::iterator bundleIter = assetBundles.find(bundleRef);
+            if (bundleIter != assetBundles.end())
+            {
+                String subAssetName;
+                ParseAssetRef(subTransfer->source.ref, 0, 0, 0, 0, 0, 0, 0, &subAssetName);
+                if (!bundleIter->second->IsSubAssetDataReady(subAssetName))
+                {
+                    ++i;
+                    continue;
+                }
+            }
+            // Loading may request further sub assets, so remove the transfer first.
+            prefetchingSubTransfers_.Erase(i);
+            LoadSubAssetToTransfer(subTransfer, bundleRef, subTransfer->source.ref);
+        }
+    }
 }
 
 String GuaranteeTrailingSlash(const String &source)
@@ -1630,6 +1873,7 @@ void AssetAPI::AssetTransferCompleted(IAssetTransfer *transfer_)
     // 3) It could be an AssetTransfer that was fulfilled from the disk cache, in which case no AssetProvider was invoked to get here. (we used the readyTransfers queue for this).
         
     AssetTransferPtr transfer(transfer_); // Elevate to a SharedPtr immediately to keep at least one ref alive of this transfer for the duration of this function call.
+    RemoveTransferInFlight(transfer_);
     //LogDebug("Transfer of asset \"" + transfer->assetType + "\", name \"" + transfer->source.ref + "\" succeeded.");
 
     // This is a duplicated transfer to an asset that has already been previously loaded. Only signal that the asset's been loaded and finish.
@@ -1760,6 +2004,9 @@ void AssetAPI::AssetTransferFailed(IAssetTransfer *transfer, String reason)
         
     LogError("Transfer of asset \"" + transfer->assetType + "\", name \"" + transfer->source.ref + "\" failed! Reason: \"" + reason + "\"");
 
+    RemoveTransferInFlight(transfer);
+    pendingTransfers_.Remove(AssetTransferPtr(transfer));
+
     ///\todo In this function, there is a danger of reaching an infinite recursion. Remember recursion parents and avoid infinite loops. (A -> B -> C -> A)
 
     AssetTransferMap::iterator iter = currentTransfers.find(transfer->source.ref);
@@ -1794,7 +2041,9 @@ void AssetAPI::AssetTransferAborted(IAssetTransfer *transfer)
     // Don't log any errors for aborted transfers. This is unwanted spam when we disconnect 
     // from a server and have x amount of pending transfers that get aborter.
     AssetTransferMap::iterator iter = currentTransfers.find(transfer->source.ref);
-    
+    RemoveTransferInFlight(transfer);
+    pendingTransfers_.Remove(AssetTransferPtr(transfer));
+
     transfer->EmitAssetFailed("Transfer aborted.");   
 
     // Propagate the failure of this asset transfer to all assets which depend on this asset.
@@ -1835,6 +2084,7 @@ void AssetAPI::AssetLoadCompleted(const String assetRef)
 
     if (asset.Get())
     {
+        asset->MarkUsed();
         asset->LoadCompleted();
 
         // Add to watch this path for changed, note this does nothing if the path is already added
@@ -1894,10 +2144,26 @@ void AssetAPI::AssetBundleLoadCompleted(IAssetBundle *bundle)
         AssetBundleMonitorPtr bundleMonitor = (*monitorIter).second;
         Vector<AssetTransferPtr> subTransfers = bundleMonitor->SubAssetTransfers();
         bundleMonitors.erase(monitorIter);
+
+        // Let the bundle prepare all requested sub assets at once.
+        StringVector subAssetNames;
+        for (Vector<AssetTransferPtr>::Iterator subIter = subTransfers.Begin(); subIter != subTransfers.End(); ++subIter)
+        {
+            String subAssetName;
+            ParseAssetRef((*subIter)->source.ref, 0, 0, 0, 0, 0, 0, 0, &subAssetName);
+            subAssetNames.Push(subAssetName);
+        }
+        bundle->PrefetchSubAssets(subAssetNames);
         
         // Start the load process for all sub asset transfers now. From here on out the normal asset request flow should followed.
-        for (Vector<AssetTransferPtr>::Iterator subIter = subTransfers.Begin(); subIter != subTransfers.End(); ++subIter)
-            LoadSubAssetToTransfer((*subIter), bundle, (*subIter)->source.ref);
+        // The sub assets that the bundle is still preparing in the background are loaded in Update once they are ready.
+        for(uint i = 0; i < subTransfers.Size(); ++i)
+        {
+            if (bundle->IsSubAssetDataReady(subAssetNames[i]))
+                LoadSubAssetToTransfer(subTransfers[i], bundle, subTransfers[i]->source.ref);
+            else
+                prefetchingSubTransfers_.Push(SubAssetLoader(bundle->Name(), subTransfers[i]));
+        }
     }
     else
         LogWarning("AssetAPI: Asset bundle load completed, but bundle monitor cannot be found: " + bundle->Name());
@@ -1994,6 +2260,10 @@ void AssetAPI::RequestAssetDependencies(AssetPtr asset)
     // Make sure we have most up-to-date internal view of the asset dependencies.
     NotifyAssetDependenciesChanged(asset);
 
+    // Dependency transfers inherit the requesters of the depending asset's transfer for prioritization.
+    AssetTransferMap::const_iterator parentIter = currentTransfers.find(asset->Name());
+    IAssetTransfer *parentTransfer = (parentIter != currentTransfers.end() ? parentIter->second.Get() : 0);
+
     Vector<AssetReference> refs = asset->FindReferences();
     for(uint i = 0; i < refs.Size(); ++i)
     {
@@ -2005,7 +2275,12 @@ void AssetAPI::RequestAssetDependencies(AssetPtr asset)
         if (!existing || !existing->IsLoaded())
         {
 //            LogDebug("Asset " + asset->ToString() + " depends on asset " + ref.ref + " (type=\"" + ref.type + "\") which has not been loaded yet. Requesting..");
-            RequestAsset(ref);
+            AssetTransferPtr transfer = RequestAsset(ref);
+            if (transfer && parentTransfer)
+            {
+                for(uint j = 0; j < parentTransfer->requesters.Size(); ++j)
+                    transfer->AddRequester(parentTransfer->requesters[j].Get());
+            }
         }
     }
 }
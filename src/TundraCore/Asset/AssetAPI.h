@@ -13,6 +13,7 @@
 #include "CoreStringUtils.h"
 #include "Signals.h"
 
+#include <Urho3D/Container/HashSet.h>
 #include <Urho3D/Core/Object.h>
 #include <map>
 #include <string>
@@ -207,6 +208,27 @@ public:
     /// Returns all assets of a specific type.
     AssetMap AssetsOfType(const String& type) const;
 
+    /// Returns the estimated memory usage of the loaded assets in bytes, grouped by asset type. @see IAsset::MemoryUsage
+    HashMap<String, ulonglong> MemoryUsageByType() const;
+
+    /// Returns the estimated total memory usage of all loaded assets in bytes.
+    ulonglong TotalMemoryUsage() const;
+
+    /// Sets the asset memory budget in bytes. 0 (the default) disables the budget.
+    /** When the total memory usage exceeds the budget, the least recently used assets that are not held by any AssetRefListener
+        are unloaded until the usage drops below 90% of the budget. Unloaded assets keep their disk source and are reloaded from it
+        when requested again. The budget can also be set in megabytes with the --assetMemoryBudget command line parameter. */
+    void SetMemoryBudget(ulonglong bytes);
+
+    /// Returns the asset memory budget in bytes, or 0 if no budget is set.
+    ulonglong MemoryBudget() const { return memoryBudget_; }
+
+    /// Unloads unused assets in least recently used order until the total memory usage is at most @c targetBytes.
+    /** Only assets that are not held by any AssetRefListener or other strong reference, are not modified, have no loaded
+        dependents and can be reloaded from their disk source or their loaded bundle are unloaded.
+        @return Number of unloaded assets. */
+    uint UnloadUnusedAssets(ulonglong targetBytes);
+
     /// Returns the known asset storage instances in the system.
     AssetStorageVector AssetStorages() const;
 
@@ -439,6 +461,9 @@ public:
 
     /// A utility function that counts the number of current asset transfers.
     size_t NumCurrentTransfers() const { return currentTransfers.size(); }
+
+    /// Returns the number of transfers that have been handed to @c provider for execution and have not yet finished.
+    uint NumTransfersInFlight(IAssetProvider *provider) const;
     
     /// Return the current asset dependency map (debugging)
     const AssetDependenciesMap& DebugGetAssetDependencies() const { return assetDependencies; }
@@ -531,9 +556,40 @@ private:
     /// Stores all currently pending transfers.
     AssetTransferPtrVector pendingTransfers_;
 
+    /// Maps transfers that have been executed but have not finished to the provider executing them.
+    HashMap<IAssetTransfer*, IAssetProvider*> transfersInFlight_;
+
+    /// Number of transfers in transfersInFlight_ per provider, so that the in-flight limit is checked without scanning all transfers.
+    HashMap<IAssetProvider*, uint> numTransfersInFlight_;
+
     /// Asset transfer prioritizer.
     AssetTransferPrioritizerPtr transferPrioritizer_;
 
+    /// Returns true if @c asset can be unloaded to stay within the memory budget.
+    bool CanUnloadAsset(const AssetPtr &asset) const;
+
+    /// Returns the loaded bundle that @c asset is a sub asset of, or null.
+    IAssetBundle *ParentBundle(const AssetPtr &asset) const;
+
+    /// Records @c transfer as executed by @c provider until it finishes.
+    void AddTransferInFlight(IAssetTransfer *transfer, IAssetProvider *provider);
+
+    /// Forgets an executed transfer when it finishes, fails or is aborted. Does nothing if @c transfer is not in flight.
+    void RemoveTransferInFlight(IAssetTransfer *transfer);
+
+    /// Reloads an asset unloaded to stay within the memory budget.
+    /** The asset is loaded from its disk source, or from its bundle if it is a sub asset without a disk source. */
+    bool ReloadUnloadedAsset(const AssetPtr &asset);
+
+    /// Asset memory budget in bytes, 0 if disabled.
+    ulonglong memoryBudget_;
+
+    /// Time since the memory usage was last checked against the budget.
+    float memoryBudgetCheckTimer_;
+
+    /// Assets that were unloaded to stay within the memory budget. These are reloaded from their disk source when requested.
+    HashSet<String> unloadedAssets_;
+
     /// Stores all the currently ongoing asset bundle monitors.
     AssetBundleMonitorMap bundleMonitors;
 
@@ -553,6 +609,9 @@ private:
     // Stores a list of sub asset requests that are pending a load from a loaded asset bundle.
     Vector<SubAssetLoader> readySubTransfers;
 
+    /// Sub asset requests whose data the loaded bundle is still preparing after PrefetchSubAssets, loaded in Update once ready.
+    Vector<SubAssetLoader> prefetchingSubTransfers_;
+
     /// Contains all known asset storages in the system.
     //Vector<AssetStoragePtr> storages;
 
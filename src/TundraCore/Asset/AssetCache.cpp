@@ -5,16 +5,24 @@
 #include "AssetCache.h"
 #include "AssetAPI.h"
 #include "IAsset.h"
+#include "MemoryMappedFile.h"
 
 #include "CoreDefines.h"
 #include "Framework.h"
 #include "LoggingFunctions.h"
 
+#include <Urho3D/Core/Mutex.h>
+#include <Urho3D/Core/StringUtils.h>
 #include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/File.h>
 
 namespace Tundra
 {
 
+/// Sub directories of the cache directory for entity tags and partially downloaded files.
+static const char *cETagDirectory = "etag/";
+static const char *cPartialDirectory = "partial/";
+
 AssetCache::AssetCache(AssetAPI *owner, String assetCacheDirectory) : 
     Object(owner->GetContext()),
     assetAPI(owner),
@@ -27,6 +35,10 @@ AssetCache::AssetCache(AssetAPI *owner, String assetCacheDirectory) :
     // Check that the main directory exists
     if (!fileSystem->DirExists(cacheDirectory))
         fileSystem->CreateDir(cacheDirectory);
+    if (!fileSystem->DirExists(cacheDirectory + cETagDirectory))
+        fileSystem->CreateDir(cacheDirectory + cETagDirectory);
+    if (!fileSystem->DirExists(cacheDirectory + cPartialDirectory))
+        fileSystem->CreateDir(cacheDirectory + cPartialDirectory);
 
     // Check --clearAssetCache start param
     if (owner->GetFramework()->HasCommandLineParameter("--clearAssetCache") ||
@@ -59,6 +71,76 @@ String AssetCache::CacheDirectory() const
     return GuaranteeTrailingSlash(cacheDirectory);
 }
 
+String AssetCache::ContentKey(const void *data, uint numBytes, const void *salt, uint saltNumBytes)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    const u8 *bytes = static_cast<const u8*>(data);
+    for(uint i = 0; i < numBytes; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    bytes = static_cast<const u8*>(salt);
+    for(uint i = 0; i < saltNumBytes; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return Urho3D::ToStringHex((unsigned)(hash >> 32)) + Urho3D::ToStringHex((unsigned)hash) + "_" + String(numBytes);
+}
+
+bool AssetCache::WriteVersionedFile(Urho3D::Context *context, const String &fileName, unsigned fileId, unsigned version, const void *data, uint numBytes)
+{
+    if (fileName.Empty())
+        return false;
+
+    // Worker threads may store the same file at the same time, so each write gets a temporary file of its own.
+    static Urho3D::Mutex tempFileMutex;
+    static uint tempFileCounter = 0;
+    uint tempFileNumber;
+    {
+        Urho3D::MutexLock lock(tempFileMutex);
+        tempFileNumber = ++tempFileCounter;
+    }
+    const String tempFileName = fileName + "." + String(tempFileNumber) + ".tmp";
+
+    Urho3D::FileSystem *fileSystem = context->GetSubsystem<Urho3D::FileSystem>();
+    {
+        Urho3D::File file(context, tempFileName, Urho3D::FILE_WRITE);
+        bool written = file.IsOpen() && file.WriteUInt(fileId) && file.WriteUInt(version);
+        if (written && numBytes)
+            written = (file.Write(data, numBytes) == numBytes);
+        if (!written)
+        {
+            LogWarning("AssetCache: Failed to write " + fileName);
+            file.Close();
+            fileSystem->Delete(tempFileName);
+            return false;
+        }
+    }
+    if (!fileSystem->Rename(tempFileName, fileName))
+    {
+        fileSystem->Delete(tempFileName); // Stored by someone else in the meantime.
+        return fileSystem->FileExists(fileName);
+    }
+    return true;
+}
+
+SharedPtr<MemoryMappedFile> AssetCache::MapVersionedFile(Urho3D::Context *context, const String &fileName, unsigned fileId, unsigned version)
+{
+    if (fileName.Empty() || !context->GetSubsystem<Urho3D::FileSystem>()->FileExists(fileName))
+        return SharedPtr<MemoryMappedFile>();
+
+    SharedPtr<MemoryMappedFile> file(new MemoryMappedFile());
+    if (!file->Open(fileName) || file->Size() < VersionedFileHeaderSize)
+        return SharedPtr<MemoryMappedFile>();
+    unsigned header[2];
+    memcpy(header, file->Data(), sizeof(header));
+    if (header[0] != fileId || header[1] != version)
+        return SharedPtr<MemoryMappedFile>();
+    return file;
+}
+
 String AssetCache::StoreAsset(AssetPtr asset)
 {
     Vector<u8> data;
@@ -93,12 +175,61 @@ bool AssetCache::SetLastModified(const String & assetRef, unsigned dateTime)
     return fileSystem->SetLastModifiedTime(absolutePath, dateTime);
 }
 
+String AssetCache::ETag(const String &assetRef)
+{
+    String absolutePath = ETagFileByRef(assetRef);
+    if (!GetSubsystem<Urho3D::FileSystem>()->FileExists(absolutePath))
+        return "";
+    Urho3D::File file(context_, absolutePath, Urho3D::FILE_READ);
+    if (!file.IsOpen())
+        return "";
+    return file.ReadLine().Trimmed();
+}
+
+bool AssetCache::SetETag(const String &assetRef, const String &eTag)
+{
+    String absolutePath = ETagFileByRef(assetRef);
+    if (eTag.Trimmed().Empty())
+    {
+        Urho3D::FileSystem* fileSystem = GetSubsystem<Urho3D::FileSystem>();
+        if (fileSystem->FileExists(absolutePath))
+            return fileSystem->Delete(absolutePath);
+        return true;
+    }
+    Urho3D::File file(context_, absolutePath, Urho3D::FILE_WRITE);
+    if (!file.IsOpen())
+        return false;
+    return file.WriteLine(eTag.Trimmed());
+}
+
+String AssetCache::PartialDiskSourceByRef(const String &assetRef)
+{
+    return cacheDirectory + cPartialDirectory + AssetAPI::SanitateAssetRef(assetRef);
+}
+
+String AssetCache::ETagFileByRef(const String &assetRef) const
+{
+    return cacheDirectory + cETagDirectory + AssetAPI::SanitateAssetRef(assetRef);
+}
+
+StringVector AssetCache::CachedAssetRefs()
+{
+    StringVector filenames;
+    GetSubsystem<Urho3D::FileSystem>()->ScanDir(filenames, cacheDirectory, "*.*", Urho3D::SCAN_FILES, false);
+    StringVector assetRefs;
+    assetRefs.Reserve(filenames.Size());
+    foreach(const String &file, filenames)
+        assetRefs.Push(AssetAPI::DesanitateAssetRef(file));
+    return assetRefs;
+}
+
 void AssetCache::DeleteAsset(const String &assetRef)
 {
-    String absolutePath = DiskSourceByRef(assetRef);
     Urho3D::FileSystem* fileSystem = GetSubsystem<Urho3D::FileSystem>();
-    if (fileSystem->FileExists(absolutePath))
-        fileSystem->Delete(absolutePath);
+    const String absolutePaths[] = { DiskSourceByRef(assetRef), ETagFileByRef(assetRef), PartialDiskSourceByRef(assetRef) };
+    for(uint i = 0; i < 3; ++i)
+        if (fileSystem->FileExists(absolutePaths[i]))
+            fileSystem->Delete(absolutePaths[i]);
 }
 
 void AssetCache::ClearAssetCache()
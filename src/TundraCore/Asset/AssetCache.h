@@ -11,6 +11,8 @@
 namespace Tundra
 {
 
+class MemoryMappedFile;
+
 /// Implements a disk cache for asset files to avoid re-downloading assets between runs.
 class TUNDRACORE_API AssetCache : public Object
 {
@@ -50,7 +52,24 @@ public:
     /// @return bool Returns true if successful, false otherwise.
     bool SetLastModified(const String &assetRef, unsigned dateTime);
 
-    /// Deletes the asset with the given assetRef from the cache, if it exists.
+    /// Returns the HTTP entity tag (ETag) stored for the assetRefs cache file.
+    /// @return String The entity tag, or an empty string if none has been stored.
+    String ETag(const String &assetRef);
+
+    /// Stores the HTTP entity tag (ETag) of the assetRefs cache file for conditional revalidation.
+    /// @param String eTag Entity tag as returned by the server. An empty string removes the stored tag.
+    /// @return bool Returns true if successful, false otherwise.
+    bool SetETag(const String &assetRef, const String &eTag);
+
+    /// Returns the absolute path on the local file system where a partially downloaded copy of the given asset ref is kept.
+    /// Interrupted downloads of large assets are resumed from this file instead of being downloaded again from the start.
+    /// @param assetRef The asset reference URL, which must be of type AssetRefExternalUrl.
+    String PartialDiskSourceByRef(const String &assetRef);
+
+    /// Returns the asset references of all assets currently stored in the cache.
+    StringVector CachedAssetRefs();
+
+    /// Deletes the asset with the given assetRef from the cache, if it exists, along with its metadata and partial download.
     /// @param String asset reference.
     void DeleteAsset(const String &assetRef);
 
@@ -61,12 +80,34 @@ public:
     /// Get the cache directory. Returned path is guaranteed to have a trailing slash /.
     /// @return String absolute path to the caches data directory
     String CacheDirectory() const;
+
+    /// Returns a key that identifies data by its content: a 64-bit FNV-1a hash of the data, and the data size. [noscript]
+    /** Caches of data converted from assets, eg. converted meshes and transcoded textures, name their files by this key, so that
+        assets with identical content share the files regardless of their names. @c salt, eg. the conversion parameters, is hashed
+        after the data but not included in the size. */
+    static String ContentKey(const void *data, uint numBytes, const void *salt = 0, uint saltNumBytes = 0);
+
+    /// Size of the header of the files written by WriteVersionedFile.
+    static const uint VersionedFileHeaderSize = 2 * sizeof(unsigned);
+
+    /// Writes a converted data file, with a header of the file identifier and format version followed by @c data. [noscript]
+    /** The file is written under a temporary name and then renamed, so that a partially written file is never read.
+        Can be called from worker threads. @return True if the file was written. */
+    static bool WriteVersionedFile(Urho3D::Context *context, const String &fileName, unsigned fileId, unsigned version, const void *data, uint numBytes);
+
+    /// Maps a file written by WriteVersionedFile to memory. The data starts at VersionedFileHeaderSize. [noscript]
+    /** Can be called from worker threads.
+        @return The mapped file, or null if the file does not exist, or if its identifier or version do not match, eg. after a format change. */
+    static SharedPtr<MemoryMappedFile> MapVersionedFile(Urho3D::Context *context, const String &fileName, unsigned fileId, unsigned version);
     
 private:
 #ifdef WIN32
     /// Windows specific helper to open a file handle to absolutePath
     void *OpenFileHandle(const String &absolutePath);
 #endif
+    /// Returns the absolute path of the file that holds the entity tag of assetRef.
+    String ETagFileByRef(const String &assetRef) const;
+
     /// Cache directory, passed here from AssetAPI in the ctor.
     String cacheDirectory;
 
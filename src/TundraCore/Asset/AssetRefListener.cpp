@@ -6,6 +6,7 @@
 #include "IAttribute.h"
 #include "AssetReference.h"
 #include "IComponent.h"
+#include "Entity.h"
 #include "Framework.h"
 #include "AssetAPI.h"
 #include "FrameAPI.h"
@@ -24,11 +25,43 @@ AssetRefListener::AssetRefListener() :
 {
 }
 
+AssetRefListener::~AssetRefListener()
+{
+    AssetPtr currentAsset = asset.Lock();
+    if (currentAsset)
+        currentAsset->Loaded.Disconnect(this, &AssetRefListener::OnAssetLoaded);
+    SetAsset(AssetPtr());
+}
+
+void AssetRefListener::SetAsset(const AssetPtr &newAsset)
+{
+    AssetPtr oldAsset = asset.Lock();
+    if (oldAsset == newAsset)
+        return;
+    // The asset is used until the moment it is released.
+    if (oldAsset && oldAsset->numRefListeners > 0)
+    {
+        oldAsset->numRefListeners--;
+        oldAsset->MarkUsed();
+    }
+    if (newAsset)
+    {
+        newAsset->numRefListeners++;
+        newAsset->MarkUsed();
+    }
+    asset = newAsset;
+}
+
 AssetPtr AssetRefListener::Asset() const
 {
     return asset.Lock();
 }
 
+void AssetRefListener::SetRequester(Entity *entity)
+{
+    requester = entity;
+}
+
 void AssetRefListener::HandleAssetRefChange(IAttribute *assetRef, const String& assetType)
 {
     Attribute<AssetReference> *attr = dynamic_cast<Attribute<AssetReference> *>(assetRef);
@@ -38,6 +71,8 @@ void AssetRefListener::HandleAssetRefChange(IAttribute *assetRef, const String&
             (assetRef == 0 ? "null" : assetRef->TypeName()) + " instead).");
         return;
     }
+    if (attr->Owner()->ParentEntity())
+        requester = attr->Owner()->ParentEntity();
     HandleAssetRefChange(attr->Owner()->GetFramework()->Asset(), attr->Get().ref, assetType);
 }
 
@@ -62,7 +97,7 @@ void AssetRefListener::HandleAssetRefChange(AssetAPI *assetApi, String assetRef,
     assetRef = assetRef.Trimmed();
     if (assetRef.Empty())
     {
-        asset = AssetPtr();
+        SetAsset(AssetPtr());
         return;
     }
     currentWaitingRef = "";
@@ -80,7 +115,7 @@ void AssetRefListener::HandleAssetRefChange(AssetAPI *assetApi, String assetRef,
             // Asset is loaded, emit Loaded with 1 msec delay to preserve the logic
             // that HandleAssetRefChange won't emit anything itself as before.
             // Otherwise existing connection can break/be too late after calling this function.
-            asset = loadedAsset;
+            SetAsset(loadedAsset);
             assetApi->GetFramework()->Frame()->DelayedExecute(0.0f).Connect(this, &AssetRefListener::EmitLoaded);
             return;
         }
@@ -102,6 +137,9 @@ void AssetRefListener::HandleAssetRefChange(AssetAPI *assetApi, String assetRef,
         }
         currentWaitingRef = assetRef;
 
+        if (!requester.Expired())
+            transfer->AddRequester(requester.Get());
+
         transfer->Succeeded.Connect(this, &AssetRefListener::OnTransferSucceeded);
         transfer->Failed.Connect(this, &AssetRefListener::OnTransferFailed);
 
@@ -111,7 +149,7 @@ void AssetRefListener::HandleAssetRefChange(AssetAPI *assetApi, String assetRef,
     // Disconnect from the old asset's load signal
     if (asset)
         asset->Loaded.Disconnect(this, &AssetRefListener::OnAssetLoaded);
-    asset = AssetPtr();
+    SetAsset(AssetPtr());
 }
 
 void AssetRefListener::OnTransferSucceeded(AssetPtr assetData)
@@ -120,7 +158,7 @@ void AssetRefListener::OnTransferSucceeded(AssetPtr assetData)
         return;
     
     // Connect to further reloads of the asset to be able to notify of them.
-    asset = assetData;
+    SetAsset(assetData);
     assetData->Loaded.Connect(this, &AssetRefListener::OnAssetLoaded);
     Loaded.Emit(assetData);
 }
@@ -151,7 +189,7 @@ void AssetRefListener::OnAssetCreated(AssetPtr assetData)
 
         // The asset we are waiting for has been created, hook to the IAsset::Loaded signal.
         currentWaitingRef = "";
-        asset = assetData;
+        SetAsset(assetData);
         assetData->Loaded.Connect(this, &AssetRefListener::OnAssetLoaded);
         if (myAssetAPI)
             myAssetAPI->AssetCreated.Disconnect(this, &AssetRefListener::OnAssetCreated);
@@ -225,6 +263,7 @@ void AssetRefListListener::HandleChange(const AssetReferenceList &refs)
         AssetRefListenerPtr listener(new AssetRefListener());
         listener->TransferFailed.Connect(this, &AssetRefListListener::OnAssetFailed);
         listener->Loaded.Connect(this, &AssetRefListListener::OnAssetLoaded);
+        listener->SetRequester(requester_.Get());
         listeners_.Push(listener);
     }
     for (uint i=0; i<numRefs; ++i)
@@ -249,6 +288,13 @@ Vector<AssetPtr> AssetRefListListener::Assets() const
     return assets;
 }
 
+void AssetRefListListener::SetRequester(Entity *entity)
+{
+    requester_ = entity;
+    for(uint i = 0; i < listeners_.Size(); ++i)
+        listeners_[i]->SetRequester(entity);
+}
+
 AssetPtr AssetRefListListener::Asset(uint index) const
 {
     if (index < current_.Size() && !current_[index].ref.Empty())
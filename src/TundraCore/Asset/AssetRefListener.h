@@ -5,6 +5,7 @@
 #include "TundraCoreApi.h"
 #include "AssetFwd.h"
 #include "AssetReference.h"
+#include "SceneFwd.h"
 #include "Signals.h"
 
 #include <Urho3D/Container/RefCounted.h>
@@ -19,6 +20,7 @@ class TUNDRACORE_API AssetRefListener : public RefCounted
 {
 public:
     AssetRefListener();
+    ~AssetRefListener();
 
     /// Issues a new asset request to the given AssetReference.
     /// @param assetRef A pointer to an attribute of type AssetReference.
@@ -33,6 +35,11 @@ public:
     /// Returns the asset currently stored in this asset reference.
     AssetPtr Asset() const;
 
+    /// Sets the entity that is reported as the requester of the issued asset transfers.
+    /** The IAttribute overload of HandleAssetRefChange sets this automatically to the attribute's parent entity.
+        @see IAssetTransfer::requesters */
+    void SetRequester(Entity *entity);
+
     /// Emitted when the raw byte download of this asset finishes.
     Signal1<IAssetTransfer*> Downloaded;
 
@@ -50,10 +57,14 @@ private:
     
     void EmitLoaded(float time);
 
+    /// Sets the currently held asset and keeps IAsset::NumRefListeners up to date.
+    void SetAsset(const AssetPtr &newAsset);
+
 private:
     AssetAPI *myAssetAPI;
     AssetWeakPtr asset;
     AssetTransferWeakPtr currentTransfer;
+    EntityWeakPtr requester;
     String currentWaitingRef;
 };
 
@@ -76,6 +87,10 @@ public:
     /// Returns Asset for index.
     AssetPtr Asset(uint index) const;
 
+    /// Sets the entity that is reported as the requester of the issued asset transfers.
+    /** @see AssetRefListener::SetRequester */
+    void SetRequester(Entity *entity);
+
     /// Emitted when list changes.
     Signal1<const AssetReferenceList&> Changed;
 
@@ -95,6 +110,7 @@ private:
     AssetAPI *assetAPI_;
     AssetReferenceList current_;
     Vector<AssetRefListenerPtr > listeners_;
+    EntityWeakPtr requester_;
 };
 
 }
@@ -56,6 +56,11 @@ public:
         return data.Size() > 0;
     }
 
+    uint CpuMemoryUsage() const override
+    {
+        return data.Capacity();
+    }
+
     Vector<u8> data;
 };
 
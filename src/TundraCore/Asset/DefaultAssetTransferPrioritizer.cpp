@@ -7,48 +7,34 @@
 namespace Tundra
 {
 
-struct TypeIndex
-{
-    uint index;
-    uint num;
-
-    TypeIndex() : index(0), num(0) {}
-
-    uint Current()
-    {
-        return index + num;
-    }
-};
-
 DefaultAssetTransferPrioritizer::DefaultAssetTransferPrioritizer()
 {
 }
 
 AssetTransferPtrVector DefaultAssetTransferPrioritizer::Prioritize(const AssetTransferPtrVector &transfers)
 {
-    /** @todo Add prioritizing with distance to active camera when EntityWeakPtr info is available in transfers.
+    /** @note Distance based prioritizing is implemented by CameraAssetTransferPrioritizer in UrhoRenderer.
         @todo Add more types? Should scripts go last or first?
         @todo Possibly add option for this function to communicate pending tranfers for a longer time if they are eg. 1km away from camera. */
-    TypeIndex iMesh;
-    TypeIndex iMaterial;
-
-    AssetTransferPtrVector sorted;
+    AssetTransferPtrVector meshes;
+    AssetTransferPtrVector materials;
+    AssetTransferPtrVector others;
     for(auto iter = transfers.Begin(); iter != transfers.End(); ++iter)
     {
         const AssetTransferPtr &transfer = (*iter);
         if (transfer->assetType.Contains("mesh", false))
-        {
-            sorted.Insert(iMesh.Current(), transfer);
-            iMesh.num++;
-        }
+            meshes.Push(transfer);
         else if (transfer->assetType.Contains("material", false))
-        {
-            sorted.Insert(iMesh.Current() + iMaterial.Current(), transfer);
-            iMaterial.num++;
-        }
+            materials.Push(transfer);
         else
-            sorted.Push(transfer);
+            others.Push(transfer);
     }
+
+    AssetTransferPtrVector sorted;
+    sorted.Reserve(transfers.Size());
+    sorted.Push(meshes);
+    sorted.Push(materials);
+    sorted.Push(others);
     return sorted;
 }
 
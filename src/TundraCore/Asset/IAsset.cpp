@@ -7,6 +7,8 @@
 #include "IAssetStorage.h"
 #include "IAssetProvider.h"
 #include "LoggingFunctions.h"
+#include "Framework.h"
+#include "FrameAPI.h"
 
 #include <Urho3D/Core/Profiler.h>
 #include <Urho3D/Container/HashSet.h>
@@ -15,9 +17,16 @@ namespace Tundra
 {
 
 IAsset::IAsset(AssetAPI *owner, const String &type_, const String &name_) :
-Object(owner->GetContext()), assetAPI(owner), type(type_), name(name_), diskSourceType(Programmatic), modified(false)
+Object(owner->GetContext()), assetAPI(owner), type(type_), name(name_), diskSourceType(Programmatic), modified(false),
+lastUsed(0.f), numRefListeners(0)
 {
     assert(assetAPI);
+    MarkUsed();
+}
+
+void IAsset::MarkUsed()
+{
+    lastUsed = assetAPI->GetFramework()->Frame()->WallClockTime();
 }
 
 void IAsset::SetDiskSource(const String &diskSource_)
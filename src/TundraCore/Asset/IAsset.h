@@ -99,6 +99,27 @@ public:
     /// Returns true if the asset is empty. An empty asset is unloaded, and has an empty disk source.
     bool IsEmpty() const;
 
+    /// Returns the estimated CPU memory used by the loaded asset in bytes.
+    /** The default implementation returns 0. Asset types should report the data they keep in memory. @see AssetAPI::SetMemoryBudget */
+    virtual uint CpuMemoryUsage() const { return 0; }
+
+    /// Returns the estimated GPU memory used by the loaded asset in bytes.
+    /** The default implementation returns 0. Asset types should report eg. their texture and vertex data. @see AssetAPI::SetMemoryBudget */
+    virtual uint GpuMemoryUsage() const { return 0; }
+
+    /// Returns the estimated total CPU and GPU memory used by the loaded asset in bytes.
+    uint MemoryUsage() const { return CpuMemoryUsage() + GpuMemoryUsage(); }
+
+    /// Marks the asset as used at the current time. Least recently used assets are unloaded first when over the memory budget.
+    void MarkUsed();
+
+    /// Returns the wall clock time when the asset was last used. @see MarkUsed
+    float LastUsed() const { return lastUsed; }
+
+    /// Returns the number of AssetRefListeners currently holding this asset.
+    /** Assets held by listeners are in use and are never unloaded to stay within the memory budget. */
+    uint NumRefListeners() const { return numRefListeners; }
+
     /// Returns true if this asset content is trusted.
     bool IsTrusted() const;
 
@@ -234,6 +255,15 @@ protected:
     
     /// Modified in memory -status of the asset.
     bool modified;
+
+private:
+    friend class AssetRefListener;
+
+    /// Wall clock time of last use.
+    float lastUsed;
+
+    /// Number of AssetRefListeners holding this asset. Maintained by AssetRefListener.
+    uint numRefListeners;
 };
 
 }
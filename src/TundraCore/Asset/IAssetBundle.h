@@ -55,6 +55,17 @@ public:
         @return Absolute disk source path if available, empty string otherwise.*/
     virtual String GetSubAssetDiskSource(const String &subAssetName) = 0;
 
+    /// Hints that the given sub assets are about to be requested.
+    /** Called by AssetAPI with all pending sub asset requests once the bundle has loaded, before querying them one by one.
+        Implementations can use this to prepare the data of several sub assets at once, eg. uncompress them in parallel.
+        If the data is prepared in the background, AssetAPI queries the sub assets only once IsSubAssetDataReady returns true for them.
+        @note Default implementation does nothing. */
+    virtual void PrefetchSubAssets(const StringVector &/*subAssetNames*/) {}
+
+    /// Returns false while the data of a sub asset is still being prepared in the background after PrefetchSubAssets.
+    /** @note Default implementation returns true. */
+    virtual bool IsSubAssetDataReady(const String &/*subAssetName*/) const { return true; }
+
     /// Returns the sub asset count in this bundle.
     /** @return Count of the assets or -1 if count is unknown. */
     virtual int SubAssetCount() const { return -1; }
@@ -4,6 +4,7 @@
 #include "IAssetTransfer.h"
 #include "IAssetProvider.h"
 #include "IAsset.h"
+#include "Entity.h"
 
 #include "LoggingFunctions.h"
 
@@ -51,6 +52,16 @@ void IAssetTransfer::EmitAssetFailed(IAssetTransfer* transfer, String reason)
     Failed.Emit(transfer, reason);
 }
 
+void IAssetTransfer::AddRequester(Entity *entity)
+{
+    if (!entity)
+        return;
+    for(uint i = 0; i < requesters.Size(); ++i)
+        if (requesters[i].Get() == entity)
+            return;
+    requesters.Push(EntityWeakPtr(entity));
+}
+
 bool IAssetTransfer::Abort()
 {
     if (provider.Get())
@@ -5,6 +5,7 @@
 #include "TundraCoreApi.h"
 #include "CoreTypes.h"
 #include "AssetFwd.h"
+#include "SceneFwd.h"
 #include "AssetReference.h"
 #include "IAsset.h"
 #include "Signals.h"
@@ -45,6 +46,14 @@ public:
     /// Specifies the storage this asset is being downloaded from.
     AssetStorageWeakPtr storage;
 
+    /// Entities that requested this asset.
+    /** Used by IAssetTransferPrioritizer implementations to order transfers spatially.
+        Transfers to asset dependencies inherit the requesters of the depending asset. */
+    Vector<EntityWeakPtr> requesters;
+
+    /// Adds @c entity to the requesters of this transfer, if not already present.
+    void AddRequester(Entity *entity);
+
     /// Emits Downloaded signal.
     void EmitAssetDownloaded();
 
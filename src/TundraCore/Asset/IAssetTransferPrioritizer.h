@@ -21,6 +21,12 @@ public:
     /** Called by AssetAPI. If the returned list does not match @c transfers size,
         the original will be used so that no transfers are lost. */
     virtual AssetTransferPtrVector Prioritize(const AssetTransferPtrVector &transfers) = 0;
+
+    /// Returns the maximum number of transfers that may be in flight simultaneously for @c provider.
+    /** Called by AssetAPI. Transfers exceeding the limit are kept pending and passed to Prioritize
+        again on the next frame, so that later prioritization can still reorder them.
+        The default implementation returns 0, which means no limit. */
+    virtual uint MaxTransfersInFlight(IAssetProvider * /*provider*/) const { return 0; }
 };
 
 }
@@ -0,0 +1,111 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "StableHeaders.h"
+#include "Win.h"
+#include "MemoryMappedFile.h"
+#include "LoggingFunctions.h"
+
+#include <Urho3D/IO/FileSystem.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Tundra
+{
+
+MemoryMappedFile::MemoryMappedFile() :
+    data_(0),
+    size_(0)
+{
+}
+
+MemoryMappedFile::~MemoryMappedFile()
+{
+    Close();
+}
+
+bool MemoryMappedFile::Open(const String &filename)
+{
+    Close();
+
+    const String path = Urho3D::GetNativePath(filename);
+#ifdef WIN32
+    HANDLE file = CreateFileW(Urho3D::WString(path).CString(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        LogError("MemoryMappedFile::Open: Failed to open file \"" + path + "\" for reading.");
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart <= 0 || (unsigned long long)fileSize.QuadPart > (size_t)-1)
+    {
+        LogError("MemoryMappedFile::Open: File \"" + path + "\" is empty or too large to map.");
+        CloseHandle(file);
+        return false;
+    }
+    // The mapping object and the view keep the file open, so the handles can be closed right away.
+    HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping)
+    {
+        LogError("MemoryMappedFile::Open: Failed to map file \"" + path + "\".");
+        return false;
+    }
+    void *view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!view)
+    {
+        LogError("MemoryMappedFile::Open: Failed to map file \"" + path + "\".");
+        return false;
+    }
+    data_ = (u8*)view;
+    size_ = (size_t)fileSize.QuadPart;
+#else
+    int file = open(path.CString(), O_RDONLY);
+    if (file == -1)
+    {
+        LogError("MemoryMappedFile::Open: Failed to open file \"" + path + "\" for reading.");
+        return false;
+    }
+    struct stat fileStat;
+    if (fstat(file, &fileStat) != 0 || fileStat.st_size <= 0)
+    {
+        LogError("MemoryMappedFile::Open: File \"" + path + "\" is empty or can not be read.");
+        close(file);
+        return false;
+    }
+    // The mapping keeps the file open, so the descriptor can be closed right away.
+    void *view = mmap(0, (size_t)fileStat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+    close(file);
+    if (view == MAP_FAILED)
+    {
+        LogError("MemoryMappedFile::Open: Failed to map file \"" + path + "\".");
+        return false;
+    }
+    data_ = (u8*)view;
+    size_ = (size_t)fileStat.st_size;
+#endif
+    fileName_ = filename;
+    return true;
+}
+
+void MemoryMappedFile::Close()
+{
+    if (!data_)
+        return;
+
+#ifdef WIN32
+    UnmapViewOfFile(data_);
+#else
+    munmap(data_, size_);
+#endif
+    data_ = 0;
+    size_ = 0;
+    fileName_.Clear();
+}
+
+}
@@ -0,0 +1,47 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#pragma once
+
+#include "TundraCoreApi.h"
+#include "CoreTypes.h"
+
+#include <Urho3D/Container/RefCounted.h>
+
+namespace Tundra
+{
+
+/// Maps the contents of a file on disk to memory without reading it in.
+/** The pages of the file are loaded by the operating system on first access, so only the parts of the file that are used take up memory.
+    The mapping is private copy-on-write: the data can be written to, but the writes are never stored to the file. */
+class TUNDRACORE_API MemoryMappedFile : public RefCounted
+{
+public:
+    MemoryMappedFile();
+    ~MemoryMappedFile();
+
+    /// Maps the given file, closing any previously mapped one. Returns false and logs an error if the file can not be mapped.
+    /** Empty files can not be mapped. */
+    bool Open(const String &filename);
+
+    /// Unmaps the file. The pointer returned by Data() is invalid after this.
+    void Close();
+
+    /// Returns whether a file is mapped.
+    bool IsOpen() const { return data_ != 0; }
+
+    /// Returns the start of the mapped file contents, or null if no file is mapped. The data is aligned to at least the page size.
+    u8 *Data() const { return data_; }
+
+    /// Returns the size of the mapped file in bytes.
+    size_t Size() const { return size_; }
+
+    /// Returns the name of the mapped file.
+    const String &FileName() const { return fileName_; }
+
+private:
+    u8 *data_;
+    size_t size_;
+    String fileName_;
+};
+
+}
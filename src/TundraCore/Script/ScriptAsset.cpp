@@ -131,4 +131,9 @@ bool ScriptAsset::IsLoaded() const
     return !scriptContent.Empty();
 }
 
+uint ScriptAsset::CpuMemoryUsage() const
+{
+    return scriptContent.Capacity() + references.Size() * sizeof(AssetReference);
+}
+
 }
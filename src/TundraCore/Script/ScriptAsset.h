@@ -40,6 +40,9 @@ public:
 
     bool IsLoaded() const;
 
+    /// IAsset override.
+    uint CpuMemoryUsage() const override;
+
 private:
     /// Unload script asset
     virtual void DoUnload();
@@ -0,0 +1,81 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "TestRunner.h"
+
+#include "Scene.h"
+#include "SceneAPI.h"
+#include "Entity.h"
+#include "AnimationController.h"
+#include "AnimationSystem.h"
+#include "GraphicsWorld.h"
+
+using namespace Tundra;
+using namespace Tundra::Test;
+
+/** Animation tests. The controllers of a scene are registered to the animation system of its graphics world, which advances
+    them at the update interval of their visibility, or of the server mode on a headless run. */
+
+class AnimationTest : public Runner
+{
+protected:
+    void SetUp() override
+    {
+        Runner::SetUp();
+        CreateViewScene();
+    }
+
+    /// Creates an entity with an animation controller.
+    SharedPtr<AnimationController> CreateController(Scene *scene)
+    {
+        EntityPtr entity = scene->CreateEntity(0, StringVector(), AttributeChange::Default, false, false);
+        return entity->CreateComponent<AnimationController>();
+    }
+};
+
+TEST_F(AnimationTest, UpdateIntervals)
+{
+    ASSERT_TRUE(viewScene != nullptr);
+    GraphicsWorld *world = viewScene->Subsystem<GraphicsWorld>().Get();
+    ASSERT_TRUE(world != nullptr);
+    AnimationSystem *animations = world->Animations();
+
+    // The runner is headless, so the skeletons are posed on demand.
+    EXPECT_TRUE(animations->ServerMode());
+    animations->SetServerUpdateInterval(0.1f);
+
+    SharedPtr<AnimationController> controller = CreateController(viewScene.Get());
+    EXPECT_EQ(1U, animations->NumControllers());
+
+    // Controllers of scenes without a graphics world are not registered anywhere.
+    SharedPtr<AnimationController> sceneController = CreateController(scene.Get());
+    EXPECT_EQ(1U, animations->NumControllers());
+
+    // The frame time accumulates until the server update interval has passed.
+    animations->Update(0.06f);
+    EXPECT_EQ(0U, animations->NumUpdatedControllers());
+    animations->Update(0.06f);
+    EXPECT_EQ(1U, animations->NumUpdatedControllers());
+    animations->Update(0.06f);
+    EXPECT_EQ(0U, animations->NumUpdatedControllers());
+
+    // Outside server mode there is no main camera, so the model counts as invisible.
+    animations->SetServerMode(false);
+    animations->SetInvisibleUpdateInterval(0.0f);
+    animations->Update(0.01f);
+    EXPECT_EQ(1U, animations->NumUpdatedControllers());
+    animations->SetInvisibleUpdateInterval(1.0f);
+    animations->Update(0.5f);
+    EXPECT_EQ(0U, animations->NumUpdatedControllers());
+    animations->Update(0.5f);
+    EXPECT_EQ(1U, animations->NumUpdatedControllers());
+    EXPECT_FALSE(animations->HasPendingPoses());
+
+    // Removing the entity frees the slot, and a new controller reuses it.
+    viewScene->RemoveEntity(controller->ParentEntity()->Id());
+    controller.Reset();
+    EXPECT_EQ(0U, animations->NumControllers());
+    animations->Update(1.0f);
+    EXPECT_EQ(0U, animations->NumUpdatedControllers());
+    controller = CreateController(viewScene.Get());
+    EXPECT_EQ(1U, animations->NumControllers());
+}
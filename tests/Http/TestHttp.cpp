@@ -0,0 +1,631 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#endif
+
+#include "TestRunner.h"
+
+#include "HttpPlugin.h"
+#include "HttpClient.h"
+#include "HttpRequest.h"
+#include "HttpAsset/HttpAssetProvider.h"
+
+#include "AssetAPI.h"
+#include "AssetCache.h"
+#include "BinaryAsset.h"
+
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Tundra;
+using namespace Tundra::Test;
+
+/** HTTP client tests. The requests are served by a stand-in server on the loopback interface, which answers each request
+    after a delay and records how many requests it was serving at the same time, in total and per Host header. The server
+    is reached both as 127.0.0.1 and as localhost, which the client treats as two hosts. Paths registered as resources
+    are served with an entity tag and answer conditional and range requests, for the cache and resume tests.
+    These run headless. */
+
+namespace
+{
+#ifdef _WIN32
+    typedef SOCKET SocketHandle;
+    const SocketHandle NoSocket = INVALID_SOCKET;
+    void CloseSocket(SocketHandle s) { closesocket(s); }
+#else
+    typedef int SocketHandle;
+    const SocketHandle NoSocket = -1;
+    void CloseSocket(SocketHandle s) { close(s); }
+#endif
+
+    /// Returns the value of the request header @c name, or an empty string if it is not present.
+    std::string RequestHeader(const std::string &request, const std::string &name)
+    {
+        const std::string field = "\r\n" + name + ": ";
+        size_t start = request.find(field);
+        if (start == std::string::npos)
+            return std::string();
+        start += field.size();
+        return request.substr(start, request.find("\r\n", start) - start);
+    }
+
+    /// Minimal HTTP/1.1 server answering every request with its path after a delay, one thread per connection.
+    /** Resources added with SetResource are answered with their body and entity tag instead. A matching If-None-Match
+        is answered with '304 Not Modified' and a Range with a matching If-Range with '206 Partial Content'. */
+    class StandInServer
+    {
+    public:
+        explicit StandInServer(uint delayMSec) :
+            delayMSec_(delayMSec),
+            listener_(NoSocket),
+            port_(0),
+            running_(false),
+            active_(0),
+            maxActive_(0)
+        {
+        }
+
+        ~StandInServer()
+        {
+            Stop();
+        }
+
+        bool Start()
+        {
+            listener_ = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+            if (listener_ == NoSocket)
+                return false;
+
+            sockaddr_in address = {};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            address.sin_port = 0;
+            socklen_t length = sizeof(address);
+            if (bind(listener_, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener_, 64) != 0 ||
+                getsockname(listener_, (sockaddr*)&address, &length) != 0)
+                return false;
+            port_ = ntohs(address.sin_port);
+
+            running_ = true;
+            acceptThread_ = std::thread(&StandInServer::Accept, this);
+            return true;
+        }
+
+        void Stop()
+        {
+            running_ = false;
+            if (acceptThread_.joinable())
+                acceptThread_.join();
+            for(size_t i = 0; i < connectionThreads_.size(); ++i)
+                connectionThreads_[i].join();
+            connectionThreads_.clear();
+            if (listener_ != NoSocket)
+                CloseSocket(listener_);
+            listener_ = NoSocket;
+        }
+
+        /// Returns the Host header of the requests to @c hostName, eg. "127.0.0.1:8080".
+        String Host(const String &hostName) const
+        {
+            return hostName + ":" + String(port_);
+        }
+
+        String Url(const String &hostName, const String &path) const
+        {
+            return "http://" + Host(hostName) + path;
+        }
+
+        /// Returns the most requests served at the same time.
+        int MaxActive()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return maxActive_;
+        }
+
+        /// Returns the most requests served at the same time with the Host header @c host.
+        int MaxActive(const String &host)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return maxActivePerHost_[host.CString()];
+        }
+
+        /// Serves @c body with the entity tag @c eTag at @c path.
+        void SetResource(const std::string &path, const std::string &body, const std::string &eTag)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            resources_[path] = Resource{ body, eTag };
+        }
+
+        /// Returns the requests received for @c path, including their headers.
+        std::vector<std::string> Requests(const std::string &path)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return requests_[path];
+        }
+
+        /// Returns the number of requests received for any path.
+        size_t NumRequests()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            size_t num = 0;
+            for(auto iter = requests_.begin(); iter != requests_.end(); ++iter)
+                num += iter->second.size();
+            return num;
+        }
+
+    private:
+        struct Resource
+        {
+            std::string body;
+            std::string eTag;
+        };
+
+        void Accept()
+        {
+            while(running_)
+            {
+                // Wake up periodically to notice Stop
+                fd_set readable;
+                FD_ZERO(&readable);
+                FD_SET(listener_, &readable);
+                timeval timeout = { 0, 20000 };
+                if (select((int)listener_ + 1, &readable, 0, 0, &timeout) <= 0)
+                    continue;
+
+                SocketHandle connection = accept(listener_, 0, 0);
+                if (connection != NoSocket)
+                    connectionThreads_.push_back(std::thread(&StandInServer::Serve, this, connection));
+            }
+        }
+
+        void Serve(SocketHandle connection)
+        {
+            std::string request;
+            char buffer[1024];
+            while(request.find("\r\n\r\n") == std::string::npos)
+            {
+                int received = (int)recv(connection, buffer, sizeof(buffer), 0);
+                if (received <= 0)
+                {
+                    CloseSocket(connection);
+                    return;
+                }
+                request.append(buffer, received);
+            }
+
+            // "GET /path HTTP/1.1" and the "Host: " header
+            size_t pathStart = request.find(' ') + 1;
+            std::string path = request.substr(pathStart, request.find(' ', pathStart) - pathStart);
+            std::string host = RequestHeader(request, "Host");
+
+            std::string status = "200 OK";
+            std::string headers;
+            std::string body = path;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                requests_[path].push_back(request);
+
+                auto resource = resources_.find(path);
+                if (resource != resources_.end())
+                {
+                    body = resource->second.body;
+                    headers = "ETag: " + resource->second.eTag + "\r\n";
+                    std::string range = RequestHeader(request, "Range");
+                    if (RequestHeader(request, "If-None-Match") == resource->second.eTag)
+                    {
+                        status = "304 Not Modified";
+                        body.clear();
+                    }
+                    else if (range.find("bytes=") == 0 && RequestHeader(request, "If-Range") == resource->second.eTag)
+                    {
+                        // "bytes=<offset>-"
+                        size_t offset = std::min((size_t)std::stoul(range.substr(6)), body.size());
+                        status = "206 Partial Content";
+                        headers += "Content-Range: bytes " + std::to_string(offset) + "-" + std::to_string(body.size() - 1) +
+                            "/" + std::to_string(body.size()) + "\r\n";
+                        body = body.substr(offset);
+                    }
+                }
+
+                maxActive_ = std::max(maxActive_, ++active_);
+                maxActivePerHost_[host] = std::max(maxActivePerHost_[host], ++activePerHost_[host]);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(delayMSec_));
+            {
+                // Stop counting before responding, so that the count never exceeds the requests the client has executing
+                std::lock_guard<std::mutex> lock(mutex_);
+                --active_;
+                --activePerHost_[host];
+            }
+
+            // A '304 Not Modified' response has no body
+            if (status != "304 Not Modified")
+                headers += "Content-Type: text/plain\r\nContent-Length: " + std::to_string(body.size()) + "\r\n";
+            std::string response = "HTTP/1.1 " + status + "\r\n" + headers + "Connection: close\r\n\r\n" + body;
+            send(connection, response.c_str(), (int)response.size(), 0);
+            CloseSocket(connection);
+        }
+
+        uint delayMSec_;
+        SocketHandle listener_;
+        unsigned short port_;
+        std::atomic<bool> running_;
+        std::thread acceptThread_;
+        std::vector<std::thread> connectionThreads_;
+
+        std::mutex mutex_;
+        int active_;
+        int maxActive_;
+        std::map<std::string, int> activePerHost_;
+        std::map<std::string, int> maxActivePerHost_;
+        std::map<std::string, Resource> resources_;
+        std::map<std::string, std::vector<std::string> > requests_;
+    };
+}
+
+class HttpTest : public Runner
+{
+protected:
+    void SetUp() override
+    {
+        Runner::SetUp();
+        HttpPlugin *plugin = framework->Module<HttpPlugin>();
+        client = (plugin ? plugin->Client() : nullptr);
+
+        // Cache and resume files of the tests
+        fileSystem = context->GetSubsystem<Urho3D::FileSystem>();
+        directory = fileSystem->GetCurrentDir() + "HttpTest/";
+        fileSystem->CreateDir(directory);
+    }
+
+    void TearDown() override
+    {
+        StringVector files;
+        fileSystem->ScanDir(files, directory, "*", Urho3D::SCAN_FILES, false);
+        foreach(const String &file, files)
+            fileSystem->Delete(directory + file);
+        client = nullptr;
+        Runner::TearDown();
+    }
+
+    bool WriteFile(const String &fileName, const std::string &data)
+    {
+        Urho3D::File file(context.Get(), fileName, Urho3D::FILE_WRITE);
+        return file.IsOpen() && file.Write(data.c_str(), (uint)data.size()) == data.size();
+    }
+
+    std::string ReadFile(const String &fileName)
+    {
+        Urho3D::File file(context.Get(), fileName, Urho3D::FILE_READ);
+        std::string data(file.IsOpen() ? file.GetSize() : 0, '\0');
+        if (!data.empty() && file.Read(&data[0], (uint)data.size()) != data.size())
+            data.clear();
+        return data;
+    }
+
+    /// Writes a resume file as left behind by an interrupted download: "TPRT", validator length, validator and the received part.
+    bool WriteResumeFile(const String &fileName, const std::string &validator, const std::string &part)
+    {
+        Urho3D::File file(context.Get(), fileName, Urho3D::FILE_WRITE);
+        return file.IsOpen() && file.WriteUInt(0x54525054) && file.WriteUInt((uint)validator.size()) &&
+            file.Write(validator.c_str(), (uint)validator.size()) == validator.size() &&
+            file.Write(part.c_str(), (uint)part.size()) == part.size();
+    }
+
+    static std::string Body(const HttpRequestPtr &request)
+    {
+        const Vector<u8> &body = request->ResponseBody();
+        return std::string((const char*)body.Buffer(), body.Size());
+    }
+
+    /// Returns a response body large enough to be streamed to a resume file.
+    static std::string LargeBody()
+    {
+        std::string body;
+        for(int i = 0; body.size() < 4000; ++i)
+            body += std::to_string(i) + " ";
+        return body;
+    }
+
+    /// Pumps the framework until all requests have completed or the time runs out.
+    bool WaitForCompletion(const Vector<HttpRequestPtr> &requests, float timeoutSeconds = 20.f)
+    {
+        Urho3D::Timer timer;
+        while(timer.GetMSec(false) < (uint)(timeoutSeconds * 1000.f))
+        {
+            ProcessEvents();
+            bool completed = true;
+            for(uint i = 0; i < requests.Size() && completed; ++i)
+                completed = requests[i]->HasCompleted();
+            if (completed)
+                return true;
+            Urho3D::Time::Sleep(5);
+        }
+        return false;
+    }
+
+    bool WaitForCompletion(const HttpRequestPtr &request, float timeoutSeconds = 20.f)
+    {
+        Vector<HttpRequestPtr> requests;
+        requests.Push(request);
+        return WaitForCompletion(requests, timeoutSeconds);
+    }
+
+    /// Checks that each request got its own path as the response body.
+    void ExpectResponses(const Vector<HttpRequestPtr> &requests, const Vector<String> &paths)
+    {
+        for(uint i = 0; i < requests.Size(); ++i)
+        {
+            EXPECT_EQ(requests[i]->StatusCode(), 200) << requests[i]->Url().CString() << " " << requests[i]->Error().CString();
+            const Vector<u8> &body = requests[i]->ResponseBody();
+            EXPECT_EQ(String((const char*)body.Buffer(), body.Size()), paths[i]);
+        }
+    }
+
+    /// Pumps the framework until @c server has received @c numRequests requests and the client has finished them all.
+    bool WaitForIdle(StandInServer &server, size_t numRequests, float timeoutSeconds = 20.f)
+    {
+        Urho3D::Timer timer;
+        while(timer.GetMSec(false) < (uint)(timeoutSeconds * 1000.f))
+        {
+            ProcessEvents();
+            // Completions are emitted in the same update that stops counting the request as executing.
+            Http::Stats *stats = client->Stats();
+            if (server.NumRequests() >= numRequests && stats && stats->current.pending == 0 && stats->current.executing == 0)
+                return true;
+            Urho3D::Time::Sleep(5);
+        }
+        return false;
+    }
+
+    HttpClient *client;
+    Urho3D::FileSystem *fileSystem;
+    String directory;
+};
+
+TEST_F(HttpTest, ConcurrencyPerHost)
+{
+    ASSERT_TRUE(client != nullptr);
+    StandInServer server(100);
+    ASSERT_TRUE(server.Start());
+
+    client->SetMaxConcurrency(0);
+    client->SetMaxConcurrencyPerHost(2);
+
+    const String hosts[] = { "127.0.0.1", "localhost" };
+    Vector<HttpRequestPtr> requests;
+    Vector<String> paths;
+    for(uint i = 0; i < 12; ++i)
+    {
+        paths.Push("/request" + String(i));
+        requests.Push(client->Get(server.Url(hosts[i % 2], paths.Back())));
+    }
+
+    ASSERT_TRUE(WaitForCompletion(requests));
+    ExpectResponses(requests, paths);
+
+    // Each host is served two requests at a time, and the hosts are limited independently
+    for(uint i = 0; i < 2; ++i)
+        EXPECT_EQ(server.MaxActive(server.Host(hosts[i])), 2) << hosts[i].CString();
+    EXPECT_LE(server.MaxActive(), 4);
+}
+
+TEST_F(HttpTest, ConcurrencyInTotal)
+{
+    ASSERT_TRUE(client != nullptr);
+    StandInServer server(100);
+    ASSERT_TRUE(server.Start());
+
+    client->SetMaxConcurrency(3);
+    client->SetMaxConcurrencyPerHost(0);
+
+    Vector<HttpRequestPtr> requests;
+    Vector<String> paths;
+    for(uint i = 0; i < 9; ++i)
+    {
+        paths.Push("/total" + String(i));
+        requests.Push(client->Get(server.Url("127.0.0.1", paths.Back())));
+    }
+
+    ASSERT_TRUE(WaitForCompletion(requests));
+    ExpectResponses(requests, paths);
+    EXPECT_EQ(server.MaxActive(), 3);
+
+    // The finished requests no longer count against the limits
+    client->SetMaxConcurrencyPerHost(1);
+    requests.Clear();
+    paths.Clear();
+    for(uint i = 0; i < 3; ++i)
+    {
+        paths.Push("/again" + String(i));
+        requests.Push(client->Get(server.Url("127.0.0.1", paths.Back())));
+    }
+    ASSERT_TRUE(WaitForCompletion(requests));
+    ExpectResponses(requests, paths);
+}
+
+TEST_F(HttpTest, NotModifiedFromCache)
+{
+    ASSERT_TRUE(client != nullptr);
+    StandInServer server(0);
+    ASSERT_TRUE(server.Start());
+    server.SetResource("/cached.txt", "fresh content", "\"v1\"");
+
+    const String cacheFile = directory + "cached.txt";
+    ASSERT_TRUE(WriteFile(cacheFile, "cached content"));
+
+    // A matching entity tag is answered without a body and the cache file is used instead
+    HttpRequestPtr request = client->Get(server.Url("127.0.0.1", "/cached.txt"));
+    request->SetCacheFile(cacheFile, false);
+    request->SetCacheETag("\"v1\"");
+    ASSERT_TRUE(WaitForCompletion(request));
+    EXPECT_EQ(request->StatusCode(), 304) << request->Error().CString();
+    EXPECT_EQ(Body(request), "cached content");
+    ASSERT_EQ(server.Requests("/cached.txt").size(), 1U);
+    EXPECT_EQ(RequestHeader(server.Requests("/cached.txt")[0], "If-None-Match"), "\"v1\"");
+
+    // A changed entity is sent in full and replaces the cache file
+    request = client->Get(server.Url("127.0.0.1", "/cached.txt"));
+    request->SetCacheFile(cacheFile, false);
+    request->SetCacheETag("\"v0\"");
+    ASSERT_TRUE(WaitForCompletion(request));
+    EXPECT_EQ(request->StatusCode(), 200) << request->Error().CString();
+    EXPECT_EQ(Body(request), "fresh content");
+    EXPECT_EQ(request->ResponseHeader("ETag"), "\"v1\"");
+    EXPECT_EQ(ReadFile(cacheFile), "fresh content");
+}
+
+TEST_F(HttpTest, ResumePartialDownload)
+{
+    ASSERT_TRUE(client != nullptr);
+    StandInServer server(0);
+    ASSERT_TRUE(server.Start());
+    const std::string body = LargeBody();
+    server.SetResource("/large.bin", body, "\"v1\"");
+
+    const String resumeFile = directory + "large.bin.partial";
+    ASSERT_TRUE(WriteResumeFile(resumeFile, "\"v1\"", body.substr(0, 1000)));
+
+    // The download continues from the received part, which is combined with the rest of the body
+    HttpRequestPtr request = client->Get(server.Url("127.0.0.1", "/large.bin"));
+    request->SetResumeFile(resumeFile, 1);
+    ASSERT_TRUE(WaitForCompletion(request));
+    EXPECT_EQ(request->StatusCode(), 206) << request->Error().CString();
+    EXPECT_TRUE(request->Error().Empty()) << request->Error().CString();
+    EXPECT_TRUE(Body(request) == body);
+    ASSERT_EQ(server.Requests("/large.bin").size(), 1U);
+    EXPECT_EQ(RequestHeader(server.Requests("/large.bin")[0], "Range"), "bytes=1000-");
+    EXPECT_EQ(RequestHeader(server.Requests("/large.bin")[0], "If-Range"), "\"v1\"");
+    EXPECT_FALSE(fileSystem->FileExists(resumeFile));
+}
+
+TEST_F(HttpTest, ResumeValidatorMismatch)
+{
+    ASSERT_TRUE(client != nullptr);
+    StandInServer server(0);
+    ASSERT_TRUE(server.Start());
+    const std::string body = LargeBody();
+    server.SetResource("/large.bin", body, "\"v2\"");
+
+    // The received part belongs to an older version of the entity
+    const String resumeFile = directory + "large.bin.partial";
+    ASSERT_TRUE(WriteResumeFile(resumeFile, "\"v1\"", std::string(1000, 'x')));
+
+    HttpRequestPtr request = client->Get(server.Url("127.0.0.1", "/large.bin"));
+    request->SetResumeFile(resumeFile, 1);
+    ASSERT_TRUE(WaitForCompletion(request));
+
+    // The server sends the full body instead of a range, and the stale part is discarded
+    EXPECT_EQ(request->StatusCode(), 200) << request->Error().CString();
+    EXPECT_TRUE(Body(request) == body);
+    ASSERT_EQ(server.Requests("/large.bin").size(), 1U);
+    EXPECT_EQ(RequestHeader(server.Requests("/large.bin")[0], "Range"), "bytes=1000-");
+    EXPECT_FALSE(fileSystem->FileExists(resumeFile));
+}
+
+TEST_F(HttpTest, ResumeFileRemovedAfterFinish)
+{
+    ASSERT_TRUE(client != nullptr);
+    StandInServer server(0);
+    ASSERT_TRUE(server.Start());
+    const std::string body = LargeBody();
+    server.SetResource("/large.bin", body, "\"v1\"");
+
+    // The body is streamed to the resume file while downloading, and the file is removed once the request is done
+    const String resumeFile = directory + "large.bin.partial";
+    HttpRequestPtr request = client->Get(server.Url("127.0.0.1", "/large.bin"));
+    request->SetResumeFile(resumeFile, 1);
+    ASSERT_TRUE(WaitForCompletion(request));
+    EXPECT_EQ(request->StatusCode(), 200) << request->Error().CString();
+    EXPECT_TRUE(Body(request) == body);
+    EXPECT_TRUE(RequestHeader(server.Requests("/large.bin")[0], "Range").empty());
+    EXPECT_FALSE(fileSystem->FileExists(resumeFile));
+}
+
+TEST_F(HttpTest, RevalidateCachedAssets)
+{
+    ASSERT_TRUE(client != nullptr);
+    AssetCache *cache = framework->Asset()->Cache();
+    SharedPtr<HttpAssetProvider> provider = framework->Asset()->AssetProvider<HttpAssetProvider>();
+    ASSERT_TRUE(cache != nullptr);
+    ASSERT_TRUE(provider != nullptr);
+
+    StandInServer server(0);
+    ASSERT_TRUE(server.Start());
+    server.SetResource("/unchanged.txt", "unchanged", "\"u1\"");
+    server.SetResource("/changed.txt", "changed on server", "\"c2\"");
+
+    const String unchangedRef = server.Url("127.0.0.1", "/unchanged.txt");
+    const String changedRef = server.Url("127.0.0.1", "/changed.txt");
+    const String uncachedRef = server.Url("127.0.0.1", "/uncached.txt");
+    const std::string unchanged = "unchanged", stale = "stale";
+    ASSERT_FALSE(cache->StoreAsset((const u8*)unchanged.c_str(), (uint)unchanged.size(), unchangedRef).Empty());
+    ASSERT_FALSE(cache->StoreAsset((const u8*)stale.c_str(), (uint)stale.size(), changedRef).Empty());
+    cache->SetETag(unchangedRef, "\"u1\"");
+    cache->SetETag(changedRef, "\"c1\"");
+
+    // Refs that are not in the cache are not revalidated
+    StringVector refs;
+    refs.Push(unchangedRef);
+    refs.Push(changedRef);
+    refs.Push(uncachedRef);
+    EXPECT_EQ(provider->RevalidateCachedAssets(refs), 2U);
+    const bool idle = WaitForIdle(server, 2);
+
+    // The changed asset has been written to the cache
+    const String changedETag = cache->ETag(changedRef);
+    const String changedFile = cache->FindInCache(changedRef);
+    const std::string changedData = (changedFile.Empty() ? std::string() : ReadFile(changedFile));
+
+    // Both are then served from the cache without another round trip
+    framework->Asset()->RequestAsset(unchangedRef, "Binary");
+    framework->Asset()->RequestAsset(changedRef, "Binary");
+    SharedPtr<BinaryAsset> unchangedAsset, changedAsset;
+    Urho3D::Timer timer;
+    while(timer.GetMSec(false) < 5000 && !(unchangedAsset && unchangedAsset->IsLoaded() && changedAsset && changedAsset->IsLoaded()))
+    {
+        ProcessEvents();
+        unchangedAsset = framework->Asset()->FindAsset<BinaryAsset>(unchangedRef);
+        changedAsset = framework->Asset()->FindAsset<BinaryAsset>(changedRef);
+        Urho3D::Time::Sleep(5);
+    }
+    const size_t numRequests = server.NumRequests();
+    std::vector<std::string> unchangedRequests = server.Requests("/unchanged.txt");
+
+    // Cleanup cache before any asserts can exit prematurely
+    cache->DeleteAsset(unchangedRef);
+    cache->DeleteAsset(changedRef);
+
+    ASSERT_TRUE(idle);
+    EXPECT_EQ(changedETag, "\"c2\"");
+    EXPECT_EQ(changedData, "changed on server");
+    ASSERT_EQ(unchangedRequests.size(), 1U);
+    EXPECT_EQ(RequestHeader(unchangedRequests[0], "If-None-Match"), "\"u1\"");
+    EXPECT_TRUE(server.Requests("/uncached.txt").empty());
+
+    ASSERT_TRUE(unchangedAsset && unchangedAsset->IsLoaded());
+    ASSERT_TRUE(changedAsset && changedAsset->IsLoaded());
+    EXPECT_EQ(std::string((const char*)unchangedAsset->data.Buffer(), unchangedAsset->data.Size()), unchanged);
+    EXPECT_EQ(std::string((const char*)changedAsset->data.Buffer(), changedAsset->data.Size()), "changed on server");
+    EXPECT_EQ(numRequests, 2U);
+}
+
+TUNDRA_TEST_MAIN();
@@ -0,0 +1,396 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "TestRunner.h"
+#include "TestBenchmark.h"
+
+#include "AssetAPI.h"
+#include "MeshOptimization.h"
+#include "MeshSimplification.h"
+#include "Ogre/OgreMeshAsset.h"
+
+#include <Urho3D/Container/Swap.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Graphics/Geometry.h>
+#include <Urho3D/Graphics/IndexBuffer.h>
+#include <Urho3D/Graphics/Model.h>
+#include <Urho3D/Graphics/VertexBuffer.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/Math/Random.h>
+
+#include <cstring>
+
+using namespace Tundra;
+using namespace Tundra::Test;
+
+/** Ogre mesh conversion tests. The vectorized vertex conversion is compared against the scalar reference conversion,
+    and the memory saved by compact index buffers is reported. The converted mesh cache and LOD generation are disabled
+    during the conversion tests. The mesh simplification tests check the triangle count and error targets of SimplifyMesh,
+    and the vertex cache tests report the ACMR and ATVR before and after the vertex cache optimization. */
+
+namespace
+{
+    const char *MeshFiles[] = {
+        "Scenes/Avatar/Jack.mesh",
+        "Scenes/Avatar/fish.mesh",
+        "Scenes/Avatar/WoodPallet.mesh",
+        "Scenes/Physics/assets/boxA.mesh"
+    };
+    const int NumLoads = 20;
+
+    /// Closed unit sphere without duplicate vertices, so that every vertex can be simplified.
+    void CreateSphere(uint rings, uint segments, PODVector<Urho3D::Vector3> &vertices, PODVector<unsigned> &indices)
+    {
+        vertices.Push(Urho3D::Vector3(0.0f, 1.0f, 0.0f));
+        for(uint r = 1; r < rings; ++r)
+            for(uint s = 0; s < segments; ++s)
+            {
+                const float theta = math::pi * r / rings, phi = 2.0f * math::pi * s / segments;
+                vertices.Push(Urho3D::Vector3(math::Sin(theta) * math::Cos(phi), math::Cos(theta), math::Sin(theta) * math::Sin(phi)));
+            }
+        vertices.Push(Urho3D::Vector3(0.0f, -1.0f, 0.0f));
+
+        const unsigned bottom = vertices.Size() - 1;
+        for(uint s = 0; s < segments; ++s)
+        {
+            const unsigned next = (s + 1) % segments;
+            indices.Push(0); indices.Push(1 + next); indices.Push(1 + s);
+            const unsigned last = 1 + (rings - 2) * segments;
+            indices.Push(bottom); indices.Push(last + s); indices.Push(last + next);
+        }
+        for(uint r = 0; r < rings - 2; ++r)
+            for(uint s = 0; s < segments; ++s)
+            {
+                const unsigned a = 1 + r * segments + s, b = 1 + r * segments + (s + 1) % segments;
+                const unsigned c = a + segments, d = b + segments;
+                indices.Push(a); indices.Push(b); indices.Push(c);
+                indices.Push(b); indices.Push(d); indices.Push(c);
+            }
+    }
+}
+
+class OgreMeshConversion : public Runner
+{
+protected:
+    void SetUp() override
+    {
+        Runner::SetUp();
+        originalOptions = OgreMeshAsset::ConversionOptions();
+        originalLodSettings = IMeshAsset::LodSettings();
+        MeshLodSettings lodSettings;
+        lodSettings.enabled = false;
+        IMeshAsset::SetLodSettings(lodSettings);
+    }
+
+    void TearDown() override
+    {
+        OgreMeshAsset::SetConversionOptions(originalOptions);
+        IMeshAsset::SetLodSettings(originalLodSettings);
+        Runner::TearDown();
+    }
+
+    /// Reads the Ogre mesh file from the working directory.
+    PODVector<u8> ReadMeshFile(const String &fileName)
+    {
+        PODVector<u8> data;
+        Urho3D::File file(context.Get(), fileName, Urho3D::FILE_READ);
+        if (file.IsOpen() && file.GetSize())
+        {
+            data.Resize(file.GetSize());
+            file.Read(&data[0], data.Size());
+        }
+        return data;
+    }
+
+    /// Converts the mesh data with the given options. Returns null on failure.
+    SharedPtr<OgreMeshAsset> Convert(const PODVector<u8> &data, bool vectorized, bool compactIndices, bool optimizeVertexCache = true)
+    {
+        OgreMeshConversionOptions options;
+        options.vectorized = vectorized;
+        options.compactIndices = compactIndices;
+        options.optimizeVertexCache = optimizeVertexCache;
+        options.useCache = false;
+        OgreMeshAsset::SetConversionOptions(options);
+
+        const String name = "OgreMeshConversion" + String(++assetCounter) + ".mesh";
+        SharedPtr<OgreMeshAsset> asset = Urho3D::DynamicCast<OgreMeshAsset>(framework->Asset()->CreateNewAsset("OgreMesh", name));
+        if (!asset || !asset->LoadFromFileInMemory(&data[0], data.Size(), false) || !asset->UrhoModel())
+            return SharedPtr<OgreMeshAsset>();
+        return asset;
+    }
+
+    OgreMeshConversionOptions originalOptions;
+    MeshLodSettings originalLodSettings;
+    static uint assetCounter;
+};
+
+uint OgreMeshConversion::assetCounter = 0;
+
+TEST_F(OgreMeshConversion, VectorizedMatchesScalar)
+{
+    foreach_std(const char *fileName, MeshFiles)
+    {
+        const PODVector<u8> data = ReadMeshFile(fileName);
+        ASSERT_FALSE(data.Empty()) << fileName;
+
+        SharedPtr<OgreMeshAsset> scalar = Convert(data, false, true);
+        SharedPtr<OgreMeshAsset> vectorized = Convert(data, true, true);
+        ASSERT_TRUE(scalar != nullptr) << fileName;
+        ASSERT_TRUE(vectorized != nullptr) << fileName;
+
+        const Vector<SharedPtr<Urho3D::VertexBuffer> > &scalarVbs = scalar->UrhoModel()->GetVertexBuffers();
+        const Vector<SharedPtr<Urho3D::VertexBuffer> > &vectorizedVbs = vectorized->UrhoModel()->GetVertexBuffers();
+        ASSERT_EQ(scalarVbs.Size(), vectorizedVbs.Size()) << fileName;
+        for(uint i = 0; i < scalarVbs.Size(); ++i)
+        {
+            ASSERT_EQ(scalarVbs[i]->GetElementMask(), vectorizedVbs[i]->GetElementMask()) << fileName;
+            ASSERT_EQ(scalarVbs[i]->GetVertexCount(), vectorizedVbs[i]->GetVertexCount()) << fileName;
+            const uint size = scalarVbs[i]->GetVertexCount() * scalarVbs[i]->GetVertexSize();
+            EXPECT_EQ(0, memcmp(scalarVbs[i]->GetShadowData(), vectorizedVbs[i]->GetShadowData(), size)) << fileName << " vertex buffer " << i;
+        }
+
+        const Urho3D::BoundingBox &scalarBox = scalar->UrhoModel()->GetBoundingBox();
+        const Urho3D::BoundingBox &vectorizedBox = vectorized->UrhoModel()->GetBoundingBox();
+        EXPECT_TRUE(scalarBox.min_ == vectorizedBox.min_ && scalarBox.max_ == vectorizedBox.max_) << fileName;
+
+        framework->Asset()->ForgetAsset(scalar, false);
+        framework->Asset()->ForgetAsset(vectorized, false);
+    }
+}
+
+TEST_F(OgreMeshConversion, CompactIndices)
+{
+    uint totalSaved = 0;
+    foreach_std(const char *fileName, MeshFiles)
+    {
+        const PODVector<u8> data = ReadMeshFile(fileName);
+        ASSERT_FALSE(data.Empty()) << fileName;
+
+        SharedPtr<OgreMeshAsset> original = Convert(data, true, false);
+        SharedPtr<OgreMeshAsset> compact = Convert(data, true, true);
+        ASSERT_TRUE(original != nullptr) << fileName;
+        ASSERT_TRUE(compact != nullptr) << fileName;
+
+        // The compact index buffers must contain the same indices
+        const Vector<SharedPtr<Urho3D::IndexBuffer> > &originalIbs = original->UrhoModel()->GetIndexBuffers();
+        const Vector<SharedPtr<Urho3D::IndexBuffer> > &compactIbs = compact->UrhoModel()->GetIndexBuffers();
+        ASSERT_EQ(originalIbs.Size(), compactIbs.Size()) << fileName;
+        for(uint i = 0; i < originalIbs.Size(); ++i)
+        {
+            ASSERT_EQ(originalIbs[i]->GetIndexCount(), compactIbs[i]->GetIndexCount()) << fileName;
+            EXPECT_LE(compactIbs[i]->GetIndexSize(), originalIbs[i]->GetIndexSize()) << fileName;
+            for(uint j = 0; j < originalIbs[i]->GetIndexCount(); ++j)
+            {
+                const u8 *originalData = originalIbs[i]->GetShadowData();
+                const u8 *compactData = compactIbs[i]->GetShadowData();
+                const uint originalIndex = originalIbs[i]->GetIndexSize() == 4 ? ((const u32*)originalData)[j] : ((const u16*)originalData)[j];
+                const uint compactIndex = compactIbs[i]->GetIndexSize() == 4 ? ((const u32*)compactData)[j] : ((const u16*)compactData)[j];
+                ASSERT_EQ(originalIndex, compactIndex) << fileName;
+            }
+        }
+
+        const uint saved = original->GpuMemoryUsage() - compact->GpuMemoryUsage();
+        totalSaved += saved;
+        Log(PadString(String(fileName), 36) + PadString(String(original->GpuMemoryUsage()) + " bytes", -14) + " -> " +
+            PadString(String(compact->GpuMemoryUsage()) + " bytes", -14) + "  saved " + String(saved) + " bytes", 2);
+
+        framework->Asset()->ForgetAsset(original, false);
+        framework->Asset()->ForgetAsset(compact, false);
+    }
+    Log("Total saved " + String(totalSaved) + " bytes", 2);
+}
+
+TEST_F(OgreMeshConversion, ConversionTime)
+{
+    foreach_std(const char *fileName, MeshFiles)
+    {
+        const PODVector<u8> data = ReadMeshFile(fileName);
+        ASSERT_FALSE(data.Empty()) << fileName;
+
+        double times[2];
+        for(int j = 0; j < 2; ++j)
+        {
+            const bool vectorized = (j == 0);
+            Urho3D::HiresTimer timer;
+            for(int i = 0; i < NumLoads; ++i)
+            {
+                SharedPtr<OgreMeshAsset> asset = Convert(data, vectorized, true);
+                ASSERT_TRUE(asset != nullptr) << fileName;
+                framework->Asset()->ForgetAsset(asset, false);
+            }
+            times[j] = (double)timer.GetUSec(false) / NumLoads;
+        }
+        Log(PadString(String(fileName), 36) + "vectorized " + PadString(Tundra::Benchmark::FormatTime(times[0] * math::Clock::TicksPerSec() / 1000000.0), -10) +
+            "  scalar " + PadString(Tundra::Benchmark::FormatTime(times[1] * math::Clock::TicksPerSec() / 1000000.0), -10), 2);
+    }
+}
+
+TEST_F(OgreMeshConversion, SimplifySphere)
+{
+    PODVector<Urho3D::Vector3> vertices;
+    PODVector<unsigned> indices;
+    CreateSphere(64, 128, vertices, indices);
+    const u8 *positions = reinterpret_cast<const u8*>(&vertices[0]);
+
+    // A smooth sphere reaches all the targets with a small error relative to its radius
+    const float ratios[] = { 0.5f, 0.25f, 0.1f };
+    foreach_std(float ratio, ratios)
+    {
+        const uint target = (uint)(indices.Size() * ratio) / 3 * 3;
+        float error = 0.0f;
+        PODVector<unsigned> result = SimplifyMesh(indices, positions, sizeof(Urho3D::Vector3), vertices.Size(), target, 0.05f, &error);
+        EXPECT_LE(result.Size(), target) << ratio;
+        EXPECT_EQ(0U, result.Size() % 3);
+        EXPECT_LE(error, 0.05f) << ratio;
+        Log(PadString("Sphere " + String(ratio), 16) + PadString(String(result.Size() / 3) + " / " + String(indices.Size() / 3) + " triangles", -26) +
+            "  error " + String(error), 2);
+    }
+
+    // The error limit stops the simplification before the target
+    float error = 0.0f;
+    PODVector<unsigned> limited = SimplifyMesh(indices, positions, sizeof(Urho3D::Vector3), vertices.Size(), 0, 0.001f, &error);
+    EXPECT_GT(limited.Size(), indices.Size() / 10);
+    EXPECT_LE(error, 0.001f);
+}
+
+TEST_F(OgreMeshConversion, SimplifyPlane)
+{
+    // A flat grid collapses to its two corner triangles without error, as its borders stay straight
+    const uint gridSize = 32;
+    PODVector<Urho3D::Vector3> vertices;
+    PODVector<unsigned> indices;
+    for(uint z = 0; z <= gridSize; ++z)
+        for(uint x = 0; x <= gridSize; ++x)
+            vertices.Push(Urho3D::Vector3((float)x, 0.0f, (float)z));
+    for(uint z = 0; z < gridSize; ++z)
+        for(uint x = 0; x < gridSize; ++x)
+        {
+            const unsigned i = z * (gridSize + 1) + x;
+            indices.Push(i); indices.Push(i + gridSize + 1); indices.Push(i + 1);
+            indices.Push(i + 1); indices.Push(i + gridSize + 1); indices.Push(i + gridSize + 2);
+        }
+
+    float error = 1.0f;
+    PODVector<unsigned> result = SimplifyMesh(indices, reinterpret_cast<const u8*>(&vertices[0]), sizeof(Urho3D::Vector3), vertices.Size(), 6, 0.001f, &error);
+    EXPECT_EQ(6U, result.Size());
+    EXPECT_LE(error, 0.001f);
+}
+
+TEST_F(OgreMeshConversion, GenerateLodLevels)
+{
+    MeshLodSettings lodSettings;
+    lodSettings.minTriangles = 0;
+    IMeshAsset::SetLodSettings(lodSettings);
+
+    foreach_std(const char *fileName, MeshFiles)
+    {
+        const PODVector<u8> data = ReadMeshFile(fileName);
+        ASSERT_FALSE(data.Empty()) << fileName;
+        SharedPtr<OgreMeshAsset> asset = Convert(data, true, true);
+        ASSERT_TRUE(asset != nullptr) << fileName;
+
+        Urho3D::Model *model = asset->UrhoModel();
+        for(uint i = 0; i < model->GetNumGeometries(); ++i)
+        {
+            String levels;
+            for(uint l = 0; l < model->GetNumGeometryLodLevels(i); ++l)
+            {
+                Urho3D::Geometry *geometry = model->GetGeometry(i, l);
+                ASSERT_TRUE(geometry != nullptr);
+                levels += " " + String(geometry->GetIndexCount() / 3);
+                if (l > 0)
+                {
+                    // Each level is simpler and taken into use farther away than the previous one
+                    EXPECT_LT(geometry->GetIndexCount(), model->GetGeometry(i, l - 1)->GetIndexCount()) << fileName;
+                    EXPECT_GT(geometry->GetLodDistance(), model->GetGeometry(i, l - 1)->GetLodDistance()) << fileName;
+                    EXPECT_EQ(geometry->GetVertexBuffer(0), model->GetGeometry(i, 0)->GetVertexBuffer(0)) << fileName;
+                }
+            }
+            Log(PadString(String(fileName), 36) + "submesh " + String(i) + " triangles" + levels, 2);
+        }
+
+        framework->Asset()->ForgetAsset(asset, false);
+    }
+}
+
+TEST_F(OgreMeshConversion, OptimizeVertexCacheGrid)
+{
+    // A grid with its triangles in random order is close to the worst case of 3 vertices per triangle
+    const uint gridSize = 100;
+    PODVector<unsigned> indices;
+    for(uint z = 0; z < gridSize; ++z)
+        for(uint x = 0; x < gridSize; ++x)
+        {
+            const unsigned i = z * (gridSize + 1) + x;
+            indices.Push(i); indices.Push(i + gridSize + 1); indices.Push(i + 1);
+            indices.Push(i + 1); indices.Push(i + gridSize + 1); indices.Push(i + gridSize + 2);
+        }
+    const uint vertexCount = (gridSize + 1) * (gridSize + 1);
+    Urho3D::SetRandomSeed(1);
+    for(uint t = indices.Size() / 3 - 1; t > 0; --t)
+    {
+        const uint other = Urho3D::Rand() % (t + 1);
+        for(uint k = 0; k < 3; ++k)
+            Urho3D::Swap(indices[t * 3 + k], indices[other * 3 + k]);
+    }
+
+    const VertexCacheStatistics before = AnalyzeVertexCache(indices, vertexCount);
+    PODVector<unsigned> optimized = indices;
+    OptimizeVertexCache(optimized, vertexCount);
+    const VertexCacheStatistics after = AnalyzeVertexCache(optimized, vertexCount);
+
+    EXPECT_EQ(before.triangles, after.triangles);
+    EXPECT_EQ(before.vertices, after.vertices);
+    EXPECT_LT(after.Acmr(), 0.8f);
+    EXPECT_LT(after.Atvr(), before.Atvr());
+    Log("Grid ACMR " + String(before.Acmr()) + " -> " + String(after.Acmr()) + "  ATVR " + String(before.Atvr()) + " -> " + String(after.Atvr()), 2);
+}
+
+TEST_F(OgreMeshConversion, OptimizeVertexCacheMeshes)
+{
+    foreach_std(const char *fileName, MeshFiles)
+    {
+        const PODVector<u8> data = ReadMeshFile(fileName);
+        ASSERT_FALSE(data.Empty()) << fileName;
+
+        SharedPtr<OgreMeshAsset> original = Convert(data, true, true, false);
+        SharedPtr<OgreMeshAsset> optimized = Convert(data, true, true, true);
+        ASSERT_TRUE(original != nullptr) << fileName;
+        ASSERT_TRUE(optimized != nullptr) << fileName;
+
+        Urho3D::Model *originalModel = original->UrhoModel();
+        Urho3D::Model *optimizedModel = optimized->UrhoModel();
+        ASSERT_EQ(originalModel->GetNumGeometries(), optimizedModel->GetNumGeometries()) << fileName;
+        VertexCacheStatistics before, after;
+        for(uint i = 0; i < originalModel->GetNumGeometries(); ++i)
+        {
+            Urho3D::Geometry *originalGeometry = originalModel->GetGeometry(i, 0);
+            Urho3D::Geometry *optimizedGeometry = optimizedModel->GetGeometry(i, 0);
+            ASSERT_EQ(originalGeometry->GetIndexCount(), optimizedGeometry->GetIndexCount()) << fileName;
+            if (originalGeometry->GetPrimitiveType() != Urho3D::TRIANGLE_LIST)
+                continue;
+
+            PODVector<unsigned> indices[2];
+            Urho3D::Geometry *geometries[2] = { originalGeometry, optimizedGeometry };
+            for(uint g = 0; g < 2; ++g)
+            {
+                Urho3D::IndexBuffer *ib = geometries[g]->GetIndexBuffer();
+                const u8 *indexData = ib->GetShadowData() + geometries[g]->GetIndexStart() * ib->GetIndexSize();
+                for(uint j = 0; j < geometries[g]->GetIndexCount(); ++j)
+                    indices[g].Push(ib->GetIndexSize() == 4 ? ((const u32*)indexData)[j] : ((const u16*)indexData)[j]);
+            }
+            before.Add(AnalyzeVertexCache(indices[0], originalGeometry->GetVertexBuffer(0)->GetVertexCount()));
+            after.Add(AnalyzeVertexCache(indices[1], optimizedGeometry->GetVertexBuffer(0)->GetVertexCount()));
+        }
+
+        EXPECT_EQ(before.triangles, after.triangles) << fileName;
+        EXPECT_EQ(before.vertices, after.vertices) << fileName;
+        EXPECT_LE(after.Acmr(), before.Acmr() + 0.05f) << fileName;
+        Log(PadString(String(fileName), 36) + "ACMR " + PadString(String(before.Acmr()), 10) + " -> " + PadString(String(after.Acmr()), 10) +
+            "  ATVR " + PadString(String(before.Atvr()), 10) + " -> " + String(after.Atvr()), 2);
+
+        framework->Asset()->ForgetAsset(original, false);
+        framework->Asset()->ForgetAsset(optimized, false);
+    }
+}
+
+TUNDRA_TEST_MAIN();
@@ -0,0 +1,758 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "TestRunner.h"
+#include "TestBenchmark.h"
+
+#include "Scene.h"
+#include "Entity.h"
+#include "AssetAPI.h"
+#include "IAsset.h"
+#include "JSON/JSON.h"
+
+#include "BulletPhysics.h"
+#include "CollisionShapeCache.h"
+#include "ConvexHull.h"
+#include "IMeshAsset.h"
+#include "PhysicsWorld.h"
+#include "RigidBody.h"
+#include "Placeable.h"
+#include "Terrain.h"
+
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Graphics/Geometry.h>
+#include <Urho3D/Graphics/IndexBuffer.h>
+#include <Urho3D/Graphics/Model.h>
+#include <Urho3D/Graphics/VertexBuffer.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/VectorBuffer.h>
+
+using namespace Tundra;
+using namespace Tundra::Test;
+
+/** Physics tests and benchmarks. Each benchmark drops a number of dynamic bodies on a ground shape, runs a fixed number of
+    PhysicsWorld::Simulate steps and reports the timings of PhysicsWorld::Statistics. The results of all benchmarks
+    are also written as JSON to PhysicsBenchmark.json in the working directory, for tracking regressions across builds. */
+
+namespace
+{
+    const String GroundMeshRef = "PhysicsBenchmarkGround.mdl";
+    const String OutputFile = "PhysicsBenchmark.json";
+    const int NumSteps = 300;
+    const uint BodyCounts[] = { 250, 1000 };
+
+    /// Min/average/max of a timing over all steps, in milliseconds.
+    struct TimeStatistics
+    {
+        TimeStatistics() : total(0.0), minTime(0.0f), maxTime(0.0f), count(0) {}
+
+        void Add(float time)
+        {
+            total += time;
+            minTime = (count > 0 ? Urho3D::Min(minTime, time) : time);
+            maxTime = Urho3D::Max(maxTime, time);
+            ++count;
+        }
+
+        float Average() const { return count > 0 ? (float)(total / count) : 0.0f; }
+
+        JSONValue ToJSON() const
+        {
+            JSONValue value;
+            value["average"] = Average();
+            value["min"] = minTime;
+            value["max"] = maxTime;
+            return value;
+        }
+
+        double total;
+        float minTime;
+        float maxTime;
+        uint count;
+    };
+
+    struct CollisionCounter
+    {
+        CollisionCounter() : count(0) {}
+
+        void OnCollision(Entity*, Entity*, const float3&, const float3&, float, float, bool) { ++count; }
+
+        uint count;
+    };
+
+    /// Results of all benchmarks run by this process.
+    JSONArray results;
+}
+
+/// Physics test fixture. Provides the physics world of the runner scene and the ground shapes to test against.
+class PhysicsTest : public Runner
+{
+protected:
+    enum Ground
+    {
+        BoxGround,
+        TriMeshGround,
+        HeightFieldGround
+    };
+
+    void SetUp() override
+    {
+        Runner::SetUp();
+
+        // Remove tundra.json hardcoded scene ents
+        scene->RemoveAllEntities();
+        world = scene->Subsystem<PhysicsWorld>();
+    }
+
+    void TearDown() override
+    {
+        world.Reset();
+        Runner::TearDown();
+    }
+
+    /// Creates the static ground and waits for its collision shape to be ready.
+    void CreateGround(Ground ground)
+    {
+        EntityPtr entity = scene->CreateEntity(0, StringVector(), AttributeChange::Default, false, false);
+        SharedPtr<Placeable> placeable = entity->CreateComponent<Placeable>();
+        SharedPtr<RigidBody> body;
+
+        if (ground == HeightFieldGround)
+        {
+            // 128 x 128 meter terrain with gentle hills, centered at the origin
+            const uint numPatches = 8;
+            placeable->transform.Set(Transform(float3(-64.0f, 0.0f, -64.0f), float3::zero, float3::one), AttributeChange::Default);
+            SharedPtr<Terrain> terrain = entity->CreateComponent<Terrain>();
+            terrain->Resize(numPatches, numPatches);
+            for(uint y = 0; y < terrain->VerticesHeight(); ++y)
+                for(uint x = 0; x < terrain->VerticesWidth(); ++x)
+                    terrain->SetPointHeight(x, y, 2.0f * math::Sin(x * 0.1f) * math::Cos(y * 0.1f));
+            terrain->RegenerateDirtyTerrainPatches();
+
+            body = entity->CreateComponent<RigidBody>();
+            body->shapeType.Set(RigidBody::HeightField, AttributeChange::Default);
+        }
+        else if (ground == TriMeshGround)
+        {
+            CreateGroundMesh();
+            body = entity->CreateComponent<RigidBody>();
+            body->shapeType.Set(RigidBody::TriMesh, AttributeChange::Default);
+            body->collisionMeshRef.Set(AssetReference(GroundMeshRef, "UrhoMesh"), AttributeChange::Default);
+        }
+        else
+        {
+            placeable->transform.Set(Transform(float3(0.0f, -0.5f, 0.0f), float3::zero, float3::one), AttributeChange::Default);
+            body = entity->CreateComponent<RigidBody>();
+            body->shapeType.Set(RigidBody::Box, AttributeChange::Default);
+            body->size.Set(float3(100.0f, 1.0f, 100.0f), AttributeChange::Default);
+        }
+
+        // Mesh assets and their collision shapes are loaded asynchronously
+        world->SetRunning(false);
+        for(int i = 0; i < 1000 && !body->ShapeAABB().IsFinite(); ++i)
+            ProcessEvents();
+        world->SetRunning(true);
+        ASSERT_TRUE(body->ShapeAABB().IsFinite());
+    }
+
+    /// Creates a tessellated, bumpy 100 x 100 meter plane mesh asset for the triangle mesh ground, or loads it again if it exists.
+    void CreateGroundMesh(float bumpHeight = 0.5f)
+    {
+        const uint gridSize = 64;
+        const float cellSize = 100.0f / gridSize;
+
+        PODVector<float> vertices;
+        for(uint z = 0; z <= gridSize; ++z)
+            for(uint x = 0; x <= gridSize; ++x)
+            {
+                vertices.Push(x * cellSize - 50.0f);
+                vertices.Push(math::Sin(x * 0.5f) * math::Cos(z * 0.5f) * bumpHeight);
+                vertices.Push(z * cellSize - 50.0f);
+            }
+        PODVector<unsigned> indices;
+        for(uint z = 0; z < gridSize; ++z)
+            for(uint x = 0; x < gridSize; ++x)
+            {
+                const unsigned i = z * (gridSize + 1) + x;
+                indices.Push(i); indices.Push(i + gridSize + 1); indices.Push(i + 1);
+                indices.Push(i + 1); indices.Push(i + gridSize + 1); indices.Push(i + gridSize + 2);
+            }
+
+        Urho3D::Context *ctx = context.Get();
+        SharedPtr<Urho3D::VertexBuffer> vb(new Urho3D::VertexBuffer(ctx));
+        vb->SetShadowed(true);
+        vb->SetSize(vertices.Size() / 3, Urho3D::MASK_POSITION);
+        vb->SetData(&vertices[0]);
+        SharedPtr<Urho3D::IndexBuffer> ib(new Urho3D::IndexBuffer(ctx));
+        ib->SetShadowed(true);
+        ib->SetSize(indices.Size(), true);
+        ib->SetData(&indices[0]);
+        SharedPtr<Urho3D::Geometry> geom(new Urho3D::Geometry(ctx));
+        geom->SetVertexBuffer(0, vb);
+        geom->SetIndexBuffer(ib);
+        geom->SetDrawRange(Urho3D::TRIANGLE_LIST, 0, ib->GetIndexCount());
+
+        SharedPtr<Urho3D::Model> model(new Urho3D::Model(ctx));
+        model->SetNumGeometries(1);
+        model->SetNumGeometryLodLevels(0, 1);
+        model->SetGeometry(0, 0, geom);
+        model->SetBoundingBox(Urho3D::BoundingBox(Urho3D::Vector3(-50.0f, -bumpHeight, -50.0f), Urho3D::Vector3(50.0f, bumpHeight, 50.0f)));
+        Vector<SharedPtr<Urho3D::VertexBuffer> > vbs;
+        vbs.Push(vb);
+        Vector<SharedPtr<Urho3D::IndexBuffer> > ibs;
+        ibs.Push(ib);
+        PODVector<unsigned> morphRanges;
+        morphRanges.Push(0);
+        model->SetVertexBuffers(vbs, morphRanges, morphRanges);
+        model->SetIndexBuffers(ibs);
+
+        Urho3D::VectorBuffer data;
+        ASSERT_TRUE(model->Save(data));
+        AssetPtr asset = framework->Asset()->FindAsset(GroundMeshRef);
+        if (!asset)
+            asset = framework->Asset()->CreateNewAsset("UrhoMesh", GroundMeshRef);
+        ASSERT_TRUE(asset != nullptr);
+        ASSERT_TRUE(asset->LoadFromFileInMemory(static_cast<const u8*>(data.GetData()), data.GetSize(), false));
+    }
+
+    SharedPtr<PhysicsWorld> world;
+};
+
+/// Physics benchmark fixture. Drops dynamic bodies on a ground and records the timings of the simulation.
+class PhysicsBenchmark : public PhysicsTest
+{
+protected:
+    /// Creates dynamic bodies in layers of 20 x 20 above the ground. Alternates boxes and spheres if mixed.
+    void CreateBodies(uint count, RigidBody::ShapeType shapeType, bool mixed)
+    {
+        const uint perRow = 20;
+        const float spacing = 1.5f;
+        for(uint i = 0; i < count; ++i)
+        {
+            const uint layer = i / (perRow * perRow);
+            const uint row = (i / perRow) % perRow;
+            const uint column = i % perRow;
+            // Offset the layers slightly so that the stacks topple
+            const float offset = (float)((i * 7) % 5) * 0.05f;
+            const float3 pos((column - perRow * 0.5f) * spacing + offset, 5.0f + layer * spacing, (row - perRow * 0.5f) * spacing + offset);
+
+            EntityPtr entity = scene->CreateEntity(0, StringVector(), AttributeChange::Default, false, false);
+            SharedPtr<Placeable> placeable = entity->CreateComponent<Placeable>();
+            placeable->transform.Set(Transform(pos, float3::zero, float3::one), AttributeChange::Default);
+            SharedPtr<RigidBody> body = entity->CreateComponent<RigidBody>();
+            body->shapeType.Set((mixed && (i % 2)) ? RigidBody::Sphere : shapeType, AttributeChange::Default);
+            body->size.Set(float3::one, AttributeChange::Default);
+            body->mass.Set(1.0f, AttributeChange::Default);
+        }
+    }
+
+    /// Simulates NumSteps steps, logs the results and adds them to the JSON output.
+    void Run(const String &name, uint numBodies)
+    {
+        CollisionCounter counter;
+        world->PhysicsCollision.Connect(&counter, &CollisionCounter::OnCollision);
+
+        TimeStatistics simulateTime, stepTime, postTickTime, transformUpdateTime;
+        uint subSteps = 0, collisionSignals = 0, maxCollidingPairs = 0, transformUpdates = 0;
+        const float frameTime = world->PhysicsUpdatePeriod();
+
+        Urho3D::HiresTimer timer;
+        for(int i = 0; i < NumSteps; ++i)
+        {
+            timer.Reset();
+            world->Simulate(frameTime);
+            simulateTime.Add(timer.GetUSec(false) / 1000.0f);
+
+            const PhysicsStatistics &stats = world->Statistics();
+            stepTime.Add(stats.stepTime);
+            postTickTime.Add(stats.postTickTime);
+            transformUpdateTime.Add(stats.transformUpdateTime);
+            subSteps += stats.subSteps;
+            collisionSignals += stats.collisionSignals;
+            maxCollidingPairs = Urho3D::Max(maxCollidingPairs, stats.collidingPairs);
+            transformUpdates += stats.transformUpdates;
+        }
+        world->PhysicsCollision.Disconnect(&counter, &CollisionCounter::OnCollision);
+
+        EXPECT_GT(transformUpdates, 0U);
+        EXPECT_GT(maxCollidingPairs, 0U);
+        EXPECT_EQ(collisionSignals, counter.count);
+
+        Log(PadString(name, 12) + PadString(String(numBodies) + " bodies", 13) +
+            "Step avg " + PadString(Tundra::Benchmark::FormatTime(stepTime.Average() * math::Clock::TicksPerSec() / 1000.0), -10) +
+            "  PostTick avg " + PadString(Tundra::Benchmark::FormatTime(postTickTime.Average() * math::Clock::TicksPerSec() / 1000.0), -10) +
+            "  Transforms avg " + PadString(Tundra::Benchmark::FormatTime(transformUpdateTime.Average() * math::Clock::TicksPerSec() / 1000.0), -10) +
+            "  " + String(collisionSignals) + " collisions", 2);
+
+        JSONValue result;
+        result["scenario"] = name;
+        result["bodies"] = numBodies;
+        result["steps"] = NumSteps;
+        result["simulateTime"] = simulateTime.ToJSON();
+        result["stepTime"] = stepTime.ToJSON();
+        result["postTickTime"] = postTickTime.ToJSON();
+        result["transformUpdateTime"] = transformUpdateTime.ToJSON();
+        result["subSteps"] = subSteps;
+        result["collisionSignals"] = collisionSignals;
+        result["maxCollidingPairs"] = maxCollidingPairs;
+        result["transformUpdates"] = transformUpdates;
+        results.Push(result);
+        WriteResults();
+    }
+
+    /// Writes the results of all benchmarks run so far.
+    void WriteResults()
+    {
+        BulletPhysics *physics = framework->Module<BulletPhysics>();
+        JSONValue output;
+        output["benchmark"] = "Physics";
+        output["timestamp"] = Urho3D::Time::GetTimeStamp().Trimmed();
+        output["physicsThreads"] = physics ? physics->PhysicsThreads() : 1;
+        output["multithreaded"] = world->IsMultithreaded();
+        output["asynchronous"] = world->AsynchronousSimulation();
+        output["updatePeriod"] = world->PhysicsUpdatePeriod();
+        output["results"] = results;
+
+        Urho3D::File file(context.Get(), OutputFile, Urho3D::FILE_WRITE);
+        ASSERT_TRUE(file.IsOpen());
+        const String json = output.ToString();
+        file.Write(json.CString(), json.Length());
+    }
+
+    /// Runs a benchmark for each body count on a fresh scene.
+    void RunAll(const String &name, Ground ground, RigidBody::ShapeType shapeType, bool mixed)
+    {
+        ASSERT_TRUE(world != nullptr);
+        foreach_std(uint count, BodyCounts)
+        {
+            scene->RemoveAllEntities();
+            CreateGround(ground);
+            CreateBodies(count, shapeType, mixed);
+            Run(name, count);
+        }
+    }
+};
+
+TEST_F(PhysicsBenchmark, Boxes)
+{
+    RunAll("Boxes", BoxGround, RigidBody::Box, false);
+}
+
+TEST_F(PhysicsBenchmark, Spheres)
+{
+    RunAll("Spheres", BoxGround, RigidBody::Sphere, false);
+}
+
+TEST_F(PhysicsBenchmark, TriMesh)
+{
+    RunAll("TriMesh", TriMeshGround, RigidBody::Box, true);
+}
+
+TEST_F(PhysicsBenchmark, HeightField)
+{
+    RunAll("HeightField", HeightFieldGround, RigidBody::Box, true);
+}
+
+TEST_F(PhysicsBenchmark, ResizeTerrainDuringAsynchronousStep)
+{
+    ASSERT_TRUE(world != nullptr);
+    world->SetAsynchronousSimulation(true);
+    CreateGround(HeightFieldGround);
+    CreateBodies(250, RigidBody::Box, true);
+
+    EntityVector grounds = scene->EntitiesWithComponent<Terrain>();
+    ASSERT_EQ(grounds.Size(), 1U);
+    SharedPtr<Terrain> terrain = grounds[0]->Component<Terrain>();
+    SharedPtr<RigidBody> body = grounds[0]->Component<RigidBody>();
+    const float oldWidth = body->ShapeAABB().Size().x;
+
+    // Each Simulate leaves a step running on the physics thread, which the heightfield of the old height grid is part of
+    for(int i = 0; i < 10; ++i)
+        world->Simulate(world->PhysicsUpdatePeriod());
+    ASSERT_TRUE(world->IsStepping());
+    terrain->Resize(4, 4);
+    EXPECT_FALSE(world->IsStepping());
+    terrain->RegenerateDirtyTerrainPatches();
+
+    const AABB aabb = body->ShapeAABB();
+    ASSERT_TRUE(aabb.IsFinite());
+    EXPECT_LT(aabb.Size().x, oldWidth * 0.75f);
+
+    // Writing single heights waits for the step as well
+    world->Simulate(world->PhysicsUpdatePeriod());
+    ASSERT_TRUE(world->IsStepping());
+    terrain->SetPointHeight(0, 0, 1.0f);
+    EXPECT_FALSE(world->IsStepping());
+    terrain->RegenerateDirtyTerrainPatches();
+
+    for(int i = 0; i < 10; ++i)
+        world->Simulate(world->PhysicsUpdatePeriod());
+    world->WaitForStep();
+    EXPECT_TRUE(body->ShapeAABB().IsFinite());
+}
+
+/// Batched query tests on the box ground and a 2 meter static box standing on it at x = 10.
+class PhysicsQueryTest : public PhysicsTest
+{
+protected:
+    void SetUp() override
+    {
+        PhysicsTest::SetUp();
+        ASSERT_TRUE(world != nullptr);
+        CreateGround(BoxGround);
+        ground = scene->EntitiesWithComponent<RigidBody>()[0];
+
+        box = scene->CreateEntity(0, StringVector(), AttributeChange::Default, false, false);
+        box->CreateComponent<Placeable>()->transform.Set(Transform(float3(10.0f, 1.0f, 0.0f), float3::zero, float3::one), AttributeChange::Default);
+        SharedPtr<RigidBody> body = box->CreateComponent<RigidBody>();
+        body->shapeType.Set(RigidBody::Box, AttributeChange::Default);
+        body->size.Set(float3(2.0f, 2.0f, 2.0f), AttributeChange::Default);
+        ASSERT_TRUE(body->ShapeAABB().IsFinite());
+    }
+
+    void TearDown() override
+    {
+        ground.Reset();
+        box.Reset();
+        PhysicsTest::TearDown();
+    }
+
+    static void AddQuery(Vector<float> &queries, const float3 &a, const float3 &b)
+    {
+        queries.Push(a.x); queries.Push(a.y); queries.Push(a.z);
+        queries.Push(b.x); queries.Push(b.y); queries.Push(b.z);
+    }
+
+    static void AddRay(Vector<float> &rays, const float3 &origin, const float3 &direction, float length)
+    {
+        AddQuery(rays, origin, direction);
+        rays.Push(length);
+    }
+
+    /// Checks the sweep hits of the downward sweeps above the ground and the box, and the miss of the upward sweep.
+    void ExpectSweepHits(const PhysicsQueryResults &results, float groundDistance, float boxDistance)
+    {
+        ASSERT_EQ(results.entities.Size(), 3U);
+        ASSERT_EQ(results.hits.Size(), 3U * 7U);
+        EXPECT_EQ(results.entities[0].Get(), ground.Get());
+        EXPECT_NEAR(results.hits[0], groundDistance, 0.1f);
+        EXPECT_GT(results.hits[5], 0.9f);
+        EXPECT_EQ(results.entities[1].Get(), box.Get());
+        EXPECT_NEAR(results.hits[7], boxDistance, 0.1f);
+        EXPECT_GT(results.hits[7 + 5], 0.9f);
+        EXPECT_EQ(results.entities[2].Get(), nullptr);
+        EXPECT_LT(results.hits[14], 0.0f);
+    }
+
+    EntityPtr ground;
+    EntityPtr box;
+};
+
+TEST_F(PhysicsQueryTest, RaycastBatch)
+{
+    Vector<float> rays;
+    AddRay(rays, float3(0.0f, 10.0f, 0.0f), float3(0.0f, -1.0f, 0.0f), 20.0f);
+    AddRay(rays, float3(10.0f, 10.0f, 0.0f), float3(0.0f, -2.0f, 0.0f), 20.0f);
+    AddRay(rays, float3(0.0f, 10.0f, 0.0f), float3(0.0f, 1.0f, 0.0f), 20.0f);
+    AddRay(rays, float3(0.0f, 10.0f, 0.0f), float3(0.0f, -1.0f, 0.0f), 5.0f);
+    AddRay(rays, float3(-20.0f, 1.0f, 0.0f), float3(1.0f, 0.0f, 0.0f), 100.0f);
+
+    PhysicsQueryResults results = world->RaycastBatch(rays);
+    ASSERT_EQ(results.entities.Size(), 5U);
+    ASSERT_EQ(results.hits.Size(), 5U * 7U);
+
+    EXPECT_EQ(results.entities[0].Get(), ground.Get());
+    EXPECT_NEAR(results.hits[0], 10.0f, 0.01f);
+    EXPECT_NEAR(results.hits[2], 0.0f, 0.01f);
+    EXPECT_NEAR(results.hits[5], 1.0f, 0.01f);
+    EXPECT_EQ(results.entities[1].Get(), box.Get());
+    EXPECT_NEAR(results.hits[7], 8.0f, 0.01f);
+    EXPECT_EQ(results.entities[2].Get(), nullptr);
+    EXPECT_LT(results.hits[14], 0.0f);
+    EXPECT_EQ(results.entities[3].Get(), nullptr);
+    EXPECT_LT(results.hits[21], 0.0f);
+    EXPECT_EQ(results.entities[4].Get(), box.Get());
+    EXPECT_NEAR(results.hits[28], 29.0f, 0.01f);
+    EXPECT_NEAR(results.hits[32], -1.0f, 0.01f);
+
+    // The batch gives the same hits as the single raycasts
+    for(uint i = 0; i < 5; ++i)
+    {
+        const float *ray = &rays[i * 7];
+        const float *hit = &results.hits[i * 7];
+        PhysicsRaycastResult single = world->Raycast(float3(ray[0], ray[1], ray[2]), float3(ray[3], ray[4], ray[5]), ray[6]);
+        EXPECT_EQ(single.entity, results.entities[i].Get());
+        if (single.entity)
+        {
+            EXPECT_NEAR(single.distance, hit[0], 0.001f);
+            EXPECT_TRUE(single.pos.Equals(float3(hit[1], hit[2], hit[3]), 0.001f));
+            EXPECT_TRUE(single.normal.Equals(float3(hit[4], hit[5], hit[6]), 0.001f));
+        }
+    }
+
+    // Serial and parallel queries agree, and reusing the results resizes them
+    world->SetParallelQueries(!world->ParallelQueries());
+    PhysicsQueryResults reused;
+    Vector<float> singleRay;
+    AddRay(singleRay, float3(0.0f, 10.0f, 0.0f), float3(0.0f, -1.0f, 0.0f), 20.0f);
+    world->RaycastBatch(singleRay, reused);
+    ASSERT_EQ(reused.entities.Size(), 1U);
+    world->RaycastBatch(rays, reused);
+    ASSERT_EQ(reused.entities.Size(), results.entities.Size());
+    for(uint i = 0; i < reused.entities.Size(); ++i)
+        EXPECT_EQ(reused.entities[i].Get(), results.entities[i].Get());
+    for(uint i = 0; i < reused.hits.Size(); ++i)
+        EXPECT_NEAR(reused.hits[i], results.hits[i], 0.001f);
+    world->SetParallelQueries(!world->ParallelQueries());
+
+    // Filtered out by the collision mask
+    world->RaycastBatch(rays, reused, -1, 0);
+    for(uint i = 0; i < reused.entities.Size(); ++i)
+    {
+        EXPECT_EQ(reused.entities[i].Get(), nullptr);
+        EXPECT_LT(reused.hits[i * 7], 0.0f);
+    }
+
+    EXPECT_TRUE(world->RaycastBatch(Vector<float>()).entities.Empty());
+}
+
+TEST_F(PhysicsQueryTest, SphereSweepBatch)
+{
+    Vector<float> sweeps;
+    AddQuery(sweeps, float3(0.0f, 10.0f, 0.0f), float3(0.0f, -10.0f, 0.0f));
+    AddQuery(sweeps, float3(10.0f, 10.0f, 0.0f), float3(10.0f, -10.0f, 0.0f));
+    AddQuery(sweeps, float3(0.0f, 10.0f, 0.0f), float3(0.0f, 30.0f, 0.0f));
+
+    // The hit distance is the distance the sphere center traveled
+    ExpectSweepHits(world->SphereSweepBatch(0.5f, sweeps), 9.5f, 7.5f);
+}
+
+TEST_F(PhysicsQueryTest, BoxSweepBatch)
+{
+    Vector<float> sweeps;
+    AddQuery(sweeps, float3(0.0f, 10.0f, 0.0f), float3(0.0f, -10.0f, 0.0f));
+    AddQuery(sweeps, float3(10.0f, 10.0f, 0.0f), float3(10.0f, -10.0f, 0.0f));
+    AddQuery(sweeps, float3(0.0f, 10.0f, 0.0f), float3(0.0f, 30.0f, 0.0f));
+
+    const float3 halfExtents(0.5f, 0.5f, 0.5f);
+    ExpectSweepHits(world->BoxSweepBatch(halfExtents, Quat::identity, sweeps), 9.5f, 7.5f);
+
+    // Standing on its edge, the box reaches half of its diagonal lower
+    const float halfDiagonal = 0.5f * math::Sqrt(2.0f);
+    ExpectSweepHits(world->BoxSweepBatch(halfExtents, Quat::RotateZ(math::pi / 4.0f), sweeps), 10.0f - halfDiagonal, 8.0f - halfDiagonal);
+}
+
+TEST_F(PhysicsQueryTest, AabbOverlapBatch)
+{
+    Vector<float> boxes;
+    AddQuery(boxes, float3(9.0f, 1.5f, -1.0f), float3(11.0f, 3.0f, 1.0f));
+    AddQuery(boxes, float3(50.0f, 50.0f, 50.0f), float3(51.0f, 51.0f, 51.0f));
+    AddQuery(boxes, float3(-1.0f, -1.0f, -1.0f), float3(1.0f, 1.0f, 1.0f));
+    AddQuery(boxes, float3(8.0f, -1.0f, -1.0f), float3(12.0f, 1.0f, 1.0f));
+
+    PhysicsQueryResults results = world->AabbOverlapBatch(boxes);
+    ASSERT_EQ(results.hits.Size(), 4U);
+    EXPECT_EQ(results.hits[0], 1.0f);
+    EXPECT_EQ(results.hits[1], 0.0f);
+    EXPECT_EQ(results.hits[2], 1.0f);
+    EXPECT_EQ(results.hits[3], 2.0f);
+    ASSERT_EQ(results.entities.Size(), 4U);
+    EXPECT_EQ(results.entities[0].Get(), box.Get());
+    EXPECT_EQ(results.entities[1].Get(), ground.Get());
+    EXPECT_TRUE(results.entities[2] != results.entities[3]);
+
+    world->AabbOverlapBatch(boxes, results, -1, 0);
+    EXPECT_TRUE(results.entities.Empty());
+    for(uint i = 0; i < results.hits.Size(); ++i)
+        EXPECT_EQ(results.hits[i], 0.0f);
+}
+
+/** CollisionShapeCache tests. Each test uses its own cache on an empty directory, so that the disk cache of the
+    BulletPhysics module is not touched and the cache files written by a test can be inspected and tampered with. */
+class CollisionShapeCacheTest : public PhysicsTest
+{
+protected:
+    void SetUp() override
+    {
+        PhysicsTest::SetUp();
+
+        fileSystem = context->GetSubsystem<Urho3D::FileSystem>();
+        directory = fileSystem->GetCurrentDir() + "CollisionShapeCacheTest/";
+        StringVector files;
+        fileSystem->ScanDir(files, directory, "*", Urho3D::SCAN_FILES, false);
+        foreach(const String &file, files)
+            fileSystem->Delete(directory + file);
+
+        CreateGroundMesh();
+        mesh = framework->Asset()->FindAsset<IMeshAsset>(GroundMeshRef);
+    }
+
+    void TearDown() override
+    {
+        mesh.Reset();
+        PhysicsTest::TearDown();
+    }
+
+    /// Creates a cache on the test directory, as if the application was started again.
+    SharedPtr<CollisionShapeCache> CreateCache()
+    {
+        return SharedPtr<CollisionShapeCache>(new CollisionShapeCache(framework.Get(), directory));
+    }
+
+    /// Waits for the background generation of a shape to complete.
+    template <typename T>
+    void WaitUntilReady(CollisionShapeCache *cache, const shared_ptr<T> &shape)
+    {
+        for(int i = 0; i < 1000 && !shape->ready_; ++i)
+        {
+            ProcessEvents();
+            cache->Update();
+        }
+        ASSERT_TRUE(shape->ready_);
+    }
+
+    /// Returns the path of the only cache file with the given extension, or an empty string if there is none.
+    String CacheFile(const String &extension)
+    {
+        StringVector files;
+        fileSystem->ScanDir(files, directory, "*" + extension, Urho3D::SCAN_FILES, false);
+        EXPECT_EQ(files.Size(), 1U);
+        return files.Size() == 1 ? directory + files[0] : String();
+    }
+
+    /// Reads a whole cache file.
+    PODVector<u8> ReadFile(const String &fileName)
+    {
+        Urho3D::File file(context.Get(), fileName, Urho3D::FILE_READ);
+        PODVector<u8> data(file.GetSize());
+        if (data.Size())
+            file.Read(&data[0], data.Size());
+        return data;
+    }
+
+    /// Overwrites a cache file.
+    void WriteFile(const String &fileName, const PODVector<u8> &data)
+    {
+        Urho3D::File file(context.Get(), fileName, Urho3D::FILE_WRITE);
+        ASSERT_TRUE(file.IsOpen());
+        file.Write(&data[0], data.Size());
+    }
+
+    Urho3D::FileSystem *fileSystem;
+    String directory;
+    SharedPtr<IMeshAsset> mesh;
+};
+
+TEST_F(CollisionShapeCacheTest, TriangleMeshShapeDiskCache)
+{
+    ASSERT_TRUE(mesh != nullptr);
+
+    // A BVH built on a cache miss is owned by the shape, a BVH loaded from the disk cache lives in bvhBuffer_
+    {
+        SharedPtr<CollisionShapeCache> cache = CreateCache();
+        shared_ptr<TriangleMeshShape> shape = cache->TriangleMeshShapeFor(mesh);
+        WaitUntilReady(cache, shape);
+        ASSERT_TRUE(shape->shape_ != 0);
+        EXPECT_TRUE(shape->bvhBuffer_ == 0);
+    }
+    const String bvhFile = CacheFile(".bvh");
+    ASSERT_FALSE(bvhFile.Empty());
+    const PODVector<u8> validData = ReadFile(bvhFile);
+    {
+        SharedPtr<CollisionShapeCache> cache = CreateCache();
+        shared_ptr<TriangleMeshShape> shape = cache->TriangleMeshShapeFor(mesh);
+        WaitUntilReady(cache, shape);
+        ASSERT_TRUE(shape->shape_ != 0);
+        EXPECT_TRUE(shape->bvhBuffer_ != 0);
+    }
+
+    // A truncated file and a file with another format version are rejected and the BVH is built again
+    PODVector<u8> truncated(validData);
+    truncated.Resize(validData.Size() / 2);
+    PODVector<u8> otherVersion(validData);
+    otherVersion[sizeof(unsigned)] += 1;
+    const PODVector<u8> *corruptFiles[] = { &truncated, &otherVersion };
+    foreach_std(const PODVector<u8> *corrupt, corruptFiles)
+    {
+        WriteFile(bvhFile, *corrupt);
+        SharedPtr<CollisionShapeCache> cache = CreateCache();
+        shared_ptr<TriangleMeshShape> shape = cache->TriangleMeshShapeFor(mesh);
+        WaitUntilReady(cache, shape);
+        ASSERT_TRUE(shape->shape_ != 0);
+        EXPECT_TRUE(shape->bvhBuffer_ == 0);
+    }
+}
+
+TEST_F(CollisionShapeCacheTest, ConvexHullSetDiskCache)
+{
+    ASSERT_TRUE(mesh != nullptr);
+
+    float3 generatedPosition;
+    {
+        SharedPtr<CollisionShapeCache> cache = CreateCache();
+        shared_ptr<ConvexHullSet> set = cache->ConvexHullSetFor(mesh);
+        WaitUntilReady(cache, set);
+        ASSERT_EQ(set->hulls_.Size(), 1U);
+        generatedPosition = set->hulls_[0].position_;
+    }
+    const String hullFile = CacheFile(".hull");
+    ASSERT_FALSE(hullFile.Empty());
+
+    // The file is the version header, the number of hulls and for each hull its position, vertex count and vertices.
+    // Move the hull in the file to tell a set loaded from the disk cache from a generated one.
+    const uint positionOffset = 3 * sizeof(unsigned);
+    const uint numVerticesOffset = positionOffset + sizeof(float3);
+    PODVector<u8> moved = ReadFile(hullFile);
+    ASSERT_GT(moved.Size(), numVerticesOffset + sizeof(unsigned));
+    const float3 movedPosition = generatedPosition + float3(100.0f, 0.0f, 0.0f);
+    memcpy(&moved[positionOffset], &movedPosition, sizeof(float3));
+    WriteFile(hullFile, moved);
+    {
+        SharedPtr<CollisionShapeCache> cache = CreateCache();
+        shared_ptr<ConvexHullSet> set = cache->ConvexHullSetFor(mesh);
+        WaitUntilReady(cache, set);
+        ASSERT_EQ(set->hulls_.Size(), 1U);
+        EXPECT_TRUE(set->hulls_[0].position_.Equals(movedPosition));
+    }
+
+    // A vertex count past the end of the file and a truncated file are rejected and the set is generated again
+    PODVector<u8> badVertexCount(moved);
+    const unsigned numVertices = 0x10000000;
+    memcpy(&badVertexCount[numVerticesOffset], &numVertices, sizeof(unsigned));
+    PODVector<u8> truncated(moved);
+    truncated.Resize(numVerticesOffset + sizeof(unsigned) + sizeof(float3));
+    const PODVector<u8> *corruptFiles[] = { &badVertexCount, &truncated };
+    foreach_std(const PODVector<u8> *corrupt, corruptFiles)
+    {
+        WriteFile(hullFile, *corrupt);
+        SharedPtr<CollisionShapeCache> cache = CreateCache();
+        shared_ptr<ConvexHullSet> set = cache->ConvexHullSetFor(mesh);
+        WaitUntilReady(cache, set);
+        ASSERT_EQ(set->hulls_.Size(), 1U);
+        EXPECT_TRUE(set->hulls_[0].position_.Equals(generatedPosition));
+        EXPECT_TRUE(set->hulls_[0].hull_ != nullptr);
+    }
+}
+
+TEST_F(CollisionShapeCacheTest, ReloadedMeshIsHashedAgain)
+{
+    ASSERT_TRUE(mesh != nullptr);
+    SharedPtr<CollisionShapeCache> cache = CreateCache();
+
+    // Shapes of the same content are shared in memory
+    shared_ptr<TriangleMeshShape> shape = cache->TriangleMeshShapeFor(mesh);
+    EXPECT_TRUE(cache->TriangleMeshShapeFor(mesh) == shape);
+
+    // Loading the mesh again with other content must not return the shape of the old content
+    CreateGroundMesh(2.0f);
+    shared_ptr<TriangleMeshShape> reloadedShape = cache->TriangleMeshShapeFor(mesh);
+    EXPECT_TRUE(reloadedShape != shape);
+
+    // Loading the old content again finds its shape by content
+    CreateGroundMesh();
+    EXPECT_TRUE(cache->TriangleMeshShapeFor(mesh) == shape);
+    WaitUntilReady(cache, shape);
+    WaitUntilReady(cache, reloadedShape);
+}
+
+TUNDRA_TEST_MAIN();
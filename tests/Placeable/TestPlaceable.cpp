@@ -0,0 +1,108 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "TestRunner.h"
+
+#include "Scene.h"
+#include "SceneAPI.h"
+#include "Entity.h"
+#include "Placeable.h"
+#include "GraphicsWorld.h"
+#include "TransformCache.h"
+
+#include <Math/float3x4.h>
+#include <Math/Quat.h>
+#include <Urho3D/Scene/Node.h>
+
+using namespace Tundra;
+using namespace Tundra::Test;
+
+/** Placeable tests. The cached world transforms are checked against the transforms of the scene node hierarchy, which the
+    placeables of a headless run update lazily, after moving and reparenting placeables of a three-level hierarchy. */
+
+class PlaceableTest : public Runner
+{
+protected:
+    void SetUp() override
+    {
+        Runner::SetUp();
+        CreateViewScene();
+    }
+
+    /// Creates an entity with a placeable at the given position, parented to @c parent if not null.
+    SharedPtr<Placeable> CreatePlaceable(const float3 &pos, Placeable *parent)
+    {
+        EntityPtr entity = viewScene->CreateEntity(0, StringVector(), AttributeChange::Default, false, false);
+        SharedPtr<Placeable> placeable = entity->CreateComponent<Placeable>();
+        placeable->SetTransform(Quat::RotateY(0.5f), pos, float3(2.0f, 2.0f, 2.0f));
+        if (parent)
+            placeable->SetParent(parent->ParentEntity(), false);
+        return placeable;
+    }
+
+    /// Returns whether the cached world transform of a placeable matches its scene node.
+    bool MatchesNode(Placeable *placeable)
+    {
+        const float3x4 nodeTransform(placeable->UrhoSceneNode()->GetWorldTransform());
+        return placeable->LocalToWorld().Equals(nodeTransform, 1e-3f);
+    }
+};
+
+TEST_F(PlaceableTest, CachedWorldTransforms)
+{
+    ASSERT_TRUE(viewScene != nullptr);
+    GraphicsWorld *world = viewScene->Subsystem<GraphicsWorld>().Get();
+    ASSERT_TRUE(world != nullptr);
+    TransformCache *cache = world->Transforms();
+
+    SharedPtr<Placeable> root = CreatePlaceable(float3(10.0f, 0.0f, 0.0f), 0);
+    SharedPtr<Placeable> child = CreatePlaceable(float3(0.0f, 5.0f, 0.0f), root);
+    SharedPtr<Placeable> grandchild = CreatePlaceable(float3(0.0f, 0.0f, 1.0f), child);
+    EXPECT_EQ(3U, cache->NumPlaceables());
+    EXPECT_EQ(root.Get(), child->ParentPlaceableComponent());
+    EXPECT_EQ(child.Get(), grandchild->ParentPlaceableComponent());
+
+    // The world transform is the concatenation of the local transforms.
+    const float3x4 expected = root->LocalToParent() * child->LocalToParent() * grandchild->LocalToParent();
+    EXPECT_TRUE(grandchild->LocalToWorld().Equals(expected, 1e-3f));
+    EXPECT_TRUE(MatchesNode(grandchild));
+
+    // Moving the root moves the descendants, both in the cache and in the scene nodes.
+    root->SetPosition(float3(-3.0f, 2.0f, 1.0f));
+    EXPECT_TRUE(grandchild->WorldPosition().Equals(
+        (root->LocalToParent() * child->LocalToParent() * grandchild->LocalToParent()).TranslatePart(), 1e-3f));
+    EXPECT_TRUE(MatchesNode(child));
+    EXPECT_TRUE(MatchesNode(grandchild));
+
+    // The batch query matches the individual queries, and tolerates null placeables.
+    child->SetOrientation(Quat::RotateX(1.0f));
+    PODVector<Placeable*> placeables;
+    placeables.Push(grandchild.Get());
+    placeables.Push(0);
+    placeables.Push(root.Get());
+    placeables.Push(child.Get());
+    PODVector<float3x4> transforms;
+    Placeable::WorldTransforms(placeables, transforms);
+    ASSERT_EQ(placeables.Size(), transforms.Size());
+    EXPECT_TRUE(transforms[0].Equals(grandchild->LocalToWorld(), 1e-3f));
+    EXPECT_TRUE(transforms[1].Equals(float3x4::identity));
+    EXPECT_TRUE(transforms[2].Equals(root->LocalToWorld(), 1e-3f));
+    EXPECT_TRUE(transforms[3].Equals(child->LocalToWorld(), 1e-3f));
+    EXPECT_TRUE(MatchesNode(grandchild));
+
+    // Reparenting to the root keeps the world transform when asked to.
+    const float3x4 grandchildWorld = grandchild->LocalToWorld();
+    grandchild->SetParent(0, true);
+    EXPECT_TRUE(grandchild->ParentPlaceableComponent() == 0);
+    EXPECT_TRUE(grandchild->LocalToWorld().Equals(grandchildWorld, 1e-3f));
+    root->SetPosition(float3(100.0f, 0.0f, 0.0f));
+    EXPECT_TRUE(grandchild->LocalToWorld().Equals(grandchildWorld, 1e-3f));
+    EXPECT_TRUE(MatchesNode(grandchild));
+
+    // Removing a parent detaches its children to the root.
+    viewScene->RemoveEntity(root->ParentEntity()->Id());
+    root.Reset();
+    EXPECT_EQ(2U, cache->NumPlaceables());
+    EXPECT_TRUE(child->ParentPlaceableComponent() == 0);
+    EXPECT_TRUE(child->LocalToWorld().Equals(child->LocalToParent(), 1e-3f));
+    EXPECT_TRUE(MatchesNode(child));
+}
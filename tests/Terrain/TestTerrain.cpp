@@ -0,0 +1,263 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "TestRunner.h"
+
+#include "Scene.h"
+#include "Entity.h"
+#include "Terrain.h"
+#include "TerrainLod.h"
+
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/Math/Random.h>
+
+using namespace Tundra;
+using namespace Tundra::Test;
+
+/** Terrain tests. The geomipmap index generation is checked for every LOD level and stitched edge combination of the patch sizes
+    a terrain has, the LOD errors and selection against known height fields, the dirtying of patch geometry on height edits
+    against the patches that use the edited vertex, and the loading of both .ntf layouts. All of these run headless. */
+
+namespace
+{
+    /// Returns the vertex coordinates used at @c level along an axis of @c count vertices.
+    PODVector<uint> LodSamples(uint count, uint level)
+    {
+        PODVector<uint> samples;
+        for(uint i = 0; i + 1 < count; i += 1U << level)
+            samples.Push(i);
+        samples.Push(count - 1);
+        return samples;
+    }
+}
+
+class TerrainTest : public Runner
+{
+protected:
+    void SetUp() override
+    {
+        Runner::SetUp();
+
+        // Remove tundra.json hardcoded scene ents
+        scene->RemoveAllEntities();
+    }
+
+    /// Creates a flat terrain of the given size, with all the patches marked clean.
+    SharedPtr<Terrain> CreateTerrain(uint patchWidth, uint patchHeight)
+    {
+        EntityPtr entity = scene->CreateEntity(0, StringVector(), AttributeChange::Default, false, false);
+        SharedPtr<Terrain> terrain = entity->CreateComponent<Terrain>();
+        terrain->Resize(patchWidth, patchHeight);
+        for(uint y = 0; y < patchHeight; ++y)
+            for(uint x = 0; x < patchWidth; ++x)
+                terrain->GetPatch(x, y).patch_geometry_dirty = false;
+        return terrain;
+    }
+};
+
+TEST_F(TerrainTest, LodIndicesStitching)
+{
+    const uint sizes[] = { Terrain::cPatchSize, Terrain::cPatchSize + 1 };
+    foreach_std(uint width, sizes)
+        foreach_std(uint height, sizes)
+            for(uint level = 0; level < cNumTerrainLodLevels; ++level)
+            {
+                const PODVector<uint> xs = LodSamples(width, level), ys = LodSamples(height, level);
+                const PODVector<uint> coarseXs = LodSamples(width, level + 1), coarseYs = LodSamples(height, level + 1);
+                for(uint edges = 0; edges < cNumTerrainLodEdgeMasks; ++edges)
+                {
+                    PODVector<unsigned short> indices;
+                    GenerateTerrainLodIndices(width, height, level, edges, indices);
+                    ASSERT_EQ(0U, indices.Size() % 3);
+
+                    // The triangles must keep the winding of the full detail geometry and cover the patch exactly once.
+                    int area = 0;
+                    for(uint i = 0; i < indices.Size(); i += 3)
+                    {
+                        int x[3], y[3];
+                        for(uint k = 0; k < 3; ++k)
+                        {
+                            ASSERT_LT(indices[i + k], width * height);
+                            x[k] = indices[i + k] % width;
+                            y[k] = indices[i + k] / width;
+
+                            // The vertices on the edges must be the ones the neighbor of the same or the coarser level has.
+                            const bool leftOrRight = (x[k] == 0 && (edges & TerrainLodEdgeLeft)) || (x[k] == (int)width - 1 && (edges & TerrainLodEdgeRight));
+                            const bool topOrBottom = (y[k] == 0 && (edges & TerrainLodEdgeTop)) || (y[k] == (int)height - 1 && (edges & TerrainLodEdgeBottom));
+                            if (x[k] == 0 || x[k] == (int)width - 1)
+                                EXPECT_TRUE((leftOrRight ? coarseYs : ys).Contains(y[k])) << "level " << level << " edges " << edges;
+                            if (y[k] == 0 || y[k] == (int)height - 1)
+                                EXPECT_TRUE((topOrBottom ? coarseXs : xs).Contains(x[k])) << "level " << level << " edges " << edges;
+                        }
+                        const int doubleArea = (x[2] - x[0]) * (y[1] - y[0]) - (x[1] - x[0]) * (y[2] - y[0]);
+                        EXPECT_GT(doubleArea, 0) << "level " << level << " edges " << edges;
+                        area += doubleArea;
+                    }
+                    EXPECT_EQ((int)(2 * (width - 1) * (height - 1)), area) << "level " << level << " edges " << edges;
+                }
+            }
+
+    // The full detail level without stitching is the 2 triangles per quad of the patch grid.
+    PODVector<unsigned short> indices;
+    GenerateTerrainLodIndices(Terrain::cPatchSize + 1, Terrain::cPatchSize + 1, 0, 0, indices);
+    EXPECT_EQ(Terrain::cPatchSize * Terrain::cPatchSize * 6, indices.Size());
+    GenerateTerrainLodIndices(Terrain::cPatchSize + 1, Terrain::cPatchSize + 1, cNumTerrainLodLevels - 1, 0, indices);
+    EXPECT_EQ(6U, indices.Size());
+}
+
+TEST_F(TerrainTest, LodErrors)
+{
+    const uint size = Terrain::cPatchSize + 1;
+    PODVector<float> heights(size * size);
+    float errors[cNumTerrainLodLevels];
+
+    // A plane is exact at every level.
+    for(uint y = 0; y < size; ++y)
+        for(uint x = 0; x < size; ++x)
+            heights[y * size + x] = 0.5f * x - 0.25f * y + 3.0f;
+    CalculateTerrainLodErrors(&heights[0], size, size, size, errors);
+    for(uint level = 0; level < cNumTerrainLodLevels; ++level)
+        EXPECT_NEAR(0.0f, errors[level], 1e-4f) << "level " << level;
+    EXPECT_EQ(cNumTerrainLodLevels - 1, SelectTerrainLod(errors, 0.001f));
+
+    // A single spike on an odd vertex is dropped from level 1 onwards, and the errors never decrease.
+    heights[5 * size + 7] += 2.0f;
+    CalculateTerrainLodErrors(&heights[0], size, size, size, errors);
+    EXPECT_EQ(0.0f, errors[0]);
+    EXPECT_NEAR(2.0f, errors[1], 1e-4f);
+    for(uint level = 1; level < cNumTerrainLodLevels; ++level)
+        EXPECT_GE(errors[level], errors[level - 1]);
+    EXPECT_EQ(0U, SelectTerrainLod(errors, 1.0f));
+    EXPECT_EQ(cNumTerrainLodLevels - 1, SelectTerrainLod(errors, errors[cNumTerrainLodLevels - 1]));
+
+    // Noise within a patch of the terrain grid, read with the row stride of a wider terrain.
+    const uint rowStride = 3 * Terrain::cPatchSize;
+    PODVector<float> grid(rowStride * size);
+    Urho3D::SetRandomSeed(1);
+    for(uint i = 0; i < grid.Size(); ++i)
+        grid[i] = (float)Urho3D::Rand() / 32768.0f;
+    CalculateTerrainLodErrors(&grid[Terrain::cPatchSize], rowStride, size, size, errors);
+    EXPECT_EQ(0.0f, errors[0]);
+    for(uint level = 1; level < cNumTerrainLodLevels; ++level)
+    {
+        EXPECT_GT(errors[level], 0.0f) << "level " << level;
+        EXPECT_LE(errors[level], 1.0f) << "level " << level;
+        EXPECT_GE(errors[level], errors[level - 1]) << "level " << level;
+    }
+}
+
+TEST_F(TerrainTest, LodSelection)
+{
+    // A full detail patch in the corner of coarse patches: the levels grow by one per patch away from it.
+    const uint width = 6, height = 4;
+    PODVector<u8> levels(width * height);
+    for(uint i = 0; i < levels.Size(); ++i)
+        levels[i] = (u8)(cNumTerrainLodLevels - 1);
+    levels[0] = 0;
+    LimitTerrainLodDifference(levels, width, height);
+    for(uint y = 0; y < height; ++y)
+        for(uint x = 0; x < width; ++x)
+        {
+            EXPECT_EQ(Urho3D::Min(x + y, cNumTerrainLodLevels - 1), (uint)levels[y * width + x]) << x << "," << y;
+            const uint edges = TerrainLodCoarserEdges(levels, width, height, x, y);
+            EXPECT_EQ(x + 1 < width && levels[y * width + x + 1] > levels[y * width + x], (edges & TerrainLodEdgeRight) != 0);
+            EXPECT_EQ(y + 1 < height && levels[(y + 1) * width + x] > levels[y * width + x], (edges & TerrainLodEdgeBottom) != 0);
+            EXPECT_EQ(0U, edges & (TerrainLodEdgeLeft | TerrainLodEdgeTop));
+        }
+}
+
+TEST_F(TerrainTest, SetPointHeightDirtiesNeighbors)
+{
+    SharedPtr<Terrain> terrain = CreateTerrain(4, 4);
+    const uint size = Terrain::cPatchSize;
+
+    // A vertex inside a patch, away from the seams, only dirties its own patch.
+    terrain->SetPointHeight(size + 5, size + 5, 1.0f);
+    for(uint y = 0; y < 4; ++y)
+        for(uint x = 0; x < 4; ++x)
+        {
+            EXPECT_EQ(x == 1 && y == 1, terrain->GetPatch(x, y).patch_geometry_dirty) << x << "," << y;
+            terrain->GetPatch(x, y).patch_geometry_dirty = false;
+        }
+
+    // The first vertex of a patch is the seam of the patches to the left and above, which also need new normals.
+    terrain->SetPointHeight(2 * size, size, 1.0f);
+    for(uint y = 0; y < 4; ++y)
+        for(uint x = 0; x < 4; ++x)
+        {
+            EXPECT_EQ((x == 1 || x == 2) && (y == 0 || y == 1), terrain->GetPatch(x, y).patch_geometry_dirty) << x << "," << y;
+            terrain->GetPatch(x, y).patch_geometry_dirty = false;
+        }
+
+    // The last vertex of a patch changes the normals of the seam vertices of the next patch.
+    terrain->SetPointHeight(size - 1, 3 * size - 1, 1.0f);
+    for(uint y = 0; y < 4; ++y)
+        for(uint x = 0; x < 4; ++x)
+            EXPECT_EQ((x == 0 || x == 1) && (y == 2 || y == 3), terrain->GetPatch(x, y).patch_geometry_dirty) << x << "," << y;
+}
+
+TEST_F(TerrainTest, NtfLoading)
+{
+    const uint width = 3, height = 2;
+    const uint rowWidth = width * Terrain::cPatchSize;
+    SharedPtr<Terrain> terrain = CreateTerrain(width, height);
+    for(uint y = 0; y < height * Terrain::cPatchSize; ++y)
+        for(uint x = 0; x < rowWidth; ++x)
+            terrain->SetPointHeight(x, y, (float)(y * rowWidth + x));
+
+    // The original format stores the patches one after another.
+    PODVector<u32> patchMajor;
+    patchMajor.Push(width);
+    patchMajor.Push(height);
+    for(uint py = 0; py < height; ++py)
+        for(uint px = 0; px < width; ++px)
+            for(uint y = 0; y < Terrain::cPatchSize; ++y)
+                for(uint x = 0; x < Terrain::cPatchSize; ++x)
+                {
+                    const float value = -terrain->GetPoint(px * Terrain::cPatchSize + x, py * Terrain::cPatchSize + y);
+                    u32 bits;
+                    memcpy(&bits, &value, sizeof(bits));
+                    patchMajor.Push(bits);
+                }
+
+    // The row-major format is memory-mapped, and the loaded height grid matches the saved one.
+    String ntfPath = framework->GetSubsystem<Urho3D::FileSystem>()->GetProgramDir() + "TundraTestTerrain.ntf";
+    ASSERT_TRUE(terrain->SaveToFile(ntfPath));
+    terrain->Resize(1, 1);
+    EXPECT_TRUE(terrain->LoadFromFile(ntfPath));
+    EXPECT_TRUE(terrain->IsHeightDataMapped());
+    EXPECT_EQ(width, terrain->PatchWidth());
+    EXPECT_EQ(height, terrain->PatchHeight());
+    EXPECT_EQ(width, terrain->xPatches.Get());
+    uint numMismatches = 0;
+    for(uint y = 0; y < height * Terrain::cPatchSize && terrain->PatchHeight() == height; ++y)
+        for(uint x = 0; x < rowWidth && terrain->PatchWidth() == width; ++x)
+            numMismatches += (terrain->GetPoint(x, y) != (float)(y * rowWidth + x));
+    EXPECT_EQ(0U, numMismatches);
+
+    // Edits change the mapped memory but not the file, and resizing copies the height grid out of the mapping.
+    terrain->SetPointHeight(1, 1, -1.0f);
+    EXPECT_EQ(-1.0f, terrain->GetPoint(1, 1));
+    terrain->Resize(width + 1, height);
+    EXPECT_FALSE(terrain->IsHeightDataMapped());
+    EXPECT_EQ(-1.0f, terrain->GetPoint(1, 1));
+    EXPECT_EQ((float)(rowWidth + 2), terrain->GetPoint(2, 1));
+    EXPECT_TRUE(terrain->LoadFromFile(ntfPath));
+    EXPECT_EQ((float)(rowWidth + 1), terrain->GetPoint(1, 1));
+
+    // Cleanup file before any asserts can exit prematurely
+    terrain->Resize(1, 1);
+    framework->GetSubsystem<Urho3D::FileSystem>()->Delete(ntfPath);
+
+    ASSERT_TRUE(terrain->LoadFromDataInMemory((const char*)&patchMajor[0], patchMajor.Size() * sizeof(u32)));
+    EXPECT_FALSE(terrain->IsHeightDataMapped());
+    EXPECT_EQ(width, terrain->PatchWidth());
+    EXPECT_EQ(height, terrain->PatchHeight());
+    for(uint y = 0; y < height * Terrain::cPatchSize; ++y)
+        for(uint x = 0; x < rowWidth; ++x)
+            ASSERT_EQ(-(float)(y * rowWidth + x), terrain->GetPoint(x, y)) << x << "," << y;
+
+    // A file shorter than its header says is rejected without losing the loaded terrain.
+    EXPECT_FALSE(terrain->LoadFromDataInMemory((const char*)&patchMajor[0], (patchMajor.Size() - 1) * sizeof(u32)));
+    EXPECT_EQ(width, terrain->PatchWidth());
+    EXPECT_EQ(-1.0f, terrain->GetPoint(1, 0));
+}
@@ -67,6 +67,7 @@ namespace Tundra
             ContextPtr context;
             FrameworkPtr framework;
             ScenePtr scene;
+            ScenePtr viewScene;
 
             void SetUp() override
             {
@@ -100,6 +101,9 @@ namespace Tundra
 
             void TearDown() override
             {
+                if (viewScene)
+                    framework->Scene()->RemoveScene(viewScene->Name());
+                viewScene.Reset();
                 scene.Reset();
 
                 framework->Uninitialize();
@@ -112,6 +116,13 @@ namespace Tundra
                 config.clear();
             }
 
+            /// Creates @c viewScene, a view enabled scene that has a graphics world if a renderer plugin is loaded.
+            /** Unlike @c scene, which is not view enabled. The scene is removed in TearDown. */
+            void CreateViewScene()
+            {
+                viewScene = framework->Scene()->CreateScene("TestViewScene", true, true);
+            }
+
             /// Call this function whenever you need framework to be processed.
             void ProcessEvents()
             {
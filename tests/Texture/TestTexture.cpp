@@ -0,0 +1,194 @@
+// For conditions of distribution and use, see copyright notice in LICENSE
+
+#include "TestRunner.h"
+
+#include "TextureTranscodeCache.h"
+#include "AssetCache.h"
+#include "Crunch/dds_defs.h"
+
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+
+using namespace Tundra;
+using namespace Tundra::Test;
+
+/** Texture tests. The transcode cache is checked by its keying, its lookup of previously stored DDS files and its rejection of
+    invalid .crn data. Actual textures are transcoded from the DXT1 .crn files in Scenes/Test: a 512 x 256 texture whose first
+    level is large enough to be transcoded by a work item of its own, and a 64 x 64 cubemap. Both have a full mip chain and start
+    with a block of red and blue endpoints and all zero selectors. These run headless. */
+
+namespace
+{
+    struct CrnFile
+    {
+        const char *fileName;
+        uint width;
+        uint height;
+        uint levels;
+        uint faces;
+    };
+
+    const CrnFile CrnFiles[] = {
+        { "Scenes/Test/TranscodeTest.crn", 512, 256, 10, 1 },
+        { "Scenes/Test/TranscodeTestCube.crn", 64, 64, 7, 6 }
+    };
+
+    /// First DXT1 block of the first level of each face of the .crn files.
+    const u8 FirstBlock[] = { 0x00, 0xf8, 0x1f, 0x00, 0x00, 0x00, 0x00, 0x00 };
+}
+
+class TextureTest : public Runner
+{
+protected:
+    /// Returns the directory used as the transcode disk cache.
+    String CacheDirectory() const
+    {
+        return framework->GetSubsystem<Urho3D::FileSystem>()->GetProgramDir() + "TundraTestTranscodedTextures/";
+    }
+
+    /// Writes the given data to a transcode cache file.
+    bool WriteCacheFile(const String &fileName, const PODVector<u8> &data)
+    {
+        return AssetCache::WriteVersionedFile(framework->GetContext(), fileName, TextureTranscodeCache::CacheFileId,
+            TextureTranscodeCache::CacheFileVersion, &data[0], data.Size());
+    }
+
+    /// Reads a whole file.
+    PODVector<u8> ReadFile(const String &fileName)
+    {
+        PODVector<u8> data;
+        Urho3D::File file(context.Get(), fileName, Urho3D::FILE_READ);
+        if (file.IsOpen() && file.GetSize())
+        {
+            data.Resize(file.GetSize());
+            file.Read(&data[0], data.Size());
+        }
+        return data;
+    }
+};
+
+TEST_F(TextureTest, TranscodeCache)
+{
+    Urho3D::FileSystem *fileSystem = framework->GetSubsystem<Urho3D::FileSystem>();
+    SharedPtr<TextureTranscodeCache> cache(new TextureTranscodeCache(framework, CacheDirectory()));
+    ASSERT_EQ(CacheDirectory(), cache->CacheDirectory());
+    ASSERT_TRUE(fileSystem->DirExists(CacheDirectory()));
+
+    // The key depends on the whole content, not just its size.
+    PODVector<u8> crn;
+    for(uint i = 0; i < 256; ++i)
+        crn.Push((u8)(i * 7));
+    const String key = AssetCache::ContentKey(&crn[0], crn.Size());
+    EXPECT_EQ(key, AssetCache::ContentKey(&crn[0], crn.Size()));
+    crn[100] ^= 1;
+    EXPECT_NE(key, AssetCache::ContentKey(&crn[0], crn.Size()));
+    crn[100] ^= 1;
+    const String cacheFile = cache->CacheFile(&crn[0], crn.Size());
+    EXPECT_TRUE(cacheFile.Contains(key));
+
+    // Invalid .crn data is rejected and nothing is cached for it.
+    Vector<u8> dds;
+    EXPECT_FALSE(cache->FindCached(&crn[0], crn.Size(), dds));
+    EXPECT_FALSE(cache->Transcode(&crn[0], crn.Size(), dds));
+    EXPECT_FALSE(cache->TranscodeAsync(&crn[0], crn.Size(), 0, 0));
+    EXPECT_EQ(0U, cache->NumPendingTranscodes());
+    EXPECT_FALSE(fileSystem->FileExists(cacheFile));
+
+    // A previously transcoded texture is read from the cache without transcoding.
+    PODVector<u8> cached;
+    cached.Resize(4 + 124 + 16);
+    memset(&cached[0], 0, cached.Size());
+    memcpy(&cached[0], "DDS ", 4);
+    cached.Back() = 0xAB;
+    const bool written = WriteCacheFile(cacheFile, cached);
+    const bool found = cache->Transcode(&crn[0], crn.Size(), dds);
+
+    // A truncated or foreign file in the cache is ignored.
+    PODVector<u8> invalid(cached);
+    memcpy(&invalid[0], "PNG ", 4);
+    const bool invalidWritten = WriteCacheFile(cacheFile, invalid);
+    Vector<u8> invalidDds;
+    const bool invalidFound = cache->FindCached(&crn[0], crn.Size(), invalidDds);
+
+    // A file of another format version is ignored.
+    const bool oldVersionWritten = AssetCache::WriteVersionedFile(framework->GetContext(), cacheFile, TextureTranscodeCache::CacheFileId,
+        TextureTranscodeCache::CacheFileVersion - 1, &cached[0], cached.Size());
+    Vector<u8> oldVersionDds;
+    const bool oldVersionFound = cache->FindCached(&crn[0], crn.Size(), oldVersionDds);
+
+    // Cleanup files before any asserts can exit prematurely
+    fileSystem->Delete(cacheFile);
+
+    ASSERT_TRUE(written);
+    ASSERT_TRUE(found);
+    ASSERT_EQ(cached.Size(), dds.Size());
+    EXPECT_EQ(0, memcmp(&cached[0], &dds[0], cached.Size()));
+    ASSERT_TRUE(invalidWritten);
+    EXPECT_FALSE(invalidFound);
+    EXPECT_TRUE(invalidDds.Empty());
+    ASSERT_TRUE(oldVersionWritten);
+    EXPECT_FALSE(oldVersionFound);
+
+    // Without a cache directory nothing is cached.
+    SharedPtr<TextureTranscodeCache> uncached(new TextureTranscodeCache(framework, String()));
+    EXPECT_TRUE(uncached->CacheDirectory().Empty());
+    EXPECT_FALSE(uncached->FindCached(&crn[0], crn.Size(), dds));
+}
+
+TEST_F(TextureTest, TranscodeSyncAndAsync)
+{
+    Urho3D::FileSystem *fileSystem = framework->GetSubsystem<Urho3D::FileSystem>();
+    SharedPtr<TextureTranscodeCache> cache(new TextureTranscodeCache(framework, CacheDirectory()));
+
+    foreach_std(const CrnFile &crnFile, CrnFiles)
+    {
+        const PODVector<u8> crn = ReadFile(crnFile.fileName);
+        ASSERT_FALSE(crn.Empty()) << crnFile.fileName;
+        const String cacheFile = cache->CacheFile(&crn[0], crn.Size());
+        fileSystem->Delete(cacheFile);
+
+        // Transcoding on the calling thread, without the cache
+        Vector<u8> sync;
+        ASSERT_TRUE(TranscodeCrnToDds(&crn[0], crn.Size(), sync)) << crnFile.fileName;
+
+        uint faceSize = 0;
+        for(uint level = 0; level < crnFile.levels; ++level)
+        {
+            const uint blocksX = (Urho3D::Max(crnFile.width >> level, 1U) + 3) / 4;
+            const uint blocksY = (Urho3D::Max(crnFile.height >> level, 1U) + 3) / 4;
+            faceSize += blocksX * blocksY * 8;
+        }
+        const uint headerSize = sizeof(crnlib::cDDSFileSignature) + sizeof(crnlib::DDSURFACEDESC2);
+        ASSERT_EQ(headerSize + crnFile.faces * faceSize, sync.Size()) << crnFile.fileName;
+        crnlib::DDSURFACEDESC2 header;
+        memcpy(&header, &sync[sizeof(crnlib::cDDSFileSignature)], sizeof(header));
+        EXPECT_EQ(crnFile.width, header.dwWidth);
+        EXPECT_EQ(crnFile.height, header.dwHeight);
+        EXPECT_EQ(crnFile.levels, header.dwMipMapCount);
+        EXPECT_EQ(crnFile.faces == 6, (header.ddsCaps.dwCaps2 & crnlib::DDSCAPS2_CUBEMAP) != 0);
+        for(uint face = 0; face < crnFile.faces; ++face)
+            EXPECT_EQ(0, memcmp(FirstBlock, &sync[headerSize + face * faceSize], sizeof(FirstBlock))) << crnFile.fileName << " face " << face;
+
+        // Transcoding on the worker threads, which stores the texture to the cache once all its levels are done
+        ASSERT_TRUE(cache->TranscodeAsync(&crn[0], crn.Size(), 0, 0));
+        for(int i = 0; i < 1000 && cache->NumPendingTranscodes(); ++i)
+        {
+            ProcessEvents();
+            cache->Update();
+        }
+        EXPECT_EQ(0U, cache->NumPendingTranscodes());
+        Vector<u8> async;
+        ASSERT_TRUE(cache->FindCached(&crn[0], crn.Size(), async)) << crnFile.fileName;
+        ASSERT_EQ(sync.Size(), async.Size());
+        EXPECT_EQ(0, memcmp(&sync[0], &async[0], sync.Size())) << crnFile.fileName;
+
+        // Transcoding through the cache on the calling thread, on a cache miss
+        fileSystem->Delete(cacheFile);
+        Vector<u8> cached;
+        ASSERT_TRUE(cache->Transcode(&crn[0], crn.Size(), cached));
+        ASSERT_EQ(sync.Size(), cached.Size());
+        EXPECT_EQ(0, memcmp(&sync[0], &cached[0], sync.Size())) << crnFile.fileName;
+        EXPECT_TRUE(fileSystem->FileExists(cacheFile));
+        fileSystem->Delete(cacheFile);
+    }
+}